@@ -0,0 +1,35 @@
+#-------------------------------------------------
+#
+# Trigger-to-output latency benchmark, renders in a
+# loopback OpenAL device (ALC_SOFT_loopback)
+#
+#-------------------------------------------------
+
+QT       += core
+QT       -= gui
+
+TARGET = LatencyBenchmark
+CONFIG   += console
+CONFIG   -= app_bundle
+TEMPLATE = app
+
+INCLUDEPATH += $(OPENAL_HOME)/include \
+			   ../../ExternalLibs/libvorbis/include \
+			   ../../ExternalLibs/libogg/include \
+
+LIBS += -L../../lib
+
+CONFIG( debug, debug|release ) {
+	TARGET = $${TARGET}_d
+	BUILD_NAME = debug
+	LIBS += -lSoundManager_d
+}
+CONFIG( release, debug|release ) {
+	BUILD_NAME = release
+	LIBS += -lSoundManager
+}
+
+SOURCES += main.cpp \
+		LatencyProbe.cpp
+
+HEADERS  += LatencyProbe.h
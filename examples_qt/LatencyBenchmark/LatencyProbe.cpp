@@ -0,0 +1,278 @@
+#include "LatencyProbe.h"
+// Qt
+#include <QVector>
+#include <QDebug>
+
+#include <stdlib.h>
+
+/*!
+	Constructs a probe that renders mono 16 bits at \a frequency, \a blockFrames frames at
+	a time. Samples with absolute value smaller than \a threshold are silence.
+*/
+LatencyProbe::LatencyProbe( int frequency, int blockFrames, int threshold ) :
+	_render(NULL),
+	_device(NULL),
+	_frequency(frequency),
+	_blockFrames(blockFrames),
+	_threshold(threshold),
+	_startTime(0),
+	_frames(0),
+	_lastSound(-1),
+	_running(0),
+	_armed(false),
+	_onsetFrame(-1)
+{
+	_attributes[0] = ALC_FORMAT_CHANNELS_SOFT;
+	_attributes[1] = ALC_MONO_SOFT;
+	_attributes[2] = ALC_FORMAT_TYPE_SOFT;
+	_attributes[3] = ALC_SHORT_SOFT;
+	_attributes[4] = ALC_FREQUENCY;
+	_attributes[5] = frequency;
+	_attributes[6] = 0;
+
+	_clock.start();
+}
+
+/*!
+	Stops the rendering.
+*/
+LatencyProbe::~LatencyProbe()
+{
+	stop();
+}
+
+/*!
+	Opens the loopback device and returns it, or NULL if the OpenAL doesn't support
+	ALC_SOFT_loopback. The context must be created with attributes().
+*/
+ALCdevice* LatencyProbe::open()
+{
+	if( !alcIsExtensionPresent( NULL, "ALC_SOFT_loopback" ) )
+	{
+		qWarning() << "[LatencyProbe::open] ALC_SOFT_loopback is not supported";
+		return NULL;
+	}
+	LoopbackOpenDeviceProc openDevice = (LoopbackOpenDeviceProc)alcGetProcAddress( NULL, "alcLoopbackOpenDeviceSOFT" );
+	IsRenderFormatSupportedProc isSupported = (IsRenderFormatSupportedProc)alcGetProcAddress( NULL, "alcIsRenderFormatSupportedSOFT" );
+	_render = (RenderSamplesProc)alcGetProcAddress( NULL, "alcRenderSamplesSOFT" );
+	if( openDevice == NULL || isSupported == NULL || _render == NULL )
+	{
+		qWarning() << "[LatencyProbe::open] ALC_SOFT_loopback functions not found";
+		return NULL;
+	}
+
+	_device = openDevice( NULL );
+	if( _device == NULL )
+	{
+		qWarning() << "[LatencyProbe::open] Can't open the loopback device";
+		return NULL;
+	}
+	if( !isSupported( _device, _frequency, ALC_MONO_SOFT, ALC_SHORT_SOFT ) )
+	{
+		qWarning() << "[LatencyProbe::open] Mono 16 bits at" << _frequency << "is not supported";
+		alcCloseDevice( _device );
+		_device = NULL;
+	}
+	return _device;
+}
+
+/*!
+	Returns the attributes to create the context of the loopback device.
+*/
+const ALCint* LatencyProbe::attributes() const
+{
+	return _attributes;
+}
+
+/*!
+	Starts the rendering thread with \a priority. It runs until stop() is called, even if
+	stop() is called before the thread is scheduled.
+*/
+void LatencyProbe::start( Priority priority )
+{
+	_running = 1;
+	QThread::start( priority );
+}
+
+/*!
+	Stops the rendering thread.
+*/
+void LatencyProbe::stop()
+{
+	_running = 0;
+	if( isRunning() )
+	{
+		wait();
+	}
+}
+
+/*!
+	Returns the current time of the probe clock, in nanoseconds.
+*/
+qint64 LatencyProbe::now() const
+{
+	return _clock.nsecsElapsed();
+}
+
+/*!
+	Returns the time when the frame \a frame is output.
+*/
+qint64 LatencyProbe::frameTime( qint64 frame ) const
+{
+	return _startTime + frame * 1000000000LL / _frequency;
+}
+
+/*!
+	Returns the frequency of the rendering.
+*/
+int LatencyProbe::frequency() const
+{
+	return _frequency;
+}
+
+/*!
+	Starts looking for the first non-silent frame rendered from now on.
+*/
+void LatencyProbe::arm()
+{
+	QMutexLocker locker( &_mutex );
+	_armed = true;
+	_onsetFrame = -1;
+	_noteEvents.clear();
+}
+
+/*!
+	Waits at most \a timeoutMs milliseconds for the first non-silent frame after arm().
+
+	Returns true if it was found, and its frame in \a onsetFrame.
+*/
+bool LatencyProbe::waitOnset( int timeoutMs, qint64* onsetFrame )
+{
+	QMutexLocker locker( &_mutex );
+	if( _onsetFrame < 0 )
+	{
+		_onsetFound.wait( &_mutex, timeoutMs );
+	}
+	_armed = false;
+	*onsetFrame = _onsetFrame;
+	return _onsetFrame >= 0;
+}
+
+/*!
+	Waits until the output is silent for \a silentMs milliseconds, at most \a timeoutMs milliseconds.
+
+	Returns true if the output is silent.
+*/
+bool LatencyProbe::waitSilence( int silentMs, int timeoutMs )
+{
+	qint64 silentFrames = (qint64)silentMs * _frequency / 1000;
+	qint64 timeout = now() + (qint64)timeoutMs * 1000000;
+	forever
+	{
+		_mutex.lock();
+		bool silent = _frames - _lastSound >= silentFrames;
+		_mutex.unlock();
+		if( silent )
+		{
+			return true;
+		}
+		if( now() > timeout )
+		{
+			return false;
+		}
+		msleep( 5 );
+	}
+}
+
+/*!
+	Returns the note signals received since arm().
+*/
+QList<ProbeNoteEvent> LatencyProbe::takeNoteEvents()
+{
+	QMutexLocker locker( &_mutex );
+	QList<ProbeNoteEvent> events = _noteEvents;
+	_noteEvents.clear();
+	return events;
+}
+
+/*!
+	Keeps the time of the signal notePlaying. Connected directly, it is called in the
+	thread that emits the signal.
+*/
+void LatencyProbe::notePlaying( QString, int melody, int id )
+{
+	addNoteEvent( melody, id, true );
+}
+
+/*!
+	Keeps the time of the signal noteStopped. Connected directly, it is called in the
+	thread that emits the signal.
+*/
+void LatencyProbe::noteStopped( QString, int melody, int id )
+{
+	addNoteEvent( melody, id, false );
+}
+
+void LatencyProbe::addNoteEvent( int melody, int id, bool playing )
+{
+	ProbeNoteEvent event;
+	event.melody = melody;
+	event.id = id;
+	event.playing = playing;
+	event.time = now();
+
+	QMutexLocker locker( &_mutex );
+	_noteEvents.append( event );
+}
+
+/*!
+	Renders one block each time the output of a sound card would need it.
+*/
+void LatencyProbe::run()
+{
+	QVector<short> block( _blockFrames );
+	_startTime = now();
+	_frames = 0;
+
+	while( _running )
+	{
+		_render( _device, block.data(), _blockFrames );
+		//
+		// Last frame that is not silence
+		//
+		int last = -1;
+		int first = -1;
+		for( int i = 0; i < _blockFrames; ++i )
+		{
+			if( abs( block[i] ) >= _threshold )
+			{
+				if( first < 0 )
+				{
+					first = i;
+				}
+				last = i;
+			}
+		}
+
+		_mutex.lock();
+		if( last >= 0 )
+		{
+			_lastSound = _frames + last;
+			if( _armed && _onsetFrame < 0 )
+			{
+				_onsetFrame = _frames + first;
+				_onsetFound.wakeAll();
+			}
+		}
+		_frames += _blockFrames;
+		_mutex.unlock();
+		//
+		// Waits until the block rendered is played
+		//
+		qint64 wait = frameTime( _frames ) - now();
+		if( wait > 0 )
+		{
+			usleep( (unsigned long)( wait / 1000 ) );
+		}
+	}
+}
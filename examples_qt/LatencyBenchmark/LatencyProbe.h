@@ -0,0 +1,101 @@
+#ifndef LATENCYPROBE_H
+#define LATENCYPROBE_H
+
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QElapsedTimer>
+#include <QAtomicInt>
+#include <QList>
+#include <QString>
+// SoundManager
+#include <../../include/SoundManager>
+
+#ifndef ALC_APIENTRY
+#define ALC_APIENTRY
+#endif
+//
+// ALC_SOFT_loopback, declared here because not every OpenAL has alext.h
+//
+#ifndef ALC_FORMAT_CHANNELS_SOFT
+#define ALC_FORMAT_CHANNELS_SOFT	0x1990
+#define ALC_FORMAT_TYPE_SOFT		0x1991
+#define ALC_MONO_SOFT				0x1500
+#define ALC_SHORT_SOFT				0x1402
+#endif
+
+typedef ALCdevice* (ALC_APIENTRY *LoopbackOpenDeviceProc)( const ALCchar* deviceName );
+typedef ALCboolean (ALC_APIENTRY *IsRenderFormatSupportedProc)( ALCdevice* device, ALCsizei freq, ALCenum channels, ALCenum type );
+typedef void (ALC_APIENTRY *RenderSamplesProc)( ALCdevice* device, ALCvoid* buffer, ALCsizei samples );
+
+/*!
+	Note signal received by the probe.
+*/
+struct ProbeNoteEvent
+{
+	int    melody;
+	int    id;
+	bool   playing;		// notePlaying, otherwise noteStopped
+	qint64 time;		// Nanoseconds in the probe clock
+};
+
+/*!
+	The LatencyProbe renders the OpenAL output in a loopback device, in real time, as
+	a sound card would. It finds the first non-silent frame after being armed and
+	keeps the time of the note signals of the SoundManager.
+
+	All the times are in nanoseconds of the probe clock, see now().
+*/
+class LatencyProbe : public QThread
+{
+	Q_OBJECT
+
+public:
+	LatencyProbe( int frequency = 44100, int blockFrames = 64, int threshold = 64 );
+	~LatencyProbe();
+
+	ALCdevice* open();
+	const ALCint* attributes() const;
+	void start( Priority priority = InheritPriority );
+	void stop();
+
+	qint64 now() const;
+	qint64 frameTime( qint64 frame ) const;
+	int frequency() const;
+
+	void arm();
+	bool waitOnset( int timeoutMs, qint64* onsetFrame );
+	bool waitSilence( int silentMs, int timeoutMs );
+
+	QList<ProbeNoteEvent> takeNoteEvents();
+
+public slots:
+	void notePlaying( QString name, int melody, int id );
+	void noteStopped( QString name, int melody, int id );
+
+protected:
+	void run();
+
+private:
+	RenderSamplesProc   _render;
+	ALCdevice*          _device;
+	ALCint              _attributes[7];
+	int                 _frequency;
+	int                 _blockFrames;
+	int                 _threshold;		// Smallest absolute sample value that is not silence
+	QElapsedTimer       _clock;
+	qint64              _startTime;		// Time of the frame 0
+	qint64              _frames;		// Frames rendered
+	qint64              _lastSound;		// Last frame not silent
+	QAtomicInt          _running;
+
+	QMutex              _mutex;
+	QWaitCondition      _onsetFound;
+	bool                _armed;
+	qint64              _onsetFrame;
+	QList<ProbeNoteEvent> _noteEvents;
+
+	void addNoteEvent( int melody, int id, bool playing );
+};
+
+#endif // LATENCYPROBE_H
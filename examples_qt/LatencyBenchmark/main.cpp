@@ -0,0 +1,298 @@
+//
+// Measures the time from the call to play a sound until the sound is output, and the
+// time of the note signals relative to the output of each note.
+//
+// The OpenAL output is rendered in a loopback device, in real time, as a stand-in for
+// the sound card. Usage:
+//
+//     LatencyBenchmark <samples path> [sample.wav] [sound.xml] [iterations]
+//
+#include <QtCore/QCoreApplication>
+#include <QStringList>
+#include <QVector>
+#include <QTime>
+#include <QtAlgorithms>
+
+#include <stdio.h>
+#include <math.h>
+
+#include "LatencyProbe.h"
+// SoundManager
+#include <../../include/SoundManager>
+#include <../../include/Sound>
+#include <../../include/Melody>
+#include <../../include/Note>
+
+using namespace CnotiAudio;
+
+static const int ONSET_TIMEOUT_MS = 2000;
+static const int SOUND_TIMEOUT_MS = 30000;
+
+//
+// QThread::msleep() is protected
+//
+class Sleeper : public QThread
+{
+public:
+	static void msleep( unsigned long msecs ) { QThread::msleep( msecs ); }
+};
+
+//
+// Latencies of one measure, in microseconds
+//
+class Stats
+{
+public:
+	Stats( const QString& name ) : _name(name), _missed(0) {}
+
+	void add( double usecs ) { _values.append( usecs ); }
+	void miss() { ++_missed; }
+
+	void print()
+	{
+		if( _values.isEmpty() )
+		{
+			printf( "%-28s no samples (%d missed)\n", _name.toLatin1().constData(), _missed );
+			return;
+		}
+		qSort( _values );
+		double mean = 0.0;
+		foreach( double v, _values )
+		{
+			mean += v;
+		}
+		mean /= _values.size();
+		double variance = 0.0;
+		foreach( double v, _values )
+		{
+			variance += ( v - mean ) * ( v - mean );
+		}
+		double jitter = sqrt( variance / _values.size() );
+
+		printf( "%-28s n=%-4d p50=%9.1f p90=%9.1f p99=%9.1f max=%9.1f jitter(sd)=%8.1f p99-p50=%8.1f us",
+				_name.toLatin1().constData(), _values.size(), percentile( 0.50 ), percentile( 0.90 ),
+				percentile( 0.99 ), _values.last(), jitter, percentile( 0.99 ) - percentile( 0.50 ) );
+		if( _missed > 0 )
+		{
+			printf( " (%d missed)", _missed );
+		}
+		printf( "\n" );
+	}
+
+private:
+	QString         _name;
+	QVector<double> _values;
+	int             _missed;
+
+	double percentile( double p ) const
+	{
+		int index = (int)ceil( p * _values.size() ) - 1;
+		return _values[qBound( 0, index, _values.size() - 1 )];
+	}
+};
+
+//
+// Frames of each note of the melodies of the sound, from the start of the melody
+//
+static QList< QVector<qint64> > noteOffsets( SoundManager* soundMgr, Sound* sound, int frequency )
+{
+	QList< QVector<qint64> > offsets;
+	foreach( Melody* melody, sound->getMelodyList() )
+	{
+		QVector<qint64> melodyOffsets;
+		qint64 frame = 0;
+		melodyOffsets.append( frame );
+		foreach( Note* note, melody->getNotes() )
+		{
+			QString name = SoundManager::nameNote( melody->getInstrument(), melody->getTempo(), note->getDuration(),
+												   note->getOctave(), note->getHeight() );
+			ALint noteFrequency = soundMgr->getFrequency( name );
+			if( noteFrequency > 0 )
+			{
+				// Samples are 16 bits, resampled to the output frequency
+				frame += (qint64)soundMgr->getSize( name ) / 2 * frequency / noteFrequency;
+			}
+			melodyOffsets.append( frame );
+		}
+		offsets.append( melodyOffsets );
+	}
+	return offsets;
+}
+
+//
+// Plays the sound with the trigger given and measures the output latency
+//
+enum Trigger { TRIGGER_SOUND, TRIGGER_MELODY, TRIGGER_NOTE };
+
+static bool measure( SoundManager* soundMgr, LatencyProbe* probe, Trigger trigger, const QString& soundName,
+					 Stats* onset, Stats* playing, Stats* stopped )
+{
+	if( !probe->waitSilence( 50, SOUND_TIMEOUT_MS ) )
+	{
+		soundMgr->stopAllSound();
+		probe->waitSilence( 50, ONSET_TIMEOUT_MS );
+	}
+	probe->arm();
+
+	qint64 triggerTime = probe->now();
+	bool result = false;
+	switch( trigger )
+	{
+	case TRIGGER_SOUND:
+		result = soundMgr->playSound( soundName );
+		break;
+	case TRIGGER_MELODY:
+		result = soundMgr->playMelodyOfSound( soundName, 0 );
+		break;
+	case TRIGGER_NOTE:
+		result = soundMgr->playNote( FLUTE, TEMPO_160, CROTCHET, LA, 3, 1.0 );
+		break;
+	}
+	if( !result )
+	{
+		return false;
+	}
+
+	qint64 onsetFrame;
+	if( !probe->waitOnset( ONSET_TIMEOUT_MS, &onsetFrame ) )
+	{
+		onset->miss();
+		soundMgr->stopAllSound();
+		return true;
+	}
+	qint64 onsetTime = probe->frameTime( onsetFrame );
+	onset->add( ( onsetTime - triggerTime ) / 1000.0 );
+
+	if( playing == NULL )
+	{
+		return true;
+	}
+	//
+	// Waits for the sound to end, and relates each note signal to the output of the note
+	//
+	QTime timeout;
+	timeout.start();
+	while( !soundMgr->isSoundStopped( soundName ) && timeout.elapsed() < SOUND_TIMEOUT_MS )
+	{
+		Sleeper::msleep( 5 );
+	}
+
+	QList< QVector<qint64> > offsets = noteOffsets( soundMgr, soundMgr->getSound( soundName ), probe->frequency() );
+	foreach( const ProbeNoteEvent& event, probe->takeNoteEvents() )
+	{
+		if( event.melody < 0 || event.melody >= offsets.size() )
+		{
+			continue;
+		}
+		const QVector<qint64>& melodyOffsets = offsets[event.melody];
+		// A note starts at its offset and stops at the offset of the next one
+		int index = event.playing ? event.id : event.id + 1;
+		if( index < 0 || index >= melodyOffsets.size() )
+		{
+			continue;
+		}
+		double delta = ( event.time - probe->frameTime( onsetFrame + melodyOffsets[index] ) ) / 1000.0;
+		if( event.playing )
+		{
+			playing->add( delta );
+		}
+		else
+		{
+			stopped->add( delta );
+		}
+	}
+	return true;
+}
+
+int main( int argc, char *argv[] )
+{
+	QCoreApplication app( argc, argv );
+	QStringList args = app.arguments();
+	if( args.size() < 2 )
+	{
+		printf( "Usage: LatencyBenchmark <samples path> [sample.wav] [sound.xml] [iterations]\n" );
+		return 1;
+	}
+	QString samplesPath = args[1];
+	QString sampleFile = args.size() > 2 ? args[2] : QString();
+	QString soundFile = args.size() > 3 ? args[3] : QString();
+	int iterations = args.size() > 4 ? args[4].toInt() : 50;
+
+	LatencyProbe probe;
+	ALCdevice* device = probe.open();
+	if( device == NULL )
+	{
+		printf( "A loopback OpenAL device (ALC_SOFT_loopback) is needed.\n" );
+		return 1;
+	}
+
+	SoundManager* soundMgr = SoundManager::instance();
+	soundMgr->init( "LatencyBenchmark" );
+	soundMgr->setLogLevel( LOG_LEVEL_WARNING );
+	if( !soundMgr->initOpenAl( device, probe.attributes() ) )
+	{
+		printf( "Can't initialize the OpenAL in the loopback device.\n" );
+		return 1;
+	}
+	soundMgr->addSamplePath( samplesPath );
+	probe.start( QThread::TimeCriticalPriority );
+
+	QObject::connect( soundMgr, SIGNAL(notePlaying(QString,int,int)), &probe, SLOT(notePlaying(QString,int,int)), Qt::DirectConnection );
+	QObject::connect( soundMgr, SIGNAL(noteStopped(QString,int,int)), &probe, SLOT(noteStopped(QString,int,int)), Qt::DirectConnection );
+
+	printf( "Output %d Hz, %d iterations, times in microseconds\n\n", probe.frequency(), iterations );
+	//
+	// SoundManager::playSound with a sample
+	//
+	if( !sampleFile.isEmpty() && soundMgr->load( sampleFile, "sample" ) )
+	{
+		Stats onset( "playSound(sample) onset" );
+		for( int i = 0; i < iterations; ++i )
+		{
+			measure( soundMgr, &probe, TRIGGER_SOUND, "sample", &onset, NULL, NULL );
+			soundMgr->stopSound( "sample" );
+		}
+		onset.print();
+	}
+	//
+	// SoundManager::playNote
+	//
+	if( soundMgr->loadSampleNote( LA, 3, CROTCHET, TEMPO_160, FLUTE ) )
+	{
+		Stats onset( "playNote onset" );
+		for( int i = 0; i < iterations; ++i )
+		{
+			measure( soundMgr, &probe, TRIGGER_NOTE, QString(), &onset, NULL, NULL );
+		}
+		onset.print();
+	}
+	//
+	// SoundManager::playSound and Melody::playSound with a xml sound
+	//
+	if( !soundFile.isEmpty() && soundMgr->load( soundFile, "sound" ) )
+	{
+		Stats onset( "playSound(xml) onset" );
+		Stats playing( "notePlaying - note onset" );
+		Stats stopped( "noteStopped - note end" );
+		for( int i = 0; i < iterations; ++i )
+		{
+			measure( soundMgr, &probe, TRIGGER_SOUND, "sound", &onset, &playing, &stopped );
+		}
+		onset.print();
+		playing.print();
+		stopped.print();
+
+		Stats melodyOnset( "Melody::playSound onset" );
+		for( int i = 0; i < iterations; ++i )
+		{
+			measure( soundMgr, &probe, TRIGGER_MELODY, "sound", &melodyOnset, NULL, NULL );
+			soundMgr->stopSound( "sound" );
+		}
+		melodyOnset.print();
+	}
+
+	soundMgr->stopAllSound();
+	probe.stop();
+	soundMgr->release();
+	return 0;
+}
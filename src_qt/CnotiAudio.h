@@ -130,6 +130,44 @@ namespace CnotiAudio{
 		RHYTHM_INST_UNKNOWN
 	};
 	
+	enum EnumVoicePriority{
+		VOICE_PRIORITY_AMBIENCE = 0,	// Background streams
+		VOICE_PRIORITY_RHYTHM,
+		VOICE_PRIORITY_MELODY,
+		VOICE_PRIORITY_UI				// User interface feedback
+	};
+
+	enum EnumSampleResidency{
+		SAMPLE_RESIDENT_BOTH = 0,		// AL buffer and samples in memory
+		SAMPLE_RESIDENT_AL,				// Only the AL buffer, for playback
+		SAMPLE_RESIDENT_CPU				// Only the samples in memory, for offline rendering
+	};
+
+	enum EnumNoteEventDelivery{
+		NOTE_EVENTS_DIRECT = 0,			// Signals emitted in the sound threads
+		NOTE_EVENTS_QUEUED,				// Queued and emitted by a timer in the SoundManager thread
+		NOTE_EVENTS_POLLED				// Queued and emitted when SoundManager::processNoteEvents() is called
+	};
+
+	enum EnumSampleLoading{
+		SAMPLE_LOADING_INSTRUMENT = 0,	// The principal notes of the instrument and tempo are loaded
+		SAMPLE_LOADING_SCORE			// Only the samples used by the notes of the sound are loaded
+	};
+
+	enum EnumSampleGroup{
+		SAMPLE_GROUP_INSTRUMENT = 0,	// Notes of an EnumInstrument
+		SAMPLE_GROUP_TEMPO,				// Notes, pauses and rhythms of a TempoType
+		SAMPLE_GROUP_DURATION,			// Notes and pauses of a DurationType
+		SAMPLE_GROUP_RHYTHM,			// Rhythms of an EnumRhythmInstrument
+		SAMPLE_GROUP_COUNT
+	};
+
+	enum EnumMixMode{
+		MIX_MODE_LEGACY = 0,			// Tracks mixed two at a time with the 16 bits mix formula
+		MIX_MODE_BUS,					// Tracks added in a float bus, with a look-ahead limiter and dither
+		MIX_MODE_GRAPH					// Tracks processed by a DspGraph, with the effects of the SoundManager
+	};
+
 	enum EnumRhythmVariation{
 		RHYTHM_01 = 0,
 		RHYTHM_02,
@@ -143,5 +181,16 @@ namespace CnotiAudio{
 		RHYTHM_10,
 		RHYTHM_UNKNOWN
 	};
+
+	struct PlayPosition
+	{
+		qint64  frame;		// Sample frames played
+		qint64  frames;		// Sample frames of the sound, 0 if unknown
+		int     melody;		// Melody of the note playing, -1 if none
+		int     note;		// Note playing, -1 if the sound has no notes
+
+		PlayPosition() : frame(0), frames(0), melody(-1), note(-1) {}
+		float percent() const { return frames > 0 ? float( frame ) / float( frames ) : 0.0f; }
+	};
 }
 #endif  //_CNOTIAUDI_H
@@ -18,6 +18,8 @@ DaisyFilter::DaisyFilter(int ffOrder, const float *ffGains, int fbOrder, const f
 {
 	mInputOrder = ffOrder;
 	mOutputOrder = fbOrder;
+	mInputGains = 0;
+	mOutputGains = 0;
 	
 	if( ffOrder > 0 )
 	{
@@ -48,11 +50,11 @@ DaisyFilter::~DaisyFilter()
 {
 	if( mInputOrder > 0 )
 	{
-		delete mInputGains;
+		delete[] mInputGains;
 	}
 	if( mOutputOrder > 0 )
 	{
-		delete mOutputGains;
+		delete[] mOutputGains;
 	}
 }
 
@@ -101,7 +103,7 @@ DaisyFilter* DaisyFilter::MovingAverageFilter(int taps)
 	}
 	
 	DaisyFilter *ret = new DaisyFilter(taps, &gains[0], 0, (float *)0);
-	delete gains;
+	delete[] gains;
 	return ret;
 }
 
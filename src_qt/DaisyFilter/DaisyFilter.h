@@ -77,10 +77,7 @@ private:
 
 		virtual ~DaisyCircularBuffer()
 		{
-			if( mSize > 0 )
-			{
-				delete mData;
-			}
+			delete[] mData;
 		}
 
 		void Increment()
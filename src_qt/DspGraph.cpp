@@ -0,0 +1,327 @@
+/**
+	\file DspGraph.cpp
+*/
+#include "DspGraph.h"
+#include "SoundLog.h"
+// Qt
+#include <QHash>
+#include <QtAlgorithms>
+// Std
+#include <math.h>
+
+namespace CnotiAudio
+{
+/*!
+	Constructs an empty graph.
+*/
+	DspGraph::DspGraph() :
+		_output (0),
+		_blockFrames (0),
+		_prepared (false),
+		_position (0)
+	{
+	}
+
+/*!
+	Destroyes the graph and its nodes.
+*/
+	DspGraph::~DspGraph()
+	{
+		qDeleteAll( _nodes );
+	}
+
+/*!
+	Adds \a node to the graph, that deletes it, and returns it. The graph must be prepared
+	again.
+*/
+	DspNode* DspGraph::addNode( DspNode* node )
+	{
+		if( node != 0 && !_nodes.contains( node ) )
+		{
+			_nodes.append( node );
+			_prepared = false;
+		}
+		return node;
+	}
+
+/*!
+	Makes the output of \a from an input of \a to. The graph must be prepared again.
+
+	Returns false if a node is not in the graph.
+*/
+	bool DspGraph::connect( DspNode* from, DspNode* to )
+	{
+		if( !_nodes.contains( from ) || !_nodes.contains( to ) )
+		{
+			csWarning() << "[DspGraph::connect] The nodes are not in the graph";
+			return false;
+		}
+		to->_inputs.append( from );
+		_prepared = false;
+		return true;
+	}
+
+/*!
+	Sets the node converted to 16 bits by render() to \a node.
+*/
+	void DspGraph::setOutput( DspNode* node )
+	{
+		_output = node;
+		_prepared = false;
+	}
+
+/*!
+	Returns the node converted to 16 bits by render().
+*/
+	DspNode* DspGraph::output() const
+	{
+		return _output;
+	}
+
+/*!
+	Adds a source for each of the \a tracks, with a gain of its intensity, a mixer, the
+	\a effects and a limiter, that is set as the output and returned.
+*/
+	DspNode* DspGraph::mixTracks( const QList<TrackCursor>& tracks, const DspEffects& effects )
+	{
+		DspNode* mixer = addNode( new MixerNode( 1 ) );
+		for( int i = 0; i < tracks.size(); i++ )
+		{
+			DspNode* source = addNode( new TrackSourceNode( tracks[i] ) );
+			DspNode* gain = addNode( new GainNode( tracks[i].intensity() ) );
+			connect( source, gain );
+			connect( gain, mixer );
+		}
+		DspNode* last = mixer;
+		if( !effects.filterForward.isEmpty() )
+		{
+			DspNode* filter = addNode( new FilterNode( effects.filterForward, effects.filterBack ) );
+			connect( last, filter );
+			last = filter;
+		}
+		if( effects.gain != 1.0f )
+		{
+			DspNode* gain = addNode( new GainNode( effects.gain ) );
+			connect( last, gain );
+			last = gain;
+		}
+		DspNode* limiter = addNode( new LimiterNode() );
+		connect( last, limiter );
+		setOutput( limiter );
+		return limiter;
+	}
+
+/*!
+	Sorts the nodes, gives them their channels and allocates their buffers, to process blocks
+	of up to \a blockFrames frames at \a frequency. Then moves the graph to the first frame.
+
+	Returns false if there is no output or the nodes make a cycle.
+*/
+	bool DspGraph::prepare( int frequency, int blockFrames )
+	{
+		_prepared = false;
+		_order.clear();
+		if( _output == 0 || !_nodes.contains( _output ) )
+		{
+			csWarning() << "[DspGraph::prepare] The graph has no output";
+			return false;
+		}
+		//
+		// Kahn sort: a node is processed when all its inputs were
+		//
+		QHash<DspNode*, int> pending;
+		QHash<DspNode*, QList<DspNode*> > readers;
+		for( int i = 0; i < _nodes.size(); i++ )
+		{
+			DspNode* node = _nodes[i];
+			pending[node] = node->_inputs.size();
+			for( int j = 0; j < node->_inputs.size(); j++ )
+			{
+				readers[node->_inputs[j]].append( node );
+			}
+		}
+		QList<DspNode*> ready;
+		for( int i = 0; i < _nodes.size(); i++ )
+		{
+			if( pending[_nodes[i]] == 0 )
+			{
+				ready.append( _nodes[i] );
+			}
+		}
+		while( !ready.isEmpty() )
+		{
+			DspNode* node = ready.takeFirst();
+			_order.append( node );
+			const QList<DspNode*>& next = readers[node];
+			for( int i = 0; i < next.size(); i++ )
+			{
+				if( --pending[next[i]] == 0 )
+				{
+					ready.append( next[i] );
+				}
+			}
+		}
+		if( _order.size() != _nodes.size() )
+		{
+			csWarning() << "[DspGraph::prepare] The nodes make a cycle";
+			_order.clear();
+			return false;
+		}
+		//
+		// Channels, latency and buffers, in the order of the nodes
+		//
+		_blockFrames = qMax( blockFrames, 1 );
+		int floats = 0;
+		for( int i = 0; i < _order.size(); i++ )
+		{
+			DspNode* node = _order[i];
+			node->_channels = node->_channelsRequested;
+			if( node->_channels == 0 )
+			{
+				node->_channels = node->_inputs.isEmpty() ? 1 : node->_inputs[0]->_channels;
+			}
+			node->_latencyTotal = 0;
+			for( int j = 0; j < node->_inputs.size(); j++ )
+			{
+				node->_latencyTotal = qMax( node->_latencyTotal, node->_inputs[j]->_latencyTotal );
+			}
+			node->_latencyTotal += node->latency();
+			floats += node->_channels * _blockFrames;
+		}
+		_buffers.fill( 0.0f, floats );
+		float* buffer = _buffers.data();
+		for( int i = 0; i < _order.size(); i++ )
+		{
+			DspNode* node = _order[i];
+			node->_output = buffer;
+			node->_blockFrames = _blockFrames;
+			buffer += node->_channels * _blockFrames;
+			node->prepare( _blockFrames, frequency );
+		}
+		_prepared = true;
+		seek( 0 );
+		return true;
+	}
+
+/*!
+	Returns true if the graph was prepared and not changed after.
+*/
+	bool DspGraph::isPrepared() const
+	{
+		return _prepared;
+	}
+
+/*!
+	Returns the channels of the output, 0 if the graph is not prepared.
+*/
+	int DspGraph::channels() const
+	{
+		return _prepared ? _output->_channels : 0;
+	}
+
+/*!
+	Returns the frames the output is delayed from the sources, dropped by render().
+*/
+	int DspGraph::latency() const
+	{
+		return _prepared ? _output->_latencyTotal : 0;
+	}
+
+/*!
+	Moves the sources to \a frame and clears the state of the processors.
+*/
+	void DspGraph::seek( qint64 frame )
+	{
+		if( !_prepared )
+		{
+			return;
+		}
+		for( int i = 0; i < _order.size(); i++ )
+		{
+			_order[i]->seek( frame );
+		}
+		_position = qMax( frame, qint64( 0 ) );
+		drop( latency() );
+	}
+
+/*!
+	Returns the next frame of the output.
+*/
+	qint64 DspGraph::position() const
+	{
+		return _position;
+	}
+
+/*!
+	Renders the next \a frames frames of the output into \a data, 16 bits with the channels
+	interleaved.
+
+	Returns the number of frames rendered, 0 if the graph is not prepared.
+*/
+	int DspGraph::render( short* data, int frames )
+	{
+		if( !_prepared )
+		{
+			return 0;
+		}
+		int channels = _output->_channels;
+		int done = 0;
+		while( done < frames )
+		{
+			int count = qMin( _blockFrames, frames - done );
+			processBlock( count );
+			for( int c = 0; c < channels; c++ )
+			{
+				const float* out = _output->output( c );
+				short* samples = data + done * channels + c;
+				for( int i = 0; i < count; i++ )
+				{
+					int sample = (int)floorf( out[i] * 32768.0f + 0.5f );
+					samples[i * channels] = (short)qBound( -32768, sample, 32767 );
+				}
+			}
+			done += count;
+		}
+		_position += frames;
+		return frames;
+	}
+
+/*!
+	Mixes \a frames frames of the \a tracks at \a frequency into \a data, with the graph of
+	mixTracks() and the \a effects.
+*/
+	void DspGraph::renderTracks( short* data, int frames, const QList<TrackCursor>& tracks, int frequency,
+		const DspEffects& effects )
+	{
+		DspGraph graph;
+		graph.mixTracks( tracks, effects );
+		if( graph.prepare( frequency ) )
+		{
+			graph.render( data, frames );
+		}
+	}
+
+/*!
+	Processes all the nodes for \a frames frames, up to a block.
+*/
+	void DspGraph::processBlock( int frames )
+	{
+		for( int i = 0; i < _order.size(); i++ )
+		{
+			_order[i]->process( frames );
+		}
+	}
+
+/*!
+	Processes \a frames frames without converting the output.
+*/
+	void DspGraph::drop( int frames )
+	{
+		while( frames > 0 )
+		{
+			int count = qMin( _blockFrames, frames );
+			processBlock( count );
+			frames -= count;
+		}
+	}
+}
@@ -0,0 +1,95 @@
+/*!
+ \class CnotiAudio::DspGraph
+ \brief The DspGraph class processes a graph of DspNode in blocks of frames.
+
+ The nodes are added to the graph, that deletes them, and connected. prepare() sorts the
+ nodes so each one comes after its inputs (Kahn), gives the channels to the nodes that take
+ them from their input and allocates all the buffers at once. Then render() processes the
+ nodes in that order, a block at a time, and converts the output node to 16 bits: no memory
+ is allocated and there is one virtual call for each node and block.
+
+ The output is aligned with the sources: the frames the output node is delayed, latency(),
+ are processed and dropped after prepare() and seek().
+
+ mixTracks() builds the graph used when the mix mode is MIX_MODE_GRAPH, by the RenderDevice
+ and by getData() of the sounds and musics: each track with its intensity, added by a mixer,
+ the DspEffects of the SoundManager and a limiter.
+
+ \version 2.2
+ \date 19-10-2026
+ \file DspGraph.h
+*/
+#if !defined(_DSPGRAPH_H)
+#define _DSPGRAPH_H
+
+#include <QList>
+#include <QVector>
+
+#include "DspNode.h"
+#include "TrackCursor.h"
+#include "soundmanager_global.h"
+
+namespace CnotiAudio
+{
+	#define CS_DSP_BLOCK			(512)		// Frames processed at a time by the nodes
+
+	//
+	// Effects applied to the mix of the tracks, by DspGraph::mixTracks()
+	//
+	struct DspEffects
+	{
+		float           gain;				// Gain of the mix, before the limiter
+		QVector<float>  filterForward;		// Feed forward gains of the filter, no filter if empty
+		QVector<float>  filterBack;			// Feed back gains of the filter
+
+		DspEffects() : gain(1.0f) {}
+
+		bool operator==( const DspEffects& other ) const
+		{
+			return gain == other.gain && filterForward == other.filterForward && filterBack == other.filterBack;
+		}
+		bool operator!=( const DspEffects& other ) const { return !( *this == other ); }
+	};
+
+	class SOUNDMANAGER_EXPORT DspGraph
+	{
+	public:
+		DspGraph();
+		~DspGraph();
+
+		DspNode* addNode( DspNode* node );
+		bool connect( DspNode* from, DspNode* to );
+		void setOutput( DspNode* node );
+		DspNode* output() const;
+
+		DspNode* mixTracks( const QList<TrackCursor>& tracks, const DspEffects& effects = DspEffects() );
+
+		bool prepare( int frequency, int blockFrames = CS_DSP_BLOCK );
+		bool isPrepared() const;
+		int channels() const;
+		int latency() const;
+
+		void seek( qint64 frame );
+		qint64 position() const;
+		int render( short* data, int frames );
+
+		static void renderTracks( short* data, int frames, const QList<TrackCursor>& tracks, int frequency,
+			const DspEffects& effects = DspEffects() );
+
+	private:
+		Q_DISABLE_COPY( DspGraph )
+
+		void processBlock( int frames );
+		void drop( int frames );
+
+		QList<DspNode*>    _nodes;
+		QVector<DspNode*>  _order;			// Nodes after their inputs
+		DspNode*           _output;
+		QVector<float>     _buffers;		// Output buffers of all the nodes
+		int                _blockFrames;
+		bool               _prepared;
+		qint64             _position;		// Next frame of the output
+	};
+}
+
+#endif //_DSPGRAPH_H
@@ -0,0 +1,523 @@
+/**
+	\file DspNode.cpp
+*/
+#include "DspNode.h"
+#include "MixBus.h"
+#include "DaisyFilter/DaisyFilter.h"
+// Qt
+#include <QtAlgorithms>
+// Std
+#include <math.h>
+#include <cstring>
+
+namespace CnotiAudio
+{
+	//
+	// Node
+	//
+
+/*!
+	Constructs a node with \a channels channels, or with the channels of its first input if
+	\a channels is 0.
+*/
+	DspNode::DspNode( int channels ) :
+		_channels (qBound( 0, channels, CS_DSP_MAX_CHANNELS )),
+		_blockFrames (0),
+		_channelsRequested (_channels),
+		_output (0),
+		_latencyTotal (0)
+	{
+	}
+
+/*!
+	Destroyes the node. The output buffers belong to the graph.
+*/
+	DspNode::~DspNode()
+	{
+	}
+
+/*!
+	Returns the number of channels of the output.
+*/
+	int DspNode::channels() const
+	{
+		return _channels;
+	}
+
+/*!
+	Returns the number of frames the output is delayed from the input, 0 by default.
+*/
+	int DspNode::latency() const
+	{
+		return 0;
+	}
+
+/*!
+	Returns the output of \a channel of the last block processed.
+*/
+	const float* DspNode::output( int channel ) const
+	{
+		return _output + channel * _blockFrames;
+	}
+
+/*!
+	Returns the nodes read by this node.
+*/
+	const QVector<DspNode*>& DspNode::inputs() const
+	{
+		return _inputs;
+	}
+
+/*!
+	Prepares the node to process blocks of up to \a blockFrames frames at \a frequency. The
+	buffers of the node are allocated here. Does nothing by default.
+*/
+	void DspNode::prepare( int blockFrames, int frequency )
+	{
+		Q_UNUSED( blockFrames );
+		Q_UNUSED( frequency );
+	}
+
+/*!
+	Moves the sources to \a frame and clears the state of the processors. Does nothing by
+	default.
+*/
+	void DspNode::seek( qint64 frame )
+	{
+		Q_UNUSED( frame );
+	}
+
+/*!
+	Returns the output of \a channel to be written by process().
+*/
+	float* DspNode::output( int channel )
+	{
+		return _output + channel * _blockFrames;
+	}
+
+/*!
+	Returns the output of the input \a index for \a channel. A mono input gives the same
+	samples to all the channels.
+*/
+	const float* DspNode::input( int index, int channel ) const
+	{
+		const DspNode* node = _inputs[index];
+		return node->output( qMin( channel, node->_channels - 1 ) );
+	}
+
+	//
+	// Track source
+	//
+
+/*!
+	Constructs a mono source that reads \a track. The intensity of the track is not applied,
+	see DspGraph::mixTracks().
+*/
+	TrackSourceNode::TrackSourceNode( const TrackCursor& track ) :
+		DspNode( 1 ),
+		_track (track)
+	{
+	}
+
+/*!
+	Allocates the samples read from the track.
+*/
+	void TrackSourceNode::prepare( int blockFrames, int frequency )
+	{
+		Q_UNUSED( frequency );
+		_samples.resize( blockFrames );
+	}
+
+/*!
+	Moves the track to \a frame.
+*/
+	void TrackSourceNode::seek( qint64 frame )
+	{
+		_track.seek( qBound( qint64( 0 ), frame, _track.size() ) );
+	}
+
+/*!
+	Reads the next \a frames samples of the track, silence after its end.
+*/
+	void TrackSourceNode::process( int frames )
+	{
+		short* samples = _samples.data();
+		float* out = output( 0 );
+		_track.read( samples, frames );
+		for( int i = 0; i < frames; i++ )
+		{
+			out[i] = samples[i] / 32768.0f;
+		}
+	}
+
+	//
+	// Gain
+	//
+
+/*!
+	Constructs a gain of \a gain, with the channels of its input.
+*/
+	GainNode::GainNode( float gain ) :
+		_gain (gain),
+		_current (gain)
+	{
+	}
+
+/*!
+	Changes the gain to \a gain. The next block goes from the old gain to the new one.
+*/
+	void GainNode::setGain( float gain )
+	{
+		_gain = gain;
+	}
+
+/*!
+	Returns the gain.
+*/
+	float GainNode::gain() const
+	{
+		return _gain;
+	}
+
+/*!
+	Ends the change of the gain.
+*/
+	void GainNode::seek( qint64 frame )
+	{
+		Q_UNUSED( frame );
+		_current = _gain;
+	}
+
+/*!
+	Multiplies the next \a frames frames of the input by the gain.
+*/
+	void GainNode::process( int frames )
+	{
+		float step = ( frames > 0 ) ? ( _gain - _current ) / frames : 0.0f;
+		for( int c = 0; c < _channels; c++ )
+		{
+			const float* in = input( 0, c );
+			float* out = output( c );
+			if( step == 0.0f )
+			{
+				for( int i = 0; i < frames; i++ )
+				{
+					out[i] = in[i] * _gain;
+				}
+			}
+			else
+			{
+				for( int i = 0; i < frames; i++ )
+				{
+					out[i] = in[i] * ( _current + step * ( i + 1 ) );
+				}
+			}
+		}
+		_current = _gain;
+	}
+
+	//
+	// Pan
+	//
+
+/*!
+	Constructs a stereo pan at \a pan, from -1 (left) to 1 (right).
+*/
+	PanNode::PanNode( float pan ) :
+		DspNode( 2 ),
+		_pan (qBound( -1.0f, pan, 1.0f ))
+	{
+	}
+
+/*!
+	Changes the pan to \a pan, from -1 (left) to 1 (right).
+*/
+	void PanNode::setPan( float pan )
+	{
+		_pan = qBound( -1.0f, pan, 1.0f );
+	}
+
+/*!
+	Returns the pan, from -1 (left) to 1 (right).
+*/
+	float PanNode::pan() const
+	{
+		return _pan;
+	}
+
+/*!
+	Places the next \a frames frames of the input. A mono input is panned with equal power, a
+	stereo one is balanced.
+*/
+	void PanNode::process( int frames )
+	{
+		float left;
+		float right;
+		if( _inputs[0]->channels() == 1 )
+		{
+			float angle = ( _pan + 1.0f ) * 0.7853982f;		// From 0 to pi / 2
+			left = cosf( angle );
+			right = sinf( angle );
+		}
+		else
+		{
+			left = qMin( 1.0f, 1.0f - _pan );
+			right = qMin( 1.0f, 1.0f + _pan );
+		}
+		const float* inLeft = input( 0, 0 );
+		const float* inRight = input( 0, 1 );
+		float* outLeft = output( 0 );
+		float* outRight = output( 1 );
+		for( int i = 0; i < frames; i++ )
+		{
+			outLeft[i] = inLeft[i] * left;
+			outRight[i] = inRight[i] * right;
+		}
+	}
+
+	//
+	// Filter
+	//
+
+/*!
+	Constructs a linear filter, with the \a feedForward (FIR) and \a feedBack (IIR) gains of
+	DaisyFilter, for each channel of its input.
+*/
+	FilterNode::FilterNode( const QVector<float>& feedForward, const QVector<float>& feedBack ) :
+		_feedForward (feedForward),
+		_feedBack (feedBack)
+	{
+	}
+
+/*!
+	Destroyes the filter.
+*/
+	FilterNode::~FilterNode()
+	{
+		deleteFilters();
+	}
+
+/*!
+	Returns a new one-pole low-pass filter, as DaisyFilter::SinglePoleIIRFilter(): lower
+	\a gain is smoother.
+*/
+	FilterNode* FilterNode::lowPass( float gain )
+	{
+		QVector<float> feedForward( 1, gain );
+		QVector<float> feedBack( 1, gain - 1.0f );
+		return new FilterNode( feedForward, feedBack );
+	}
+
+/*!
+	Returns a new moving average of \a taps samples, as DaisyFilter::MovingAverageFilter().
+*/
+	FilterNode* FilterNode::movingAverage( int taps )
+	{
+		taps = qMax( taps, 1 );
+		return new FilterNode( QVector<float>( taps, 1.0f / taps ), QVector<float>() );
+	}
+
+/*!
+	Creates the filters of the channels.
+*/
+	void FilterNode::prepare( int blockFrames, int frequency )
+	{
+		Q_UNUSED( blockFrames );
+		Q_UNUSED( frequency );
+		createFilters();
+	}
+
+/*!
+	Clears the samples kept by the filters.
+*/
+	void FilterNode::seek( qint64 frame )
+	{
+		Q_UNUSED( frame );
+		createFilters();
+	}
+
+/*!
+	Filters the next \a frames frames of each channel of the input.
+*/
+	void FilterNode::process( int frames )
+	{
+		for( int c = 0; c < _channels; c++ )
+		{
+			DaisyFilter* filter = _filters[c];
+			const float* in = input( 0, c );
+			float* out = output( c );
+			for( int i = 0; i < frames; i++ )
+			{
+				out[i] = filter->Calculate( in[i] );
+			}
+		}
+	}
+
+/*!
+	Creates a new filter for each channel, without samples.
+*/
+	void FilterNode::createFilters()
+	{
+		deleteFilters();
+		for( int c = 0; c < _channels; c++ )
+		{
+			_filters.append( new DaisyFilter( _feedForward.size(), _feedForward.constData(),
+				_feedBack.size(), _feedBack.constData() ) );
+		}
+	}
+
+/*!
+	Deletes the filters of the channels.
+*/
+	void FilterNode::deleteFilters()
+	{
+		qDeleteAll( _filters );
+		_filters.clear();
+	}
+
+	//
+	// Mixer
+	//
+
+/*!
+	Constructs a mixer with \a channels channels.
+*/
+	MixerNode::MixerNode( int channels ) :
+		DspNode( qMax( channels, 1 ) )
+	{
+	}
+
+/*!
+	Adds the next \a frames frames of all the inputs. A mono input is added to all the
+	channels, the channels of an input that the mixer doesn't have are added to the last one.
+*/
+	void MixerNode::process( int frames )
+	{
+		for( int c = 0; c < _channels; c++ )
+		{
+			memset( output( c ), 0, frames * sizeof(float) );
+		}
+		for( int n = 0; n < _inputs.size(); n++ )
+		{
+			int inputChannels = _inputs[n]->channels();
+			for( int c = 0; c < qMax( _channels, inputChannels ); c++ )
+			{
+				const float* in = input( n, c );
+				float* out = output( qMin( c, _channels - 1 ) );
+				for( int i = 0; i < frames; i++ )
+				{
+					out[i] += in[i];
+				}
+			}
+		}
+	}
+
+	//
+	// Limiter
+	//
+
+/*!
+	Constructs a look-ahead limiter, with the channels of its input.
+
+	The gain at a frame is the mean, over CS_LIMITER_LOOKAHEAD frames, of the minimum gain
+	needed in the CS_LIMITER_LOOKAHEAD frames after, as in MixBus: no frame goes over
+	CS_LIMITER_CEILING. The output is delayed by latency() frames.
+*/
+	LimiterNode::LimiterNode() :
+		_minFirst (0),
+		_minCount (0),
+		_sum (0.0),
+		_frame (0)
+	{
+	}
+
+/*!
+	Returns CS_LIMITER_LOOKAHEAD - 1, the frames the output is delayed.
+*/
+	int LimiterNode::latency() const
+	{
+		return CS_LIMITER_LOOKAHEAD - 1;
+	}
+
+/*!
+	Allocates the delay and the windows of the gains.
+*/
+	void LimiterNode::prepare( int blockFrames, int frequency )
+	{
+		Q_UNUSED( blockFrames );
+		Q_UNUSED( frequency );
+		_delay.resize( _channels * CS_LIMITER_LOOKAHEAD );
+		_minGains.resize( CS_LIMITER_LOOKAHEAD );
+		_minFrames.resize( CS_LIMITER_LOOKAHEAD );
+		_means.resize( CS_LIMITER_LOOKAHEAD );
+		seek( 0 );
+	}
+
+/*!
+	Clears the delay and the gains.
+*/
+	void LimiterNode::seek( qint64 frame )
+	{
+		Q_UNUSED( frame );
+		_delay.fill( 0.0f );
+		_means.fill( 1.0f );
+		_sum = CS_LIMITER_LOOKAHEAD;
+		_minFirst = 0;
+		_minCount = 0;
+		_frame = 0;
+	}
+
+/*!
+	Limits the next \a frames frames of the input. The window minimum is kept with a queue of
+	decreasing gains, and the mean with a running sum.
+*/
+	void LimiterNode::process( int frames )
+	{
+		const int window = CS_LIMITER_LOOKAHEAD;
+		const float ceiling = CS_LIMITER_CEILING / 32768.0f;
+		float* delay = _delay.data();
+		float* minGains = _minGains.data();
+		qint64* minFrames = _minFrames.data();
+		float* means = _means.data();
+		for( int i = 0; i < frames; i++, _frame++ )
+		{
+			int slot = int( _frame % window );
+			float peak = 0.0f;
+			for( int c = 0; c < _channels; c++ )
+			{
+				float value = input( 0, c )[i];
+				delay[c * window + slot] = value;
+				peak = qMax( peak, fabsf( value ) );
+			}
+			float needed = ( peak > ceiling ) ? ceiling / peak : 1.0f;
+			//
+			// Minimum of the gains needed in the window that ends in this frame
+			//
+			while( _minCount > 0 && minGains[( _minFirst + _minCount - 1 ) % window] >= needed )
+			{
+				_minCount--;
+			}
+			if( _minCount > 0 && minFrames[_minFirst] <= _frame - window )
+			{
+				_minFirst = ( _minFirst + 1 ) % window;
+				_minCount--;
+			}
+			int last = ( _minFirst + _minCount ) % window;
+			minGains[last] = needed;
+			minFrames[last] = _frame;
+			_minCount++;
+			float minimum = minGains[_minFirst];
+			//
+			// Mean of the minimums, applied to the frame that entered the window first
+			//
+			_sum += minimum - means[slot];
+			means[slot] = minimum;
+			float gain = qMin( 1.0f, (float)( _sum / window ) );
+			int delayed = ( slot + 1 ) % window;
+			for( int c = 0; c < _channels; c++ )
+			{
+				output( c )[i] = delay[c * window + delayed] * gain;
+			}
+		}
+	}
+}
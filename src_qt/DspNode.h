@@ -0,0 +1,176 @@
+/*!
+ \class CnotiAudio::DspNode
+ \brief The DspNode class is a node of a DspGraph: a source, a processor or a mixer.
+
+ A node processes a block of frames at a time: process() reads the output of its inputs and
+ writes its own output, a buffer of floats for each channel, with the samples in 16 bits
+ scale. The buffers belong to the graph and are given to the node by DspGraph::prepare(),
+ where the node also allocates its state: process() doesn't allocate and has only one
+ virtual call for the whole block.
+
+ A node with 0 channels has the channels of its first input.
+
+ The nodes of the library:
+ - TrackSourceNode reads a TrackCursor: the notes of a melody, a rhythm repeated or the
+   samples of a stream or of a capture in a buffer.
+ - GainNode multiplies by a gain, changed without clicks.
+ - PanNode places a mono input in a stereo output.
+ - FilterNode applies a DaisyFilter to each channel.
+ - MixerNode adds its inputs.
+ - LimiterNode keeps the peaks under CS_LIMITER_CEILING, as MixBus does.
+
+ \version 2.2
+ \date 19-10-2026
+ \file DspNode.h
+*/
+#if !defined(_DSPNODE_H)
+#define _DSPNODE_H
+
+#include <QVector>
+
+#include "TrackCursor.h"
+#include "soundmanager_global.h"
+
+class DaisyFilter;
+
+namespace CnotiAudio
+{
+	#define CS_DSP_MAX_CHANNELS		(2)			// Channels of a node, mono or stereo
+
+	class SOUNDMANAGER_EXPORT DspNode
+	{
+		friend class DspGraph;
+
+	public:
+		DspNode( int channels = 0 );
+		virtual ~DspNode();
+
+		int channels() const;
+		virtual int latency() const;
+		const float* output( int channel ) const;
+		const QVector<DspNode*>& inputs() const;
+
+	protected:
+		virtual void prepare( int blockFrames, int frequency );
+		virtual void seek( qint64 frame );
+		virtual void process( int frames ) = 0;
+
+		float* output( int channel );
+		const float* input( int index, int channel ) const;
+
+		QVector<DspNode*>  _inputs;
+		int                _channels;
+		int                _blockFrames;		// Frames of the output buffers
+
+	private:
+		Q_DISABLE_COPY( DspNode )
+
+		int                _channelsRequested;	// Channels of the constructor, 0 to take them from the input
+		float*             _output;				// Buffers of the channels, one after the other
+		int                _latencyTotal;		// Latency of the node and of its inputs
+	};
+
+	class SOUNDMANAGER_EXPORT TrackSourceNode : public DspNode
+	{
+	public:
+		TrackSourceNode( const TrackCursor& track );
+
+	protected:
+		void prepare( int blockFrames, int frequency );
+		void seek( qint64 frame );
+		void process( int frames );
+
+	private:
+		TrackCursor       _track;
+		QVector<short>    _samples;		// Samples read from the track
+	};
+
+	class SOUNDMANAGER_EXPORT GainNode : public DspNode
+	{
+	public:
+		GainNode( float gain = 1.0 );
+
+		void setGain( float gain );
+		float gain() const;
+
+	protected:
+		void seek( qint64 frame );
+		void process( int frames );
+
+	private:
+		float  _gain;
+		float  _current;		// Gain at the end of the last block, the next one goes from it to _gain
+	};
+
+	class SOUNDMANAGER_EXPORT PanNode : public DspNode
+	{
+	public:
+		PanNode( float pan = 0.0 );
+
+		void setPan( float pan );
+		float pan() const;
+
+	protected:
+		void process( int frames );
+
+	private:
+		float  _pan;			// -1 left, 0 center, 1 right
+	};
+
+	class SOUNDMANAGER_EXPORT FilterNode : public DspNode
+	{
+	public:
+		FilterNode( const QVector<float>& feedForward, const QVector<float>& feedBack );
+		~FilterNode();
+
+		static FilterNode* lowPass( float gain );
+		static FilterNode* movingAverage( int taps );
+
+	protected:
+		void prepare( int blockFrames, int frequency );
+		void seek( qint64 frame );
+		void process( int frames );
+
+	private:
+		void createFilters();
+		void deleteFilters();
+
+		QVector<float>          _feedForward;
+		QVector<float>          _feedBack;
+		QVector<DaisyFilter*>   _filters;		// Filter of each channel
+	};
+
+	class SOUNDMANAGER_EXPORT MixerNode : public DspNode
+	{
+	public:
+		MixerNode( int channels = 1 );
+
+	protected:
+		void process( int frames );
+	};
+
+	class SOUNDMANAGER_EXPORT LimiterNode : public DspNode
+	{
+	public:
+		LimiterNode();
+
+		int latency() const;
+
+	protected:
+		void prepare( int blockFrames, int frequency );
+		void seek( qint64 frame );
+		void process( int frames );
+
+	private:
+		QVector<float>   _delay;			// Last frames of the input, by channel
+		QVector<float>   _minGains;			// Decreasing gains needed in the window, as a ring
+		QVector<qint64>  _minFrames;		// Frame of each gain of _minGains
+		int              _minFirst;
+		int              _minCount;
+		QVector<float>   _means;			// Last minimum gains, to average them
+		double           _sum;				// Sum of _means
+		qint64           _frame;			// Next frame of the input
+	};
+}
+
+#endif //_DSPNODE_H
@@ -20,6 +20,7 @@
 #include <algorithm>
 
 #include "logmanager.h"
+#include "logwriter.h"
 
 /*!
 	\class CnotiLogManager
@@ -62,10 +63,15 @@ mSuppressFile(suppressFile), mLogName(name)
 		mfpLog.flush();
 	}
 
+	mWriter = new LogWriter( mSuppressFile ? 0 : &mfpLog );
+	mWriter->start( QThread::LowPriority );
 }
 //-----------------------------------------------------------------------
 Log::~Log()
 {
+	// Writes the messages still in the queue
+	delete mWriter;
+
 	if (!mSuppressFile)
 	{
 		mfpLog.close();
@@ -79,21 +85,11 @@ void Log::logMessage( const QString& message, LogMessageLevel lml, bool maskDebu
 		for( mtLogListener::iterator i = mListeners.begin(); i != mListeners.end(); ++i )
 			(*i)->messageLogged( message, lml, maskDebug, mLogName );
 
-		if (mDebugOut && !maskDebug) std::cerr << message.toStdString() << std::endl;
-
-		// Write time into log
-		if( !mSuppressFile )
+		// The time is written and the file flushed by the writer thread
+		bool toConsole = mDebugOut && !maskDebug;
+		if( toConsole || !mSuppressFile )
 		{
-			struct tm *pTime;
-			time_t ctTime; time(&ctTime);
-			pTime = localtime( &ctTime );
-			mfpLog << std::setw(2) << std::setfill('0') << pTime->tm_hour
-				<< ":" << std::setw(2) << std::setfill('0') << pTime->tm_min
-				<< ":" << std::setw(2) << std::setfill('0') << pTime->tm_sec 
-				<< ": " << message.toStdString() << std::endl;
-
-			// Flush stcmdream to ensure it is written (incase of a crash, we need log to be up to date)
-			mfpLog.flush();
+			mWriter->post( message, toConsole, !mSuppressFile );
 		}
 	}
 }
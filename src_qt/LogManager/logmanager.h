@@ -11,6 +11,8 @@
 
 #include <QString>
 #include <QList>
+
+class LogWriter;
 //namespace Logger
 //{
 
@@ -80,6 +82,8 @@ protected:
 	typedef QList<LogListener*> mtLogListener;
 	mtLogListener	mListeners;
 
+	LogWriter*     mWriter;
+
 public:
 	/**
 	@remarks
@@ -101,6 +105,9 @@ public:
 	bool isFileOutputSuppressed() const	{ return mSuppressFile; }
 
 	/** Log a message to the debugger and to log file (the default is "<code>OGRE.log</code>"),
+	@remarks
+	The message is written by a background thread, the caller never waits for the file.
+	The listeners are still called in the caller's thread.
 	*/
 	void logMessage( const QString& message, LogMessageLevel lml = LML_NORMAL, bool maskDebug = false );
 
@@ -0,0 +1,122 @@
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+
+#include "logwriter.h"
+
+/************************************************************************/
+/*
+LOGWRITER
+*/
+/************************************************************************/
+
+//-----------------------------------------------------------------------
+LogWriter::LogWriter( std::ofstream* file ) :
+mFile(file), mLastTime(0)
+{
+	// The queue always keeps one entry, the last one written
+	Entry* stub = new Entry();
+	stub->next = 0;
+	mHead = stub;
+	mTail = stub;
+	mStopping = 0;
+}
+//-----------------------------------------------------------------------
+LogWriter::~LogWriter()
+{
+	stop();
+	drain();
+	delete mTail;
+}
+//-----------------------------------------------------------------------
+void LogWriter::post( const QString& message, bool toConsole, bool toFile )
+{
+	Entry* entry = new Entry();
+	entry->next = 0;
+	entry->message = message;
+	entry->toConsole = toConsole;
+	entry->toFile = toFile;
+	time( &entry->time );
+
+	// Takes the place of the last entry, and only then links it to the new one
+	Entry* prev = mHead.fetchAndStoreOrdered( entry );
+	prev->next.fetchAndStoreRelease( entry );
+}
+//-----------------------------------------------------------------------
+void LogWriter::stop()
+{
+	mStopping = 1;
+	if( isRunning() )
+	{
+		wait();
+	}
+}
+//-----------------------------------------------------------------------
+void LogWriter::run()
+{
+	while( mStopping == 0 )
+	{
+		if( drain() == 0 )
+		{
+			msleep( LOG_WRITER_IDLE_MS );
+		}
+	}
+	// Messages posted while stopping
+	drain();
+}
+//-----------------------------------------------------------------------
+int LogWriter::drain()
+{
+	int written = 0;
+	bool toFile = false;
+	bool toConsole = false;
+
+	Entry* next = mTail->next;
+	while( next != 0 )
+	{
+		if( next->toConsole )
+		{
+			std::cerr << next->message.toStdString() << '\n';
+			toConsole = true;
+		}
+		if( next->toFile && mFile != 0 )
+		{
+			*mFile << prefix( next->time ).toStdString() << next->message.toStdString() << '\n';
+			toFile = true;
+		}
+		// The entry written is kept as the first of the queue, without the message
+		next->message = QString();
+		delete mTail;
+		mTail = next;
+		next = mTail->next;
+		++written;
+	}
+
+	// Flush once per batch
+	if( toConsole )
+	{
+		std::cerr.flush();
+	}
+	if( toFile )
+	{
+		mFile->flush();
+	}
+	return written;
+}
+//-----------------------------------------------------------------------
+const QString& LogWriter::prefix( time_t time )
+{
+	// Messages in the same second share the prefix
+	if( time != mLastTime || mLastPrefix.isEmpty() )
+	{
+		struct tm *pTime = localtime( &time );
+		std::ostringstream stream;
+		stream << std::setw(2) << std::setfill('0') << pTime->tm_hour
+			<< ":" << std::setw(2) << std::setfill('0') << pTime->tm_min
+			<< ":" << std::setw(2) << std::setfill('0') << pTime->tm_sec
+			<< ": ";
+		mLastPrefix = QString::fromStdString( stream.str() );
+		mLastTime = time;
+	}
+	return mLastPrefix;
+}
@@ -0,0 +1,75 @@
+#ifndef LOGWRITER_H
+#define LOGWRITER_H
+
+#include "logmanager_global.h"
+
+#include <fstream>
+#include <ctime>
+
+#include <QThread>
+#include <QString>
+#include <QAtomicInt>
+#include <QAtomicPointer>
+
+// Time the writer sleeps when there are no messages to write, in milliseconds
+#define LOG_WRITER_IDLE_MS 50
+
+/**
+@remarks
+Background writer of a Log.
+@par
+The messages are posted to a lock-free queue, that accepts many producers and has
+one consumer, the writer thread. The writer formats the time of each message, writes
+all the messages waiting in the queue and flushes the file once per batch, so the
+threads that log never wait for the disk.
+@note
+<br>Should not be used directly, but trough the Log class.
+*/
+class LOGMANAGER_EXPORT LogWriter : public QThread
+{
+public:
+	/**
+	@remarks
+	Creates a writer of the file \a file, that can also write to the console.
+	*/
+	LogWriter( std::ofstream* file );
+
+	/**
+	@remarks
+	Stops the writer, the messages still in the queue are written before.
+	*/
+	~LogWriter();
+
+	/** Posts a message to be written. Can be called from any thread.
+	*/
+	void post( const QString& message, bool toConsole, bool toFile );
+
+	/** Writes the messages still in the queue and stops the writer thread.
+	*/
+	void stop();
+
+protected:
+	void run();
+
+private:
+	struct Entry
+	{
+		QAtomicPointer<Entry> next;
+		QString               message;
+		time_t                time;
+		bool                  toConsole;
+		bool                  toFile;
+	};
+
+	std::ofstream*        mFile;
+	QAtomicPointer<Entry> mHead;		// Last entry posted, producers side
+	Entry*                mTail;		// Last entry written, only used by the writer thread
+	QAtomicInt            mStopping;
+	time_t                mLastTime;	// Time of the prefix cached
+	QString               mLastPrefix;	// Time already formatted
+
+	int drain();
+	const QString& prefix( time_t time );
+};
+
+#endif // LOGWRITER_H
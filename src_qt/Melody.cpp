@@ -1,10 +1,13 @@
 
 #include "Sound.h"
+#include "SoundLog.h"
 #include "Melody.h"
 #include "Note.h"
 #include "SoundManager.h"
+#include "VoiceManager.h"
 
 #include <QDebug>
+#include <QtAlgorithms>
 
 namespace CnotiAudio
 {
@@ -29,7 +32,18 @@ namespace CnotiAudio
 		_sourcePos[2]		= 0.0;
 		_intensity			= 1.0;
 		_isStopped			= true;
+		_playedSamples		= 0;
+		_uiSource			= 0;
 		_logFile            = CnotiAudio::SoundManager::instance()->getLogFile();
+		_renderDirty		= 0;
+		_renderFrom			= -1;
+		_renderGeneration	= -1;
+		_changedSample		= -1;
+		_timelineDirty		= 0;
+		_firstNote			= 0;
+		_rangeFrom			= 0;
+		_rangeTo			= 0;
+		_rangeOffset		= 0;
 	}
 
 /*!
@@ -51,9 +65,21 @@ namespace CnotiAudio
 		this->_logFile		        = other._logFile;
 
 		_parent						= other._parent;
+		_isStopped					= true;
+		_playedSamples				= 0;
+		_uiSource					= 0;
 		_sourcePos[0]				= other._sourcePos[0];
 		_sourcePos[1]				= other._sourcePos[1];
 		_sourcePos[2]				= other._sourcePos[2];
+		_renderDirty				= 0;
+		_renderFrom					= -1;
+		_renderGeneration			= -1;
+		_changedSample				= -1;
+		_timelineDirty				= 0;
+		_firstNote					= 0;
+		_rangeFrom					= 0;
+		_rangeTo					= 0;
+		_rangeOffset				= 0;
 
 		for(int i=0; i<other._noteList.size(); i++){
 			Note *newNote = new Note(*(other._noteList[i]));
@@ -91,61 +117,198 @@ namespace CnotiAudio
 */
 	bool Melody::playSound( ALuint source, bool loop, bool blockSignal )
 	{
+		return playFrom( source, 0, loop, blockSignal );
+	}
+
+/*!
+	Plays the melody from the note \a note to the end, using the \a source.
+
+	The notes before are not played, the melody starts at once.
+*/
+	bool Melody::playFrom( ALuint source, int note, bool loop, bool blockSignal )
+	{
+		int position = getNotePosition( note );
+		return playRange( source, position < 0 ? getLastPosition() : position, -1, loop, blockSignal );
+	}
+
+/*!
+	Plays the part of the melody from the position \a from to the position \a to, or to the
+	end if -1, using the \a source. The positions are in the units of the note durations,
+	see getBarPosition() to play some bars.
+
+	If \a from is in the middle of a note, the note is played from that point. The notes
+	starting before \a to are played to their end.
+
+	The range is kept, replay() plays it again.
+*/
+	bool Melody::playRange( ALuint source, int from, int to, bool loop, bool blockSignal )
+	{
+		Q_UNUSED( loop );
+		updateTimeline();
+		int size = _noteList.size();
+		_rangeFrom = qBound( 0, int( qUpperBound( _timeline.constBegin(), _timeline.constEnd(), from ) - _timeline.constBegin() ) - 1, size );
+		_rangeTo = ( to < 0 ) ? size : qBound( _rangeFrom, int( qLowerBound( _timeline.constBegin(), _timeline.constEnd(), to ) - _timeline.constBegin() ), size );
+		_rangeOffset = 0;
 		_uiSource = source;
+		blockSignals( blockSignal );
+
+		refreshBuffer();
+		//
+		// Starts in the middle of the first note, at the same fraction of its samples
+		//
+		if( _rangeFrom < _rangeTo && from > _timeline[_rangeFrom] )
+		{
+			qint64 noteFrames = _bufferOffsets[_rangeFrom + 1] - _bufferOffsets[_rangeFrom];
+			int noteDuration = _timeline[_rangeFrom + 1] - _timeline[_rangeFrom];
+			if( noteDuration > 0 )
+			{
+				_rangeOffset = noteFrames * ( from - _timeline[_rangeFrom] ) / noteDuration;
+			}
+		}
+		return queueNotes( _rangeFrom, _rangeOffset, true );
+	}
 
+/*!
+	Plays again the range of the last play, using the \a source. Used to play in loop.
+*/
+	bool Melody::replay( ALuint source, bool blockSignal )
+	{
+		_uiSource = source;
 		blockSignals( blockSignal );
+		refreshBuffer();
+		return queueNotes( qMin( _rangeFrom, _rangeTo ), _rangeOffset, true );
+	}
+
+/*!
+	Moves the melody being played to the sample frame \a frame, counted from the beginning
+	of the melody, inside the range being played.
+
+	The notes are queued again from the note at that frame, and the source offset set inside
+	it, so the notes before are not played again.
+
+	Returns false if the melody is stopped.
+*/
+	bool Melody::seek( qint64 frame )
+	{
+		if( _isStopped || _uiSource == 0 )
+		{
+			_lastError = CS_IS_ALREADY_STOPPED;
+			return false;
+		}
+		if( _rangeFrom >= _rangeTo )
+		{
+			_lastError = CS_MELODY_EMPTY;
+			return false;
+		}
+		int note = int( qUpperBound( _bufferOffsets.constBegin(), _bufferOffsets.constEnd(), frame ) - _bufferOffsets.constBegin() ) - 1;
+		note = qBound( _rangeFrom, note, _rangeTo - 1 );
+		qint64 offset = qBound( qint64( 0 ), frame - _bufferOffsets[note], _bufferOffsets[note + 1] - _bufferOffsets[note] - 1 );
+		bool paused = isPaused();
+		//
+		// Stops the notes queued, without stopping the melody
+		//
+		alSourceStop( _uiSource );
+		for( int i = _lastNoteStopped + 1; i <= _lastNotePlay && _firstNote + i < _rangeTo; i++ )
+		{
+			emit noteStopped( _index, _firstNote + i );
+		}
+		unqueueNotes();
+		if( !queueNotes( note, offset, false ) )
+		{
+			return false;
+		}
+		if( paused )
+		{
+			alSourcePause( _uiSource );
+		}
+		return true;
+	}
+
+/*!
+	Queues the notes from \a fromNote to the end of the range, and plays them starting \a offset
+	sample frames inside the first note. The buffers of the notes must be already refreshed.
 
+	Emits melodyPlaying() if \a starting is true, and notePlaying() for the first note.
+*/
+	bool Melody::queueNotes( int fromNote, qint64 offset, bool starting )
+	{
 		int error = alGetError();
-		int size = _noteList.size();
-		if( size == 0 )
+		int count = _rangeTo - fromNote;
+		_firstNote = fromNote;
+		if( count <= 0 )
 		{
 			_lastError = CS_NO_ERROR;
 			return true;
 		}
-		else
+		else if( _uiSource == 0 )
 		{
-//            alSourceStop( _source );
-//int processed;
-//alGetSourcei(_source, AL_BUFFERS_PROCESSED, &processed);
-//CnotiLogManager::getSingleton().getLog(soundLog)->logMessage("Melody::playSound: " + QString::number( processed ));
-			//
-			// Reset source values, intensity, position, etc
-			//
-			resetSource();
-			//
-			// Fill buffer with new information
-			//
-			refreshBuffer();
-			//
-			// Queue buffer into source
-			//
-			alSourceQueueBuffers( _uiSource, size, _buffer);
-			error = alGetError();
-			if( error != AL_NO_ERROR )
-			{
-				qDebug() << "[Melody::playSound] ERROR while queueing buffers " << error ;
-				return false;
-			}
-			//[
-			// PLAY
-			//
-			_lastNotePlay = 0;
-			_lastNoteStopped = -1;
-			_isStopped = false;
-			alSourcePlay( _uiSource );
-			error = alGetError();
-			if( error != AL_NO_ERROR )
-			{
-				qDebug() << "Melody::playSound: ERROR start playing " << error;
-				return false;
-			}
+			csWarning() << "[Melody::playSound] No sound source to play melody" << _index;
+			_lastError = CS_AL_ERROR;
+			return false;
+		}
+		//
+		// Reset source values, intensity, position, etc
+		//
+		resetSource();
+		//
+		// Queue buffer into source
+		//
+		alSourceQueueBuffers( _uiSource, count, _buffer.constData() + fromNote );
+		error = alGetError();
+		if( error != AL_NO_ERROR )
+		{
+			csDebug() << "[Melody::playSound] ERROR while queueing buffers " << error ;
+			return false;
+		}
+		if( offset > 0 )
+		{
+			alSourcei( _uiSource, AL_SAMPLE_OFFSET, (ALint)offset );
+		}
+		//
+		// Frames of the queue, to find the position without asking the buffers
+		//
+		_queueOffsets.resize( count + 1 );
+		for( int i = 0; i <= count; i++ )
+		{
+			_queueOffsets[i] = _bufferOffsets[fromNote + i] - _bufferOffsets[fromNote];
+		}
+		//[
+		// PLAY
+		//
+		_lastNotePlay = 0;
+		_lastNoteStopped = -1;
+		_playedSamples = _bufferOffsets[fromNote];
+		_isStopped = false;
+		alSourcePlay( _uiSource );
+		error = alGetError();
+		if( error != AL_NO_ERROR )
+		{
+			csDebug() << "Melody::playSound: ERROR start playing " << error;
+			return false;
+		}
 
+		if( starting )
+		{
 			emit melodyPlaying(_index);
-			emit notePlaying(_index, 0);
+		}
+		emit notePlaying(_index, fromNote);
 
-			_lastError = CS_NO_ERROR;
-			return true;
+		_lastError = CS_NO_ERROR;
+		return true;
+	}
+
+/*!
+	Removes from the source the buffers queued. The source must be stopped.
+*/
+	void Melody::unqueueNotes()
+	{
+		int count = _rangeTo - _firstNote;
+		if( _uiSource == 0 || count <= 0 )
+		{
+			return;
 		}
+		QVector<ALuint> buffers( count );
+		alSourceUnqueueBuffers( _uiSource, count, buffers.data() );
 	}
 
 /*!
@@ -203,17 +366,23 @@ namespace CnotiAudio
 		if( !isStopped() || !_isStopped )
 		{
 			//
-			// STOP
+			// STOP (the source can be already stolen by other sound)
 			//
-			alSourceStop( _uiSource );
+			{
+				VoiceManager::SourceGuard guard( SoundManager::instance()->getVoiceManager(), _uiSource, _parent );
+				if( guard.source() )
+				{
+					alSourceStop( guard.source() );
+				}
+			}
 			//
 			// update();
 			//
-			for( int i = _lastNoteStopped+1; i <= _lastNotePlay; i++ )
+			for( int i = _lastNoteStopped+1; i <= _lastNotePlay && _firstNote + i < _rangeTo; i++ )
 			{
-				emit noteStopped( _index, i );
+				emit noteStopped( _index, _firstNote + i );
 			}
-			int error = alGetError();
+			int error = _uiSource ? alGetError() : AL_NO_ERROR;
 			if( error == AL_NO_ERROR )
 			{
 				_isStopped = true;
@@ -222,17 +391,23 @@ namespace CnotiAudio
 				//
 				// Remove from source, buffer not played
 				//
-				alSourceUnqueueBuffers( _uiSource, _noteList.size(), _buffer);
-				resetSource();
+				{
+					VoiceManager::SourceGuard guard( SoundManager::instance()->getVoiceManager(), _uiSource, _parent );
+					if( guard.source() )
+					{
+						unqueueNotes();
+						resetSource();
+					}
+				}
 
 				emit melodyStopped(_index);
-				qDebug() << "[Melody::stopSound]"<< " melodyStopped( " << _index << " )";
+				csDebug() << "[Melody::stopSound]"<< " melodyStopped( " << _index << " )";
 				_lastError = CS_NO_ERROR;
 				return true;
 			}
 			else
 			{
-				qDebug() << "[Melody::stopSound]"<< " ERROR stop playing " << error;
+				csDebug() << "[Melody::stopSound]"<< " ERROR stop playing " << error;
 				return true;
 			}
 		}
@@ -249,11 +424,10 @@ namespace CnotiAudio
 	void Melody::clear()
 	{
 		_lastError			= CS_NO_ERROR;
-		_lastPosition		= 0;
-		_totalDuration		= 0;
 		for(int i=0; i<_noteList.size(); i++)
 			delete( _noteList[i]);
 		_noteList.clear();
+		invalidateRender();
 	}
 
 /*!
@@ -275,6 +449,10 @@ namespace CnotiAudio
 */
 	bool Melody::isPlaying()
 	{
+		if( _uiSource == 0 )
+		{
+			return false;
+		}
 		ALenum state;
 		alGetSourcei( _uiSource, AL_SOURCE_STATE, &state );
 		return state == AL_PLAYING;
@@ -297,6 +475,10 @@ namespace CnotiAudio
 */
 	bool Melody::isPaused()
 	{
+		if( _uiSource == 0 )
+		{
+			return false;
+		}
 		ALenum state;
 		alGetSourcei( _uiSource, AL_SOURCE_STATE, &state );
 		return state == AL_PAUSED;
@@ -321,14 +503,7 @@ namespace CnotiAudio
 		//
 		Note *note = new Note(duration, height, octave);
 		_noteList << note;
-		//
-		// update the total duration of sound
-		//
-//		if( _lastPosition <= note->getTimeToStop() )
-//		{
-//			_lastPosition = note->getTimeToStop();
-//			_totalDuration = int( ( ( float(_lastPosition) / float(_unitTime) ) * 60000.0 ) / float(_tempo) );
-//		}
+		invalidateRender(_noteList.size() - 1);
 		_lastError = CS_NO_ERROR;
 		return true;
 	}
@@ -362,15 +537,7 @@ namespace CnotiAudio
 //		}
 //		_noteList.insert(it, note);
 		_noteList.append(note);
-
-		//
-		// update the total duration of sound
-		//
-//		if(_lastPosition <= note->getTimeToStop())
-//		{
-//			_lastPosition = note->getTimeToStop();
-//			_totalDuration = int( ( ( float(_lastPosition) / float(_unitTime) ) *60000.0 ) / float(_tempo) );
-//		}
+		invalidateRender(_noteList.size() - 1);
 
 		_lastError = CS_NO_ERROR;
 		return true;
@@ -495,21 +662,7 @@ namespace CnotiAudio
 			//
 			delete(_noteList[size-1]);
 			_noteList.removeLast();
-			//
-			// Updates the position where the melody ends
-			//
-			_lastPosition = 0;
-//			for(int i=0; i<_noteList.size(); i++)
-//			{
-//				if(_lastPosition<_noteList[i]->getTimeToStop())
-//				{
-//					_lastPosition = _noteList[i]->getTimeToStop();
-//				}
-//			}
-			//
-			// Updates the melody total duration
-			//
-			_totalDuration = int( ( ( float(_lastPosition) / float(_unitTime) ) * 60000.0 ) / float(_tempo) );
+			invalidateRender(_noteList.size());
 			return true;
 		}
 		else
@@ -551,11 +704,7 @@ NOT IMPLEMENTED
 		//
 		while(!_noteList.empty())
 			_noteList.erase(_noteList.begin());
-		//
-		// Reste info
-		//
-		_lastPosition = 0;
-		_totalDuration = 0;
+		invalidateRender();
 
 		_lastError = CS_NO_ERROR;
 		return true;
@@ -587,7 +736,7 @@ NOT IMPLEMENTED
 		//
 		for( int i=0; i < noteListSize; i++ )
 		{
-			if( !(_noteList[i] == secondNoteList[i]) )
+			if( *_noteList[i] != *secondNoteList[i] )
 			{
 				return -1;
 			}
@@ -596,6 +745,24 @@ NOT IMPLEMENTED
 		return noteListSize;
 	}
 
+/*!
+	Compares this melody with the \a second melody, allowing differences.
+
+	The \a mode is a combination of EnumSimilarityMode, and \a weights give the costs of the
+	different notes. Returns the distance, the score and the alignment of the notes.
+
+	\sa MelodySimilarity
+*/
+	SimilarityResult Melody::similarity(Melody *second, int mode, const SimilarityWeights& weights)
+	{
+		if( second == NULL )
+		{
+			return SimilarityResult();
+		}
+		MelodySimilarity similarity( mode, weights );
+		return similarity.compare( MelodySimilarity::notes( _noteList ), MelodySimilarity::notes( second->getNotes() ) );
+	}
+
 /*!
 	Gets melody height.
 
@@ -618,6 +785,10 @@ NOT IMPLEMENTED
 */
 	bool Melody::setInstrument(EnumInstrument instrument)
 	{
+		if( instrument != _instrument )
+		{
+			invalidateRender();
+		}
 		_instrument = instrument;
 		_lastError = CS_NO_ERROR;
 		return true;
@@ -630,6 +801,10 @@ NOT IMPLEMENTED
 */
 	bool Melody::setTempo(TempoType tempo)
 	{
+		if( tempo != _tempo )
+		{
+			invalidateRender();
+		}
 		_tempo = tempo;
 		_lastError = CS_NO_ERROR;
 		return true;
@@ -722,6 +897,7 @@ NOT IMPLEMENTED
 */
 	int Melody::getTotalDuration()
 	{
+		updateTimeline();
 		return _totalDuration;
 	}
 
@@ -734,6 +910,7 @@ NOT IMPLEMENTED
 */
 	int Melody::getLastPosition()
 	{
+		updateTimeline();
 		return _lastPosition;
 	}
 
@@ -809,6 +986,14 @@ NOT IMPLEMENTED
 */
 	bool Melody::update()
 	{
+		//
+		// The source was stolen to play a sound with higher priority
+		//
+		if( _uiSource == 0 )
+		{
+			stopSound();
+			return true;
+		}
 		int processed;
 		alGetSourcei( _uiSource, AL_BUFFERS_PROCESSED, &processed );
 		//
@@ -828,11 +1013,13 @@ NOT IMPLEMENTED
 			//
 			for( int i = _lastNotePlay; i < processed; i++ )
 			{
+				int note = _firstNote + i;
 				_lastNoteStopped = i;
-				emit noteStopped( _index, i );
-				if( i < _noteList.size() - 1 )
+				_playedSamples = ( note + 1 < _bufferOffsets.size() ) ? _bufferOffsets[note + 1] : _playedSamples;
+				emit noteStopped( _index, note );
+				if( note < _rangeTo - 1 )
 				{
-					emit notePlaying(_index, i+1);
+					emit notePlaying(_index, note + 1);
 				}
 			}
 			_lastNotePlay = processed;
@@ -840,7 +1027,7 @@ NOT IMPLEMENTED
 		//
 		// end of melody
 		//
-		if( processed == _noteList.size() || _noteList.size() == 0 )
+		if( processed >= _rangeTo - _firstNote || _noteList.size() == 0 )
 		{
 			toStop = true;
 			stopSound();
@@ -850,6 +1037,37 @@ NOT IMPLEMENTED
 		return toStop;
 	}
 
+/*!
+	Returns the number of sample frames of the notes already played, the position of the last
+	note event.
+*/
+	qint64 Melody::playedSamples()
+	{
+		return _playedSamples;
+	}
+
+/*!
+	Returns the position of the melody being played, and the note playing.
+
+	Only reads the state of the sound source, the lengths of the notes are kept when the
+	melody starts to play.
+*/
+	PlayPosition Melody::playPosition()
+	{
+		if( _isStopped )
+		{
+			PlayPosition position;
+			position.frames = _bufferOffsets.isEmpty() ? 0 : _bufferOffsets.last();
+			return position;
+		}
+		PlayPosition position = SoundBase::queuePosition( _uiSource, _queueOffsets );
+		position.frame += _bufferOffsets[_firstNote];
+		position.frames = _bufferOffsets.last();
+		position.note = ( position.note < 0 ) ? -1 : _firstNote + position.note;
+		position.melody = _index;
+		return position;
+	}
+
 /*!
 	Changes the intensity of the melody to \a intensity.
 */
@@ -897,56 +1115,287 @@ NOT IMPLEMENTED
 		return _uiSource;
 	}
 
+/*!
+	Stops using the sound source  uiSource, stolen by the voice manager from another thread.
+
+	Returns false if the melody wasn't using \a uiSource.
+*/
+	bool Melody::sourceStolen( ALuint uiSource )
+	{
+		return uiSource != 0 && _uiSource.testAndSetOrdered( (int)uiSource, 0 );
+	}
+
 /*!
 	Gets the data of the melody.
 
+	The data of the notes is joined in a cache, only the notes changed since the last call
+	are joined again. The samples are shared with the cache, a change of the melody doesn't
+	change the buffers already returned.
+
 	Returns pointer to the melody data buffer.
 */
-	short* Melody::getData()
+	PcmBuffer Melody::getData()
 	{
-		unsigned long _size = getSize();
-		int notesSize = _noteList.size();
-		short* _data = new short[_size];
+		render();
+		return _render;
+	}
 
-		//
-		// Joins the data of all the nnotes into a buffer
-		//
-		unsigned long index = 0;
-		for(int j=0; j<notesSize; j++){
-			QString noteCurrentName = SoundManager::nameNote(_parent->getInstrument(_index), _parent->getTempo(_index),
-				_noteList[j]->getDuration(), _noteList[j]->getOctave(), _noteList[j]->getHeight());
+/*!
+	Gets the size of the melody.
+
+	Returns the melody size.
+*/
+	unsigned long Melody::getSize()
+	{
+		render();
+		return _render.size();
+	}
 
-			unsigned long currentSize = SoundManager::instance()->getSize(noteCurrentName);
+/*!
+	Marks the data of the notes from \a fromNote to the end to be joined again, by the next
+	call to getData() or getSize().
 
-			memcpy( _data+index, SoundManager::instance()->getData(noteCurrentName), currentSize );
+	Called by every change of the notes. When the samples of the SoundManager are loaded or
+	released, fetchRender() joins again the notes from the first one whose sample changed.
+*/
+	void Melody::invalidateRender(int fromNote)
+	{
+		if( _renderDirty < 0 || fromNote < _renderDirty )
+		{
+			_renderDirty = qMax( fromNote, 0 );
+		}
+		if( _timelineDirty < 0 || fromNote < _timelineDirty )
+		{
+			_timelineDirty = qMax( fromNote, 0 );
+		}
+	}
 
-			index += currentSize/2.0;
+/*!
+	Computes again the positions of the notes marked by invalidateRender(), adding the
+	durations of the notes from the last position kept. Updates the last position and the
+	total duration.
+*/
+	void Melody::updateTimeline()
+	{
+		if( _timelineDirty < 0 )
+		{
+			return;
+		}
+		int from = qMin( _timelineDirty, _timeline.size() - 1 );
+		if( from < 0 )
+		{
+			from = 0;
+			_timeline.clear();
+			_timeline.append( 0 );
+		}
+		_timeline.resize( from + 1 );
+		for( int j = from; j < _noteList.size(); j++ )
+		{
+			_timeline.append( _timeline[j] + int( _noteList[j]->getDuration() ) );
 		}
+		_lastPosition = _timeline.last();
+		_totalDuration = ( _tempo > 0 && _unitTime > 0 ) ? int( ( ( float(_lastPosition) / float(_unitTime) ) * 60000.0 ) / float(_tempo) ) : 0;
+		_timelineDirty = -1;
+	}
 
-		return _data;
+/*!
+	Returns the position where the note \a note starts, in the units of the note durations,
+	or -1 if the note doesn't exist.
+*/
+	int Melody::getNotePosition( int note )
+	{
+		updateTimeline();
+		if( note < 0 || note >= _noteList.size() )
+		{
+			return -1;
+		}
+		return _timeline[note];
 	}
 
 /*!
-	Gets the size of the melody.
+	Returns the note playing at the \a position, or the number of notes if the position is
+	after the end of the melody.
+*/
+	int Melody::getNoteAtPosition( int position )
+	{
+		updateTimeline();
+		int note = int( qUpperBound( _timeline.constBegin(), _timeline.constEnd(), position ) - _timeline.constBegin() ) - 1;
+		return qBound( 0, note, _noteList.size() );
+	}
 
-	Returns the melody size.
+/*!
+	Returns the length of a bar, from the compass, in the units of the note durations.
 */
-	unsigned long Melody::getSize()
+	int Melody::getBarLength()
 	{
-		unsigned long _size = 0;
-		int notesSize = _noteList.size();
+		return _nominatorCompass * _unitTime;
+	}
+
+/*!
+	Returns the number of bars of the melody, the last one can be incomplete.
+*/
+	int Melody::getBarCount()
+	{
+		int length = getBarLength();
+		return length > 0 ? ( getLastPosition() + length - 1 ) / length : 0;
+	}
+
+/*!
+	Returns the position where the \a bar starts, counting from 0.
+*/
+	int Melody::getBarPosition( int bar )
+	{
+		return qMax( bar, 0 ) * getBarLength();
+	}
+
+/*!
+	Returns the first sample of the data changed since the last call, or -1 if none.
+
+	Used by Sound to mix again only the changed part of the melodies.
+*/
+	int Melody::takeChangedSample()
+	{
+		render();
+		int changed = _changedSample;
+		_changedSample = -1;
+		return changed;
+	}
+
+/*!
+	Joins again the data of the notes marked by invalidateRender().
+
+	The samples of the notes before are kept, the others are copied from the samples loaded
+	in the SoundManager.
+*/
+	void Melody::render()
+	{
+		if( fetchRender() )
+		{
+			joinRender();
+		}
+	}
+
+/*!
+	Returns a cursor reading the samples of the notes, as joined by getData(), without
+	joining them.
+*/
+	TrackCursor Melody::trackCursor()
+	{
+		return TrackCursor( sampleNames(), _intensity );
+	}
+
+/*!
+	Returns the names of the samples of \a count notes from \a fromNote, or of all the notes
+	after \a fromNote if \a count is -1. A sample used by several notes is repeated.
+*/
+	QStringList Melody::sampleNames( int fromNote, int count )
+	{
+		QStringList notes;
+		int end = ( count < 0 ) ? _noteList.size() : qMin( fromNote + count, _noteList.size() );
+		for( int j = qMax( fromNote, 0 ); j < end; j++ )
+		{
+			notes << SoundManager::nameNote(_parent->getInstrument(_index), _parent->getTempo(_index),
+				_noteList[j]->getDuration(), _noteList[j]->getOctave(), _noteList[j]->getHeight());
+		}
+		return notes;
+	}
+
+/*!
+	Gets from the SoundManager the samples of the notes marked by invalidateRender(), to be
+	joined by joinRender().
+
+	When the samples of the SoundManager changed since the last call, the notes from the first
+	one whose sample was loaded or released after it was fetched are fetched again. The notes
+	whose samples were missing or replaced are not kept, the others are.
+
+	Must be called from the thread of the SoundManager. Returns false if there is nothing to
+	render again.
+*/
+	bool Melody::fetchRender()
+	{
+		SoundManager* soundMgr = SoundManager::instance();
+		int generation = soundMgr->getSamplesGeneration();
+		if( generation != _renderGeneration )
+		{
+			//
+			// Only the notes already fetched, the others are fetched anyway
+			//
+			QStringList fetched = sampleNames( 0, qMax( _renderOffsets.size() - 1, 0 ) );
+			for( int j = 0; j < fetched.size(); j++ )
+			{
+				if( soundMgr->getSampleGeneration( fetched[j] ) - _renderGeneration > 0 )
+				{
+					invalidateRender( j );
+					break;
+				}
+			}
+			_renderGeneration = generation;
+		}
+		if( _renderDirty < 0 )
+		{
+			return _renderFrom >= 0;
+		}
+		int from = qMin( _renderDirty, _renderOffsets.size() - 1 );
+		if( _renderFrom >= 0 )
+		{
+			from = qMin( from, _renderFrom );		// The notes fetched before are not joined yet
+		}
+		if( from < 0 )
+		{
+			from = 0;
+			_renderOffsets.clear();
+			_renderOffsets.append( 0 );
+		}
+		int end = _renderOffsets[from];
+		_renderOffsets.resize( from + 1 );
 		//
-		// Calculates the size of the melody
+		// Gets the samples of the notes, to resize the buffer only once
 		//
-		for(int j=0; j<notesSize; j++)
+		int notesSize = _noteList.size();
+		_renderNotes.clear();
+		_renderNotes.reserve( notesSize - from );
+		for( int j = from; j < notesSize; j++ )
 		{
 			QString noteCurrentName = SoundManager::nameNote(_parent->getInstrument(_index), _parent->getTempo(_index),
 				_noteList[j]->getDuration(), _noteList[j]->getOctave(), _noteList[j]->getHeight());
-			int aux = SoundManager::instance()->getSize(noteCurrentName);
-			_size +=  aux;
+			PcmBuffer data = SoundManager::instance()->getData(noteCurrentName);
+			_renderNotes.append( data );
+			end += data.samples();
+			_renderOffsets.append( end );
 		}
+		_renderFrom = from;
+		_renderDirty = -1;
+		return true;
+	}
+
+/*!
+	Joins into the buffer the samples got by fetchRender().
 
-		return _size;
+	Only uses the data of this melody, the melodies of a sound can be joined at the same time
+	in different threads.
+*/
+	void Melody::joinRender()
+	{
+		if( _renderFrom < 0 )
+		{
+			return;
+		}
+		int from = _renderFrom;
+		int start = _renderOffsets[from];
+		_render.resize( _renderOffsets.last() );
+		short* render = _render.data();
+		for( int j = 0; j < _renderNotes.size(); j++ )
+		{
+			int offset = _renderOffsets[from + j];
+			int samples = _renderOffsets[from + j + 1] - offset;
+			if( samples > 0 )
+			{
+				memcpy( render + offset, _renderNotes[j].constData(), samples * sizeof(short) );
+			}
+		}
+		_renderNotes.clear();
+		_renderFrom = -1;
+		_changedSample = ( _changedSample < 0 ) ? start : qMin( _changedSample, start );
 	}
 
 /*!
@@ -978,10 +1427,12 @@ NOT IMPLEMENTED
 		//
 		// Fills the buffer with the data of the notes in the melody
 		//
+		_buffer.resize( size );
 		for(int i=0; i<size; i++){
 			_buffer[i] = _parent->getBufferFromNote(_noteList[i]->getDuration(),
 				_noteList[i]->getHeight(), _noteList[i]->getOctave(), _instrument);
 		}
+		_bufferOffsets = SoundBase::bufferOffsets( _buffer.constData(), size );
 	}
 
 /*!
@@ -11,8 +11,12 @@
 #define _CNOTIMELODY_H
 
 #include <QObject>
+#include <QVector>
+#include <QAtomicInt>
 //#include <vector>
 #include "CnotiAudio.h"
+#include "MelodySimilarity.h"
+#include "PcmBuffer.h"
 #include "soundmanager_global.h"
 #ifdef _WIN32
 // OpenAL Framework
@@ -37,6 +41,10 @@ namespace CnotiAudio
 		~Melody();
 
 		bool playSound(ALuint source, bool loop = false, bool blockSignal = false );
+		bool playFrom(ALuint source, int note, bool loop = false, bool blockSignal = false );
+		bool playRange(ALuint source, int from, int to = -1, bool loop = false, bool blockSignal = false );
+		bool replay(ALuint source, bool blockSignal = false );
+		bool seek(qint64 frame);
 		bool pauseSound();
 		bool stopSound();
 
@@ -51,6 +59,7 @@ namespace CnotiAudio
 		bool deleteAllNote();
 
 		int compareMelody(Melody *second);
+		SimilarityResult similarity(Melody *second, int mode = SIMILARITY_EXACT, const SimilarityWeights& weights = SimilarityWeights());
 
 		NoteType getHeight();
 
@@ -60,6 +69,8 @@ namespace CnotiAudio
 		bool isPaused();
 
 		bool update();
+		qint64 playedSamples();
+		PlayPosition playPosition();
 
 		bool setInstrument(EnumInstrument instrument);
 		bool setTempo(TempoType tempo);
@@ -75,6 +86,11 @@ namespace CnotiAudio
 		QList<Note*> getNotes();
 		int getTotalDuration();
 		int getLastPosition();
+		int getNotePosition(int note);
+		int getNoteAtPosition(int position);
+		int getBarLength();
+		int getBarCount();
+		int getBarPosition(int bar);
 		int getUnitTime();
 		NoteType getHeightFirstNote();
 		Note* getFirstNote();
@@ -85,9 +101,16 @@ namespace CnotiAudio
 		void setSourcePosition(float x, float y, float z);
 		void setSource( ALuint uiSource );
 		ALuint getSource();
+		bool sourceStolen( ALuint uiSource );
 
-		short* getData();
+		PcmBuffer getData();
 		unsigned long getSize();
+		void invalidateRender(int fromNote = 0);
+		int takeChangedSample();
+		bool fetchRender();
+		TrackCursor trackCursor();
+		QStringList sampleNames(int fromNote = 0, int count = -1);
+		void joinRender();
 
 		void setGraphicBreakLines( QList<int> list );
 		QList<int> getGraphicBreakLines();
@@ -124,19 +147,43 @@ namespace CnotiAudio
 		int					_unitTime;
 
 		Sound*              _parent;
-		ALuint				_buffer[100];
-		ALuint				_uiSource;
+		QVector<ALuint>		_buffer;			// Buffer of each note
+		QVector<qint64>		_bufferOffsets;		// First sample frame of each buffer, and the end of the last
+		QVector<qint64>		_queueOffsets;		// The same, for the buffers queued, from the first queued
+		QVector<int>		_timeline;			// Position of each note, and the end of the last
+		int					_timelineDirty;		// First note to compute again the position, -1 if none
+		int					_firstNote;			// First note queued
+		int					_rangeFrom;			// First note of the range played
+		int					_rangeTo;			// Note after the range played
+		qint64				_rangeOffset;		// Sample frames of the first note not played
+		QAtomicInt			_uiSource;			// Cleared by the voice manager when stolen
 		ALfloat				_sourcePos[3];
 
 		int					_lastNotePlay;
 		int					_lastNoteStopped;
 		bool				_isStopped;
+		qint64				_playedSamples;		// Sample frames of the notes already played
 
 		QList<int> _graphicsBreakLineList;
 
+		//
+		// Render cache, the samples of the notes joined
+		//
+		PcmBuffer			_render;
+		QVector<int>		_renderOffsets;		// First sample of each note, and the end of the last
+		int					_renderDirty;		// First note to render again, -1 if none
+		QVector<PcmBuffer>	_renderNotes;		// Samples of the notes fetched, to be joined
+		int					_renderFrom;		// First note fetched, -1 if none
+		int					_renderGeneration;	// SoundManager::getSamplesGeneration() of the notes fetched
+		int					_changedSample;		// First sample changed since takeChangedSample(), -1 if none
+
 	protected:	// Functions
 		void resetSource();
 		void refreshBuffer();
+		void render();
+		void updateTimeline();
+		bool queueNotes(int fromNote, qint64 offset, bool starting);
+		void unqueueNotes();
 		bool addMultipleNote(int position, DurationType duration, NoteType height, int octave, int intensity);
 
 	private:
@@ -0,0 +1,452 @@
+/**
+	\file MelodySimilarity.cpp
+*/
+#include "MelodySimilarity.h"
+#include "note.h"
+// Std
+#include <algorithm>
+#include <climits>
+#include <cstring>
+
+namespace CnotiAudio
+{
+	//
+	// Fields of the symbols: height (bits 24 to 31), octave (bits 16 to 23) and duration (bits 0 to 15)
+	//
+	static const quint32 heightRest = 12;		// The note is a pause
+	static const quint32 heightNone = 13;		// There is no note before to get the interval
+
+	static inline quint32 symbol( quint32 height, int octave, int duration )
+	{
+		return ( height << 24 ) | ( (quint32)( ( octave + 128 ) & 0xFF ) << 16 ) | ( (quint32)duration & 0xFFFF );
+	}
+
+	static int gcd( int a, int b )
+	{
+		while( b != 0 )
+		{
+			int t = a % b;
+			a = b;
+			b = t;
+		}
+		return a;
+	}
+
+/*!
+	Creates a similarity for the \a mode, a combination of EnumSimilarityMode, with the costs given by \a weights.
+*/
+	MelodySimilarity::MelodySimilarity( int mode, const SimilarityWeights& weights ) :
+		_mode( mode ),
+		_weights( weights )
+	{
+	}
+
+/*!
+	Compares the melodies \a first and \a second.
+
+	Returns the weighted distance, the score and, if \a alignment is true, the alignment of the notes.
+*/
+	SimilarityResult MelodySimilarity::compare( const QVector<ScoreNote>& first, const QVector<ScoreNote>& second,
+												bool alignment ) const
+	{
+		QVector<quint32> a = symbols( first );
+		QVector<quint32> b = symbols( second );
+		SimilarityResult result;
+		result.distance = weighted( a, b, alignment ? &result.alignment : 0 );
+		result.score = score( result.distance, a.size(), b.size() );
+		return result;
+	}
+
+/*!
+	Returns the weighted distance between the melodies \a first and \a second.
+*/
+	int MelodySimilarity::distance( const QVector<ScoreNote>& first, const QVector<ScoreNote>& second ) const
+	{
+		return weighted( symbols( first ), symbols( second ), 0 );
+	}
+
+/*!
+	Compares \a input with every melody of \a references, and returns the \a maxResults closest,
+	with their index in \a references and their score, the closest first.
+
+	The unit edit distance gives a lower bound of the weighted distance, so the references that
+	can't be closer than the ones already found are skipped without computing it.
+*/
+	QList< QPair<int, float> > MelodySimilarity::rank( const QVector<ScoreNote>& input,
+													   const QList< QVector<ScoreNote> >& references, int maxResults ) const
+	{
+		QList< QPair<int, float> > result;
+		if( maxResults <= 0 )
+		{
+			return result;
+		}
+		int minWeight = qMin( qMin( _weights.height, _weights.octave ), qMin( _weights.duration, _weights.gap ) );
+		QVector<quint32> a = symbols( input );
+		//
+		// Closest references, ordered by distance
+		//
+		QList< QPair<int, int> > best;
+		for( int i = 0; i < references.size(); i++ )
+		{
+			QVector<quint32> b = symbols( references[i] );
+			if( best.size() == maxResults && minWeight > 0 &&
+				unitDistance( a, b ) * minWeight >= best.last().first )
+			{
+				continue;
+			}
+			int d = weighted( a, b, 0 );
+			if( best.size() == maxResults )
+			{
+				if( d >= best.last().first )
+				{
+					continue;
+				}
+				best.removeLast();
+			}
+			QList< QPair<int, int> >::iterator it = std::upper_bound( best.begin(), best.end(), qMakePair( d, i ) );
+			best.insert( it, qMakePair( d, i ) );
+		}
+		for( int i = 0; i < best.size(); i++ )
+		{
+			result.append( qMakePair( best[i].second, score( best[i].first, a.size(), symbols( references[best[i].second] ).size() ) ) );
+		}
+		return result;
+	}
+
+/*!
+	Returns the mode of the similarity, a combination of EnumSimilarityMode.
+*/
+	int MelodySimilarity::mode() const
+	{
+		return _mode;
+	}
+
+/*!
+	Returns the costs of the edits.
+*/
+	SimilarityWeights MelodySimilarity::weights() const
+	{
+		return _weights;
+	}
+
+/*!
+	Returns the notes of \a list, to be compared.
+*/
+	QVector<ScoreNote> MelodySimilarity::notes( const QList<Note*>& list )
+	{
+		QVector<ScoreNote> result;
+		result.reserve( list.size() );
+		for( int i = 0; i < list.size(); i++ )
+		{
+			result.append( ScoreNote( list[i]->getDuration(), list[i]->getHeight(), list[i]->getOctave() ) );
+		}
+		return result;
+	}
+
+//
+// Private
+//
+
+/*!
+	Returns the symbols of \a notes, for the mode of the similarity.
+*/
+	QVector<quint32> MelodySimilarity::symbols( const QVector<ScoreNote>& notes ) const
+	{
+		QVector<quint32> result( notes.size() );
+		int divisor = 1;
+		if( _mode & SIMILARITY_TEMPO )
+		{
+			divisor = 0;
+			for( int i = 0; i < notes.size(); i++ )
+			{
+				divisor = gcd( notes[i].duration, divisor );
+			}
+			divisor = qMax( divisor, 1 );
+		}
+		int lastPitch = -1;
+		for( int i = 0; i < notes.size(); i++ )
+		{
+			const ScoreNote& note = notes[i];
+			int duration = note.duration / divisor;
+			if( note.height == PAUSE )
+			{
+				result[i] = symbol( heightRest, 0, duration );
+			}
+			else if( !( _mode & SIMILARITY_TRANSPOSITION ) )
+			{
+				result[i] = symbol( note.height, note.octave, duration );
+			}
+			else
+			{
+				//
+				// Interval from the last note, split in height and octave
+				//
+				int pitch = note.height + note.octave * CS_NUMBERNOTE;
+				if( lastPitch < 0 )
+				{
+					result[i] = symbol( heightNone, 0, duration );
+				}
+				else
+				{
+					int interval = pitch - lastPitch;
+					int height = ( ( interval % CS_NUMBERNOTE ) + CS_NUMBERNOTE ) % CS_NUMBERNOTE;
+					result[i] = symbol( height, ( interval - height ) / CS_NUMBERNOTE, duration );
+				}
+				lastPitch = pitch;
+			}
+		}
+		return result;
+	}
+
+/*!
+	Returns the cost of replacing the symbol \a a by \a b.
+*/
+	int MelodySimilarity::cost( quint32 a, quint32 b ) const
+	{
+		if( a == b )
+		{
+			return 0;
+		}
+		int result = 0;
+		if( ( a >> 24 ) != ( b >> 24 ) )
+		{
+			result += _weights.height;
+		}
+		else if( ( ( a >> 16 ) & 0xFF ) != ( ( b >> 16 ) & 0xFF ) )
+		{
+			result += _weights.octave;
+		}
+		if( ( a & 0xFFFF ) != ( b & 0xFFFF ) )
+		{
+			result += _weights.duration;
+		}
+		return result;
+	}
+
+/*!
+	Returns the weighted distance between \a a and \a b, and its \a alignment if not null.
+
+	The band is doubled until the distance found is lower than the cost of any alignment that
+	leaves it, so the distance is always the exact one.
+*/
+	int MelodySimilarity::weighted( const QVector<quint32>& a, const QVector<quint32>& b,
+									QVector< QPair<int, int> >* alignment ) const
+	{
+		int difference = qAbs( a.size() - b.size() );
+		int longest = qMax( a.size(), b.size() );
+		int band = qMin( qMax( difference, 8 ), longest );
+		forever
+		{
+			int result = banded( a, b, band, alignment );
+			if( band >= longest || _weights.gap <= 0 || result <= _weights.gap * ( 2 * band + 2 - difference ) )
+			{
+				return result;
+			}
+			band = qMin( band * 2, longest );
+		}
+	}
+
+/*!
+	Returns the weighted distance between \a a and \a b of the alignments that are at most \a band
+	notes away from the diagonal, and the \a alignment if not null.
+*/
+	int MelodySimilarity::banded( const QVector<quint32>& a, const QVector<quint32>& b, int band,
+								  QVector< QPair<int, int> >* alignment ) const
+	{
+		const int n = a.size();
+		const int m = b.size();
+		const int width = 2 * band + 1;
+		const int infinity = INT_MAX / 2;
+		//
+		// Row i keeps the columns from i - band to i + band
+		//
+		QVector<int> matrix( ( n + 1 ) * width, infinity );
+		#define CELL( i, j ) matrix[ ( i ) * width + ( j ) - ( i ) + band ]
+
+		for( int i = 0; i <= n; i++ )
+		{
+			int from = qMax( 0, i - band );
+			int to = qMin( m, i + band );
+			for( int j = from; j <= to; j++ )
+			{
+				int value;
+				if( i == 0 )
+				{
+					value = j * _weights.gap;
+				}
+				else if( j == 0 )
+				{
+					value = i * _weights.gap;
+				}
+				else
+				{
+					value = CELL( i - 1, j - 1 ) + cost( a[i - 1], b[j - 1] );
+					if( j - ( i - 1 ) <= band )
+					{
+						value = qMin( value, CELL( i - 1, j ) + _weights.gap );
+					}
+					if( j - 1 >= i - band )
+					{
+						value = qMin( value, CELL( i, j - 1 ) + _weights.gap );
+					}
+				}
+				CELL( i, j ) = value;
+			}
+		}
+		int result = CELL( n, m );
+
+		if( alignment != 0 )
+		{
+			//
+			// Traces back the path from the end
+			//
+			alignment->clear();
+			int i = n;
+			int j = m;
+			while( i > 0 || j > 0 )
+			{
+				int value = CELL( i, j );
+				if( i > 0 && j > 0 && CELL( i - 1, j - 1 ) + cost( a[i - 1], b[j - 1] ) == value )
+				{
+					alignment->append( qMakePair( --i, --j ) );
+				}
+				else if( i > 0 && j - ( i - 1 ) <= band && CELL( i - 1, j ) + _weights.gap == value )
+				{
+					alignment->append( qMakePair( --i, -1 ) );
+				}
+				else
+				{
+					alignment->append( qMakePair( -1, --j ) );
+				}
+			}
+			std::reverse( alignment->begin(), alignment->end() );
+		}
+		#undef CELL
+		return result;
+	}
+
+/*!
+	Returns the score of the \a distance between melodies with \a sizeFirst and \a sizeSecond notes.
+	The highest distance is to delete all the notes of the first and insert all of the second.
+*/
+	float MelodySimilarity::score( int distance, int sizeFirst, int sizeSecond ) const
+	{
+		int highest = _weights.gap * ( sizeFirst + sizeSecond );
+		if( highest <= 0 )
+		{
+			return distance == 0 ? 1.0f : 0.0f;
+		}
+		return qBound( 0.0f, 1.0f - (float)distance / highest, 1.0f );
+	}
+
+/*!
+	Returns the unit edit distance between \a a and \a b.
+*/
+	int MelodySimilarity::unitDistance( const QVector<quint32>& a, const QVector<quint32>& b )
+	{
+		if( a.size() <= 64 )
+		{
+			return myers( a, b );
+		}
+		if( b.size() <= 64 )
+		{
+			return myers( b, a );
+		}
+		//
+		// Too long for the bit-parallel algorithm, 2 rows of the matrix
+		//
+		QVector<int> previous( b.size() + 1 );
+		QVector<int> current( b.size() + 1 );
+		for( int j = 0; j <= b.size(); j++ )
+		{
+			previous[j] = j;
+		}
+		for( int i = 1; i <= a.size(); i++ )
+		{
+			current[0] = i;
+			for( int j = 1; j <= b.size(); j++ )
+			{
+				current[j] = qMin( previous[j - 1] + ( a[i - 1] != b[j - 1] ? 1 : 0 ),
+								   qMin( previous[j], current[j - 1] ) + 1 );
+			}
+			qSwap( previous, current );
+		}
+		return previous[b.size()];
+	}
+
+/*!
+	Returns the unit edit distance between \a pattern, with up to 64 symbols, and \a text,
+	with the bit-parallel algorithm of Myers: each column of the matrix is kept in the bits
+	of the vertical differences.
+*/
+	int MelodySimilarity::myers( const QVector<quint32>& pattern, const QVector<quint32>& text )
+	{
+		const int m = pattern.size();
+		if( m == 0 )
+		{
+			return text.size();
+		}
+		//
+		// Bits of the positions of each symbol in the pattern, in a small open addressing table
+		//
+		const int slots = 128;
+		quint32 keys[slots];
+		quint64 masks[slots];
+		bool used[slots];
+		memset( used, 0, sizeof( used ) );
+		for( int i = 0; i < m; i++ )
+		{
+			int slot = ( pattern[i] * 2654435761u ) >> 25;
+			while( used[slot] && keys[slot] != pattern[i] )
+			{
+				slot = ( slot + 1 ) & ( slots - 1 );
+			}
+			if( !used[slot] )
+			{
+				used[slot] = true;
+				keys[slot] = pattern[i];
+				masks[slot] = 0;
+			}
+			masks[slot] |= Q_UINT64_C(1) << i;
+		}
+
+		const quint64 last = Q_UINT64_C(1) << ( m - 1 );
+		quint64 pv = ~Q_UINT64_C(0);
+		quint64 mv = 0;
+		int distance = m;
+		for( int j = 0; j < text.size(); j++ )
+		{
+			quint64 eq = 0;
+			int slot = ( text[j] * 2654435761u ) >> 25;
+			while( used[slot] )
+			{
+				if( keys[slot] == text[j] )
+				{
+					eq = masks[slot];
+					break;
+				}
+				slot = ( slot + 1 ) & ( slots - 1 );
+			}
+			quint64 xv = eq | mv;
+			quint64 xh = ( ( ( eq & pv ) + pv ) ^ pv ) | eq;
+			quint64 ph = mv | ~( xh | pv );
+			quint64 mh = pv & xh;
+			if( ph & last )
+			{
+				distance++;
+			}
+			else if( mh & last )
+			{
+				distance--;
+			}
+			//
+			// The first row grows by one in each column
+			//
+			ph = ( ph << 1 ) | 1;
+			mh <<= 1;
+			pv = mh | ~( xv | ph );
+			mv = ph & xv;
+		}
+		return distance;
+	}
+}
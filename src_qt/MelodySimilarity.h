@@ -0,0 +1,98 @@
+/*!
+ \class CnotiAudio::MelodySimilarity
+ \brief The MelodySimilarity class measures how close two melodies are, with a weighted edit distance.
+
+ Each note is turned into a symbol with its height, octave and duration. Substituting a note
+ costs the sum of the weights of the parts that differ, a wrong height already including
+ the octave, and inserting or deleting a note costs the gap weight.
+
+ The modes can be combined:
+
+ \list
+ \o SIMILARITY_TRANSPOSITION compares the intervals between the notes instead of the
+	heights, so a melody played in another key is equal.
+ \o SIMILARITY_TEMPO divides the durations of each melody by their greatest common divisor,
+	so a melody with all the durations doubled is equal.
+ \endlist
+
+ The weighted distance is computed by a banded dynamic programming, the band is doubled
+ until no better alignment can be outside of it, and the alignment is traced back. The
+ unit edit distance, used by rank() to skip the melodies that can't be close enough, is
+ computed with the bit-parallel algorithm of Myers when the melody has up to 64 notes.
+
+ \version 2.2
+ \date 19-10-2026
+ \file MelodySimilarity.h
+*/
+#if !defined(_MELODYSIMILARITY_H)
+#define _MELODYSIMILARITY_H
+
+#include <QList>
+#include <QVector>
+#include <QPair>
+
+#include "Score.h"
+#include "soundmanager_global.h"
+
+namespace CnotiAudio
+{
+	class Note;
+
+	enum EnumSimilarityMode{
+		SIMILARITY_EXACT = 0,				// Heights and durations as they are
+		SIMILARITY_TRANSPOSITION = 0x1,		// Intervals instead of heights
+		SIMILARITY_TEMPO = 0x2				// Durations relative to the melody
+	};
+
+	struct SimilarityWeights
+	{
+		int height;		// Different height
+		int octave;		// Same height, different octave
+		int duration;	// Different duration
+		int gap;		// Note inserted or deleted
+
+		SimilarityWeights( int h = 2, int o = 1, int d = 1, int g = 2 ) :
+			height(h), octave(o), duration(d), gap(g) {}
+	};
+
+	struct SimilarityResult
+	{
+		int    distance;		// Weighted edit distance
+		float  score;			// 1 when equal, 0 when nothing is alike
+		QVector< QPair<int, int> >  alignment;	// Notes aligned, -1 for a note inserted or deleted
+
+		SimilarityResult() : distance(0), score(1.0f) {}
+	};
+
+	class SOUNDMANAGER_EXPORT MelodySimilarity
+	{
+	public:
+		MelodySimilarity( int mode = SIMILARITY_EXACT, const SimilarityWeights& weights = SimilarityWeights() );
+
+		SimilarityResult compare( const QVector<ScoreNote>& first, const QVector<ScoreNote>& second,
+								  bool alignment = true ) const;
+		int distance( const QVector<ScoreNote>& first, const QVector<ScoreNote>& second ) const;
+		QList< QPair<int, float> > rank( const QVector<ScoreNote>& input, const QList< QVector<ScoreNote> >& references,
+										 int maxResults = 10 ) const;
+
+		int mode() const;
+		SimilarityWeights weights() const;
+
+		static QVector<ScoreNote> notes( const QList<Note*>& list );
+
+	private:
+		QVector<quint32> symbols( const QVector<ScoreNote>& notes ) const;
+		int cost( quint32 a, quint32 b ) const;
+		int weighted( const QVector<quint32>& a, const QVector<quint32>& b, QVector< QPair<int, int> >* alignment ) const;
+		int banded( const QVector<quint32>& a, const QVector<quint32>& b, int band, QVector< QPair<int, int> >* alignment ) const;
+		float score( int distance, int sizeFirst, int sizeSecond ) const;
+
+		static int unitDistance( const QVector<quint32>& a, const QVector<quint32>& b );
+		static int myers( const QVector<quint32>& pattern, const QVector<quint32>& text );
+
+		int                _mode;
+		SimilarityWeights  _weights;
+	};
+}
+
+#endif //_MELODYSIMILARITY_H
@@ -0,0 +1,175 @@
+/**
+	\file MixBus.cpp
+*/
+#include "MixBus.h"
+// Qt
+#include <QThreadPool>
+#include <QtConcurrentMap>
+// Std
+#include <math.h>
+
+namespace CnotiAudio
+{
+	static const qint32 gainOne = 1 << 24;		// Gain 1.0 of the limiter, in integer
+
+	//
+	// Integer hash of the position of a sample, for the dither
+	//
+	static inline quint32 ditherHash( quint32 x )
+	{
+		x ^= x >> 16;
+		x *= 0x7feb352dU;
+		x ^= x >> 15;
+		x *= 0x846ca68bU;
+		x ^= x >> 16;
+		return x;
+	}
+
+	//
+	// Mixes a block of samples into the bus, for QtConcurrent
+	//
+	struct BusMixer
+	{
+		short*                    data;
+		const QVector<MixTrack>*  tracks;
+		int                       size;
+		int                       from;
+		int                       to;
+		qint64                    offset;
+
+		BusMixer( short* d, const QVector<MixTrack>* t, int s, int f, int e, qint64 o ) :
+			data(d), tracks(t), size(s), from(f), to(e), offset(o) {}
+
+		void operator()( const int& block )
+		{
+			MixBus::mixBlock( data + ( block - from ), *tracks, size, block, qMin( block + CS_MIX_BLOCK, to ), offset );
+		}
+	};
+
+/*!
+	Mixes the samples from \a from to \a to of the \a tracks, that have \a size samples, into
+	\a data, that starts at \a from. \a offset is the position of the first sample of the
+	tracks in the sound, for the dither.
+
+	The buffer is split in blocks of CS_MIX_BLOCK samples mixed by the thread pool.
+*/
+	void MixBus::mix( short* data, const QVector<MixTrack>& tracks, int size, int from, int to, qint64 offset )
+	{
+		if( from >= to )
+		{
+			return;
+		}
+		if( to - from <= CS_MIX_BLOCK || QThreadPool::globalInstance()->maxThreadCount() < 2 )
+		{
+			mixBlock( data, tracks, size, from, to, offset );
+			return;
+		}
+		QVector<int> blocks;
+		for( int block = from; block < to; block += CS_MIX_BLOCK )
+		{
+			blocks.append( block );
+		}
+		QtConcurrent::blockingMap( blocks, BusMixer( data, &tracks, size, from, to, offset ) );
+	}
+
+/*!
+	Mixes the samples from \a from to \a to of the \a tracks into \a data, in the calling
+	thread. The arguments are the same as mix().
+
+	The tracks are read reach() samples before \a from and after \a to, for the limiter.
+*/
+	void MixBus::mixBlock( short* data, const QVector<MixTrack>& tracks, int size, int from, int to, qint64 offset )
+	{
+		const int window = CS_LIMITER_LOOKAHEAD;
+		const int reach = window - 1;
+		const int base = from - reach;					// Sample of the track at the start of the bus
+		const int count = ( to - from ) + 2 * reach;
+		//
+		// Adds all the tracks, one pass over each
+		//
+		QVector<float> bus( count, 0.0f );
+		for( int t = 0; t < tracks.size(); t++ )
+		{
+			int lo = qMax( base, 0 );
+			int hi = qMin( qMin( to + reach, size ), tracks[t].size );
+			if( lo >= hi || tracks[t].samples == 0 )
+			{
+				continue;
+			}
+			float gain = tracks[t].intensity / 32768.0f;
+			const short* samples = tracks[t].samples + lo;
+			float* sum = bus.data() + ( lo - base );
+			for( int i = 0; i < hi - lo; i++ )
+			{
+				sum[i] += samples[i] * gain;
+			}
+		}
+		//
+		// Gain needed by each sample, and its minimum over the look-ahead (van Herk - Gil - Werman)
+		//
+		const float ceiling = CS_LIMITER_CEILING / 32768.0f;
+		QVector<qint32> needed( count );
+		for( int i = 0; i < count; i++ )
+		{
+			float peak = fabsf( bus[i] );
+			needed[i] = ( peak > ceiling ) ? (qint32)( ceiling / peak * gainOne ) : gainOne;
+		}
+		QVector<qint32> prefix( count );
+		QVector<qint32> suffix( count );
+		for( int start = 0; start < count; start += window )
+		{
+			int end = qMin( start + window, count );
+			prefix[start] = needed[start];
+			for( int i = start + 1; i < end; i++ )
+			{
+				prefix[i] = qMin( prefix[i - 1], needed[i] );
+			}
+			suffix[end - 1] = needed[end - 1];
+			for( int i = end - 2; i >= start; i-- )
+			{
+				suffix[i] = qMin( suffix[i + 1], needed[i] );
+			}
+		}
+		QVector<qint32> minimum( count - reach );
+		for( int i = 0; i < count - reach; i++ )
+		{
+			minimum[i] = qMin( suffix[i], prefix[i + reach] );
+		}
+		//
+		// Mean of the minimums before each sample, dither and conversion to 16 bits
+		//
+		qint64 total = 0;
+		for( int i = 0; i < window; i++ )
+		{
+			total += minimum[i];
+		}
+		for( int j = 0; j < to - from; j++ )
+		{
+			if( j > 0 )
+			{
+				total += minimum[j + reach] - minimum[j - 1];
+			}
+			float value = bus[j + reach];
+			if( value == 0.0f )
+			{
+				data[j] = 0;		// Digital silence is kept without dither
+				continue;
+			}
+			float gain = (float)( (double)total / ( (double)window * gainOne ) );
+			quint32 position = (quint32)( offset + from + j );
+			float dither = ( ditherHash( 2 * position ) >> 8 ) / 16777216.0f
+				- ( ditherHash( 2 * position + 1 ) >> 8 ) / 16777216.0f;
+			int sample = (int)floorf( value * gain * 32768.0f + dither + 0.5f );
+			data[j] = (short)qBound( -32768, sample, 32767 );
+		}
+	}
+
+/*!
+	Returns the number of samples, before and after, that change a mixed sample. When a part
+	of the tracks changes the mix must be done again from reach() samples before.
+*/
+	int MixBus::reach()
+	{
+		return CS_LIMITER_LOOKAHEAD - 1;
+	}
+}
@@ -0,0 +1,42 @@
+/*!
+ \class CnotiAudio::MixBus
+ \brief The MixBus class mixes the tracks of a sound in a float bus, with a limiter.
+
+ Used when the mix mode is MIX_MODE_BUS. The samples of all the tracks, multiplied by their
+ intensity, are added in one pass into a float buffer. Then a look-ahead limiter keeps the
+ peaks under the ceiling and the result is converted to 16 bits with TPDF dither.
+
+ The gain of the limiter at a sample is the mean, over CS_LIMITER_LOOKAHEAD samples before,
+ of the minimum gain needed in the CS_LIMITER_LOOKAHEAD samples after: it starts to go down
+ before a peak and never lets a sample over the ceiling. The means are computed with integer
+ gains and the dither only depends on the position of the sample, so a sample only depends
+ on the tracks around it: any part of a sound can be mixed again, by any number of threads,
+ with the same result.
+
+ \version 2.2
+ \date 19-10-2026
+ \file MixBus.h
+*/
+#if !defined(_MIXBUS_H)
+#define _MIXBUS_H
+
+#include <QVector>
+
+#include "SoundBase.h"
+#include "soundmanager_global.h"
+
+namespace CnotiAudio
+{
+	#define CS_LIMITER_LOOKAHEAD	(64)		// Samples the limiter looks ahead, and takes to release
+	#define CS_LIMITER_CEILING		(32766)		// Maximum sample after the limiter, leaving room for the dither
+
+	class SOUNDMANAGER_EXPORT MixBus
+	{
+	public:
+		static void mix( short* data, const QVector<MixTrack>& tracks, int size, int from, int to, qint64 offset = 0 );
+		static void mixBlock( short* data, const QVector<MixTrack>& tracks, int size, int from, int to, qint64 offset );
+		static int reach();
+	};
+}
+
+#endif //_MIXBUS_H
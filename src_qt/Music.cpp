@@ -1,20 +1,43 @@
 #include "Music.h"
+#include "SoundLog.h"
 #include "sample.h"
 #include "SoundManager.h"
+#include "VoiceManager.h"
 #include "note.h"
+#include "PerfCounters.h"
+#include "MixBus.h"
+#include "DspGraph.h"
+#include "ScoreXml.h"
+#include "ScoreBinary.h"
+#include "ScoreMidi.h"
 // Qt
 #include <QDebug>
 #include <QFile>
 #include <QFileInfo>
-#include <QXmlInputSource>
-#include <QDomDocument>
-#include <QDomElement>
-#include <QDateTime>
-#include <QTextCodec>
+#include <QElapsedTimer>
+#include <QtAlgorithms>
+#include <QtConcurrentMap>
 
 namespace CnotiAudio
 {
 
+//
+// Fills a rhythm track with its sample, for QtConcurrent
+//
+struct RhythmTiler
+{
+		typedef PcmBuffer result_type;
+
+		int size;
+
+		RhythmTiler(int bytes) : size(bytes) {}
+
+		PcmBuffer operator()(const PcmBuffer& sampleData) const
+		{
+				return Music::tileRhythm(sampleData, size);
+		}
+};
+
 /*!
 
 */
@@ -23,122 +46,136 @@ Music::Music(const QString name) :
 	_instrument(INSTRUMENT_UNKNOWN),
 	_tempo(TEMPO_UNKNOWN),
 	_graphicalRepresentation(-1),
-	_rhythmsOn( true )
+	_rhythmsOn( true ),
+	_lastNotePlay(0),
+	_lastNoteStopped(-1),
+	_playedSamples(0),
+	_firstNote(0),
+	_playFromNote(0)
 {
 
 }
 
 /*!
+	Destroyes the music. Its voices are checked in first, so they can't be stolen while
+	the music is destroyed.
+*/
+Music::~Music()
+{
+		_soundMgr->checkInSources(this);
+}
 
+/*!
+	Loads the music from the XML file \a filename, from the binary file if it has the .csb
+	extension, or from the MIDI file if it has the .mid extension.
 */
 bool Music::load(const QString filename)
 {
-	release();
-	// Open file
-	QFile *file = new QFile(filename);
-	if(file->open(QIODevice::ReadOnly | QIODevice::Text))
-	{
-			QDomDocument doc("");
-			QTextStream stream(file);
-			stream.setCodec(QTextCodec::codecForName("UTF-8"));
-
-			if (!doc.setContent(file))
-			{
-					qWarning() << "[Music::load] Not possible to read XML from file:" << filename;
-					return false;
-			}
-
-			//Get the root element
-			QDomElement root = doc.documentElement();
-			if(root.tagName() != "music")
-			{
-					qWarning() << "[Music::load] Tag music not found:";
-					return false;
-			}
-			_name = root.attribute("name");
-			setTempo(SoundManager::convertStrToTempo(root.attribute("tempo")));
-			if(_tempo == TEMPO_UNKNOWN)
-			{
-					qWarning() << "[Music::load] Unknown tempo";
-					release();
-					return false;
-			}
-			// Update the possible graphical represenation
-			// if not set it return -1
-			_graphicalRepresentation = root.attribute("representation", "-1").toInt();
+		ScoreData data;
+		QString error;
+		bool result;
+		if(ScoreBinary::isBinary(filename))
+		{
+				result = ScoreBinary::read(filename, &data, &error);
+		}
+		else if(ScoreMidi::isMidi(filename))
+		{
+				result = ScoreMidi::read(filename, SCORE_MUSIC, &data, &error);
+		}
+		else
+		{
+				result = ScoreXml::read(filename, SCORE_MUSIC, &data, &error);
+		}
+		if(result && data.kind != SCORE_MUSIC)
+		{
+				error = "The file has a sound, not a music";
+				result = false;
+		}
+		if(!result)
+		{
+				csWarning() << "[Music::load] Not possible to read XML from file:" << filename << error;
+				release();
+				_lastError = QFile::exists(filename) ? CS_PARSER_ERROR : CS_FILE_ERROR;
+				return false;
+		}
+		return setScore(data);
+}
 
-			//
-			// Get music information
-			//
-			QDomNodeList nodeList = root.elementsByTagName("melody");
-			QDomElement melody = nodeList.at(0).toElement();
-			setInstrument(SoundManager::convertStrToInstrument(melody.attribute("instrument")));
-			if(_instrument == INSTRUMENT_UNKNOWN )
-			{
-					qWarning() << "[Music::load] Unknown instrument";
-					release();
-					return false;
-			}
-			//
-			// Get notes
-			//
-			QDomNodeList musicNodeList = melody.elementsByTagName("note");
-			//Check each node one by one.
-			for(int i = 0;i < musicNodeList.count(); i++)
-			{
-					QDomElement el = musicNodeList.at(i).toElement();
-					NoteType height = SoundManager::convertStrToHeight(el.attribute("height"));
-					if(height == UNKNOWN_NOTE)
-					{
-							qWarning() << "[Music::load] Unknown note";
-							release();
-							return false;
-					}
-					DurationType duration = SoundManager::convertStrToDuration(el.attribute("duration"));
-					if(duration == UNKNOWN_DURATION)
-					{
-							qWarning() << "[Music::load] Unknown duration";
-							release();
-							return false;
-					}
-					EnumOctave octave = SoundManager::convertStrToOctave(el.attribute("octave"));
-					if(octave == OCTAVE_UNKNOWN)
-					{
-							qWarning() << "[Music::load] Unknown octave";
-							release();
-							return false;
-					}
-					addNote(duration, height, octave);
-			}
+/*!
+	Replaces the music by the one in \a score.
 
-			QDomNodeList rhythmNodeList = root.elementsByTagName("rhythm");
-			//Check each node one by one.
-			for(int i = 0;i < rhythmNodeList.count(); i++)
-			{
-					QDomElement el = rhythmNodeList.at(i).toElement();
-					EnumRhythmInstrument rhythm = SoundManager::convertStrToRhythmInstrument(el.attribute("instrument"));
-					if(rhythm == RHYTHM_INST_UNKNOWN)
-					{
-							qWarning() << "[Music::load] Unknown rhythm";
-							return false;
-					}
-					EnumRhythmVariation rVariation = SoundManager::convertStrToRhythmVariation(el.attribute("variation"));
-					if(rVariation == RHYTHM_UNKNOWN)
-					{
-							qWarning() << "[Music::load] Unknown rhythm variation";
-							return false;
-					}
-					addRhythm(rhythm, rVariation);
-			}
+	Returns false if the score has no melody, or if its tempo or instrument are unknown.
+*/
+bool Music::setScore(const ScoreData& score)
+{
+		release();
+		_name = score.name;
+		setTempo(score.tempo);
+		if(_tempo == TEMPO_UNKNOWN)
+		{
+				csWarning() << "[Music::setScore] Unknown tempo";
+				release();
+				return false;
+		}
+		// Update the possible graphical represenation
+		// if not set it is -1
+		_graphicalRepresentation = score.representation;
+		//
+		// Music has only one melody
+		//
+		if(score.melodies.isEmpty())
+		{
+				csWarning() << "[Music::setScore] The score has no melody";
+				release();
+				_lastError = CS_PARSER_ERROR;
+				return false;
+		}
+		setInstrument(score.melodies.first().instrument);
+		if(_instrument == INSTRUMENT_UNKNOWN)
+		{
+				csWarning() << "[Music::setScore] Unknown instrument";
+				release();
+				return false;
+		}
+		const QVector<ScoreNote>& notes = score.melodies.first().notes;
+		for(int i = 0; i < notes.size(); i++)
+		{
+				addNote(notes[i].duration, notes[i].height, notes[i].octave);
+		}
+		for(int i = 0; i < score.rhythms.size(); i++)
+		{
+				addRhythm(score.rhythms[i].instrument, score.rhythms[i].variation);
+		}
+		_lastError = CS_NO_ERROR;
+		return true;
+}
 
-			file->close();
-			_lastError = CS_NO_ERROR;
-			return true;
-	}
-	_lastError = CS_FILE_ERROR;
-	return false;
+/*!
+	Returns the notes and rhythms of the music.
+*/
+ScoreData Music::score()
+{
+		ScoreData data(SCORE_MUSIC);
+		data.name = _name;
+		data.tempo = _tempo;
+		data.representation = _graphicalRepresentation;
+
+		ScoreMelody melody(_instrument);
+		melody.notes.reserve(_notes.size());
+		for(int j = 0; j < _notes.size(); j++)
+		{
+				melody.notes.append(ScoreNote(_notes[j]->getDuration(), _notes[j]->getHeight(), _notes[j]->getOctave()));
+		}
+		data.melodies.append(melody);
 
-//	TODO: new way -> http://wiki.forum.nokia.com/index.php/Using_QDomDocument_to_parse_XML
+		Rhythm *r;
+		QListIterator<Rhythm *> it(_rhythms);
+		while(it.hasNext())
+		{
+				r = it.next();
+				data.rhythms.append(ScoreRhythm(r->instrument, r->variation));
+		}
+		return data;
 }
 
 
@@ -153,52 +190,58 @@ void Music::release()
 }
 
 /*!
-
+	Plays the music from the beginning.
 */
 bool Music::playSound(bool loop, bool blockSignal)
 {
-		qDebug() << "[Music::playSound] - Loop:" << loop << "blockSignal" << blockSignal;
+		return playFrom(0, loop, blockSignal);
+}
+
+/*!
+	Plays the music from the note \a note, without playing the notes before. When played
+	in \a loop, it restarts from the same note.
+*/
+bool Music::playFrom(int note, bool loop, bool blockSignal)
+{
+		csDebug() << "[Music::playSound] - Note:" << note << "Loop:" << loop << "blockSignal" << blockSignal;
 		_loop = loop;
 		blockSignals(blockSignal);
 		//
-		// Get sound source
-		//
-		_uiSource = _soundMgr->checkOutSource();
-		int error = alGetError();
-		//
 		// Empty
 		//
 		if(_notes.empty())
 		{
 			_lastError = CS_SOUND_EMPTY;
-			qWarning() << "[Music::playSound] - Music is empty";
+			csWarning() << "[Music::playSound] - Music is empty";
+			return false;
+		}
+		if(note < 0 || note >= _notes.size())
+		{
+			_lastError = CS_NOTE_NOT_EXISTE;
 			return false;
 		}
 		//
-		// Fill buffer with new information
-		//
-		fillBuffer();
-		//
-		// Queue buffer into source
+		// Get sound source, returning the previous one when restarting in loop
 		//
-		alSourceQueueBuffers(_uiSource, _notes.size(), _buffer);
-		error = alGetError();
-		if(error != AL_NO_ERROR)
+		if(_uiSource)
 		{
-		  qWarning() << "[Melody::playSound] ERROR while queueing buffers " << error ;
-		  return false;
+				_soundMgr->checkInSource(_uiSource, this);
+		}
+		_uiSource = _soundMgr->checkOutSource(this);
+		if(_uiSource == 0)
+		{
+			_lastError = CS_AL_ERROR;
+			csWarning() << "[Music::playSound] - No sound source available";
+			return false;
 		}
 		//
-		// PLAY
+		// Fill buffer with new information
 		//
-		_lastNotePlay = 0;
-		_lastNoteStopped = -1;
-		alSourcePlay(_uiSource);
-		error = alGetError();
-		if(error != AL_NO_ERROR)
+		fillBuffer();
+		_playFromNote = note;
+		if(!queueNotes(note, 0))
 		{
-		  qWarning() << "[Music::playSound] ERROR start playing " << error;
-		  return false;
+			return false;
 		}
 
 		if (_rhythmsOn)
@@ -216,7 +259,7 @@ bool Music::playSound(bool loop, bool blockSignal)
 		}
 
 		emit soundPlaying(_name);
-		emit notePlaying(0);
+		noteEvent(note, NOTE_EVENT_PLAYING);
 		_stopped = false;
 
 		// THREAD
@@ -225,6 +268,104 @@ bool Music::playSound(bool loop, bool blockSignal)
 		return true;
 }
 
+/*!
+	Moves the music being played to the sample frame \a frame, counted from the beginning of
+	the music. The notes are queued again from the note at that frame, and the source offset
+	set inside it. The rhythms keep on playing.
+
+	Returns false if the music is stopped.
+*/
+bool Music::seek(qint64 frame)
+{
+		if(_stopped || _uiSource == 0)
+		{
+				_lastError = CS_IS_ALREADY_STOPPED;
+				return false;
+		}
+		int count = _notes.size();
+		if(count == 0 || _bufferOffsets.size() != count + 1)
+		{
+				_lastError = CS_SOUND_EMPTY;
+				return false;
+		}
+		int note = int(qUpperBound(_bufferOffsets.constBegin(), _bufferOffsets.constEnd(), frame) - _bufferOffsets.constBegin()) - 1;
+		note = qBound(0, note, count - 1);
+		qint64 offset = qBound(qint64(0), frame - _bufferOffsets[note], _bufferOffsets[note + 1] - _bufferOffsets[note] - 1);
+		//
+		// Stops the notes queued, without stopping the music
+		//
+		alSourceStop(_uiSource);
+		for(int i = _lastNoteStopped+1; i <= _lastNotePlay && _firstNote + i < count; i++)
+		{
+				noteEvent(_firstNote + i, NOTE_EVENT_STOPPED);
+		}
+		unqueueNotes();
+		if(!queueNotes(note, offset))
+		{
+				return false;
+		}
+		noteEvent(note, NOTE_EVENT_PLAYING);
+		return true;
+}
+
+/*!
+	Queues the notes from \a fromNote to the end, and plays them starting \a offset sample
+	frames inside the first note. The buffers must be already filled.
+*/
+bool Music::queueNotes(int fromNote, qint64 offset)
+{
+		int error = alGetError();
+		int count = _notes.size() - fromNote;
+		_firstNote = fromNote;
+		//
+		// Queue buffer into source
+		//
+		alSourceQueueBuffers(_uiSource, count, _buffer.constData() + fromNote);
+		error = alGetError();
+		if(error != AL_NO_ERROR)
+		{
+		  csWarning() << "[Melody::playSound] ERROR while queueing buffers " << error ;
+		  return false;
+		}
+		if(offset > 0)
+		{
+				alSourcei(_uiSource, AL_SAMPLE_OFFSET, (ALint)offset);
+		}
+		_queueOffsets.resize(count + 1);
+		for(int i = 0; i <= count; i++)
+		{
+				_queueOffsets[i] = _bufferOffsets[fromNote + i] - _bufferOffsets[fromNote];
+		}
+		//
+		// PLAY
+		//
+		_lastNotePlay = 0;
+		_lastNoteStopped = -1;
+		_playedSamples = _bufferOffsets[fromNote];
+		alSourcePlay(_uiSource);
+		error = alGetError();
+		if(error != AL_NO_ERROR)
+		{
+		  csWarning() << "[Music::playSound] ERROR start playing " << error;
+		  return false;
+		}
+		return true;
+}
+
+/*!
+	Removes from the source the buffers queued. The source must be stopped.
+*/
+void Music::unqueueNotes()
+{
+		int count = _notes.size() - _firstNote;
+		if(_uiSource == 0 || count <= 0)
+		{
+				return;
+		}
+		QVector<ALuint> buffers(count);
+		alSourceUnqueueBuffers(_uiSource, count, buffers.data());
+}
+
 /*!
 
 */
@@ -238,27 +379,33 @@ bool Music::pauseSound()
 */
 bool Music::stopSound()
 {
-		qDebug() << "[Music::stopSound]";
+		csDebug() << "[Music::stopSound]";
 		if(isStopped() && _stopped)
 		{
 				_lastError = CS_IS_ALREADY_STOPPED;
 				return false;
 		}
 		//
-		// STOP
+		// STOP (the source can be already stolen by other sound)
 		//
-		alSourceStop(_uiSource);
+		{
+				VoiceManager::SourceGuard guard(_soundMgr->getVoiceManager(), _uiSource, this);
+				if(guard.source())
+				{
+						alSourceStop(guard.source());
+				}
+		}
 		//
 		// update();
 		//
-		for(int i = _lastNoteStopped+1; i <= _lastNotePlay && i < _notes.size(); i++)
+		for(int i = _lastNoteStopped+1; i <= _lastNotePlay && _firstNote + i < _notes.size(); i++)
 		{
-				emit noteStopped(i);
+				noteEvent(_firstNote + i, NOTE_EVENT_STOPPED);
 		}
 		int error = alGetError();
-		if(error != AL_NO_ERROR)
+		if(_uiSource && error != AL_NO_ERROR)
 		{
-				qWarning() << "[Music::stopSound]"<< " ERROR stop playing " << error;
+				csWarning() << "[Music::stopSound]"<< " ERROR stop playing " << error;
 				return false;
 		}
 		// Stop rhythms
@@ -269,16 +416,25 @@ bool Music::stopSound()
 		}
 		_flagThreadSoundStopped = true;
 		_stopped = true;
-		qDebug() << "[Music::stopSound] Emit soundStopped";
+		csDebug() << "[Music::stopSound] Emit soundStopped";
 		emit soundStopped(_name);
 
 		_lastError = CS_NO_ERROR;
 		//
 		// Remove from source, buffer not played
 		//
-		alSourceUnqueueBuffers(_uiSource, _notes.size(), _buffer);
-
-		_soundMgr->checkInSource(_uiSource);
+		if(_uiSource)
+		{
+				{
+						VoiceManager::SourceGuard guard(_soundMgr->getVoiceManager(), _uiSource, this);
+						if(guard.source())
+						{
+								unqueueNotes();
+						}
+				}
+				_soundMgr->checkInSource(_uiSource, this);
+				_uiSource = 0;
+		}
 
 		return true;
 }
@@ -292,10 +448,21 @@ bool Music::isEmpty()
 }
 
 /*!
-
+	Saves the music into a XML file, into a binary file if \a filename has the .csb extension,
+	or into a MIDI file if it has the .mid extension.
 */
 bool Music::save(const QString filename)
 {
+		if(ScoreBinary::isBinary(filename))
+		{
+				_lastError = ScoreBinary::write(filename, score()) ? CS_NO_ERROR : CS_FILE_ERROR;
+				return _lastError == CS_NO_ERROR;
+		}
+		if(ScoreMidi::isMidi(filename))
+		{
+				_lastError = ScoreMidi::write(filename, score()) ? CS_NO_ERROR : CS_FILE_ERROR;
+				return _lastError == CS_NO_ERROR;
+		}
 		QString newSoundName = filename;
 
 		if(!newSoundName.contains(".xml"))
@@ -306,59 +473,8 @@ bool Music::save(const QString filename)
 				newSoundName.append(".xml");
 			}
 		}
-		QDomDocument doc("");
-		QFile file(newSoundName);
-		if(file.open(QIODevice::WriteOnly))
-		{
-				QTextStream stream(&file);
-				stream.setCodec(QTextCodec::codecForName("UTF-8"));
-				stream << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>" << "\n";
-
-				QDomElement root = doc.createElement("music");
-				doc.appendChild(root);
-				root.setAttribute("name", _name);
-				root.setAttribute("tempo", QString::number(_tempo));
-#if QT_VERSION >= 0x070000
-				root.setAttribute("date", QDateTime::currentMSecsSinceEpoch());
-#endif
-				//
-				// Saves the music information
-				//
-				QDomElement melody = doc.createElement("melody");
-				root.appendChild(melody);
-
-				melody.setAttribute("instrument", _instrument);
-				//
-				// Saves the notes information
-				//
-				for(int j=0; j < _notes.size(); j++)
-				{
-						QDomElement note = doc.createElement("note");
-						melody.appendChild(note);
-						note.setAttribute("height",QString::number(_notes[j]->getHeight()));
-						note.setAttribute("duration",QString::number(_notes[j]->getDuration()));
-						note.setAttribute("octave",QString::number(_notes[j]->getOctave()));
-				}
-				//
-				// Saves rhythm information
-				//
-				Rhythm *r;
-				QListIterator<Rhythm *> it(_rhythms);
-				while(it.hasNext())
-				{
-						r = it.next();
-						if(r->variation != RHYTHM_UNKNOWN)
-						{
-								QDomElement rhythmElement = doc.createElement("rhythm");
-								root.appendChild(rhythmElement);
-								rhythmElement.setAttribute("instrument", r->instrument);
-								rhythmElement.setAttribute("variation", r->variation);
-						}
-				}
-
-				doc.save(stream,4);
-
-				file.close();
+		if(ScoreXml::write(newSoundName, score()))
+		{
 				_lastError = CS_NO_ERROR;
 				return true;
 		}
@@ -381,14 +497,18 @@ void Music::setTempo(TempoType tempo)
 {
 		if(tempo != _tempo && tempo != TEMPO_UNKNOWN)
 		{
+				bool scoreLoading = (_soundMgr->getSampleLoading() == SAMPLE_LOADING_SCORE);
 				if(_instrument != INSTRUMENT_UNKNOWN)
 				{
 						_soundMgr->releaseSamplesInstrument(_instrument);
-						_soundMgr->loadInstrumentSamples(_instrument, tempo);
+						if(!scoreLoading)
+						{
+								_soundMgr->loadInstrumentSamples(_instrument, tempo);
+						}
 				}
 				else
 				{
-						qWarning() << "[Music::setTempo] Samples for instrument not loaded, instrument is unknown";
+						csWarning() << "[Music::setTempo] Samples for instrument not loaded, instrument is unknown";
 				}
 				_tempo = tempo;
 				// Rhythms
@@ -403,6 +523,11 @@ void Music::setTempo(TempoType tempo)
 								r->sampleName = _soundMgr->rhythmName(r->instrument, _tempo, r->variation);
 						}
 				}
+				// Only the samples of the notes
+				if(scoreLoading && _instrument != INSTRUMENT_UNKNOWN)
+				{
+						_soundMgr->preloadSamples(sampleNames());
+				}
 		}
 }
 
@@ -425,7 +550,7 @@ bool Music::addNote(DurationType duration, NoteType height, int octave)
 		Note *note = new Note(duration, height, octave);
 		if(!note)
 		{
-				qWarning() << "[Music::addNote] Not possible to create note";
+				csWarning() << "[Music::addNote] Not possible to create note";
 				return false;
 		}
 		_notes << note;
@@ -502,15 +627,20 @@ void Music::setInstrument(EnumInstrument instrument)
 				{
 						_soundMgr->releaseSamplesInstrument(_instrument);
 				}
-				if(_tempo != TEMPO_UNKNOWN)
+				if(_tempo == TEMPO_UNKNOWN)
 				{
-						_soundMgr->loadInstrumentSamples(instrument, _tempo);
+						csWarning() << "[Music::setInstrument] Samples not loaded, tempo is unknown";
 				}
-				else
+				else if(_soundMgr->getSampleLoading() != SAMPLE_LOADING_SCORE)
 				{
-						qWarning() << "[Music::setInstrument] Samples not loaded, tempo is unknown";
+						_soundMgr->loadInstrumentSamples(instrument, _tempo);
 				}
 				_instrument = instrument;
+				// Only the samples of the notes
+				if(_tempo != TEMPO_UNKNOWN && _soundMgr->getSampleLoading() == SAMPLE_LOADING_SCORE)
+				{
+						_soundMgr->preloadSamples(sampleNames());
+				}
 		}
 }
 
@@ -595,7 +725,7 @@ EnumRhythmVariation Music::rhythmVariation(EnumRhythmInstrument inst)
 */
 void Music::addRhythm(EnumRhythmInstrument instrument, EnumRhythmVariation variation, DurationType duration)
 {
-		qDebug() << "[Music::addRhythm] Instrument:" << instrument << "Rhythm:" << variation << "Duration" << duration;
+		csDebug() << "[Music::addRhythm] Instrument:" << instrument << "Rhythm:" << variation << "Duration" << duration;
 		Rhythm *r = new Rhythm();
 		r->instrument = instrument;
 		r->variation = variation;
@@ -609,7 +739,7 @@ void Music::addRhythm(EnumRhythmInstrument instrument, EnumRhythmVariation varia
 				}
 				else
 				{
-						qDebug() << "[Music::addRhythm] Not possible to load rhythm sample";
+						csDebug() << "[Music::addRhythm] Not possible to load rhythm sample";
 				}
 		}
 		r->volume = _soundMgr->getIntensitySound(r->sampleName);
@@ -635,7 +765,7 @@ void Music::changeRhythmVariation(EnumRhythmInstrument instrument, EnumRhythmVar
 						}
 						else
 						{
-								qDebug() << "[Music::changeRhythmVariation] Not possible to load rhythm sample";
+								csDebug() << "[Music::changeRhythmVariation] Not possible to load rhythm sample";
 						}
 				}
 				removeRhythm(r);
@@ -651,6 +781,14 @@ void Music::changeRhythmVariation(EnumRhythmInstrument instrument, EnumRhythmVar
 */
 void Music::update()
 {
+		//
+		// The source was stolen to play a sound with higher priority
+		//
+		if(_uiSource == 0)
+		{
+				stopSound();
+				return;
+		}
 		int processed;
 		alGetSourcei(_uiSource, AL_BUFFERS_PROCESSED, &processed);
 
@@ -661,11 +799,13 @@ void Music::update()
 				//
 				for(int i = _lastNotePlay; i < processed; i++)
 				{
+						int note = _firstNote + i;
 						_lastNoteStopped = i;
-						emit noteStopped(i);
-						if(i < _notes.size() - 1)
+						_playedSamples = (note + 1 < _bufferOffsets.size()) ? _bufferOffsets[note + 1] : _playedSamples;
+						noteEvent(note, NOTE_EVENT_STOPPED);
+						if(note < _notes.size() - 1)
 						{
-								emit notePlaying(i+1);
+								noteEvent(note + 1, NOTE_EVENT_PLAYING);
 						}
 				}
 				_lastNotePlay = processed;
@@ -673,12 +813,12 @@ void Music::update()
 		//
 		// end of music
 		//
-		if(processed == _notes.size() || _notes.isEmpty())
+		if(processed >= _notes.size() - _firstNote || _notes.isEmpty())
 		{
 				if(_loop)
 				{
 						// restarts sound
-						if(playSound(_loop, signalsBlocked()))
+						if(playFrom(_playFromNote, _loop, signalsBlocked()))
 						{
 								_lastError = CS_NO_ERROR;
 								return;
@@ -697,6 +837,7 @@ void Music::fillBuffer()
 	//
 	// Fills the buffer with the data of the notes in the melody
 	//
+	_buffer.resize(_notes.size());
 	for(int i = 0; i < _notes.size(); i++)
 	{
 		_buffer[i] =  _soundMgr->getBufferFromNote(
@@ -704,20 +845,31 @@ void Music::fillBuffer()
 					_notes[i]->getOctave(), _tempo, _instrument
 		);
 	}
+	_bufferOffsets = bufferOffsets(_buffer.constData(), _notes.size());
 }
 
 /*!
+	Returns the notes of the music joined, mixed with the rhythms.
 
+	The samples are shared with the music, a change of the music doesn't change the buffers
+	already returned. The buffer of the music is reused when it is not shared.
 */
-short* Music::getData()
+PcmBuffer Music::getData()
 {
 		if(isEmpty())
 		{
-				return 0;
+				_data.clear();
+				return _data;
 		}
+		preloadScoreSamples();
+
+		QElapsedTimer renderTimer;
+		renderTimer.start();
 
 		int musicSize = getSize();
-		_data = new short[musicSize];
+		int musicSamples = musicSize / sizeof(short);
+		_data.resize(musicSamples);
+		short* data = _data.data();
 		int notesSize = _notes.size();
 
 		//
@@ -728,21 +880,24 @@ short* Music::getData()
 		{
 				QString noteCurrentName = _soundMgr->nameNote(_instrument, _tempo, _notes[j]->getDuration(),
 																										  _notes[j]->getOctave(), _notes[j]->getHeight());
-				unsigned long currentSize =_soundMgr->getSize(noteCurrentName);
+				PcmBuffer noteData = _soundMgr->getData(noteCurrentName);
+				unsigned long currentSize = qMin(noteData.size(), (unsigned long)(musicSize - index * sizeof(short)));
 
-				memcpy( _data+index, _soundMgr->getData(noteCurrentName), currentSize );
+				if(currentSize > 0)
+				{
+						memcpy( data+index, noteData.constData(), currentSize );
+				}
 
 				index += currentSize/2.0;
 		}
 
-//	return _data;
-
-		/**
-		* mix's every rhythm to one monoral track
-		*/
+		//
+		// Fills the rhythm tracks, each in a thread of the pool
+		//
+		QList<PcmBuffer> rhythmSamples;
+		QList<float> rhythmVolumes;
 		Rhythm *r;
 		QListIterator<Rhythm *> it(_rhythms);
-		bool first = true;
 		while(it.hasNext())
 		{
 			r = it.next();
@@ -750,43 +905,135 @@ short* Music::getData()
 			{
 				continue; // Skip this rhythm
 			}
-			short *readRhythm = getRhythmData(r, musicSize); //data of the Rhythm
+			rhythmSamples.append(_soundMgr->getData(r->sampleName));
+			rhythmVolumes.append(r->volume);
+		}
+		QList<PcmBuffer> rhythmData = QtConcurrent::blockingMapped< QList<PcmBuffer> >(rhythmSamples, RhythmTiler(musicSize));
 
-			float fa, fb, fresult;
+		if(_soundMgr->getMixMode() == MIX_MODE_GRAPH)
+		{
 			//
-			// Do  mix ( integer computation for accuracy)
+			// The notes are a track of the graph, rendered into a new buffer
 			//
-			for( int j=0; j < musicSize; j++ )
+			PcmBuffer notesData = _data;
+			data = _data.data();
+			QList<TrackCursor> tracks;
+			tracks.append(TrackCursor(notesData, _intensity));
+			for(int i = 0; i < rhythmData.size(); i++)
 			{
-				if(first) // If is the first, start whith the melody
-				{
-					fa = (((_data[j] * _intensity) + 32768) / 65536.0);
-				}
-				else
+				if(!rhythmData[i].isEmpty())
 				{
-					fa = ((_data[j] + 32768) / 65536.0);
+					tracks.append(TrackCursor(rhythmData[i], rhythmVolumes[i]));
 				}
+			}
+			DspGraph::renderTracks(data, musicSamples, tracks, getFrequency(), _soundMgr->getMixEffects());
 
-				fb = (((readRhythm[j] * r->volume) + 32768) / 65536.0);
-				if( fa < 0.5 || fb < 0.5 )
-				{
-					fresult = (((fa*fb)*2.0));
-				}
-				else
+			PerfCounters::add( PERF_RENDERED_FRAMES, musicSamples );
+			PerfCounters::add( PERF_RENDER_TIME_US, (int)( renderTimer.nsecsElapsed() / 1000 ) );
+			return _data;
+		}
+
+		if(_soundMgr->getMixMode() == MIX_MODE_BUS)
+		{
+			//
+			// The notes are a track of the bus, mixed into a new buffer
+			//
+			PcmBuffer notesData = _data;
+			data = _data.data();
+			QVector<MixTrack> tracks;
+			tracks.append(MixTrack(notesData.constData(), musicSamples, _intensity));
+			for(int i = 0; i < rhythmData.size(); i++)
+			{
+				if(!rhythmData[i].isEmpty())
 				{
-					fresult = (2 * (fa + fb) - ((fa * fb) * 2.0) - 1);
+					tracks.append(MixTrack(rhythmData[i].constData(), musicSamples, rhythmVolumes[i]));
 				}
-				_data[j] = (short)((fresult * 65536) - 32768);
 			}
-			if(first)
+			MixBus::mix(data, tracks, musicSamples, 0, musicSamples);
+
+			PerfCounters::add( PERF_RENDERED_FRAMES, musicSamples );
+			PerfCounters::add( PERF_RENDER_TIME_US, (int)( renderTimer.nsecsElapsed() / 1000 ) );
+			return _data;
+		}
+
+		/**
+		* mix's every rhythm to one monoral track, the first with the melody
+		*/
+		QVector<MixTrack> tracks;
+		for(int i = 0; i < rhythmData.size(); i++)
+		{
+			if(rhythmData[i].isEmpty())
 			{
-				first = false;
+				continue;
 			}
+			tracks.append(MixTrack(rhythmData[i].constData(), musicSamples, rhythmVolumes[i]));
 		}
+		mixTracks(data, tracks, _intensity, 0, musicSamples);
 
+		PerfCounters::add( PERF_RENDERED_FRAMES, musicSamples );
+		PerfCounters::add( PERF_RENDER_TIME_US, (int)( renderTimer.nsecsElapsed() / 1000 ) );
 		return _data;
 }
 
+/*!
+	Returns the track of the notes and a track for each rhythm, to be mixed as getData() does
+	by a RenderDevice.
+*/
+QList<TrackCursor> Music::renderTracks()
+{
+		QList<TrackCursor> tracks;
+		if(isEmpty())
+		{
+				return tracks;
+		}
+		QStringList notes;
+		for(int j = 0; j < _notes.size(); j++)
+		{
+				notes << _soundMgr->nameNote(_instrument, _tempo, _notes[j]->getDuration(),
+											 _notes[j]->getOctave(), _notes[j]->getHeight());
+		}
+		tracks.append(TrackCursor(notes, _intensity));
+		qint64 musicSamples = tracks[0].size();
+		for(int i = 0; i < _rhythms.size(); i++)
+		{
+				Rhythm *r = _rhythms[i];
+				if(r->variation == RHYTHM_UNKNOWN)
+				{
+						continue; // Skip this rhythm
+				}
+				PcmBuffer sampleData = _soundMgr->getData(r->sampleName);
+				if(sampleData.isEmpty())
+				{
+						continue;
+				}
+				tracks.append(TrackCursor(sampleData, r->volume, musicSamples));
+		}
+		return tracks;
+}
+
+/*!
+	Returns the names of the samples of \a count notes from \a fromNote, or of all the notes
+	after \a fromNote if \a count is -1, and of the rhythms.
+*/
+QStringList Music::sampleNames(int fromNote, int count)
+{
+		QStringList names;
+		int end = (count < 0) ? _notes.size() : qMin(fromNote + count, _notes.size());
+		for(int j = qMax(fromNote, 0); j < end; j++)
+		{
+				names << _soundMgr->nameNote(_instrument, _tempo, _notes[j]->getDuration(),
+											 _notes[j]->getOctave(), _notes[j]->getHeight());
+		}
+		for(int i = 0; i < _rhythms.size(); i++)
+		{
+				if(_rhythms[i]->variation != RHYTHM_UNKNOWN && !_rhythms[i]->sampleName.isEmpty())
+				{
+						names << _rhythms[i]->sampleName;
+				}
+		}
+		return names;
+}
+
 unsigned long Music::getSize()
 {
 		unsigned long musicSize = 0;
@@ -805,29 +1052,45 @@ unsigned long Music::getSize()
 		return musicSize;
 }
 
-short* Music::getRhythmData(Rhythm *r, int size)
+/*!
+	Returns the sample of the rhythm \a r repeated to fill \a size bytes.
+*/
+PcmBuffer Music::getRhythmData(Rhythm *r, int size)
+{
+		return tileRhythm(_soundMgr->getData(r->sampleName), size);
+}
+
+/*!
+	Returns \a sampleData repeated to fill \a size bytes, or an empty buffer if there are
+	no samples. Only uses its arguments, can be called from any thread.
+*/
+PcmBuffer Music::tileRhythm(const PcmBuffer& sampleData, int size)
 {
-		short* data = new short[size];
 		// Rhythm size and data (buffer)
-		unsigned long sampleSize = _soundMgr->getSize(r->sampleName);
-		short* sampleData = _soundMgr->getData(r->sampleName);
+		unsigned long sampleSize = sampleData.size();
+		if(sampleSize == 0)
+		{
+				return PcmBuffer();
+		}
+		PcmBuffer rhythmData(size / (int)sizeof(short));
+		short* data = rhythmData.data();
 		// Number of times the rhythm is repetead
 		int musicRhythmRepetitions = size / sampleSize;
 		// Fills data to be returned
 		unsigned long index = 0;
 		for(int j = 0; j < musicRhythmRepetitions; j++)
 		{
-				memcpy(data+index, sampleData, sampleSize);
+				memcpy(data+index, sampleData.constData(), sampleSize);
 				index += sampleSize/2.0;
 		}
 		// Check if still is necessary to add some more part of an rhythm
 		int divisionRest = size % sampleSize;
 		if( divisionRest != 0)
 		{
-				unsigned long sizeRemaining = size - (musicRhythmRepetitions * sampleSize);
-				memcpy(data+index, sampleData, sizeRemaining);
+				unsigned long sizeRemaining = rhythmData.size() - (musicRhythmRepetitions * sampleSize);
+				memcpy(data+index, sampleData.constData(), sizeRemaining);
 		}
-		return data;
+		return rhythmData;
 }
 
 
@@ -837,9 +1100,49 @@ bool Music::compareSound(SoundBase* second)
 		return false;
 }
 
+/*!
+	Compares the notes of this music with the ones of the \a second music, allowing differences.
+
+	The \a mode is a combination of EnumSimilarityMode, and \a weights give the costs of the
+	different notes. Returns the distance, the score and the alignment of the notes.
+
+	\sa MelodySimilarity
+*/
+SimilarityResult Music::similarity(Music* second, int mode, const SimilarityWeights& weights)
+{
+		if(second == NULL)
+		{
+				return SimilarityResult();
+		}
+		MelodySimilarity similarity(mode, weights);
+		return similarity.compare(MelodySimilarity::notes(_notes), MelodySimilarity::notes(second->noteList()));
+}
+
+/*!
+	Returns the percentage of the music already played.
+*/
 float Music::percentPlay()
 {
-		return 0.0f;
+		return playPosition().percent();
+}
+
+/*!
+	Returns the position of the music being played, and the note playing.
+*/
+PlayPosition Music::playPosition()
+{
+		if(_stopped)
+		{
+				PlayPosition position;
+				position.frames = _bufferOffsets.isEmpty() ? 0 : _bufferOffsets.last();
+				return position;
+		}
+		PlayPosition position = queuePosition(_uiSource, _queueOffsets);
+		position.frame += _bufferOffsets[_firstNote];
+		position.frames = _bufferOffsets.last();
+		position.note = (position.note < 0) ? -1 : _firstNote + position.note;
+		position.melody = 0;
+		return position;
 }
 
 /*!
@@ -882,6 +1185,14 @@ int Music::graphicalRepresentation() const
 	return _graphicalRepresentation;
 }
 
+/*!
+	Sets the graphical represenation to use for the music, -1 if none.
+*/
+void Music::setGraphicalRepresentation(int representation)
+{
+	_graphicalRepresentation = representation;
+}
+
 
 void Music::saveToMp3(const QString filename, int minimumRate, bool deleteWav)
 {
@@ -903,6 +1214,41 @@ void Music::setRhythmsOn(bool rhythmsOn)
 	_rhythmsOn = rhythmsOn;
 }
 
+/*!
+	Emits the signal of the \a event of the \a note, or queues it if the SoundManager
+	delivers the note events later.
+*/
+void Music::noteEvent(int note, EnumNoteEvent event)
+{
+		if(queueNoteEvent(0, note, event, _playedSamples))
+		{
+				return;
+		}
+		if(event == NOTE_EVENT_STOPPED)
+		{
+				emit noteStopped(note);
+		}
+		else
+		{
+				emit notePlaying(note);
+		}
+}
+
+/*!
+	Emits the signal of the note \a event queued by the sound thread.
+*/
+void Music::deliverNoteEvent(const NoteEvent& event)
+{
+		if(event.event == NOTE_EVENT_STOPPED)
+		{
+				emit noteStopped(event.note);
+		}
+		else
+		{
+				emit notePlaying(event.note);
+		}
+}
+
 }	// CnotiAudio
 
 
@@ -12,6 +12,8 @@
 
 #include "soundBase.h"
 #include "CnotiAudio.h"
+#include "Score.h"
+#include "MelodySimilarity.h"
 #include "soundmanager_global.h"
 #ifdef _WIN32
 // OpenAL Framework
@@ -30,11 +32,14 @@ namespace CnotiAudio
 		Q_OBJECT
 	public:
 		Music(const QString name);
+		~Music();
 
 		bool load(const QString filename);
 		void release();
 
 		bool playSound(bool loop = false, bool blockSignal = false);
+		bool playFrom(int note, bool loop = false, bool blockSignal = false);
+		bool seek(qint64 frame);
 		bool pauseSound();
 		bool stopSound();
 
@@ -42,8 +47,13 @@ namespace CnotiAudio
 
 		bool save(const QString filename);
 
+		bool setScore(const ScoreData& score);
+		ScoreData score();
+
 		bool compareSound(SoundBase* second);
+		SimilarityResult similarity(Music* second, int mode = SIMILARITY_EXACT, const SimilarityWeights& weights = SimilarityWeights());
 		float percentPlay();
+		PlayPosition playPosition();
 
 		TempoType tempo();
 		void setTempo(TempoType tempo);
@@ -72,12 +82,17 @@ namespace CnotiAudio
 		bool isRhythmsOn() const;
 		void setRhythmsOn(bool rhythmsOn);
 
-		short* getData();
+		PcmBuffer getData();
+		QList<TrackCursor> renderTracks();
+		QStringList sampleNames(int fromNote = 0, int count = -1);
+		void deliverNoteEvent(const NoteEvent& event);
 		unsigned long getSize();
+		static PcmBuffer tileRhythm(const PcmBuffer& sampleData, int size);
 
 		int durationNotes() const;
 
 		int graphicalRepresentation() const;
+		void setGraphicalRepresentation(int representation);
 
 	public slots:
 		void saveToMp3(const QString filename, int minimumRate, bool deleteWav=true);
@@ -106,7 +121,7 @@ namespace CnotiAudio
 		} Rhythm;
 
 		void update();
-		short* getRhythmData(Rhythm *r, int size);
+		PcmBuffer getRhythmData(Rhythm *r, int size);
 
 	private:
 		EnumInstrument  _instrument;
@@ -118,11 +133,19 @@ namespace CnotiAudio
 		// Notes
 		int	_lastNotePlay;
 		int	_lastNoteStopped;
+		qint64 _playedSamples; // Sample frames of the notes already played
 		// openAL
-		ALuint _buffer[100];
+		QVector<ALuint> _buffer; // Buffer of each note
+		QVector<qint64> _bufferOffsets; // First sample frame of each buffer, and the end of the last
+		QVector<qint64> _queueOffsets; // The same, for the buffers queued, from the first queued
+		int _firstNote; // First note queued
+		int _playFromNote; // Note where the music starts, and restarts in loop
 
 		// Functions
 		void fillBuffer();
+		bool queueNotes(int fromNote, qint64 offset);
+		void unqueueNotes();
+		void noteEvent(int note, EnumNoteEvent event);
 		Rhythm *rhythmPtr(EnumRhythmInstrument inst);
 		void removeRhythm(Rhythm *rhythm);
 	};
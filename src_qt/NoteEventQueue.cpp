@@ -0,0 +1,169 @@
+/**
+	\file NoteEventQueue.cpp
+*/
+#include "NoteEventQueue.h"
+// Qt
+#include <QHash>
+#include <QPair>
+
+namespace CnotiAudio
+{
+/*!
+	Constructs a queue for \a capacity events, rounded up to a power of 2.
+*/
+	NoteEventQueue::NoteEventQueue( int capacity ) :
+		_cells (NULL),
+		_mask (0),
+		_tail (0),
+		_head (0)
+	{
+		int size = 2;
+		while( size < capacity && size < ( 1 << 20 ) )
+		{
+			size <<= 1;
+		}
+		_cells = new Cell[size];
+		_mask = size - 1;
+		for( int i = 0; i < size; ++i )
+		{
+			_cells[i].sequence = i;
+		}
+	}
+
+/*!
+	Destroyes the queue, the events not taken are lost.
+*/
+	NoteEventQueue::~NoteEventQueue()
+	{
+		delete[] _cells;
+	}
+
+/*!
+	Adds \a event to the end of the queue. Can be called from any thread.
+
+	Returns false if the queue is full.
+*/
+	bool NoteEventQueue::post( const NoteEvent& event )
+	{
+		forever
+		{
+			int position = _tail;
+			Cell& cell = _cells[position & _mask];
+			int sequence = cell.sequence.fetchAndAddAcquire( 0 );
+			int difference = int( (unsigned int)sequence - (unsigned int)position );
+			if( difference == 0 )
+			{
+				//
+				// The cell is free, tries to reserve it
+				//
+				if( _tail.testAndSetRelaxed( position, int( (unsigned int)position + 1 ) ) )
+				{
+					cell.event = event;
+					cell.sequence.fetchAndStoreRelease( int( (unsigned int)position + 1 ) );
+					return true;
+				}
+			}
+			else if( difference < 0 )
+			{
+				//
+				// The cell wasn't read yet, the queue is full
+				//
+				return false;
+			}
+		}
+	}
+
+/*!
+	Removes the first event of the queue into \a event. Must be called always from the same
+	thread.
+
+	Returns false if the queue is empty.
+*/
+	bool NoteEventQueue::take( NoteEvent* event )
+	{
+		Cell& cell = _cells[_head & _mask];
+		int sequence = cell.sequence.fetchAndAddAcquire( 0 );
+		if( sequence != int( (unsigned int)_head + 1 ) )
+		{
+			return false;
+		}
+		*event = cell.event;
+		cell.event.sound = QString();
+		cell.sequence.fetchAndStoreRelease( int( (unsigned int)_head + _mask + 1 ) );
+		_head = int( (unsigned int)_head + 1 );
+		return true;
+	}
+
+/*!
+	Removes all the events of the queue, adding them to \a events.
+
+	Returns the number of events taken.
+*/
+	int NoteEventQueue::takeAll( QVector<NoteEvent>* events )
+	{
+		int count = 0;
+		NoteEvent event;
+		while( take( &event ) )
+		{
+			events->append( event );
+			count++;
+		}
+		return count;
+	}
+
+/*!
+	Returns the maximum number of events in the queue.
+*/
+	int NoteEventQueue::capacity() const
+	{
+		return _mask + 1;
+	}
+
+/*!
+	Removes from \a events the notes that started and stopped in the same batch, as the
+	GUI would show and hide them at once. The order of the other events is kept.
+
+	Returns the number of events removed.
+*/
+	int NoteEventQueue::coalesce( QVector<NoteEvent>* events )
+	{
+		typedef QPair<QString, qint64> NoteKey;
+		QHash<NoteKey, int> playing;		// Index of the notes started in the batch
+		QVector<bool> removed( events->size(), false );
+		int count = 0;
+		for( int i = 0; i < events->size(); ++i )
+		{
+			const NoteEvent& e = events->at( i );
+			NoteKey key( e.sound, ( qint64( e.melody ) << 32 ) | quint32( e.note ) );
+			if( e.event == NOTE_EVENT_PLAYING )
+			{
+				playing.insert( key, i );
+			}
+			else
+			{
+				QHash<NoteKey, int>::iterator it = playing.find( key );
+				if( it != playing.end() )
+				{
+					removed[it.value()] = true;
+					removed[i] = true;
+					playing.erase( it );
+					count += 2;
+				}
+			}
+		}
+		if( count == 0 )
+		{
+			return 0;
+		}
+		int j = 0;
+		for( int i = 0; i < events->size(); ++i )
+		{
+			if( !removed[i] )
+			{
+				(*events)[j++] = events->at( i );
+			}
+		}
+		events->resize( j );
+		return count;
+	}
+}
@@ -0,0 +1,79 @@
+/*!
+ \class CnotiAudio::NoteEventQueue
+ \brief The NoteEventQueue class passes the note events from the sound threads to the GUI thread.
+
+ The sound threads post the events, without locks, in a bounded ring of cells. Each cell has
+ a sequence number telling if it is free to be written or ready to be read (the bounded
+ queue of Dmitry Vyukov). Any number of threads can post, only one thread, the one of the
+ SoundManager, takes the events.
+
+ When the queue is full the event is not posted, post() returns false and the sound thread
+ keeps on playing.
+
+ coalesce() removes the events superseded in a batch: a note that started and stopped
+ before the batch was taken is never seen by the GUI.
+
+ \version 2.2
+ \date 19-10-2026
+ \file NoteEventQueue.h
+*/
+#if !defined(_NOTEEVENTQUEUE_H)
+#define _NOTEEVENTQUEUE_H
+
+#include <QAtomicInt>
+#include <QString>
+#include <QVector>
+
+#include "soundmanager_global.h"
+
+namespace CnotiAudio
+{
+	enum EnumNoteEvent{
+		NOTE_EVENT_PLAYING = 0,		// The note started to play
+		NOTE_EVENT_STOPPED			// The note stopped
+	};
+
+	struct NoteEvent
+	{
+		QString        sound;		// Name of the sound
+		int            melody;		// Melody of the sound, 0 for a music
+		int            note;		// Note of the melody
+		EnumNoteEvent  event;
+		qint64         sample;		// Sample frames of the melody played when the event happened
+
+		NoteEvent() : melody(0), note(0), event(NOTE_EVENT_PLAYING), sample(0) {}
+		NoteEvent( const QString& s, int m, int n, EnumNoteEvent e, qint64 t ) :
+			sound(s), melody(m), note(n), event(e), sample(t) {}
+	};
+
+	class SOUNDMANAGER_EXPORT NoteEventQueue
+	{
+	public:
+		NoteEventQueue( int capacity = 1024 );
+		~NoteEventQueue();
+
+		bool post( const NoteEvent& event );
+		bool take( NoteEvent* event );
+		int takeAll( QVector<NoteEvent>* events );
+
+		int capacity() const;
+
+		static int coalesce( QVector<NoteEvent>* events );
+
+	private:
+		Q_DISABLE_COPY( NoteEventQueue )
+
+		struct Cell
+		{
+			QAtomicInt  sequence;	// Position that can write the cell, or position + 1 when it can be read
+			NoteEvent   event;
+		};
+
+		Cell*       _cells;
+		int         _mask;			// Capacity - 1, the capacity is a power of 2
+		QAtomicInt  _tail;			// Next position to write
+		int         _head;			// Next position to read, only used by the reader
+	};
+}
+
+#endif //_NOTEEVENTQUEUE_H
@@ -0,0 +1,267 @@
+/**
+	\file NoteKey.cpp
+*/
+#include "NoteKey.h"
+#include "SoundManager.h"
+
+namespace CnotiAudio
+{
+/*!
+	Constructs a key that isn't of any sample.
+*/
+	NoteKey::NoteKey() :
+		kind (NOTE_KEY_NONE),
+		instrument (0),
+		tempo (0),
+		duration (0),
+		octave (0),
+		height (0)
+	{
+	}
+
+/*!
+	Constructs the key of a note of \a instrument, or of a pause if \a height is PAUSE.
+*/
+	NoteKey::NoteKey( EnumInstrument instrument, TempoType tempo, DurationType duration, int octave, NoteType height ) :
+		kind (height == PAUSE ? NOTE_KEY_PAUSE : NOTE_KEY_NOTE),
+		instrument (height == PAUSE ? 0 : instrument),
+		tempo (tempo),
+		duration (duration),
+		octave (height == PAUSE ? 0 : octave),
+		height (height == PAUSE ? (int)PAUSE : height)
+	{
+	}
+
+/*!
+	Constructs the key of the \a variation of a rhythm \a instrument.
+*/
+	NoteKey::NoteKey( EnumRhythmInstrument instrument, TempoType tempo, EnumRhythmVariation variation ) :
+		kind (NOTE_KEY_RHYTHM),
+		instrument (instrument),
+		tempo (tempo),
+		duration (0),
+		octave (0),
+		height (variation)
+	{
+	}
+
+/*!
+	Returns the key of the sample \a name, as given by SoundManager::nameNote() or
+	SoundManager::rhythmName(). Returns a key of kind NOTE_KEY_NONE if \a name isn't the
+	name of a sample.
+*/
+	NoteKey NoteKey::fromName( const QString& name )
+	{
+		NoteKey key;
+		if( !name.endsWith( ".wav" ) )
+		{
+			return key;
+		}
+		QString base = name.left( name.length() - 4 );
+		bool pause = base.startsWith( pauseName );
+		if( pause )
+		{
+			base = base.mid( pauseName.length() );
+		}
+		QStringList fields = base.split( '_' );
+		int values[5];
+		if( fields.size() > 5 )
+		{
+			return key;
+		}
+		for( int i = 0; i < fields.size(); i++ )
+		{
+			bool ok;
+			values[i] = fields[i].toInt( &ok );
+			if( !ok )
+			{
+				return key;
+			}
+		}
+		if( pause && fields.size() == 2 )
+		{
+			key.kind = NOTE_KEY_PAUSE;
+			key.tempo = values[0];
+			key.duration = values[1];
+			key.height = PAUSE;
+		}
+		else if( !pause && fields.size() == 5 )
+		{
+			key.kind = NOTE_KEY_NOTE;
+			key.instrument = values[0];
+			key.tempo = values[1];
+			key.duration = values[2];
+			key.octave = values[3];
+			key.height = values[4];
+		}
+		else if( !pause && fields.size() == 3 )
+		{
+			key.kind = NOTE_KEY_RHYTHM;
+			key.instrument = values[0];
+			key.tempo = values[1];
+			key.height = values[2];
+		}
+		return key;
+	}
+
+/*!
+	Returns the name of the sample of the key, or an empty string if the key isn't valid.
+*/
+	QString NoteKey::name() const
+	{
+		switch( kind )
+		{
+		case NOTE_KEY_NOTE:
+		case NOTE_KEY_PAUSE:
+			return SoundManager::nameNote( (EnumInstrument)instrument, (TempoType)tempo, (DurationType)duration,
+				octave, (NoteType)height );
+		case NOTE_KEY_RHYTHM:
+			return SoundManager::rhythmName( (EnumRhythmInstrument)instrument, (TempoType)tempo, (EnumRhythmVariation)height );
+		default:
+			return QString();
+		}
+	}
+
+/*!
+	Returns true if the key is of a sample.
+*/
+	bool NoteKey::isValid() const
+	{
+		return kind != NOTE_KEY_NONE;
+	}
+
+/*!
+	Returns true if both keys are of the same sample.
+*/
+	bool NoteKey::operator==( const NoteKey& other ) const
+	{
+		return kind == other.kind && instrument == other.instrument && tempo == other.tempo &&
+			duration == other.duration && octave == other.octave && height == other.height;
+	}
+
+/*!
+	Returns true if the keys are of different samples.
+*/
+	bool NoteKey::operator!=( const NoteKey& other ) const
+	{
+		return !( *this == other );
+	}
+
+/*!
+	Returns the hash of \a key, to use it in a QHash.
+*/
+	uint qHash( const NoteKey& key )
+	{
+		uint h = key.kind;
+		h = h * 31 + key.instrument;
+		h = h * 31 + key.tempo;
+		h = h * 31 + key.duration;
+		h = h * 31 + key.octave;
+		h = h * 31 + (uint)( key.height + 2 );
+		return h;
+	}
+
+/*!
+	Adds the sample \a name to the groups of its key.
+
+	Returns false if \a name isn't the name of a sample.
+*/
+	bool NoteKeyIndex::insert( const QString& name )
+	{
+		NoteKey key = NoteKey::fromName( name );
+		switch( key.kind )
+		{
+		case NOTE_KEY_NOTE:
+			group( SAMPLE_GROUP_INSTRUMENT )[key.instrument].insert( name );
+			group( SAMPLE_GROUP_DURATION )[key.duration].insert( name );
+			break;
+		case NOTE_KEY_PAUSE:
+			group( SAMPLE_GROUP_DURATION )[key.duration].insert( name );
+			break;
+		case NOTE_KEY_RHYTHM:
+			group( SAMPLE_GROUP_RHYTHM )[key.instrument].insert( name );
+			break;
+		default:
+			return false;
+		}
+		group( SAMPLE_GROUP_TEMPO )[key.tempo].insert( name );
+		return true;
+	}
+
+/*!
+	Removes the sample \a name from the groups of its key.
+
+	Returns false if \a name isn't the name of a sample.
+*/
+	bool NoteKeyIndex::remove( const QString& name )
+	{
+		NoteKey key = NoteKey::fromName( name );
+		if( !key.isValid() )
+		{
+			return false;
+		}
+		int values[SAMPLE_GROUP_COUNT];
+		values[SAMPLE_GROUP_INSTRUMENT] = key.instrument;
+		values[SAMPLE_GROUP_TEMPO] = key.tempo;
+		values[SAMPLE_GROUP_DURATION] = key.duration;
+		values[SAMPLE_GROUP_RHYTHM] = key.instrument;
+		for( int i = 0; i < SAMPLE_GROUP_COUNT; i++ )
+		{
+			Group::iterator it = _groups[i].find( values[i] );
+			if( it != _groups[i].end() )
+			{
+				it.value().remove( name );
+				if( it.value().isEmpty() )
+				{
+					_groups[i].erase( it );
+				}
+			}
+		}
+		return true;
+	}
+
+/*!
+	Removes all the samples.
+*/
+	void NoteKeyIndex::clear()
+	{
+		for( int i = 0; i < SAMPLE_GROUP_COUNT; i++ )
+		{
+			_groups[i].clear();
+		}
+	}
+
+/*!
+	Returns the names of the samples of the \a group with \a value, like the samples of the
+	instrument PIANO for SAMPLE_GROUP_INSTRUMENT.
+*/
+	QStringList NoteKeyIndex::names( EnumSampleGroup group, int value ) const
+	{
+		return this->group( group ).value( value ).toList();
+	}
+
+/*!
+	Returns the number of samples of the \a group with \a value.
+*/
+	int NoteKeyIndex::count( EnumSampleGroup group, int value ) const
+	{
+		Group::const_iterator it = this->group( group ).find( value );
+		return ( it == this->group( group ).end() ) ? 0 : it.value().size();
+	}
+
+/*!
+	Returns the samples by the values of \a group.
+*/
+	const NoteKeyIndex::Group& NoteKeyIndex::group( EnumSampleGroup group ) const
+	{
+		return _groups[group];
+	}
+
+/*!
+	This is an overloaded member function, provided for convenience.
+*/
+	NoteKeyIndex::Group& NoteKeyIndex::group( EnumSampleGroup group )
+	{
+		return _groups[group];
+	}
+}
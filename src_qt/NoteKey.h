@@ -0,0 +1,84 @@
+/*!
+ \class CnotiAudio::NoteKey
+ \brief The NoteKey class identifies a sample by the information in its name.
+
+ The samples are named by SoundManager::nameNote() and SoundManager::rhythmName(). NoteKey
+ gets back the instrument, tempo, duration, octave and height of a note, the tempo and
+ duration of a pause, or the instrument, tempo and variation of a rhythm. Other names give
+ a key of kind NOTE_KEY_NONE.
+
+ \class CnotiAudio::NoteKeyIndex
+ \brief The NoteKeyIndex class keeps the names of the samples loaded by group.
+
+ The SoundManager adds the names of the sounds when they are loaded and removes them when
+ they are released. The samples of a group, like all the samples of an instrument, are found
+ without going through all the sounds.
+
+ \version 2.2
+ \date 19-10-2026
+ \file NoteKey.h
+*/
+#if !defined(_NOTEKEY_H)
+#define _NOTEKEY_H
+
+#include <QHash>
+#include <QSet>
+#include <QString>
+#include <QStringList>
+
+#include "CnotiAudio.h"
+#include "soundmanager_global.h"
+
+namespace CnotiAudio
+{
+	enum EnumNoteKeyKind{
+		NOTE_KEY_NONE = 0,		// Not the name of a sample
+		NOTE_KEY_NOTE,			// Note of an instrument
+		NOTE_KEY_PAUSE,			// Pause of a tempo and duration
+		NOTE_KEY_RHYTHM			// Variation of a rhythm instrument
+	};
+
+	struct SOUNDMANAGER_EXPORT NoteKey
+	{
+		EnumNoteKeyKind kind;
+		int             instrument;		// EnumInstrument of a note, EnumRhythmInstrument of a rhythm
+		int             tempo;
+		int             duration;		// Duration of a note or a pause
+		int             octave;
+		int             height;			// Height of a note, variation of a rhythm
+
+		NoteKey();
+		NoteKey( EnumInstrument instrument, TempoType tempo, DurationType duration, int octave, NoteType height );
+		NoteKey( EnumRhythmInstrument instrument, TempoType tempo, EnumRhythmVariation variation );
+
+		static NoteKey fromName( const QString& name );
+		QString name() const;
+		bool isValid() const;
+
+		bool operator==( const NoteKey& other ) const;
+		bool operator!=( const NoteKey& other ) const;
+	};
+
+	uint qHash( const NoteKey& key );
+
+	class SOUNDMANAGER_EXPORT NoteKeyIndex
+	{
+	public:
+		bool insert( const QString& name );
+		bool remove( const QString& name );
+		void clear();
+
+		QStringList names( EnumSampleGroup group, int value ) const;
+		int count( EnumSampleGroup group, int value ) const;
+
+	private:
+		typedef QHash< int, QSet<QString> > Group;
+
+		const Group& group( EnumSampleGroup group ) const;
+		Group& group( EnumSampleGroup group );
+
+		Group _groups[SAMPLE_GROUP_COUNT];		// Names of the samples by the value of each group
+	};
+}
+
+#endif //_NOTEKEY_H
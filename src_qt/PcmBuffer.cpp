@@ -0,0 +1,150 @@
+/**
+	\file PcmBuffer.cpp
+*/
+#include "PcmBuffer.h"
+// Std
+#include <cstring>
+
+namespace CnotiAudio
+{
+/*!
+	Constructs an empty buffer.
+*/
+	PcmBuffer::PcmBuffer()
+	{
+	}
+
+/*!
+	Constructs a buffer with \a samples samples of silence.
+*/
+	PcmBuffer::PcmBuffer( int samples ) :
+		_bytes( samples * (int)sizeof(short), '\0' )
+	{
+	}
+
+/*!
+	Constructs a buffer with a copy of the \a bytes bytes of \a data.
+*/
+	PcmBuffer::PcmBuffer( const short* data, unsigned long bytes )
+	{
+		if( data != 0 && bytes > 0 )
+		{
+			_bytes = QByteArray( (const char*)data, (int)bytes );
+		}
+	}
+
+/*!
+	Returns the samples, without copying them. Returns 0 if the buffer is empty.
+*/
+	const short* PcmBuffer::constData() const
+	{
+		return _bytes.isEmpty() ? 0 : (const short*)_bytes.constData();
+	}
+
+/*!
+	This is an overloaded member function, provided for convenience.
+
+	Returns the samples, without copying them. Returns 0 if the buffer is empty.
+*/
+	const short* PcmBuffer::data() const
+	{
+		return constData();
+	}
+
+/*!
+	Returns the samples to be changed. If the buffer is shared with other copies the samples
+	are copied first, the others are not changed. Returns 0 if the buffer is empty.
+*/
+	short* PcmBuffer::data()
+	{
+		return _bytes.isEmpty() ? 0 : (short*)_bytes.data();
+	}
+
+/*!
+	Returns the size of the samples, in bytes.
+*/
+	unsigned long PcmBuffer::size() const
+	{
+		return _bytes.size();
+	}
+
+/*!
+	Returns the number of samples.
+*/
+	int PcmBuffer::samples() const
+	{
+		return _bytes.size() / (int)sizeof(short);
+	}
+
+/*!
+	Returns true if the buffer has no samples.
+*/
+	bool PcmBuffer::isEmpty() const
+	{
+		return _bytes.isEmpty();
+	}
+
+/*!
+	Returns true if the samples are shared with other copies, and would be copied by data().
+*/
+	bool PcmBuffer::isShared() const
+	{
+		return !_bytes.isEmpty() && !_bytes.isDetached();
+	}
+
+/*!
+	Changes the number of samples to \a samples. The samples kept are not changed, the new ones
+	are not initialized. If the buffer is shared, only this copy changes.
+*/
+	void PcmBuffer::resize( int samples )
+	{
+		_bytes.resize( qMax( samples, 0 ) * (int)sizeof(short) );
+	}
+
+/*!
+	Sets the samples from \a from to \a to, or to the end if -1, to \a value.
+*/
+	void PcmBuffer::fill( short value, int from, int to )
+	{
+		int count = samples();
+		to = ( to < 0 || to > count ) ? count : to;
+		if( from >= to )
+		{
+			return;
+		}
+		short* buffer = data();
+		if( value == 0 )
+		{
+			memset( buffer + from, 0, ( to - from ) * sizeof(short) );
+			return;
+		}
+		for( int i = from; i < to; i++ )
+		{
+			buffer[i] = value;
+		}
+	}
+
+/*!
+	Removes all the samples. The samples are released when no other copy uses them.
+*/
+	void PcmBuffer::clear()
+	{
+		_bytes.clear();
+	}
+
+/*!
+	Returns true if both buffers have the same samples.
+*/
+	bool PcmBuffer::operator==( const PcmBuffer& other ) const
+	{
+		return _bytes == other._bytes;
+	}
+
+/*!
+	Returns true if the buffers have different samples.
+*/
+	bool PcmBuffer::operator!=( const PcmBuffer& other ) const
+	{
+		return _bytes != other._bytes;
+	}
+}
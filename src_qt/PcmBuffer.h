@@ -0,0 +1,55 @@
+/*!
+ \class CnotiAudio::PcmBuffer
+ \brief The PcmBuffer class keeps 16 bits PCM samples, shared between copies.
+
+ The samples are kept in an implicitly shared QByteArray: copying a buffer only increases
+ a reference count, so the copies of a sound and the buffers returned by getData() don't
+ duplicate the audio data. The reference count is atomic, buffers can be passed between
+ threads.
+
+ A buffer shared by several copies is never changed: data(), resize() and fill() detach it
+ first, copying the samples, so the other copies keep the previous samples (copy-on-write).
+ constData() never copies.
+
+ \version 2.2
+ \date 19-10-2026
+ \file PcmBuffer.h
+*/
+#if !defined(_PCMBUFFER_H)
+#define _PCMBUFFER_H
+
+#include <QByteArray>
+
+#include "soundmanager_global.h"
+
+namespace CnotiAudio
+{
+	class SOUNDMANAGER_EXPORT PcmBuffer
+	{
+	public:
+		PcmBuffer();
+		explicit PcmBuffer( int samples );
+		PcmBuffer( const short* data, unsigned long bytes );
+
+		const short* constData() const;
+		const short* data() const;
+		short* data();
+
+		unsigned long size() const;
+		int samples() const;
+		bool isEmpty() const;
+		bool isShared() const;
+
+		void resize( int samples );
+		void fill( short value, int from = 0, int to = -1 );
+		void clear();
+
+		bool operator==( const PcmBuffer& other ) const;
+		bool operator!=( const PcmBuffer& other ) const;
+
+	private:
+		QByteArray _bytes;
+	};
+}
+
+#endif //_PCMBUFFER_H
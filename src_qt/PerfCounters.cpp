@@ -0,0 +1,104 @@
+/**
+	\file PerfCounters.cpp
+*/
+#include "PerfCounters.h"
+
+namespace CnotiAudio
+{
+	QAtomicInt PerfCounters::_values[PERF_COUNTER_COUNT];
+
+	//
+	// Names of the counters, in the order of EnumPerfCounter
+	//
+	static const char* const counterNames[PERF_COUNTER_COUNT] = {
+		"samples_loaded",
+		"bytes_resident",
+		"bytes_al",
+		"loads",
+		"load_time_total_us",
+		"load_time_max_us",
+		"cache_hits",
+		"cache_misses",
+		"sources_active",
+		"sources_peak",
+		"checkout_failures",
+		"voice_steals",
+		"update_wakeups",
+		"update_lateness_total_us",
+		"update_lateness_max_us",
+		"stream_refills",
+		"stream_underruns",
+		"capture_overruns",
+		"rendered_frames",
+		"render_time_us",
+		"sample_fetches",
+		"note_events_dropped",
+		"note_events_coalesced"
+	};
+
+/*!
+	Adds \a value to \a counter.
+*/
+	void PerfCounters::add( EnumPerfCounter counter, int value )
+	{
+		_values[counter].fetchAndAddRelaxed( value );
+	}
+
+/*!
+	Changes \a counter to \a value, if \a value is bigger than the current value.
+*/
+	void PerfCounters::raise( EnumPerfCounter counter, int value )
+	{
+		int current = _values[counter];
+		while( value > current )
+		{
+			if( _values[counter].testAndSetRelaxed( current, value ) )
+			{
+				return;
+			}
+			current = _values[counter];
+		}
+	}
+
+/*!
+	Adds \a value to \a gauge and keeps the maximum value reached in \a peak.
+*/
+	void PerfCounters::addGauge( EnumPerfCounter gauge, int value, EnumPerfCounter peak )
+	{
+		int current = _values[gauge].fetchAndAddRelaxed( value ) + value;
+		raise( peak, current );
+	}
+
+/*!
+	Returns the current value of \a counter.
+*/
+	int PerfCounters::value( EnumPerfCounter counter )
+	{
+		return _values[counter];
+	}
+
+/*!
+	Returns the name of \a counter.
+*/
+	QString PerfCounters::name( EnumPerfCounter counter )
+	{
+		return QString( counterNames[counter] );
+	}
+
+/*!
+	Resets the counters and the peaks to zero. The gauges are kept, they describe the
+	current state of the engine.
+*/
+	void PerfCounters::reset()
+	{
+		for( int i = 0; i < PERF_COUNTER_COUNT; ++i )
+		{
+			if( i == PERF_SAMPLES_LOADED || i == PERF_BYTES_RESIDENT || i == PERF_BYTES_AL || i == PERF_SOURCES_ACTIVE )
+			{
+				continue;
+			}
+			_values[i].fetchAndStoreRelaxed( 0 );
+		}
+		raise( PERF_SOURCES_PEAK, _values[PERF_SOURCES_ACTIVE] );
+	}
+}
@@ -0,0 +1,68 @@
+/*!
+ \class CnotiAudio::PerfCounters
+ \brief The PerfCounters class keeps the runtime counters and gauges of the sound engine.
+
+ The values are updated from any thread with relaxed atomic operations, without locks,
+ so they can be used in the sound threads. Use SoundManager::getCounter() and
+ SoundManager::getCounters() to read them.
+
+ The counters are 32 bits and wrap around. Rates must be computed from the difference
+ between two reads, like the periodic dump made by SoundManager::setCountersDumpInterval().
+
+ \version 2.2
+ \date 19-10-2026
+ \file PerfCounters.h
+*/
+#if !defined(_PERFCOUNTERS_H)
+#define _PERFCOUNTERS_H
+
+#include <QAtomicInt>
+#include <QString>
+
+#include "soundmanager_global.h"
+
+namespace CnotiAudio
+{
+	enum EnumPerfCounter{
+		PERF_SAMPLES_LOADED = 0,		// Samples in memory (gauge)
+		PERF_BYTES_RESIDENT,			// Bytes of sample data kept in memory (gauge)
+		PERF_BYTES_AL,					// Bytes of sample data copied to AL buffers (gauge)
+		PERF_LOADS,						// Files loaded
+		PERF_LOAD_TIME_TOTAL_US,		// Time spent loading files
+		PERF_LOAD_TIME_MAX_US,			// Slowest file load
+		PERF_CACHE_HITS,				// Loads avoided because the sound was already loaded
+		PERF_CACHE_MISSES,				// Loads that had to read the file
+		PERF_SOURCES_ACTIVE,			// Sound sources checked out (gauge)
+		PERF_SOURCES_PEAK,				// Maximum of sound sources checked out
+		PERF_CHECKOUT_FAILURES,			// Sounds not played because there was no sound source
+		PERF_VOICE_STEALS,				// Sound sources stolen to play sounds with higher priority
+		PERF_UPDATE_WAKEUPS,			// Iterations of the sound threads
+		PERF_UPDATE_LATENESS_TOTAL_US,	// Time the sound threads woke up after the expected time
+		PERF_UPDATE_LATENESS_MAX_US,	// Maximum lateness of a sound thread
+		PERF_STREAM_REFILLS,			// Stream buffers decoded and queued
+		PERF_STREAM_UNDERRUNS,			// Times a stream played all the queued buffers
+		PERF_CAPTURE_OVERRUNS,			// Times the capture buffer was full when read
+		PERF_RENDERED_FRAMES,			// Frames mixed by Sound::getData(), Music::getData() and RenderDevice
+		PERF_RENDER_TIME_US,			// Time spent mixing those frames
+		PERF_SAMPLE_FETCHES,			// Samples read again from the file because they were not in memory
+		PERF_NOTE_EVENTS_DROPPED,		// Note events lost because the event queue was full
+		PERF_NOTE_EVENTS_COALESCED,		// Note events not delivered because they were superseded
+		PERF_COUNTER_COUNT
+	};
+
+	class SOUNDMANAGER_EXPORT PerfCounters
+	{
+	public:
+		static void add( EnumPerfCounter counter, int value = 1 );
+		static void raise( EnumPerfCounter counter, int value );
+		static void addGauge( EnumPerfCounter gauge, int value, EnumPerfCounter peak );
+		static int value( EnumPerfCounter counter );
+		static QString name( EnumPerfCounter counter );
+		static void reset();
+
+	private:
+		static QAtomicInt _values[PERF_COUNTER_COUNT];
+	};
+}
+
+#endif //_PERFCOUNTERS_H
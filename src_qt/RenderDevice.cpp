@@ -0,0 +1,313 @@
+/**
+	\file RenderDevice.cpp
+*/
+#include "RenderDevice.h"
+#include "SoundBase.h"
+#include "SoundLog.h"
+#include "SoundManager.h"
+#include "MixBus.h"
+#include "DspGraph.h"
+#include "PerfCounters.h"
+// Qt
+#include <QElapsedTimer>
+// Std
+#include <cstring>
+
+namespace CnotiAudio
+{
+/*!
+	Constructs a device to read the samples of \a sound, with the given \a parent.
+
+	The sound must exist while the device is opened.
+*/
+	RenderDevice::RenderDevice( SoundBase* sound, QObject* parent ) :
+		QIODevice( parent ),
+		_sound (sound),
+		_frequency (0),
+		_mixMode (MIX_MODE_LEGACY),
+		_samples (0),
+		_next (0),
+		_blockSamples (CS_RENDER_BLOCK),
+		_blockBytes (0),
+		_blockRead (0),
+		_graph (0)
+	{
+		if( _sound != 0 )
+		{
+			_frequency = _sound->getFrequency();
+		}
+	}
+
+/*!
+	Destroyes the device.
+*/
+	RenderDevice::~RenderDevice()
+	{
+		delete _graph;
+	}
+
+/*!
+	Opens the device in \a mode, that must be QIODevice::ReadOnly, and takes the tracks of the
+	sound. The device is always unbuffered, the blocks mixed are its buffer.
+
+	With SAMPLE_LOADING_SCORE the samples of the sound not loaded are loaded before.
+
+	Returns false if the device has no sound or \a mode is not ReadOnly.
+*/
+	bool RenderDevice::open( OpenMode mode )
+	{
+		if( _sound == 0 )
+		{
+			setErrorString( "No sound to render" );
+			return false;
+		}
+		if( ( mode & QIODevice::WriteOnly ) || !( mode & QIODevice::ReadOnly ) )
+		{
+			csWarning() << "[RenderDevice::open] The device can only be read";
+			setErrorString( "The device can only be read" );
+			return false;
+		}
+		SoundManager* soundMgr = SoundManager::instance();
+		if( soundMgr->getSampleLoading() == SAMPLE_LOADING_SCORE )
+		{
+			soundMgr->preloadSamples( _sound->sampleNames() );
+		}
+		_tracks = _sound->renderTracks();
+		_frequency = _sound->getFrequency();
+		_mixMode = soundMgr->getMixMode();
+		_samples = 0;
+		for( int i = 0; i < _tracks.size(); i++ )
+		{
+			_tracks[i].setPrefetch( soundMgr->getPrefetchNotes() );
+			_samples = qMax( _samples, _tracks[i].size() );
+		}
+		_next = 0;
+		_blockBytes = 0;
+		_blockRead = 0;
+		_block.resize( _blockSamples );
+		delete _graph;
+		_graph = 0;
+		if( _mixMode == MIX_MODE_GRAPH )
+		{
+			_graph = new DspGraph();
+			_graph->mixTracks( _tracks, soundMgr->getMixEffects() );
+			_scratch.clear();
+			if( !_graph->prepare( _frequency, _blockSamples ) )
+			{
+				csWarning() << "[RenderDevice::open] The mix graph can't be prepared, mixing with the bus";
+				delete _graph;
+				_graph = 0;
+				_mixMode = MIX_MODE_BUS;
+			}
+		}
+		if( _mixMode == MIX_MODE_BUS )
+		{
+			_scratch.resize( _tracks.size() * ( _blockSamples + 2 * MixBus::reach() ) );
+		}
+		else if( _mixMode == MIX_MODE_LEGACY )
+		{
+			_scratch.resize( qMax( _tracks.size() - 1, 0 ) * _blockSamples );
+		}
+		return QIODevice::open( mode | QIODevice::Unbuffered );
+	}
+
+/*!
+	Closes the device and releases the tracks and the blocks.
+*/
+	void RenderDevice::close()
+	{
+		QIODevice::close();
+		_tracks.clear();
+		_block.clear();
+		_scratch.clear();
+		delete _graph;
+		_graph = 0;
+		_samples = 0;
+		_next = 0;
+		_blockBytes = 0;
+		_blockRead = 0;
+	}
+
+/*!
+	Returns false, the device can seek.
+*/
+	bool RenderDevice::isSequential() const
+	{
+		return false;
+	}
+
+/*!
+	Returns the size of the sound in bytes, 0 if the device is not open.
+*/
+	qint64 RenderDevice::size() const
+	{
+		return _samples * (qint64)sizeof(short);
+	}
+
+/*!
+	Moves to the byte \a pos of the sound. The notes before are not mixed.
+
+	Returns false if \a pos is out of the sound.
+*/
+	bool RenderDevice::seek( qint64 pos )
+	{
+		if( !isOpen() || pos < 0 || pos > size() )
+		{
+			return false;
+		}
+		if( !QIODevice::seek( pos ) )
+		{
+			return false;
+		}
+		_next = pos / (qint64)sizeof(short);
+		for( int i = 0; i < _tracks.size(); i++ )
+		{
+			_tracks[i].seek( qMin( _next, _tracks[i].size() ) );
+		}
+		if( _graph != 0 )
+		{
+			_graph->seek( _next );
+		}
+		_blockBytes = 0;
+		_blockRead = 0;
+		if( pos % (qint64)sizeof(short) != 0 )
+		{
+			renderBlock();
+			_blockRead = 1;
+		}
+		return true;
+	}
+
+/*!
+	Returns the sound rendered by the device.
+*/
+	SoundBase* RenderDevice::sound() const
+	{
+		return _sound;
+	}
+
+/*!
+	Returns the frequency of the samples.
+*/
+	int RenderDevice::frequency() const
+	{
+		return _frequency;
+	}
+
+/*!
+	Sets the number of samples mixed at a time to \a samples. Changes when the device is
+	opened again.
+*/
+	void RenderDevice::setBlockSamples( int samples )
+	{
+		_blockSamples = qMax( samples, 64 );
+	}
+
+/*!
+	Returns the number of samples mixed at a time.
+*/
+	int RenderDevice::blockSamples() const
+	{
+		return _blockSamples;
+	}
+
+/*!
+	Reads up to \a maxSize bytes of the sound into \a data, mixing the blocks needed.
+
+	Returns the number of bytes read, 0 at the end of the sound.
+*/
+	qint64 RenderDevice::readData( char* data, qint64 maxSize )
+	{
+		qint64 copied = 0;
+		while( copied < maxSize )
+		{
+			if( _blockRead >= _blockBytes )
+			{
+				if( _next >= _samples )
+				{
+					break;
+				}
+				renderBlock();
+			}
+			int bytes = (int)qMin( qint64( _blockBytes - _blockRead ), maxSize - copied );
+			memcpy( data + copied, (const char*)_block.constData() + _blockRead, bytes );
+			_blockRead += bytes;
+			copied += bytes;
+		}
+		return copied;
+	}
+
+/*!
+	The device can't be written, returns -1.
+*/
+	qint64 RenderDevice::writeData( const char* data, qint64 maxSize )
+	{
+		Q_UNUSED( data );
+		Q_UNUSED( maxSize );
+		return -1;
+	}
+
+/*!
+	Mixes the next block of samples, as getData() mixes them: the first track as it is, the
+	others mixed with the result of the ones before.
+
+	In MIX_MODE_BUS the tracks are read from MixBus::reach() samples before the block to
+	MixBus::reach() samples after, for the limiter. In MIX_MODE_GRAPH the block is rendered
+	by the graph of the tracks, that keeps its state from a block to the next.
+*/
+	void RenderDevice::renderBlock()
+	{
+		QElapsedTimer renderTimer;
+		renderTimer.start();
+
+		int blockSamples = _block.size();
+		int samples = (int)qMin( qint64( blockSamples ), _samples - _next );
+		short* block = _block.data();
+		if( _tracks.isEmpty() || samples <= 0 )
+		{
+			_blockBytes = 0;
+			_blockRead = 0;
+			return;
+		}
+		QVector<MixTrack> mix;
+		if( _graph != 0 )
+		{
+			_graph->render( block, samples );
+		}
+		else if( _mixMode == MIX_MODE_BUS )
+		{
+			int reach = MixBus::reach();
+			qint64 start = qMax( _next - reach, qint64( 0 ) );
+			int context = (int)( qMin( _next + samples + reach, _samples ) - start );
+			mix.reserve( _tracks.size() );
+			for( int i = 0; i < _tracks.size(); i++ )
+			{
+				short* scratch = _scratch.data() + i * ( blockSamples + 2 * reach );
+				_tracks[i].seek( qMin( start, _tracks[i].size() ) );
+				int size = _tracks[i].read( scratch, context );
+				mix.append( MixTrack( scratch, size, _tracks[i].intensity() ) );
+			}
+			int from = (int)( _next - start );
+			MixBus::mix( block, mix, context, from, from + samples, start );
+		}
+		else
+		{
+			_tracks[0].read( block, samples );
+			mix.reserve( _tracks.size() - 1 );
+			for( int i = 1; i < _tracks.size(); i++ )
+			{
+				short* scratch = _scratch.data() + ( i - 1 ) * blockSamples;
+				int size = _tracks[i].read( scratch, samples );
+				mix.append( MixTrack( scratch, size, _tracks[i].intensity() ) );
+			}
+			SoundBase::mixTracks( block, mix, _tracks[0].intensity(), 0, samples );
+		}
+
+		_next += samples;
+		_blockBytes = samples * (int)sizeof(short);
+		_blockRead = 0;
+
+		PerfCounters::add( PERF_RENDERED_FRAMES, samples );
+		PerfCounters::add( PERF_RENDER_TIME_US, (int)( renderTimer.nsecsElapsed() / 1000 ) );
+	}
+}
@@ -0,0 +1,82 @@
+/*!
+ \class CnotiAudio::RenderDevice
+ \brief The RenderDevice class reads the samples of a sound as they are mixed.
+
+ The device mixes the tracks of the sound one block at a time, when the samples are read,
+ instead of mixing the whole sound with getData(). Only a block of samples and the samples
+ of the current notes are kept in memory. It can be given to QAudioOutput, an encoder, a
+ socket or a file.
+
+ The samples are 16 bits mono at the frequency of the sound, the same as getData(). The
+ tracks are taken from the sound when the device is opened: the changes made to the sound
+ after are not read.
+
+ The device must be used from the thread of the SoundManager.
+
+ \version 2.2
+ \date 19-10-2026
+ \file RenderDevice.h
+*/
+#if !defined(_RENDERDEVICE_H)
+#define _RENDERDEVICE_H
+
+#include <QIODevice>
+#include <QList>
+#include <QVector>
+
+#include "CnotiAudio.h"
+#include "TrackCursor.h"
+#include "soundmanager_global.h"
+
+namespace CnotiAudio
+{
+	#define CS_RENDER_BLOCK			(4096)		// Samples mixed at a time by the device
+
+	class SoundBase;
+	class DspGraph;
+
+	class SOUNDMANAGER_EXPORT RenderDevice : public QIODevice
+	{
+		Q_OBJECT
+
+	public:
+		RenderDevice( SoundBase* sound, QObject* parent = 0 );
+		~RenderDevice();
+
+		bool open( OpenMode mode );
+		void close();
+
+		bool isSequential() const;
+		qint64 size() const;
+		bool seek( qint64 pos );
+
+		SoundBase* sound() const;
+		int frequency() const;
+
+		void setBlockSamples( int samples );
+		int blockSamples() const;
+
+	protected:
+		qint64 readData( char* data, qint64 maxSize );
+		qint64 writeData( const char* data, qint64 maxSize );
+
+	private:
+		void renderBlock();
+
+		SoundBase*           _sound;
+		int                  _frequency;
+		EnumMixMode          _mixMode;			// Mix mode when the device was opened
+		QList<TrackCursor>   _tracks;			// First track, mixed with the others
+		qint64               _samples;			// Samples of the sound
+		qint64               _next;				// Next sample to mix
+		int                  _blockSamples;		// Samples mixed at a time
+
+		QVector<short>       _block;			// Samples mixed
+		QVector<short>       _scratch;			// Samples of the tracks mixed, one block for each
+		int                  _blockBytes;		// Bytes of the block mixed
+		int                  _blockRead;		// Bytes of the block already read
+		DspGraph*            _graph;			// Graph of the tracks in MIX_MODE_GRAPH, 0 in the other modes
+	};
+}
+
+#endif //_RENDERDEVICE_H
@@ -2,10 +2,14 @@
 #include <QFile>
 
 #include "SoundManager.h"
+#include "VoiceManager.h"
+#include "SoundLog.h"
 #include "Sample.h"
 #include "LogManager.h"
+#include "PerfCounters.h"
 
 #include <QDebug>
+#include <QMutexLocker>
 
 namespace CnotiAudio
 {
@@ -16,18 +20,34 @@ namespace CnotiAudio
 		: SoundBase( name )
 	{
 		_buffer		= 0;
-		_data		= 0;
 		_size		= 0;
+		_residency	= SAMPLE_RESIDENT_BOTH;
+		_format		= 0;
+		_alBytes	= 0;
+		_cpuBytes	= 0;
 	}
 
 /*!
 	Constructs a copy of other.
+
+	The copy shares the samples of \a other, so they are not counted again as resident. The
+	AL buffer of \a other can be deleted while the copy plays, so the copy creates its own
+	one when it is needed.
 */
 	Sample::Sample( Sample &other )
 		: SoundBase( other )
 	{
-		_buffer			= other._buffer;
+		_buffer			= 0;
 		_size			= other._size;
+		_residency		= other._residency;
+		_filename		= other._filename;
+		_format			= other._format;
+		_alBytes		= 0;
+		_cpuBytes		= 0;
+		if( _size > 0 )
+		{
+			PerfCounters::add( PERF_SAMPLES_LOADED );
+		}
 	}
 
 /*!
@@ -36,14 +56,24 @@ namespace CnotiAudio
 	Sample::Sample( Sample &other, const QString newName )
 		: SoundBase( other, newName )
 	{
-		_buffer			= other._buffer;
+		_buffer			= 0;
 		_size			= other._size;
+		_residency		= other._residency;
+		_filename		= other._filename;
+		_format			= other._format;
+		_alBytes		= 0;
+		_cpuBytes		= 0;
+		if( _size > 0 )
+		{
+			PerfCounters::add( PERF_SAMPLES_LOADED );
+		}
 	}
 /*!
 	Destroyes the sample.
 */
 	Sample::~Sample()
 	{
+		_soundMgr->checkInSources( this );
 		release();
 	}
 
@@ -56,46 +86,105 @@ namespace CnotiAudio
 		stopSound();
 //		_flagThreadSoundStopped = false;
 		//
-		// Delete buffer
+		// Delete buffer & samples, the samples are released when no copy uses them
 		//
-		alDeleteBuffers(1 , &_buffer);
-
-		_dataMutex.lock();
-//TODO: check why sometimes it gives error here
-		//if(_data)
-		//{
-		//	delete(_data);
-		//}
-		_dataMutex.unlock();
+		deleteBuffer();
+		setCpuData( PcmBuffer() );
 		//
 		// Resets data
 		//
+		if( _size > 0 )
+		{
+			PerfCounters::add( PERF_SAMPLES_LOADED, -1 );
+		}
 		_size = 0;
-		_buffer = 0;
 //		_iFrequency = 0;
 		_lastError = CS_NO_ERROR;
 	}
 
 /*!
 	Loads a sample from the file \a filename.
+
+	The samples are kept in an AL buffer, in memory or both, as set by setResidency(). The
+	file is kept to read the samples again when they are needed and not in memory.
 */
 	bool Sample::load( const QString filename )
 	{
-		alGetError();
 		//
-		// Removes the previous buffers and generates a new one
+		// Gets the samples from the file
 		//
-		alDeleteBuffers( 1, &_buffer );
+		PcmBuffer data;
+		ALenum format;
+		ALint frequency;
+		if( !decodeFile( filename, &data, &format, &frequency ) )
+		{
+			csDebug() << "[Sample::loadWav] " << "Error: loading file" << filename;
+			_lastError = CS_FILE_ERROR;
+			return false;
+		}
+		return load( filename, data, format, frequency );
+	}
+
+/*!
+	Loads the samples \a data, already read from the wav file \a filename by decodeFile(),
+	with their AL \a format and \a frequency.
+
+	Used to read the files in other threads, only the AL buffer is created in this one. Without
+	a \a filename the samples can't be read again, as the notes of the Synthesizer, and are
+	always kept in memory.
+
+	Returns true if it was successful, otherwise false.
+*/
+	bool Sample::load( const QString& filename, const PcmBuffer& data, ALenum format, ALint frequency )
+	{
 		alGetError();
-		alGenBuffers( 1, &_buffer );
-		if( alGetError() != AL_NO_ERROR )
+		//
+		// The previous data is no longer resident
+		//
+		deleteBuffer();
+		setCpuData( PcmBuffer() );
+		if( _size > 0 )
 		{
-			qDebug() << "[Sample::loadWav]"<< " Error: While creating AL buffer ";
+			PerfCounters::add( PERF_SAMPLES_LOADED, -1 );
+			_size = 0;
+		}
+		_format = format;
+		_iFrequency = frequency;
+		_filename = filename;
+		_size = data.size();
+		//
+		// Copies them to the AL buffer and keeps them, as needed
+		//
+		if( _residency != SAMPLE_RESIDENT_CPU && !uploadBuffer( data ) )
+		{
+			csDebug() << "[Sample::loadWav] " << "Error: Copying wave data to AL Buffer";
+			_size = 0;
+			_lastError = CS_AL_ERROR;
 			return false;
 		}
+		if( _residency != SAMPLE_RESIDENT_AL || _filename.isEmpty() )
+		{
+			setCpuData( data );
+		}
 
+		if( _size > 0 )
+		{
+			PerfCounters::add( PERF_SAMPLES_LOADED );
+		}
+		_lastError = CS_NO_ERROR;
+		return true;
+	}
+
+/*!
+	Reads the wav file \a filename into \a data, with its AL \a format and \a frequency.
+
+	Used to load the samples, and to read them again when they are not kept in memory.
+
+	Returns true if the file was read, otherwise false.
+*/
+	bool Sample::decodeFile( const QString& filename, PcmBuffer* data, ALenum* format, ALint* frequency )
+	{
 #if defined(__WIN32__) || defined(_WIN32) || defined(Q_WS_WIN) || defined(Q_WS_WIN32)
-		int				WaveID;
 		ALint			iDataSize;
 		ALenum			eBufferFormat;
 		ALchar			*pData;
@@ -108,99 +197,114 @@ namespace CnotiAudio
 		{
 			return false;
 		}
-		int i = alGetError();
 		//
 		// Tries to gets data from file
 		//
+		bool result = false;
 		if ((SUCCEEDED(waves.GetWaveSize(wId, (unsigned long*)&iDataSize))) &&
 			(SUCCEEDED(waves.GetWaveData(wId, (void**)&pData))) &&
-			(SUCCEEDED(waves.GetWaveFrequency(wId, (unsigned long*)&_iFrequency))) &&
+			(SUCCEEDED(waves.GetWaveFrequency(wId, (unsigned long*)frequency))) &&
 			(SUCCEEDED(waves.GetWaveALBufferFormat(wId, &alGetEnumValue, (unsigned long*)&eBufferFormat))))
 		{
+			*data = PcmBuffer((const short*)pData, iDataSize);
+			*format = eBufferFormat;
+			result = true;
+		}
+		//
+		// Releases wave file
+		//
+		waves.DeleteWaveFile(wId);
+		return result;
+#else
+		ALvoid* audioData;
+		ALsizei size;
+		ALsizei freq;
+		//
+		// get some audio data from a wave file
+		//
+		CFStringRef fileName = CFStringCreateWithCString( NULL, filename.toStdString().c_str(), kCFStringEncodingUTF8 );
+		CFStringRef fileNameEscaped = CFURLCreateStringByAddingPercentEscapes(NULL, fileName, NULL, NULL, kCFStringEncodingUTF8);
+		CFURLRef fileURL = CFURLCreateWithString(kCFAllocatorDefault, fileNameEscaped, NULL);
+		audioData = MyGetOpenALAudioData(fileURL, &size, format, &freq);
+		CFRelease(fileURL);
 
-			i = alGetError();
-			//
-			// Set XRAM Mode (if application)
-			//
-			if (eaxSetBufferMode && 0)
-				eaxSetBufferMode(1, &_buffer, 0);
+		if(audioData == NULL)
+		{
+			return false;
+		}
+		*data = PcmBuffer((const short*)audioData, size);
+		*frequency = freq;
+		//
+		// Release the audio data
+		//
+		free(audioData);
+		return true;
+#endif
+	}
 
-			i = alGetError();
-			//
-			// Gets data from file to buffer
-			//
-			alBufferData(_buffer, eBufferFormat, pData, iDataSize, _iFrequency);
-			if (alGetError() == AL_NO_ERROR)
-				_lastError = CS_NO_ERROR;
-			else
-			{
-				//CnotiLogManager::getSingleton().getLog(_logFile)->logMessage("[Sample::loadWav] Error: Copying wave data to AL Buffer");
-				qDebug() << "[Sample::loadWav] " << "Error: Copying wave data to AL Buffer";
-			}
-			//
-			// Copies data
-			//
-			_dataMutex.lock();
-			_data = new short[iDataSize];
-			memcpy(_data, (short*)pData, iDataSize);
-			_dataMutex.unlock();
-			_size = iDataSize;
-			//
-			// Releases wave file
-			//
-			waves.DeleteWaveFile(wId);
+/*!
+	Changes where the samples are kept to \a residency.
+
+	The samples no longer needed are released now, the ones missing are only read or copied
+	when they are needed. The samples without a file are kept in memory.
+*/
+	void Sample::setResidency( EnumSampleResidency residency )
+	{
+		_residency = residency;
+		if( _size == 0 )
+		{
+			return;
 		}
+		if( residency == SAMPLE_RESIDENT_AL && getBuffer() != 0 && !_filename.isEmpty() )
+		{
+			setCpuData( PcmBuffer() );
+		}
+		else if( residency == SAMPLE_RESIDENT_CPU && !_data.isEmpty() && isStopped() )
+		{
+			deleteBuffer();
+		}
+	}
 
-#else
-                ALenum  format;
-                ALvoid* data;
-                ALsizei size;
-                ALsizei freq;
-                //
-                // get some audio data from a wave file
-                //
-                CFStringRef fileName = CFStringCreateWithCString( NULL, filename.toStdString().c_str(), kCFStringEncodingUTF8 );
-                CFStringRef fileNameEscaped = CFURLCreateStringByAddingPercentEscapes(NULL, fileName, NULL, NULL, kCFStringEncodingUTF8);
-                CFURLRef fileURL = CFURLCreateWithString(kCFAllocatorDefault, fileNameEscaped, NULL);
-                data = MyGetOpenALAudioData(fileURL, &size, &format, &freq);
-                CFRelease(fileURL);
-
-				if(data == NULL)
-				{
-					qDebug() << "[Sample::loadWav] " << "Error: loading file" << filename;
-					return false;
-                }
-                //
-                // Copy data
-                //
-                _dataMutex.lock();
-                _data = new short[size];
-                memcpy(_data, (short*)data, size);
-                _dataMutex.unlock();
-                _size = size;
-                //
-                // Attach Audio Data to OpenAL Buffer
-                //
-                alBufferData(_buffer, format, data, size, freq);
-                //
-                // Release the audio data
-                //
-                free(data);
-
-                if(alGetError() != AL_NO_ERROR)
-				{
-					qDebug() << "Sample::loadWav] "<< "Error: Copying wave data to AL Buffer";
-                }
-                else
+/*!
+	Returns where the samples are kept.
+*/
+	EnumSampleResidency Sample::getResidency()
+	{
+		return _residency;
+	}
+
+/*!
+	Returns the samples of the sample.
+
+	If they are not in memory they are read again from the file. They are kept until the
+	residency is changed or the sample is released, but with SAMPLE_RESIDENT_AL, where they
+	are only returned.
+*/
+	PcmBuffer Sample::getData()
+	{
+		QMutexLocker locker( &_dataMutex );
+		if( _data.isEmpty() && _size > 0 && !_filename.isEmpty() )
+		{
+			PcmBuffer data;
+			ALenum format;
+			ALint frequency;
+			if( decodeFile( _filename, &data, &format, &frequency ) )
+			{
+				PerfCounters::add( PERF_SAMPLE_FETCHES );
+				if( _residency == SAMPLE_RESIDENT_AL )
 				{
-					_lastError = CS_NO_ERROR;
+					return data;
 				}
-#endif
-
-		if(_lastError == CS_NO_ERROR)
-			return true;
-		else
-			return false;
+				PerfCounters::add( PERF_BYTES_RESIDENT, (int)data.size() - _cpuBytes );
+				_cpuBytes = data.size();
+				_data = data;
+			}
+			else
+			{
+				csWarning() << "[Sample::getData] Not possible to read again the file" << _filename;
+			}
+		}
+		return _data;
 	}
 
 /*!
@@ -215,34 +319,53 @@ namespace CnotiAudio
 	\sa loadSound(), pauseSound() and stopSound().
 */
 	bool Sample::playSound( bool loop, bool blockSignal )
+	{
+		return playSound( _priority, loop, blockSignal );
+	}
+
+/*!
+	Plays the sample previously loaded, with a sound source of priority \a priority.
+
+	The priority is only used by this play, the priority of the sample is not changed.
+
+	\sa setPriority()
+*/
+	bool Sample::playSound( EnumVoicePriority priority, bool loop, bool blockSignal )
 	{
 		_loop = loop;
 		blockSignals( blockSignal );
 
 		ALenum error = alGetError();
 
-		// Gets a new source
-		_uiSource = _soundMgr->checkOutSource();
-
-		if( isPlaying() )
+		// Stops the sample if is playing, returning its source
+		if( !isStopped() )
 		{
 			stopSound();
 		}
 
+		// Gets a new source
+		_uiSource = _soundMgr->checkOutSource( this, priority );
+		if( _uiSource == 0 )
+		{
+			csWarning() << "[Sample::playSound] No sound source available to play" << _name;
+			_lastError = CS_AL_ERROR;
+			return false;
+		}
+
 		// Set intensity
 		alGetError(); // clean previous errors
 		alSourcef( _uiSource, AL_GAIN, _intensity );
 		error = alGetError();
 		if( error != AL_NO_ERROR )
 		{
-			qWarning() << "[Sample::playSound] Not possible to change the Intensity to:" << _intensity << alGetString( error );
+			csWarning() << "[Sample::playSound] Not possible to change the Intensity to:" << _intensity << alGetString( error );
 		}
 
 		// Set buffer to be played
-		alSourcei( _uiSource, AL_BUFFER, _buffer );
+		alSourcei( _uiSource, AL_BUFFER, getBuffer() );
 		if( error = alGetError() != AL_NO_ERROR )
 		{
-			qDebug() << "[Sample::playSound] " << "Error: Associate a Buffer to a Source";
+			csDebug() << "[Sample::playSound] " << "Error: Associate a Buffer to a Source";
 		}
 
 		//
@@ -257,7 +380,7 @@ namespace CnotiAudio
 		alSourcePlay( _uiSource );
 		if(alGetError() != AL_NO_ERROR)
 		{
-			qDebug() << "[Sample::playSound]" << " Error: CS_AL_ERROR - not possible to alSourcePlay";
+			csDebug() << "[Sample::playSound]" << " Error: CS_AL_ERROR - not possible to alSourcePlay";
 
 			stopSound();
 			_lastError = CS_AL_ERROR;
@@ -268,7 +391,7 @@ namespace CnotiAudio
 		emit soundPlaying( _name );
 		if(!signalsBlocked())
 		{
-			qDebug() << "[Sample::playSound]"<< " emit soundPlaying of sound: "<< _name;
+			csDebug() << "[Sample::playSound]"<< " emit soundPlaying of sound: "<< _name;
 		}
 
 		//
@@ -312,7 +435,7 @@ namespace CnotiAudio
 
 			if(!signalsBlocked())
 			{
-				qDebug() << "[Sample::pauseSound]" << " emit soundPaused of sound: "<< _name;
+				csDebug() << "[Sample::pauseSound]" << " emit soundPaused of sound: "<< _name;
 			}
 			emit soundPaused( _name );
 			_lastError = CS_NO_ERROR;
@@ -330,7 +453,7 @@ namespace CnotiAudio
 				start();
 				if(!signalsBlocked())
 				{
-					qDebug() << "[Sample::pauseSound]" << " emit soundPlaying of sound: "<< _name;
+					csDebug() << "[Sample::pauseSound]" << " emit soundPlaying of sound: "<< _name;
 				}
 				emit soundPlaying( _name );
 				_lastError = CS_NO_ERROR;
@@ -363,9 +486,10 @@ namespace CnotiAudio
 			//
 			// Disables looping for this source
 			//
-			if( _uiSource )
+			VoiceManager::SourceGuard guard( _soundMgr->getVoiceManager(), _uiSource, this );
+			if( guard.source() )
 			{
-				alSourcei( _uiSource, AL_LOOPING, AL_FALSE );
+				alSourcei( guard.source(), AL_LOOPING, AL_FALSE );
 			}
 		}
 
@@ -376,27 +500,31 @@ namespace CnotiAudio
 			//
 			if( _uiSource )
 			{
-				if( !isStopped() )
+				int error = AL_NO_ERROR;
 				{
-					int error = alGetError(); // clear last error
-					// Stop source
-					alSourceStop( _uiSource );
-					error = alGetError();
-					if( error != AL_NO_ERROR )
+					VoiceManager::SourceGuard guard( _soundMgr->getVoiceManager(), _uiSource, this );
+					if( guard.source() && !isStopped() )
 					{
-						qWarning() << "[Sample::stopSound] ERROR stop playing " << error;
-						_soundMgr->checkInSource( _uiSource );
-						return false;
+						error = alGetError(); // clear last error
+						// Stop source
+						alSourceStop( guard.source() );
+						error = alGetError();
 					}
 				}
-				_soundMgr->checkInSource( _uiSource );
+				if( error != AL_NO_ERROR )
+				{
+					csWarning() << "[Sample::stopSound] ERROR stop playing " << error;
+					_soundMgr->checkInSource( _uiSource, this );
+					return false;
+				}
+				_soundMgr->checkInSource( _uiSource, this );
 				_uiSource = 0;
 			}
 			_flagThreadSoundStopped = true;
 			_stopped = true;
 			if(!signalsBlocked())
 			{
-				qDebug() << "[Sample::stopSound()]"<< " emit soundStopped of sound: "<< _name;
+				csDebug() << "[Sample::stopSound()]"<< " emit soundStopped of sound: "<< _name;
 			}
 			emit soundStopped( _name );
 			return true;
@@ -413,17 +541,83 @@ namespace CnotiAudio
 */
 	bool Sample::isEmpty()
 	{
-		return _data == 0;
+		return _size == 0;
 	}
 
 /*!
 	Returns the sample buffer.
+
+	If the samples are only kept in memory, they are copied to a new AL buffer.
 */
 	ALuint Sample::getBuffer()
 	{
+		if( _buffer == 0 && _size > 0 )
+		{
+			PcmBuffer data = getData();
+			if( !uploadBuffer( data ) )
+			{
+				csWarning() << "[Sample::getBuffer] Not possible to create the AL buffer of" << _name;
+			}
+		}
 		return _buffer;
 	}
 
+/*!
+	Copies \a data to a new AL buffer, replacing the previous one.
+
+	Returns true if the buffer was created, otherwise false.
+*/
+	bool Sample::uploadBuffer( const PcmBuffer& data )
+	{
+		deleteBuffer();
+		if( data.isEmpty() )
+		{
+			return false;
+		}
+		alGetError();
+		alGenBuffers( 1, &_buffer );
+		if( alGetError() != AL_NO_ERROR )
+		{
+			csDebug() << "[Sample::uploadBuffer]"<< " Error: While creating AL buffer ";
+			_buffer = 0;
+			return false;
+		}
+		alBufferData( _buffer, _format, data.constData(), data.size(), _iFrequency );
+		if( alGetError() != AL_NO_ERROR )
+		{
+			deleteBuffer();
+			return false;
+		}
+		_alBytes = data.size();
+		PerfCounters::add( PERF_BYTES_AL, _alBytes );
+		return true;
+	}
+
+/*!
+	Deletes the AL buffer, if it was created by this sample.
+*/
+	void Sample::deleteBuffer()
+	{
+		if( _buffer != 0 && _alBytes > 0 )
+		{
+			alDeleteBuffers( 1, &_buffer );
+			PerfCounters::add( PERF_BYTES_AL, -_alBytes );
+		}
+		_buffer = 0;
+		_alBytes = 0;
+	}
+
+/*!
+	Keeps \a data as the samples in memory, updating the bytes resident.
+*/
+	void Sample::setCpuData( const PcmBuffer& data )
+	{
+		QMutexLocker locker( &_dataMutex );
+		_data = data;
+		PerfCounters::add( PERF_BYTES_RESIDENT, (int)data.size() - _cpuBytes );
+		_cpuBytes = data.size();
+	}
+
 /*!
 	Compares two samples.
 
@@ -452,7 +646,18 @@ namespace CnotiAudio
 */
 	float Sample::percentPlay()
 	{
-		return (_currTime*1.0) / (_totalDuration*1.0);
+		return playPosition().percent();
+	}
+
+/*!
+	Returns the position of the sample being played, from the offset of its sound source.
+*/
+	PlayPosition Sample::playPosition()
+	{
+		PlayPosition position = SoundBase::playPosition();
+		int frameBytes = ( _format == AL_FORMAT_STEREO16 ) ? 4 : ( _format == AL_FORMAT_MONO8 ) ? 1 : 2;
+		position.frames = _size / frameBytes;
+		return position;
 	}
 
 /*!
@@ -476,7 +681,7 @@ namespace CnotiAudio
 		if( isStopped() )
 		{
 //            if( !_flagThreadSoundStopped ) { // Check if was not manually stopped previously
-			qDebug() << "[Sample::update()]"<< " --------- Going to stop sound: "<< _name;
+			csDebug() << "[Sample::update()]"<< " --------- Going to stop sound: "<< _name;
 			stopSound();
 //            }
 		}
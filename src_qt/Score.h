@@ -0,0 +1,91 @@
+/*!
+ \file Score.h
+ \brief Plain description of the notes of a Sound or a Music, without any sound data.
+
+ A score is read and written by ScoreXml, ScoreBinary or ScoreMidi, and given to
+ Sound::setScore() or Music::setScore() to build the sound.
+
+ As in the sound files, the notes of the melodies after the first of a SCORE_SOUND are a
+ semitone higher than the ones played. Sound::setScore() and Sound::score() move them.
+
+ \version 2.2
+ \date 19-10-2026
+*/
+#if !defined(_SCORE_H)
+#define _SCORE_H
+
+#include <QString>
+#include <QList>
+#include <QVector>
+
+#include "CnotiAudio.h"
+
+namespace CnotiAudio
+{
+	enum EnumScoreKind{
+		SCORE_SOUND = 0,	// Sound xml file, with several melodies
+		SCORE_MUSIC			// Music xml file, with one melody and rhythms
+	};
+
+	struct ScoreNote
+	{
+		DurationType  duration;
+		NoteType      height;
+		int           octave;
+		int           intensity;	// Not used yet, only kept from the sound files
+		int           position;		// Not used yet, only kept from the sound files
+
+		ScoreNote( DurationType d = CROTCHET, NoteType h = PAUSE, int o = OCTAVE_C3 ) :
+			duration(d), height(h), octave(o), intensity(127), position(-1) {}
+
+		//
+		// Moves the note \a semitones up or down, through the octaves. Pauses are not moved.
+		//
+		void transpose( int semitones )
+		{
+			if( height < DO || height > SI )
+			{
+				return;
+			}
+			int key = octave * CS_NUMBERNOTE + height + semitones;
+			octave = ( key >= 0 ) ? key / CS_NUMBERNOTE : -( ( CS_NUMBERNOTE - 1 - key ) / CS_NUMBERNOTE );
+			height = (NoteType)( key - octave * CS_NUMBERNOTE );
+		}
+	};
+
+	struct ScoreMelody
+	{
+		EnumInstrument      instrument;
+		CompassType         compass;
+		QVector<ScoreNote>  notes;
+		QList<int>          breakLines;		// Graphical break lines, only kept in the binary files
+
+		ScoreMelody( EnumInstrument i = INSTRUMENT_UNKNOWN, CompassType c = quaternario_simples ) :
+			instrument(i), compass(c) {}
+	};
+
+	struct ScoreRhythm
+	{
+		EnumRhythmInstrument  instrument;
+		EnumRhythmVariation   variation;
+
+		ScoreRhythm( EnumRhythmInstrument i = RHYTHM_INST_UNKNOWN, EnumRhythmVariation v = RHYTHM_UNKNOWN ) :
+			instrument(i), variation(v) {}
+	};
+
+	struct ScoreData
+	{
+		EnumScoreKind       kind;
+		QString             name;
+		TempoType           tempo;
+		int                 duration;			// Duration chosen for a new sound, 0 if none
+		int                 representation;		// Graphical representation of a music, -1 if none
+		QList<ScoreMelody>  melodies;
+		QList<ScoreRhythm>  rhythms;
+
+		ScoreData( EnumScoreKind k = SCORE_SOUND ) :
+			kind(k), tempo(TEMPO_UNKNOWN), duration(0), representation(-1) {}
+	};
+}
+
+#endif //_SCORE_H
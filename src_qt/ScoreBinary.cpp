@@ -0,0 +1,378 @@
+/**
+	\file ScoreBinary.cpp
+*/
+#include "ScoreBinary.h"
+#include "ScoreXml.h"
+#include "ScoreMidi.h"
+// Qt
+#include <QFile>
+#include <QtEndian>
+// Std
+#include <cstring>
+
+namespace CnotiAudio
+{
+	static const char scoreMagic[4] = { 'C', 'S', 'B', 'F' };
+
+	static const int headerSize = 16;
+	static const int scoreSize = 24;
+	static const int melodySize = 16;
+	static const int noteSize = 4;
+	static const int rhythmSize = 4;
+
+	//
+	// Reads the little endian values of a buffer, checking its size
+	//
+	class BinaryCursor
+	{
+	public:
+		BinaryCursor( const uchar* data, qint64 size ) : _data(data), _size(size), _pos(0) {}
+
+		bool has( qint64 bytes ) const { return bytes >= 0 && _pos + bytes <= _size; }
+		const uchar* current() const { return _data + _pos; }
+		void skip( qint64 bytes ) { _pos += bytes; }
+		qint64 pos() const { return _pos; }
+
+		quint32 u32() { quint32 v = qFromLittleEndian<quint32>( _data + _pos ); _pos += 4; return v; }
+		qint32 i32() { qint32 v = qFromLittleEndian<qint32>( _data + _pos ); _pos += 4; return v; }
+		quint16 u16() { quint16 v = qFromLittleEndian<quint16>( _data + _pos ); _pos += 2; return v; }
+
+	private:
+		const uchar* _data;
+		qint64       _size;
+		qint64       _pos;
+	};
+
+	//
+	// Appends little endian values to a buffer
+	//
+	static void putU32( QByteArray& buffer, quint32 value )
+	{
+		uchar bytes[4];
+		qToLittleEndian<quint32>( value, bytes );
+		buffer.append( (const char*)bytes, 4 );
+	}
+
+	static void putU16( QByteArray& buffer, quint16 value )
+	{
+		uchar bytes[2];
+		qToLittleEndian<quint16>( value, bytes );
+		buffer.append( (const char*)bytes, 2 );
+	}
+
+	static int padding( int size )
+	{
+		return ( 4 - ( size % 4 ) ) % 4;
+	}
+
+	static bool fail( QString* error, const QString& message )
+	{
+		if( error )
+		{
+			*error = message;
+		}
+		return false;
+	}
+
+/*!
+	Reads the score of the binary file \a filename to \a score, mapping the file in memory.
+
+	Returns false if the file couldn't be read or is not valid, the reason is given in \a error.
+*/
+	bool ScoreBinary::read( const QString& filename, ScoreData* score, QString* error )
+	{
+		QFile file( filename );
+		if( !file.open( QIODevice::ReadOnly ) )
+		{
+			return fail( error, QString( "%1: %2" ).arg( filename ).arg( file.errorString() ) );
+		}
+		qint64 size = file.size();
+		uchar* data = file.map( 0, size );
+		if( data != NULL )
+		{
+			bool result = read( data, size, score, error );
+			file.unmap( data );
+			return result;
+		}
+		//
+		// Some files can't be mapped
+		//
+		QByteArray content = file.readAll();
+		return read( (const uchar*)content.constData(), content.size(), score, error );
+	}
+
+/*!
+	Reads the score in the \a size bytes of \a data to \a score.
+
+	Returns false if the data is not valid, the reason is given in \a error.
+*/
+	bool ScoreBinary::read( const uchar* data, qint64 size, ScoreData* score, QString* error )
+	{
+		BinaryCursor cursor( data, size );
+		//
+		// Header
+		//
+		if( !cursor.has( headerSize ) || memcmp( data, scoreMagic, 4 ) != 0 )
+		{
+			return fail( error, "Not a binary score" );
+		}
+		cursor.skip( 4 );
+		quint16 version = cursor.u16();
+		quint16 kind = cursor.u16();
+		quint32 payloadSize = cursor.u32();
+		quint16 checksum = cursor.u16();
+		cursor.skip( 2 );
+		if( version != CS_SCORE_BINARY_VERSION )
+		{
+			return fail( error, QString( "Binary score version %1 is not supported" ).arg( version ) );
+		}
+		if( kind != SCORE_SOUND && kind != SCORE_MUSIC )
+		{
+			return fail( error, QString( "Unknown kind of score %1" ).arg( kind ) );
+		}
+		if( !cursor.has( payloadSize ) )
+		{
+			return fail( error, "Binary score is truncated" );
+		}
+		if( qChecksum( (const char*)cursor.current(), payloadSize ) != checksum )
+		{
+			return fail( error, "Binary score checksum doesn't match" );
+		}
+		BinaryCursor payload( cursor.current(), payloadSize );
+		//
+		// Score
+		//
+		*score = ScoreData( (EnumScoreKind)kind );
+		if( !payload.has( scoreSize ) )
+		{
+			return fail( error, "Binary score is truncated" );
+		}
+		score->tempo = (TempoType)payload.i32();
+		score->duration = payload.i32();
+		score->representation = payload.i32();
+		quint32 nameSize = payload.u32();
+		quint32 melodyCount = payload.u32();
+		quint32 rhythmCount = payload.u32();
+		if( !payload.has( (qint64)nameSize + padding( nameSize ) ) )
+		{
+			return fail( error, "Binary score is truncated" );
+		}
+		score->name = QString::fromUtf8( (const char*)payload.current(), nameSize );
+		payload.skip( nameSize + padding( nameSize ) );
+		//
+		// Melodies, a music has one at least
+		//
+		if( kind == SCORE_MUSIC && melodyCount == 0 )
+		{
+			return fail( error, "Binary score has no melody" );
+		}
+		for( quint32 i = 0; i < melodyCount; ++i )
+		{
+			if( !payload.has( melodySize ) )
+			{
+				return fail( error, QString( "Binary score is truncated in melody %1" ).arg( i ) );
+			}
+			EnumInstrument instrument = (EnumInstrument)payload.i32();
+			CompassType compass = (CompassType)payload.i32();
+			ScoreMelody melody( instrument, compass );
+			quint32 noteCount = payload.u32();
+			quint32 breakLineCount = payload.u32();
+			if( !payload.has( (qint64)noteCount * noteSize + (qint64)breakLineCount * 4 ) )
+			{
+				return fail( error, QString( "Binary score is truncated in melody %1" ).arg( i ) );
+			}
+			//
+			// Fixed width records, read straight from the data
+			//
+			melody.notes.resize( noteCount );
+			ScoreNote* notes = melody.notes.data();
+			const uchar* record = payload.current();
+			for( quint32 j = 0; j < noteCount; ++j, record += noteSize )
+			{
+				notes[j].duration = (DurationType)qFromLittleEndian<quint16>( record );
+				notes[j].height = (NoteType)(qint8)record[2];
+				notes[j].octave = (qint8)record[3];
+			}
+			payload.skip( (qint64)noteCount * noteSize );
+
+			melody.breakLines.reserve( breakLineCount );
+			for( quint32 j = 0; j < breakLineCount; ++j )
+			{
+				melody.breakLines.append( payload.i32() );
+			}
+			score->melodies.append( melody );
+		}
+		//
+		// Rhythms
+		//
+		if( !payload.has( (qint64)rhythmCount * rhythmSize ) )
+		{
+			return fail( error, "Binary score is truncated in the rhythms" );
+		}
+		for( quint32 i = 0; i < rhythmCount; ++i )
+		{
+			EnumRhythmInstrument instrument = (EnumRhythmInstrument)payload.u16();
+			EnumRhythmVariation variation = (EnumRhythmVariation)payload.u16();
+			score->rhythms.append( ScoreRhythm( instrument, variation ) );
+		}
+		return true;
+	}
+
+/*!
+	Writes \a score to the binary file \a filename.
+
+	Returns false if the file couldn't be written.
+*/
+	bool ScoreBinary::write( const QString& filename, const ScoreData& score )
+	{
+		QFile file( filename );
+		if( !file.open( QIODevice::WriteOnly | QIODevice::Truncate ) )
+		{
+			return false;
+		}
+		QByteArray data = toByteArray( score );
+		return file.write( data ) == data.size();
+	}
+
+/*!
+	Returns \a score in the binary format.
+*/
+	QByteArray ScoreBinary::toByteArray( const ScoreData& score )
+	{
+		QByteArray name = score.name.toUtf8();
+		//
+		// Size of the payload, to allocate it only once
+		//
+		int size = scoreSize + name.size() + padding( name.size() ) + score.rhythms.size() * rhythmSize;
+		for( int i = 0; i < score.melodies.size(); ++i )
+		{
+			size += melodySize + score.melodies[i].notes.size() * noteSize + score.melodies[i].breakLines.size() * 4;
+		}
+		QByteArray payload;
+		payload.reserve( size );
+
+		putU32( payload, score.tempo );
+		putU32( payload, score.duration );
+		putU32( payload, score.representation );
+		putU32( payload, name.size() );
+		putU32( payload, score.melodies.size() );
+		putU32( payload, score.rhythms.size() );
+		payload.append( name );
+		payload.append( QByteArray( padding( name.size() ), '\0' ) );
+
+		for( int i = 0; i < score.melodies.size(); ++i )
+		{
+			const ScoreMelody& melody = score.melodies[i];
+			putU32( payload, melody.instrument );
+			putU32( payload, melody.compass );
+			putU32( payload, melody.notes.size() );
+			putU32( payload, melody.breakLines.size() );
+			for( int j = 0; j < melody.notes.size(); ++j )
+			{
+				putU16( payload, melody.notes[j].duration );
+				payload.append( (char)(qint8)melody.notes[j].height );
+				payload.append( (char)(qint8)melody.notes[j].octave );
+			}
+			for( int j = 0; j < melody.breakLines.size(); ++j )
+			{
+				putU32( payload, melody.breakLines[j] );
+			}
+		}
+		for( int i = 0; i < score.rhythms.size(); ++i )
+		{
+			putU16( payload, score.rhythms[i].instrument );
+			putU16( payload, score.rhythms[i].variation );
+		}
+
+		QByteArray data;
+		data.reserve( headerSize + payload.size() );
+		data.append( scoreMagic, 4 );
+		putU16( data, CS_SCORE_BINARY_VERSION );
+		putU16( data, score.kind );
+		putU32( data, payload.size() );
+		putU16( data, qChecksum( payload.constData(), payload.size() ) );
+		putU16( data, 0 );
+		data.append( payload );
+		return data;
+	}
+
+/*!
+	Reads only the header of the binary file \a filename, to find the kind of score in \a kind.
+
+	Returns false if the file is not a binary score.
+*/
+	bool ScoreBinary::peekKind( const QString& filename, EnumScoreKind* kind )
+	{
+		QFile file( filename );
+		if( !file.open( QIODevice::ReadOnly ) )
+		{
+			return false;
+		}
+		QByteArray header = file.read( headerSize );
+		if( header.size() < headerSize || memcmp( header.constData(), scoreMagic, 4 ) != 0 )
+		{
+			return false;
+		}
+		quint16 value = qFromLittleEndian<quint16>( (const uchar*)header.constData() + 6 );
+		if( value != SCORE_SOUND && value != SCORE_MUSIC )
+		{
+			return false;
+		}
+		*kind = (EnumScoreKind)value;
+		return true;
+	}
+
+/*!
+	Returns true if \a filename has the extension of the binary scores.
+*/
+	bool ScoreBinary::isBinary( const QString& filename )
+	{
+		return filename.endsWith( ".csb", Qt::CaseInsensitive );
+	}
+
+/*!
+	Converts the score file \a from to the file \a to, the format of each one is given by its
+	extension. If \a from is a xml file, it must have a score of kind \a kind, if it is a MIDI
+	file it is read as a score of kind \a kind.
+
+	Returns false if the conversion failed, the reason is given in \a error.
+*/
+	bool ScoreBinary::convert( const QString& from, const QString& to, EnumScoreKind kind, QString* error )
+	{
+		ScoreData score;
+		bool result;
+		if( isBinary( from ) )
+		{
+			result = read( from, &score, error );
+		}
+		else if( ScoreMidi::isMidi( from ) )
+		{
+			result = ScoreMidi::read( from, kind, &score, error );
+		}
+		else
+		{
+			result = ScoreXml::read( from, kind, &score, error );
+		}
+		if( !result )
+		{
+			return false;
+		}
+		if( isBinary( to ) )
+		{
+			result = write( to, score );
+		}
+		else if( ScoreMidi::isMidi( to ) )
+		{
+			result = ScoreMidi::write( to, score );
+		}
+		else
+		{
+			result = ScoreXml::write( to, score );
+		}
+		if( !result )
+		{
+			return fail( error, QString( "%1: can't be written" ).arg( to ) );
+		}
+		return true;
+	}
+}
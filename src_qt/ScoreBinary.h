@@ -0,0 +1,52 @@
+/*!
+ \class CnotiAudio::ScoreBinary
+ \brief The ScoreBinary class reads and writes the scores in the compact binary format (.csb).
+
+ The binary format keeps the same information as the xml files, plus the break lines of
+ the melodies, and is used for the score cache and the autosave. All the values are little
+ endian and aligned to 4 bytes, so the file is read straight from a memory map:
+
+ \list
+ \o Header, 16 bytes: magic "CSBF", version, kind of score, payload size and the
+	qChecksum() of the payload.
+ \o Score, 24 bytes: tempo, duration, representation, name size, number of melodies and
+	number of rhythms, followed by the name in UTF-8, padded to 4 bytes.
+ \o Each melody, 16 bytes: instrument, compass, number of notes and number of break lines,
+	followed by the notes, 4 bytes each (duration, height and octave), and by the break lines.
+ \o Each rhythm, 4 bytes: instrument and variation.
+ \endlist
+
+ The intensity and the position of the notes are not kept, as in the xml files saved.
+
+ \version 2.2
+ \date 19-10-2026
+ \file ScoreBinary.h
+*/
+#if !defined(_SCOREBINARY_H)
+#define _SCOREBINARY_H
+
+#include <QString>
+#include <QByteArray>
+
+#include "Score.h"
+#include "soundmanager_global.h"
+
+namespace CnotiAudio
+{
+	#define CS_SCORE_BINARY_VERSION		(1)
+
+	class SOUNDMANAGER_EXPORT ScoreBinary
+	{
+	public:
+		static bool read( const QString& filename, ScoreData* score, QString* error = 0 );
+		static bool read( const uchar* data, qint64 size, ScoreData* score, QString* error = 0 );
+		static bool write( const QString& filename, const ScoreData& score );
+		static QByteArray toByteArray( const ScoreData& score );
+
+		static bool peekKind( const QString& filename, EnumScoreKind* kind );
+		static bool isBinary( const QString& filename );
+		static bool convert( const QString& from, const QString& to, EnumScoreKind kind = SCORE_SOUND, QString* error = 0 );
+	};
+}
+
+#endif //_SCOREBINARY_H
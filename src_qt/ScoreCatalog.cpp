@@ -0,0 +1,461 @@
+/**
+	\file ScoreCatalog.cpp
+*/
+#include "ScoreCatalog.h"
+#include "ScoreXml.h"
+#include "ScoreBinary.h"
+#include "ScoreMidi.h"
+#include "SoundLog.h"
+// Qt
+#include <QtConcurrentMap>
+#include <QReadLocker>
+#include <QWriteLocker>
+// Std
+#include <algorithm>
+
+namespace CnotiAudio
+{
+	//
+	// Interval codes of the tokens, the intervals are between 2 and 254
+	//
+	static const quint32 intervalRest = 0;		// The note is a pause
+	static const quint32 intervalNone = 1;		// There is no note before to compare
+	static const int intervalMax = 126;
+
+	//
+	// Score read and tokenized by a worker thread
+	//
+	struct ParsedScore
+	{
+		bool                        ok;
+		QString                     filename;
+		QString                     name;
+		EnumScoreKind               kind;
+		QList< QVector<quint32> >   melodies;
+	};
+
+	struct ScoreParser
+	{
+		typedef ParsedScore result_type;
+
+		ScoreParser( EnumScoreKind kind ) : _kind(kind) {}
+
+		ParsedScore operator()( const QString& filename ) const
+		{
+			ParsedScore parsed;
+			parsed.filename = filename;
+			ScoreData data;
+			QString error;
+			if( ScoreBinary::isBinary( filename ) )
+			{
+				parsed.ok = ScoreBinary::read( filename, &data, &error );
+			}
+			else if( ScoreMidi::isMidi( filename ) )
+			{
+				parsed.ok = ScoreMidi::read( filename, _kind, &data, &error );
+			}
+			else
+			{
+				parsed.ok = ScoreXml::read( filename, _kind, &data, &error );
+			}
+			if( !parsed.ok )
+			{
+				csWarning() << "[ScoreCatalog::addFiles]" << filename << error;
+				return parsed;
+			}
+			parsed.name = data.name;
+			parsed.kind = data.kind;
+			for( int i = 0; i < data.melodies.size(); i++ )
+			{
+				parsed.melodies.append( ScoreCatalog::tokens( data.melodies[i].notes ) );
+			}
+			return parsed;
+		}
+
+		EnumScoreKind _kind;
+	};
+
+/*!
+	Creates an empty catalog.
+*/
+	ScoreCatalog::ScoreCatalog()
+	{
+	}
+
+/*!
+	Adds the melodies of \a score to the catalog, \a filename is kept to identify the score.
+
+	Returns the id of the score in the catalog.
+*/
+	int ScoreCatalog::addScore( const ScoreData& score, const QString& filename )
+	{
+		QList< QVector<quint32> > melodies;
+		for( int i = 0; i < score.melodies.size(); i++ )
+		{
+			melodies.append( tokens( score.melodies[i].notes ) );
+		}
+
+		QWriteLocker locker( &_lock );
+		CatalogScore catalogScore;
+		catalogScore.filename = filename;
+		catalogScore.name = score.name;
+		catalogScore.kind = score.kind;
+		_scores.append( catalogScore );
+		int id = _scores.size() - 1;
+		for( int i = 0; i < melodies.size(); i++ )
+		{
+			insertMelody( id, i, melodies[i] );
+		}
+		return id;
+	}
+
+/*!
+	Reads the score \a files, xml or binary, and adds them to the catalog. The xml files must
+	have scores of kind \a kind.
+
+	The files are read in parallel, in the global QThreadPool, and added to the index in the
+	order given. The files that couldn't be read are skipped.
+
+	Returns the number of scores added.
+*/
+	int ScoreCatalog::addFiles( const QStringList& files, EnumScoreKind kind )
+	{
+		QList<ParsedScore> parsed = QtConcurrent::blockingMapped< QList<ParsedScore> >( files, ScoreParser( kind ) );
+
+		QWriteLocker locker( &_lock );
+		int added = 0;
+		for( int i = 0; i < parsed.size(); i++ )
+		{
+			if( !parsed[i].ok )
+			{
+				continue;
+			}
+			CatalogScore catalogScore;
+			catalogScore.filename = parsed[i].filename;
+			catalogScore.name = parsed[i].name;
+			catalogScore.kind = parsed[i].kind;
+			_scores.append( catalogScore );
+			int id = _scores.size() - 1;
+			for( int j = 0; j < parsed[i].melodies.size(); j++ )
+			{
+				insertMelody( id, j, parsed[i].melodies[j] );
+			}
+			added++;
+		}
+		csDebug() << "[ScoreCatalog::addFiles]" << added << "of" << files.size() << "scores added";
+		return added;
+	}
+
+/*!
+	Removes all the scores of the catalog.
+*/
+	void ScoreCatalog::clear()
+	{
+		QWriteLocker locker( &_lock );
+		_scores.clear();
+		_melodies.clear();
+		_index.clear();
+		_fingerprints.clear();
+	}
+
+/*!
+	Returns where \a phrase is found in the melodies of the catalog, in any transposition.
+	The search stops after \a maxResults matches, if it is not -1.
+
+	A phrase must have at least 2 notes after its first pauses, which are skipped. The matches
+	start at the first note of the phrase.
+*/
+	QList<ScoreMatch> ScoreCatalog::findPhrase( const QVector<ScoreNote>& phrase, int maxResults ) const
+	{
+		QList<ScoreMatch> matches;
+		QVector<quint32> query = tokens( phrase );
+		query.remove( 0, leadingTokens( query ) );
+		if( query.isEmpty() )
+		{
+			return matches;
+		}
+
+		QReadLocker locker( &_lock );
+		//
+		// Short phrases don't have n-grams, all the melodies are checked
+		//
+		if( query.size() < CS_CATALOG_NGRAM )
+		{
+			for( int i = 0; i < _melodies.size(); i++ )
+			{
+				if( !contains( _melodies[i], query, maxResults, &matches ) )
+				{
+					break;
+				}
+			}
+			return matches;
+		}
+		//
+		// Melodies of each n-gram of the phrase, the phrase can only be in the ones
+		// that have all the n-grams
+		//
+		QVector<const QVector<int>*> postings;
+		for( int i = 0; i + CS_CATALOG_NGRAM <= query.size(); i++ )
+		{
+			QHash<quint64, QVector<int> >::const_iterator it = _index.constFind( ngram( query.constData() + i, CS_CATALOG_NGRAM ) );
+			if( it == _index.constEnd() )
+			{
+				return matches;
+			}
+			postings.append( &it.value() );
+		}
+		//
+		// Starts with the rarest n-gram, so few melodies are looked up in the others
+		//
+		for( int i = 1; i < postings.size(); i++ )
+		{
+			if( postings[i]->size() < postings[0]->size() )
+			{
+				qSwap( postings[0], postings[i] );
+			}
+		}
+		const QVector<int>& candidates = *postings[0];
+		for( int i = 0; i < candidates.size(); i++ )
+		{
+			int id = candidates[i];
+			bool found = true;
+			for( int j = 1; j < postings.size() && found; j++ )
+			{
+				found = std::binary_search( postings[j]->constBegin(), postings[j]->constEnd(), id );
+			}
+			if( found && !contains( _melodies[id], query, maxResults, &matches ) )
+			{
+				break;
+			}
+		}
+		return matches;
+	}
+
+/*!
+	Returns the melodies of the catalog that are equal to \a melody, in any transposition.
+	The pauses before the first note are not compared.
+*/
+	QList<ScoreMatch> ScoreCatalog::findDuplicates( const ScoreMelody& melody ) const
+	{
+		QList<ScoreMatch> matches;
+		QVector<quint32> query = tokens( melody.notes );
+		query.remove( 0, leadingTokens( query ) );
+
+		QReadLocker locker( &_lock );
+		QVector<int> ids = _fingerprints.value( ngram( query.constData(), query.size() ) );
+		for( int i = 0; i < ids.size(); i++ )
+		{
+			const CatalogMelody& candidate = _melodies[ids[i]];
+			if( candidate.tokens.mid( candidate.lead ) == query )
+			{
+				matches.append( ScoreMatch( candidate.score, candidate.melody, 0 ) );
+			}
+		}
+		return matches;
+	}
+
+/*!
+	Returns the groups of melodies of the catalog that are equal, in any transposition.
+	Melodies with less than 2 notes are not compared, nor the pauses before the first note.
+*/
+	QList< QList<ScoreMatch> > ScoreCatalog::duplicates() const
+	{
+		QList< QList<ScoreMatch> > groups;
+
+		QReadLocker locker( &_lock );
+		QHash<quint64, QVector<int> >::const_iterator it;
+		for( it = _fingerprints.constBegin(); it != _fingerprints.constEnd(); ++it )
+		{
+			QVector<int> ids = it.value();
+			//
+			// Different sequences can have the same fingerprint, they are split
+			//
+			while( ids.size() > 1 )
+			{
+				QVector<quint32> first = _melodies[ids[0]].tokens.mid( _melodies[ids[0]].lead );
+				QList<ScoreMatch> group;
+				QVector<int> others;
+				for( int i = 0; i < ids.size(); i++ )
+				{
+					const CatalogMelody& melody = _melodies[ids[i]];
+					if( melody.tokens.mid( melody.lead ) == first )
+					{
+						group.append( ScoreMatch( melody.score, melody.melody, 0 ) );
+					}
+					else
+					{
+						others.append( ids[i] );
+					}
+				}
+				if( group.size() > 1 && !first.isEmpty() )
+				{
+					groups.append( group );
+				}
+				ids = others;
+			}
+		}
+		return groups;
+	}
+
+/*!
+	Returns the number of scores in the catalog.
+*/
+	int ScoreCatalog::scoreCount() const
+	{
+		QReadLocker locker( &_lock );
+		return _scores.size();
+	}
+
+/*!
+	Returns the number of melodies in the catalog.
+*/
+	int ScoreCatalog::melodyCount() const
+	{
+		QReadLocker locker( &_lock );
+		return _melodies.size();
+	}
+
+/*!
+	Returns the file of the \a score, empty if it was not added from a file.
+*/
+	QString ScoreCatalog::filename( int score ) const
+	{
+		QReadLocker locker( &_lock );
+		return ( score >= 0 && score < _scores.size() ) ? _scores[score].filename : QString();
+	}
+
+/*!
+	Returns the name of the \a score.
+*/
+	QString ScoreCatalog::name( int score ) const
+	{
+		QReadLocker locker( &_lock );
+		return ( score >= 0 && score < _scores.size() ) ? _scores[score].name : QString();
+	}
+
+/*!
+	Returns the tokens of \a notes, one for each note after the first.
+
+	Each token has the interval from the last note that isn't a pause (bits 20 to 27), the
+	duration of the previous note (bits 10 to 19) and the duration of the note (bits 0 to 9).
+*/
+	QVector<quint32> ScoreCatalog::tokens( const QVector<ScoreNote>& notes )
+	{
+		QVector<quint32> result;
+		if( notes.size() < 2 )
+		{
+			return result;
+		}
+		result.reserve( notes.size() - 1 );
+		int lastPitch = ( notes[0].height == PAUSE ) ? -1 : notes[0].height + notes[0].octave * CS_NUMBERNOTE;
+		for( int i = 1; i < notes.size(); i++ )
+		{
+			const ScoreNote& note = notes[i];
+			quint32 interval;
+			if( note.height == PAUSE )
+			{
+				interval = intervalRest;
+			}
+			else
+			{
+				int pitch = note.height + note.octave * CS_NUMBERNOTE;
+				interval = ( lastPitch < 0 ) ? intervalNone
+											 : (quint32)( qBound( -intervalMax, pitch - lastPitch, intervalMax ) + intervalMax + 2 );
+				lastPitch = pitch;
+			}
+			result.append( ( interval << 20 ) | ( ( notes[i - 1].duration & 0x3FF ) << 10 ) | ( note.duration & 0x3FF ) );
+		}
+		return result;
+	}
+
+//
+// Private
+//
+
+/*!
+	Adds the melody number \a melody of \a score, with \a tokens, to the index.
+
+	Must be called with the lock for writing.
+*/
+	void ScoreCatalog::insertMelody( int score, int melody, const QVector<quint32>& tokens )
+	{
+		CatalogMelody catalogMelody;
+		catalogMelody.score = score;
+		catalogMelody.melody = melody;
+		catalogMelody.tokens = tokens;
+		catalogMelody.lead = leadingTokens( tokens );
+		catalogMelody.fingerprint = ngram( tokens.constData() + catalogMelody.lead, tokens.size() - catalogMelody.lead );
+		_melodies.append( catalogMelody );
+		int id = _melodies.size() - 1;
+
+		for( int i = 0; i + CS_CATALOG_NGRAM <= tokens.size(); i++ )
+		{
+			//
+			// The ids are added in ascending order, repeated n-grams only once
+			//
+			QVector<int>& list = _index[ ngram( tokens.constData() + i, CS_CATALOG_NGRAM ) ];
+			if( list.isEmpty() || list.last() != id )
+			{
+				list.append( id );
+			}
+		}
+		_fingerprints[catalogMelody.fingerprint].append( id );
+	}
+
+/*!
+	Adds to \a matches every position of \a melody where \a tokens are.
+
+	Returns false if \a maxResults matches were reached.
+*/
+	bool ScoreCatalog::contains( const CatalogMelody& melody, const QVector<quint32>& tokens, int maxResults,
+								 QList<ScoreMatch>* matches ) const
+	{
+		const quint32* begin = melody.tokens.constData();
+		const quint32* end = begin + melody.tokens.size();
+		const quint32* it = std::search( begin, end, tokens.constBegin(), tokens.constEnd() );
+		while( it != end )
+		{
+			if( maxResults >= 0 && matches->size() >= maxResults )
+			{
+				return false;
+			}
+			matches->append( ScoreMatch( melody.score, melody.melody, (int)( it - begin ) ) );
+			it = std::search( it + 1, end, tokens.constBegin(), tokens.constEnd() );
+		}
+		return maxResults < 0 || matches->size() < maxResults;
+	}
+
+/*!
+	Returns the number of \a tokens of the pauses before the first note, up to the one of the
+	first note, which has no interval. 0 if the melody starts with a note.
+*/
+	int ScoreCatalog::leadingTokens( const QVector<quint32>& tokens )
+	{
+		for( int i = 0; i < tokens.size(); i++ )
+		{
+			quint32 interval = tokens[i] >> 20;
+			if( interval == intervalNone )
+			{
+				return i + 1;
+			}
+			if( interval != intervalRest )
+			{
+				return 0;
+			}
+		}
+		return 0;
+	}
+
+/*!
+	Returns the hash of \a count \a tokens (64 bits FNV-1a).
+*/
+	quint64 ScoreCatalog::ngram( const quint32* tokens, int count )
+	{
+		quint64 hash = Q_UINT64_C(14695981039346656037) ^ (quint64)count;
+		for( int i = 0; i < count; i++ )
+		{
+			hash = ( hash ^ tokens[i] ) * Q_UINT64_C(1099511628211);
+		}
+		return hash;
+	}
+}
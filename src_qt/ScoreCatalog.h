@@ -0,0 +1,102 @@
+/*!
+ \class CnotiAudio::ScoreCatalog
+ \brief The ScoreCatalog class keeps the melodies of many scores in memory, indexed to find phrases.
+
+ Each melody is turned into a sequence of tokens, one for each note after the first, with
+ the interval from the previous note (or a rest) and the durations of both notes. As only
+ the intervals are kept, the tokens don't change when the melody is transposed.
+
+ The catalog has an inverted index from each n-gram of \c CS_CATALOG_NGRAM tokens to the
+ melodies that have it. A phrase is searched by intersecting the melodies of all its n-grams,
+ starting with the rarest, and then checking the tokens of the few melodies left. Phrases
+ shorter than the n-grams are checked against every melody.
+
+ The pauses before the first note have no interval, they are skipped in the phrases and
+ when the melodies are compared. Melodies with the same tokens after them are duplicates,
+ they are found through a fingerprint of the sequence.
+
+ The score files are read and tokenized in parallel with QtConcurrent, and then added to
+ the index by the calling thread. The catalog can be searched from any thread.
+
+ \version 2.2
+ \date 19-10-2026
+ \file ScoreCatalog.h
+*/
+#if !defined(_SCORECATALOG_H)
+#define _SCORECATALOG_H
+
+#include <QString>
+#include <QStringList>
+#include <QList>
+#include <QVector>
+#include <QHash>
+#include <QReadWriteLock>
+
+#include "Score.h"
+#include "soundmanager_global.h"
+
+namespace CnotiAudio
+{
+	#define CS_CATALOG_NGRAM		(3)		// Tokens in each n-gram of the index
+
+	struct ScoreMatch
+	{
+		int  score;		// Id of the score in the catalog
+		int  melody;	// Melody of the score
+		int  note;		// Note of the melody where the phrase starts
+
+		ScoreMatch( int s = -1, int m = -1, int n = -1 ) : score(s), melody(m), note(n) {}
+	};
+
+	class SOUNDMANAGER_EXPORT ScoreCatalog
+	{
+	public:
+		ScoreCatalog();
+
+		int addScore( const ScoreData& score, const QString& filename = QString() );
+		int addFiles( const QStringList& files, EnumScoreKind kind = SCORE_SOUND );
+		void clear();
+
+		QList<ScoreMatch> findPhrase( const QVector<ScoreNote>& phrase, int maxResults = -1 ) const;
+		QList<ScoreMatch> findDuplicates( const ScoreMelody& melody ) const;
+		QList< QList<ScoreMatch> > duplicates() const;
+
+		int scoreCount() const;
+		int melodyCount() const;
+		QString filename( int score ) const;
+		QString name( int score ) const;
+
+		static QVector<quint32> tokens( const QVector<ScoreNote>& notes );
+
+	private:
+		struct CatalogScore
+		{
+			QString        filename;
+			QString        name;
+			EnumScoreKind  kind;
+		};
+		struct CatalogMelody
+		{
+			int               score;
+			int               melody;
+			quint64           fingerprint;		// Of the tokens after the pauses before the first note
+			QVector<quint32>  tokens;
+			int               lead;				// Tokens of the pauses before the first note
+		};
+
+		void insertMelody( int score, int melody, const QVector<quint32>& tokens );
+		bool contains( const CatalogMelody& melody, const QVector<quint32>& tokens, int maxResults,
+					   QList<ScoreMatch>* matches ) const;
+
+		static quint64 ngram( const quint32* tokens, int count );
+		static int leadingTokens( const QVector<quint32>& tokens );
+
+		QList<CatalogScore>              _scores;
+		QVector<CatalogMelody>           _melodies;
+		QHash<quint64, QVector<int> >    _index;			// N-gram to the melodies, in ascending order
+		QHash<quint64, QVector<int> >    _fingerprints;		// Whole sequence to the melodies
+		mutable QReadWriteLock           _lock;
+	};
+}
+
+#endif //_SCORECATALOG_H
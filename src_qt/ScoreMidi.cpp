@@ -0,0 +1,1001 @@
+/**
+	\file ScoreMidi.cpp
+*/
+#include "ScoreMidi.h"
+#include "SoundLog.h"
+// Qt
+#include <QFile>
+#include <QVector>
+#include <QMultiMap>
+#include <QtEndian>
+#include <QtAlgorithms>
+#include <QtConcurrentMap>
+// Std
+#include <cstring>
+#include <algorithm>
+
+namespace CnotiAudio
+{
+	static const char headerMagic[4] = { 'M', 'T', 'h', 'd' };
+	static const char trackMagic[4] = { 'M', 'T', 'r', 'k' };
+
+	static const int drumChannel = 9;			// Channel 10, the percussion of General MIDI
+	static const int defaultMicrosPerBeat = 500000;		// 120 beats per minute, when the file has no tempo
+	static const int fileKind = -1;				// Kind of score given by the file, see songKind()
+
+	//
+	// Durations and tempos of the scores, to quantize the files
+	//
+	static const int durations[] = { LONGA, BREVE, SEMIBREVE_DOTTED, SEMIBREVE, MINIM_DOTTED, MINIM,
+									 CROTCHET_DOTTED, CROTCHET, QUAVER_HALF, QUAVER, SEMIQUAVER,
+									 DEMISEMIQUAVER, HEMIDEMISEMIQUAVER, SEMIHEMIDEMISEMIQUAVER };
+	static const int durationCount = sizeof( durations ) / sizeof( durations[0] );
+	static const int tempos[] = { TEMPO_60, TEMPO_120, TEMPO_160, TEMPO_200 };
+	static const int tempoCount = sizeof( tempos ) / sizeof( tempos[0] );
+
+	//
+	// Reads the big endian values and the variable length quantities of a buffer
+	//
+	class MidiCursor
+	{
+	public:
+		MidiCursor( const uchar* data, qint64 size ) : _data(data), _size(size), _pos(0) {}
+
+		bool has( qint64 bytes ) const { return bytes >= 0 && _pos + bytes <= _size; }
+		bool atEnd() const { return _pos >= _size; }
+		const uchar* current() const { return _data + _pos; }
+		void skip( qint64 bytes ) { _pos += bytes; }
+
+		uchar peek() const { return _data[_pos]; }
+		uchar u8() { return _data[_pos++]; }
+		quint16 u16() { quint16 v = qFromBigEndian<quint16>( _data + _pos ); _pos += 2; return v; }
+		quint32 u32() { quint32 v = qFromBigEndian<quint32>( _data + _pos ); _pos += 4; return v; }
+
+		bool varLength( quint32* value )
+		{
+			quint32 v = 0;
+			for( int i = 0; i < 4 && _pos < _size; i++ )
+			{
+				uchar byte = _data[_pos++];
+				v = ( v << 7 ) | ( byte & 0x7F );
+				if( ( byte & 0x80 ) == 0 )
+				{
+					*value = v;
+					return true;
+				}
+			}
+			return false;
+		}
+
+	private:
+		const uchar* _data;
+		qint64       _size;
+		qint64       _pos;
+	};
+
+	//
+	// Notes of a file, by track and channel, in ticks
+	//
+	struct MidiNote
+	{
+		qint64  start;
+		qint64  end;
+		int     key;
+		int     velocity;
+
+		MidiNote( qint64 s = 0, int k = 0, int v = 0 ) : start(s), end(-1), key(k), velocity(v) {}
+	};
+
+	struct MidiPart
+	{
+		int                 track;
+		int                 channel;
+		int                 program;		// Program of the channel at the first note
+		QVector<MidiNote>   notes;			// Notes by their start
+
+		MidiPart( int t = 0, int c = 0, int p = 0 ) : track(t), channel(c), program(p) {}
+	};
+
+	struct MidiSong
+	{
+		int              division;			// Ticks of a beat
+		int              microsPerBeat;		// First tempo, 0 if none
+		int              numerator;			// First time signature, 0 if none
+		int              denominator;
+		QString          name;
+		QList<MidiPart>  parts;
+
+		MidiSong() : division(0), microsPerBeat(0), numerator(0), denominator(0) {}
+	};
+
+	//
+	// Note quantized to the grid of the score
+	//
+	struct GridNote
+	{
+		qint64  start;
+		qint64  end;
+		int     key;
+		int     velocity;
+	};
+
+	static bool gridNoteLessThan( const GridNote& a, const GridNote& b )
+	{
+		return a.start < b.start || ( a.start == b.start && a.key > b.key );
+	}
+
+	//
+	// Score read by a worker thread, for readBatch()
+	//
+	struct ParsedMidi
+	{
+		bool       ok;
+		ScoreData  score;
+		QString    error;
+	};
+
+	struct MidiReader
+	{
+		typedef ParsedMidi result_type;
+
+		MidiReader( EnumScoreKind kind ) : _kind(kind) {}
+
+		ParsedMidi operator()( const QString& filename ) const
+		{
+			ParsedMidi parsed;
+			parsed.ok = ScoreMidi::read( filename, _kind, &parsed.score, &parsed.error );
+			return parsed;
+		}
+
+		EnumScoreKind _kind;
+	};
+
+	static bool fail( QString* error, const QString& message )
+	{
+		if( error )
+		{
+			*error = message;
+		}
+		return false;
+	}
+
+	//
+	// Appends big endian values and variable length quantities to a buffer
+	//
+	static void putU32( QByteArray& buffer, quint32 value )
+	{
+		uchar bytes[4];
+		qToBigEndian<quint32>( value, bytes );
+		buffer.append( (const char*)bytes, 4 );
+	}
+
+	static void putU16( QByteArray& buffer, quint16 value )
+	{
+		uchar bytes[2];
+		qToBigEndian<quint16>( value, bytes );
+		buffer.append( (const char*)bytes, 2 );
+	}
+
+	static void putVarLength( QByteArray& buffer, quint32 value )
+	{
+		uchar bytes[4];
+		int count = 0;
+		do
+		{
+			bytes[count++] = value & 0x7F;
+			value >>= 7;
+		} while( value > 0 && count < 4 );
+		while( count > 0 )
+		{
+			uchar byte = bytes[--count];
+			buffer.append( (char)( count > 0 ? byte | 0x80 : byte ) );
+		}
+	}
+
+	//
+	// Events of a track being written, in order of time
+	//
+	class MidiTrackWriter
+	{
+	public:
+		MidiTrackWriter() : _last(0) {}
+
+		void event( qint64 tick, uchar status, uchar first, int second = -1 )
+		{
+			delta( tick );
+			_events.append( (char)status );
+			_events.append( (char)first );
+			if( second >= 0 )
+			{
+				_events.append( (char)second );
+			}
+		}
+
+		void meta( qint64 tick, uchar type, const QByteArray& data )
+		{
+			delta( tick );
+			_events.append( (char)0xFF );
+			_events.append( (char)type );
+			putVarLength( _events, data.size() );
+			_events.append( data );
+		}
+
+		void appendTo( QByteArray& file )
+		{
+			meta( _last, 0x2F, QByteArray() );		// End of track
+			file.append( trackMagic, 4 );
+			putU32( file, _events.size() );
+			file.append( _events );
+		}
+
+	private:
+		void delta( qint64 tick )
+		{
+			putVarLength( _events, (quint32)qMax( tick - _last, qint64( 0 ) ) );
+			_last = qMax( tick, _last );
+		}
+
+		QByteArray  _events;
+		qint64      _last;
+	};
+
+/*!
+	Returns the longest duration of the scores up to \a length, the shortest one if none.
+*/
+	static int fitDuration( qint64 length )
+	{
+		for( int i = 0; i < durationCount; i++ )
+		{
+			if( durations[i] <= length )
+			{
+				return durations[i];
+			}
+		}
+		return SEMIHEMIDEMISEMIQUAVER;
+	}
+
+/*!
+	Appends to \a notes the pauses of \a length, in the grid of the score.
+*/
+	static void appendPauses( QVector<ScoreNote>* notes, qint64 length )
+	{
+		while( length > 0 )
+		{
+			int duration = fitDuration( length );
+			notes->append( ScoreNote( (DurationType)duration, PAUSE, OCTAVE_C3 ) );
+			length -= duration;
+		}
+	}
+
+/*!
+	Reads the events of the track number \a track, the \a size bytes of \a data, adding its
+	notes to \a song. \a programs has the program of each channel, changed by the track.
+*/
+	static bool parseTrack( const uchar* data, qint64 size, int track, MidiSong* song, int* programs, QString* error )
+	{
+		MidiCursor cursor( data, size );
+		int parts[16];				// Part of each channel in the song, -1 if none
+		int active[16][128];		// Note playing of each channel and key in its part, -1 if none
+		memset( parts, 0xFF, sizeof( parts ) );
+		memset( active, 0xFF, sizeof( active ) );
+		qint64 tick = 0;
+		uchar running = 0;
+		while( !cursor.atEnd() )
+		{
+			quint32 delta = 0;
+			if( !cursor.varLength( &delta ) || !cursor.has( 1 ) )
+			{
+				return fail( error, QString( "MIDI track %1 is truncated" ).arg( track ) );
+			}
+			tick += delta;
+			//
+			// Status, repeated from the previous event if missing
+			//
+			uchar status = cursor.peek();
+			if( status & 0x80 )
+			{
+				cursor.skip( 1 );
+				running = ( status < 0xF0 ) ? status : 0;
+			}
+			else if( running != 0 )
+			{
+				status = running;
+			}
+			else
+			{
+				return fail( error, QString( "MIDI track %1 has data without status" ).arg( track ) );
+			}
+			if( status == 0xFF )
+			{
+				quint32 length = 0;
+				if( !cursor.has( 1 ) )
+				{
+					return fail( error, QString( "MIDI track %1 is truncated" ).arg( track ) );
+				}
+				uchar type = cursor.u8();
+				if( !cursor.varLength( &length ) || !cursor.has( length ) )
+				{
+					return fail( error, QString( "MIDI track %1 is truncated" ).arg( track ) );
+				}
+				const uchar* meta = cursor.current();
+				if( type == 0x2F )
+				{
+					break;		// End of track
+				}
+				if( type == 0x51 && length >= 3 && song->microsPerBeat == 0 )
+				{
+					song->microsPerBeat = ( meta[0] << 16 ) | ( meta[1] << 8 ) | meta[2];
+				}
+				else if( type == 0x58 && length >= 2 && song->numerator == 0 )
+				{
+					song->numerator = meta[0];
+					song->denominator = 1 << qMin( (int)meta[1], 6 );
+				}
+				else if( type == 0x03 && track == 0 && song->name.isEmpty() )
+				{
+					song->name = QString::fromLatin1( (const char*)meta, length );
+				}
+				cursor.skip( length );
+				continue;
+			}
+			if( status == 0xF0 || status == 0xF7 )
+			{
+				quint32 length = 0;
+				if( !cursor.varLength( &length ) || !cursor.has( length ) )
+				{
+					return fail( error, QString( "MIDI track %1 is truncated" ).arg( track ) );
+				}
+				cursor.skip( length );
+				continue;
+			}
+			if( status >= 0xF0 )
+			{
+				return fail( error, QString( "MIDI track %1 has an unknown status %2" ).arg( track ).arg( status, 0, 16 ) );
+			}
+			//
+			// Channel events
+			//
+			int channel = status & 0x0F;
+			int kind = status & 0xF0;
+			int bytes = ( kind == 0xC0 || kind == 0xD0 ) ? 1 : 2;
+			if( !cursor.has( bytes ) )
+			{
+				return fail( error, QString( "MIDI track %1 is truncated" ).arg( track ) );
+			}
+			int first = cursor.u8() & 0x7F;
+			int second = ( bytes == 2 ) ? cursor.u8() & 0x7F : 0;
+			if( kind == 0x90 && second > 0 )
+			{
+				if( parts[channel] < 0 )
+				{
+					parts[channel] = song->parts.size();
+					song->parts.append( MidiPart( track, channel, programs[channel] ) );
+				}
+				QVector<MidiNote>& notes = song->parts[parts[channel]].notes;
+				int& note = active[channel][first];
+				if( note >= 0 )
+				{
+					notes[note].end = tick;		// Played again before its end
+				}
+				note = notes.size();
+				notes.append( MidiNote( tick, first, second ) );
+			}
+			else if( kind == 0x80 || kind == 0x90 )
+			{
+				int& note = active[channel][first];
+				if( note >= 0 )
+				{
+					song->parts[parts[channel]].notes[note].end = tick;
+					note = -1;
+				}
+			}
+			else if( kind == 0xC0 )
+			{
+				programs[channel] = first;
+			}
+		}
+		//
+		// The notes not ended, end with the track
+		//
+		for( int channel = 0; channel < 16; channel++ )
+		{
+			if( parts[channel] < 0 )
+			{
+				continue;
+			}
+			QVector<MidiNote>& notes = song->parts[parts[channel]].notes;
+			for( int key = 0; key < 128; key++ )
+			{
+				if( active[channel][key] >= 0 )
+				{
+					notes[active[channel][key]].end = tick;
+				}
+			}
+		}
+		return true;
+	}
+
+/*!
+	Reads the notes of the MIDI file in the \a size bytes of \a data to \a song.
+*/
+	static bool parseSong( const uchar* data, qint64 size, MidiSong* song, QString* error )
+	{
+		MidiCursor cursor( data, size );
+		if( !cursor.has( 14 ) || memcmp( data, headerMagic, 4 ) != 0 )
+		{
+			return fail( error, "Not a MIDI file" );
+		}
+		cursor.skip( 4 );
+		quint32 headerLength = cursor.u32();
+		if( headerLength < 6 || !cursor.has( headerLength ) )
+		{
+			return fail( error, "MIDI header is truncated" );
+		}
+		quint16 format = cursor.u16();
+		quint16 trackCount = cursor.u16();
+		quint16 division = cursor.u16();
+		cursor.skip( headerLength - 6 );
+		if( format > 2 )
+		{
+			return fail( error, QString( "MIDI format %1 is not supported" ).arg( format ) );
+		}
+		if( division == 0 || ( division & 0x8000 ) )
+		{
+			return fail( error, "MIDI time division in SMPTE frames is not supported" );
+		}
+		song->division = division;
+		//
+		// Tracks, the other chunks are skipped
+		//
+		int programs[16] = { 0 };
+		int track = 0;
+		while( track < trackCount && cursor.has( 8 ) )
+		{
+			bool isTrack = memcmp( cursor.current(), trackMagic, 4 ) == 0;
+			cursor.skip( 4 );
+			quint32 length = cursor.u32();
+			if( !cursor.has( length ) )
+			{
+				return fail( error, QString( "MIDI track %1 is truncated" ).arg( track ) );
+			}
+			if( isTrack )
+			{
+				if( !parseTrack( cursor.current(), length, track, song, programs, error ) )
+				{
+					return false;
+				}
+				track++;
+			}
+			cursor.skip( length );
+		}
+		return true;
+	}
+
+/*!
+	Appends to \a score the \a note played from \a start to \a end, after the pauses from
+	\a position, and moves \a position to the end of the note.
+*/
+	static void appendNote( QVector<ScoreNote>* score, const GridNote& note, qint64 start, qint64 end, qint64* position )
+	{
+		appendPauses( score, start - *position );
+		int duration = fitDuration( end - start );
+		ScoreNote scoreNote( (DurationType)duration, (NoteType)( note.key % CS_NUMBERNOTE ),
+							 qBound( CS_MINOCTAVE, note.key / CS_NUMBERNOTE - 1, CS_MAXOCTAVE ) );
+		scoreNote.intensity = note.velocity;
+		score->append( scoreNote );
+		*position = start + duration;
+	}
+
+/*!
+	Appends the \a notes of a part to \a score, one at a time in the grid of the score.
+	\a division is the number of ticks of a beat.
+
+	While several notes sound, the highest one is kept. A note covered by a higher one is
+	played again when that one ends, if it still sounds.
+*/
+	static void quantize( const QVector<MidiNote>& notes, int division, QVector<ScoreNote>* score )
+	{
+		//
+		// Ticks to the grid, rounded, and the times where the notes start or end
+		//
+		QVector<GridNote> grid( notes.size() );
+		QVector<qint64> times;
+		times.reserve( notes.size() * 2 );
+		for( int i = 0; i < notes.size(); i++ )
+		{
+			const MidiNote& note = notes[i];
+			grid[i].start = ( note.start * CROTCHET * 2 + division ) / ( division * 2 );
+			grid[i].end = ( qMax( note.end, note.start ) * CROTCHET * 2 + division ) / ( division * 2 );
+			grid[i].end = qMax( grid[i].end, grid[i].start + 1 );
+			grid[i].key = note.key;
+			grid[i].velocity = note.velocity;
+			times.append( grid[i].start );
+			times.append( grid[i].end );
+		}
+		qSort( grid.begin(), grid.end(), gridNoteLessThan );
+		qSort( times.begin(), times.end() );
+		times.erase( std::unique( times.begin(), times.end() ), times.end() );
+		score->reserve( score->size() + grid.size() );
+		//
+		// The highest note sounding from each time to the next one, joined while it's the same
+		//
+		QMultiMap<int, int> sounding;		// Notes of the grid sounding, by key
+		qint64 position = 0;
+		int next = 0;
+		int playing = -1;					// Note of the grid played, -1 if none
+		qint64 playingFrom = 0;
+		for( int t = 0; t < times.size(); t++ )
+		{
+			qint64 time = times[t];
+			QMultiMap<int, int>::iterator it = sounding.begin();
+			while( it != sounding.end() )
+			{
+				if( grid[it.value()].end <= time )
+				{
+					it = sounding.erase( it );
+				}
+				else
+				{
+					++it;
+				}
+			}
+			while( next < grid.size() && grid[next].start == time )
+			{
+				sounding.insert( grid[next].key, next );
+				next++;
+			}
+			int highest = sounding.isEmpty() ? -1 : ( sounding.end() - 1 ).value();
+			if( highest != playing )
+			{
+				if( playing >= 0 )
+				{
+					appendNote( score, grid[playing], playingFrom, time, &position );
+				}
+				playing = highest;
+				playingFrom = time;
+			}
+		}
+	}
+
+/*!
+	Returns the TempoType nearest to \a microsPerBeat.
+*/
+	static TempoType nearestTempo( int microsPerBeat )
+	{
+		double bpm = 60000000.0 / ( microsPerBeat > 0 ? microsPerBeat : defaultMicrosPerBeat );
+		int nearest = tempos[0];
+		for( int i = 1; i < tempoCount; i++ )
+		{
+			if( qAbs( tempos[i] - bpm ) < qAbs( nearest - bpm ) )
+			{
+				nearest = tempos[i];
+			}
+		}
+		return (TempoType)nearest;
+	}
+
+/*!
+	Returns the kind of score \a song is read as: a music if it has one melody and rhythms.
+*/
+	static EnumScoreKind songKind( const MidiSong& song )
+	{
+		int melodies = 0;
+		bool rhythms = false;
+		for( int i = 0; i < song.parts.size(); i++ )
+		{
+			const MidiPart& part = song.parts[i];
+			if( part.channel != drumChannel )
+			{
+				melodies++;
+				continue;
+			}
+			for( int j = 0; j < part.notes.size() && !rhythms; j++ )
+			{
+				rhythms = ScoreMidi::rhythmInstrument( part.notes[j].key ) != RHYTHM_INST_UNKNOWN;
+			}
+		}
+		return ( melodies == 1 && rhythms ) ? SCORE_MUSIC : SCORE_SOUND;
+	}
+
+/*!
+	Gives to \a score the notes of \a song, as a sound or a music as given by \a kind.
+
+	Returns false if a music has no melody, the reason is given in \a error.
+*/
+	static bool songScore( const MidiSong& song, EnumScoreKind kind, ScoreData* score, QString* error )
+	{
+		*score = ScoreData( kind );
+		score->name = song.name;
+		score->tempo = nearestTempo( song.microsPerBeat );
+		CompassType compass = quaternario_simples;
+		if( song.numerator == 2 && song.denominator == 4 )
+		{
+			compass = binario_simples;
+		}
+		else if( song.numerator == 3 && song.denominator == 4 )
+		{
+			compass = ternario_simple;
+		}
+		for( int i = 0; i < song.parts.size(); i++ )
+		{
+			const MidiPart& part = song.parts[i];
+			if( part.channel == drumChannel )
+			{
+				if( kind != SCORE_MUSIC )
+				{
+					continue;
+				}
+				//
+				// Each percussion known is a rhythm, once
+				//
+				for( int j = 0; j < part.notes.size(); j++ )
+				{
+					EnumRhythmInstrument instrument = ScoreMidi::rhythmInstrument( part.notes[j].key );
+					bool found = ( instrument == RHYTHM_INST_UNKNOWN );
+					for( int k = 0; k < score->rhythms.size() && !found; k++ )
+					{
+						found = score->rhythms[k].instrument == instrument;
+					}
+					if( !found )
+					{
+						score->rhythms.append( ScoreRhythm( instrument, RHYTHM_01 ) );
+					}
+				}
+				continue;
+			}
+			if( kind == SCORE_MUSIC && !score->melodies.isEmpty() )
+			{
+				continue;		// Music has only one melody
+			}
+			score->melodies.append( ScoreMelody( ScoreMidi::instrument( part.program ), compass ) );
+			QVector<ScoreNote>& notes = score->melodies.last().notes;
+			quantize( part.notes, song.division, &notes );
+			//
+			// The notes of the melodies after the first of a sound are a semitone higher
+			//
+			for( int j = 0; score->melodies.size() > 1 && j < notes.size(); j++ )
+			{
+				notes[j].transpose( 1 );
+			}
+		}
+		if( kind == SCORE_MUSIC && score->melodies.isEmpty() )
+		{
+			return fail( error, "The MIDI file has no melody" );
+		}
+		return true;
+	}
+
+/*!
+	Reads the score of the MIDI file \a filename to \a score, mapping the file in memory.
+	\a kind is the kind of score, or fileKind for the one of the file.
+*/
+	static bool readFile( const QString& filename, int kind, ScoreData* score, QString* error )
+	{
+		QFile file( filename );
+		if( !file.open( QIODevice::ReadOnly ) )
+		{
+			return fail( error, QString( "%1: %2" ).arg( filename ).arg( file.errorString() ) );
+		}
+		qint64 size = file.size();
+		uchar* data = file.map( 0, size );
+		QByteArray content;
+		if( data == NULL )
+		{
+			//
+			// Some files can't be mapped
+			//
+			content = file.readAll();
+		}
+		MidiSong song;
+		bool result = parseSong( data != NULL ? data : (const uchar*)content.constData(),
+								 data != NULL ? size : content.size(), &song, error );
+		if( data != NULL )
+		{
+			file.unmap( data );
+		}
+		if( !result )
+		{
+			return false;
+		}
+		return songScore( song, kind == fileKind ? songKind( song ) : (EnumScoreKind)kind, score, error );
+	}
+
+/*!
+	Reads the score of the MIDI file \a filename to \a score, as a sound or a music as given
+	by \a kind, mapping the file in memory.
+
+	Returns false if the file couldn't be read or is not valid, the reason is given in \a error.
+*/
+	bool ScoreMidi::read( const QString& filename, EnumScoreKind kind, ScoreData* score, QString* error )
+	{
+		return readFile( filename, kind, score, error );
+	}
+
+/*!
+	Reads the score of the MIDI file \a filename to \a score, as the kind of score of the
+	file, see peekKind(). The file is only read once.
+
+	Returns false if the file couldn't be read or is not valid, the reason is given in \a error.
+*/
+	bool ScoreMidi::read( const QString& filename, ScoreData* score, QString* error )
+	{
+		return readFile( filename, fileKind, score, error );
+	}
+
+/*!
+	Reads the score of the MIDI file in the \a size bytes of \a data to \a score, as a sound
+	or a music as given by \a kind.
+
+	Returns false if the data is not valid, or a music has no melody. The reason is given
+	in \a error.
+*/
+	bool ScoreMidi::read( const uchar* data, qint64 size, EnumScoreKind kind, ScoreData* score, QString* error )
+	{
+		MidiSong song;
+		if( !parseSong( data, size, &song, error ) )
+		{
+			return false;
+		}
+		return songScore( song, kind, score, error );
+	}
+
+/*!
+	Writes \a score to the MIDI file \a filename.
+
+	Returns false if the file couldn't be written.
+*/
+	bool ScoreMidi::write( const QString& filename, const ScoreData& score )
+	{
+		QFile file( filename );
+		if( !file.open( QIODevice::WriteOnly | QIODevice::Truncate ) )
+		{
+			return false;
+		}
+		QByteArray data = toByteArray( score );
+		return file.write( data ) == data.size();
+	}
+
+/*!
+	Returns \a score as a MIDI file.
+*/
+	QByteArray ScoreMidi::toByteArray( const ScoreData& score )
+	{
+		bool hasRhythms = ( score.kind == SCORE_MUSIC && !score.rhythms.isEmpty() );
+		QByteArray data;
+		data.append( headerMagic, 4 );
+		putU32( data, 6 );
+		putU16( data, 1 );
+		putU16( data, 1 + score.melodies.size() + ( hasRhythms ? 1 : 0 ) );
+		putU16( data, CROTCHET );		// A tick is the shortest duration
+		//
+		// Name, time signature and tempo
+		//
+		MidiTrackWriter conductor;
+		if( !score.name.isEmpty() )
+		{
+			conductor.meta( 0, 0x03, score.name.toLatin1() );
+		}
+		CompassType compass = score.melodies.isEmpty() ? quaternario_simples : score.melodies.first().compass;
+		QByteArray signature;
+		signature.append( (char)( compass / 10 ) ).append( (char)2 ).append( (char)24 ).append( (char)8 );
+		conductor.meta( 0, 0x58, signature );
+		quint32 micros = 60000000 / ( score.tempo > 0 ? score.tempo : TEMPO_120 );
+		QByteArray tempo;
+		tempo.append( (char)( micros >> 16 ) ).append( (char)( micros >> 8 ) ).append( (char)micros );
+		conductor.meta( 0, 0x51, tempo );
+		conductor.appendTo( data );
+		//
+		// A track for each melody, in its own channel
+		//
+		qint64 length = 0;
+		for( int i = 0; i < score.melodies.size(); i++ )
+		{
+			const ScoreMelody& melody = score.melodies[i];
+			int channel = i % 15;
+			channel = ( channel < drumChannel ) ? channel : channel + 1;
+			MidiTrackWriter track;
+			track.event( 0, 0xC0 | channel, program( melody.instrument ) );
+			qint64 tick = 0;
+			for( int j = 0; j < melody.notes.size(); j++ )
+			{
+				const ScoreNote& note = melody.notes[j];
+				if( note.height >= DO && note.height <= SI )
+				{
+					int key = ( note.octave + 1 ) * CS_NUMBERNOTE + note.height;
+					if( score.kind == SCORE_SOUND && i > 0 )
+					{
+						key--;		// A semitone higher in the score
+					}
+					key = qBound( 0, key, 127 );
+					track.event( tick, 0x90 | channel, key, qBound( 1, note.intensity, 127 ) );
+					track.event( tick + note.duration, 0x80 | channel, key, 0 );
+				}
+				tick += note.duration;
+			}
+			length = qMax( length, tick );
+			track.appendTo( data );
+		}
+		//
+		// The rhythms, a hit on each beat
+		//
+		if( hasRhythms )
+		{
+			MidiTrackWriter drums;
+			for( qint64 beat = 0; beat < length; beat += CROTCHET )
+			{
+				for( int i = 0; i < score.rhythms.size(); i++ )
+				{
+					drums.event( beat, 0x90 | drumChannel, rhythmKey( score.rhythms[i].instrument ), 100 );
+				}
+				for( int i = 0; i < score.rhythms.size(); i++ )
+				{
+					drums.event( beat + SEMIQUAVER, 0x80 | drumChannel, rhythmKey( score.rhythms[i].instrument ), 0 );
+				}
+			}
+			drums.appendTo( data );
+		}
+		return data;
+	}
+
+/*!
+	Reads the MIDI files \a files at the same time, with the thread pool, as sounds or musics
+	as given by \a kind. The score of each file is added to \a scores, and the reason it
+	couldn't be read to \a errors, empty if it was read, both in the order of \a files.
+
+	Returns the number of files read.
+*/
+	int ScoreMidi::readBatch( const QStringList& files, EnumScoreKind kind, QList<ScoreData>* scores, QStringList* errors )
+	{
+		QList<ParsedMidi> parsed = QtConcurrent::blockingMapped< QList<ParsedMidi> >( files, MidiReader( kind ) );
+		scores->clear();
+		if( errors )
+		{
+			errors->clear();
+		}
+		int count = 0;
+		for( int i = 0; i < parsed.size(); i++ )
+		{
+			if( parsed[i].ok )
+			{
+				count++;
+			}
+			else
+			{
+				csWarning() << "[ScoreMidi::readBatch]" << files[i] << parsed[i].error;
+			}
+			scores->append( parsed[i].score );
+			if( errors )
+			{
+				errors->append( parsed[i].error );
+			}
+		}
+		return count;
+	}
+
+/*!
+	Reads the MIDI file \a filename to find the kind of score it is read as in \a kind: a
+	music if it has one melody and rhythms, otherwise a sound.
+
+	Returns false if the file is not a MIDI file.
+*/
+	bool ScoreMidi::peekKind( const QString& filename, EnumScoreKind* kind )
+	{
+		QFile file( filename );
+		if( !file.open( QIODevice::ReadOnly ) )
+		{
+			return false;
+		}
+		QByteArray content = file.readAll();
+		MidiSong song;
+		if( !parseSong( (const uchar*)content.constData(), content.size(), &song, 0 ) )
+		{
+			return false;
+		}
+		*kind = songKind( song );
+		return true;
+	}
+
+/*!
+	Returns true if \a filename has the extension of the MIDI files.
+*/
+	bool ScoreMidi::isMidi( const QString& filename )
+	{
+		return filename.endsWith( ".mid", Qt::CaseInsensitive ) || filename.endsWith( ".midi", Qt::CaseInsensitive );
+	}
+
+/*!
+	Returns the instrument of the General MIDI \a program, the one of its family.
+*/
+	EnumInstrument ScoreMidi::instrument( int program )
+	{
+		switch( program / 8 )
+		{
+		case 1:			// Chromatic percussion
+			return XYLOPHONE;
+		case 5:			// Strings
+		case 6:			// Ensemble
+			return VIOLIN;
+		case 7:			// Brass
+			return TRUMPET;
+		case 8:			// Reed
+		case 9:			// Pipe
+			return FLUTE;
+		default:		// Piano, organ, guitar, bass and the others
+			return PIANO;
+		}
+	}
+
+/*!
+	Returns the General MIDI program of \a instrument.
+*/
+	int ScoreMidi::program( EnumInstrument instrument )
+	{
+		switch( instrument )
+		{
+		case FLUTE:
+			return 73;
+		case VIOLIN:
+			return 40;
+		case XYLOPHONE:
+			return 13;
+		case TRUMPET:
+			return 56;
+		default:
+			return 0;		// Acoustic grand piano
+		}
+	}
+
+/*!
+	Returns the rhythm instrument of the General MIDI percussion \a key, RHYTHM_INST_UNKNOWN
+	if there is none.
+*/
+	EnumRhythmInstrument ScoreMidi::rhythmInstrument( int key )
+	{
+		switch( key )
+		{
+		case 35:		// Acoustic bass drum
+		case 36:		// Bass drum
+			return RHYTHM_INST_BASS_DRUM;
+		case 54:		// Tambourine
+			return RHYTHM_INST_TAMBOURINE;
+		case 62:		// Mute high conga
+		case 63:		// Open high conga
+		case 64:		// Low conga
+			return RHYTHM_INST_CONGAS;
+		case 76:		// High wood block
+		case 77:		// Low wood block
+			return RHYTHM_INST_CHINESE_BOX;
+		case 80:		// Mute triangle
+		case 81:		// Open triangle
+			return RHYTHM_INST_TRIANGLE;
+		case 37:		// Side stick
+		case 38:		// Acoustic snare
+		case 40:		// Electric snare
+			return RHYTHM_INST_BEAT_BOX;
+		default:
+			return RHYTHM_INST_UNKNOWN;
+		}
+	}
+
+/*!
+	Returns the General MIDI percussion key of the rhythm \a instrument.
+*/
+	int ScoreMidi::rhythmKey( EnumRhythmInstrument instrument )
+	{
+		switch( instrument )
+		{
+		case RHYTHM_INST_CHINESE_BOX:
+			return 76;
+		case RHYTHM_INST_CONGAS:
+			return 63;
+		case RHYTHM_INST_TAMBOURINE:
+			return 54;
+		case RHYTHM_INST_TRIANGLE:
+			return 81;
+		case RHYTHM_INST_BEAT_BOX:
+			return 38;
+		default:
+			return 36;		// Bass drum
+		}
+	}
+}
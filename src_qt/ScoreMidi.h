@@ -0,0 +1,72 @@
+/*!
+ \class CnotiAudio::ScoreMidi
+ \brief The ScoreMidi class reads and writes the scores as Standard MIDI Files (.mid).
+
+ The files are read in a single pass over a memory map, the events are not kept: the notes
+ of each track and channel are collected as they come, and then quantized to the score.
+
+ \list
+ \o The tempo is the first tempo of the file, rounded to the nearest TempoType. The later
+	changes of tempo are ignored.
+ \o The notes start and end in a grid of a SEMIHEMIDEMISEMIQUAVER, and take the longest
+	DurationType that fits before the next note. The silences are filled with pauses.
+	When several notes sound together the highest one is kept, as the melodies have one
+	note at a time, and a note covered by a higher one is played again when that one
+	ends. The octaves are moved into the ones of the samples.
+ \o As in the sound files, the notes of the melodies after the first of a sound are a
+	semitone higher in the score than in the file, see Score.h.
+ \o Each track and channel with notes is a melody, with the EnumInstrument of the family
+	of its General MIDI program, and the compass of the first time signature.
+ \o The notes of the channel 10 are the rhythms of a music, an EnumRhythmInstrument for
+	each percussion key known. As the files have no variations, RHYTHM_01 is used.
+ \endlist
+
+ A file is read as a music if it has one melody and rhythms, see peekKind(). A sound has
+ no rhythms, and a music only keeps the first melody. read() without a kind reads the file
+ as the kind it has, in a single pass.
+
+ The files written are of format 1, with a crotchet of CROTCHET ticks, so the durations
+ are kept exactly. The rhythms are written as a hit on each beat of their key.
+
+ readBatch() reads many files at the same time with QtConcurrent.
+
+ \version 2.2
+ \date 19-10-2026
+ \file ScoreMidi.h
+*/
+#if !defined(_SCOREMIDI_H)
+#define _SCOREMIDI_H
+
+#include <QString>
+#include <QStringList>
+#include <QList>
+#include <QByteArray>
+
+#include "Score.h"
+#include "soundmanager_global.h"
+
+namespace CnotiAudio
+{
+	class SOUNDMANAGER_EXPORT ScoreMidi
+	{
+	public:
+		static bool read( const QString& filename, EnumScoreKind kind, ScoreData* score, QString* error = 0 );
+		static bool read( const QString& filename, ScoreData* score, QString* error = 0 );
+		static bool read( const uchar* data, qint64 size, EnumScoreKind kind, ScoreData* score, QString* error = 0 );
+		static bool write( const QString& filename, const ScoreData& score );
+		static QByteArray toByteArray( const ScoreData& score );
+
+		static int readBatch( const QStringList& files, EnumScoreKind kind, QList<ScoreData>* scores,
+							  QStringList* errors = 0 );
+
+		static bool peekKind( const QString& filename, EnumScoreKind* kind );
+		static bool isMidi( const QString& filename );
+
+		static EnumInstrument instrument( int program );
+		static int program( EnumInstrument instrument );
+		static EnumRhythmInstrument rhythmInstrument( int key );
+		static int rhythmKey( EnumRhythmInstrument instrument );
+	};
+}
+
+#endif //_SCOREMIDI_H
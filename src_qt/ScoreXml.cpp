@@ -0,0 +1,437 @@
+/**
+	\file ScoreXml.cpp
+*/
+#include "ScoreXml.h"
+#include "SoundManager.h"
+// Qt
+#include <QFile>
+#include <QXmlStreamReader>
+#include <QXmlStreamWriter>
+
+namespace CnotiAudio
+{
+	//
+	// Document type written in the sound files
+	//
+	static const char* const soundDTD =
+		"<!DOCTYPE music [ <!ELEMENT music (melody)> <!ELEMENT melody  (note)> <!ELEMENT note  (#PCDATA)>]>";
+
+/*!
+	Reads the score of kind \a kind from the file \a filename to \a score.
+
+	Returns false if the file couldn't be read or is not valid, the reason is given in \a error.
+*/
+	bool ScoreXml::read( const QString& filename, EnumScoreKind kind, ScoreData* score, QString* error )
+	{
+		QFile file( filename );
+		if( !file.open( QIODevice::ReadOnly ) )
+		{
+			if( error )
+			{
+				*error = QString( "%1: %2" ).arg( filename ).arg( file.errorString() );
+			}
+			return false;
+		}
+		return read( &file, kind, score, error );
+	}
+
+/*!
+	Reads the score of kind \a kind from \a device to \a score.
+
+	Returns false if the xml is not valid, the reason is given in \a error with the line and the column.
+*/
+	bool ScoreXml::read( QIODevice* device, EnumScoreKind kind, ScoreData* score, QString* error )
+	{
+		*score = ScoreData( kind );
+		QXmlStreamReader reader( device );
+
+		bool result = ( kind == SCORE_MUSIC ) ? readMusic( reader, score ) : readSound( reader, score );
+		if( !result || reader.hasError() )
+		{
+			if( error )
+			{
+				*error = QString( "%1:%2: %3" ).arg( reader.lineNumber() )
+											   .arg( reader.columnNumber() )
+											   .arg( reader.errorString() );
+			}
+			return false;
+		}
+		return true;
+	}
+
+/*!
+	Writes \a score to the file \a filename.
+
+	Returns false if the file couldn't be written.
+*/
+	bool ScoreXml::write( const QString& filename, const ScoreData& score )
+	{
+		QFile file( filename );
+		if( !file.open( QIODevice::WriteOnly | QIODevice::Truncate ) )
+		{
+			return false;
+		}
+		return write( &file, score );
+	}
+
+/*!
+	Writes \a score to \a device, in the format of its kind.
+*/
+	bool ScoreXml::write( QIODevice* device, const ScoreData& score )
+	{
+		QXmlStreamWriter writer( device );
+		writer.setAutoFormatting( true );
+		writer.setAutoFormattingIndent( 4 );
+
+		if( score.kind == SCORE_MUSIC )
+		{
+			writer.writeStartDocument();
+			writer.writeStartElement( "music" );
+			writer.writeAttribute( "name", score.name );
+			writer.writeAttribute( "tempo", QString::number( score.tempo ) );
+			if( score.representation >= 0 )
+			{
+				writer.writeAttribute( "representation", QString::number( score.representation ) );
+			}
+			//
+			// Music has only one melody
+			//
+			if( !score.melodies.isEmpty() )
+			{
+				const ScoreMelody& melody = score.melodies.first();
+				writer.writeStartElement( "melody" );
+				writer.writeAttribute( "instrument", QString::number( melody.instrument ) );
+				for( int j = 0; j < melody.notes.size(); ++j )
+				{
+					const ScoreNote& note = melody.notes[j];
+					writer.writeEmptyElement( "note" );
+					writer.writeAttribute( "height", QString::number( note.height ) );
+					writer.writeAttribute( "duration", QString::number( note.duration ) );
+					writer.writeAttribute( "octave", QString::number( note.octave ) );
+				}
+				writer.writeEndElement();
+			}
+			//
+			// The rhythms without variation are not saved
+			//
+			for( int i = 0; i < score.rhythms.size(); ++i )
+			{
+				if( score.rhythms[i].variation != RHYTHM_UNKNOWN )
+				{
+					writer.writeEmptyElement( "rhythm" );
+					writer.writeAttribute( "instrument", QString::number( score.rhythms[i].instrument ) );
+					writer.writeAttribute( "variation", QString::number( score.rhythms[i].variation ) );
+				}
+			}
+			writer.writeEndElement();
+			writer.writeEndDocument();
+		}
+		else
+		{
+			writer.writeDTD( soundDTD );
+			writer.writeStartElement( "music" );
+			writer.writeAttribute( "name", score.name );
+			writer.writeAttribute( "tempo", QString::number( score.tempo ) );
+			if( score.duration != 0 )
+			{
+				writer.writeAttribute( "duration", QString::number( score.duration ) );
+			}
+			for( int i = 0; i < score.melodies.size(); ++i )
+			{
+				const ScoreMelody& melody = score.melodies[i];
+				writer.writeStartElement( "melody" );
+				writer.writeAttribute( "instrument", QString::number( melody.instrument ) );
+				writer.writeAttribute( "compass", QString::number( melody.compass ) );
+				for( int j = 0; j < melody.notes.size(); ++j )
+				{
+					const ScoreNote& note = melody.notes[j];
+					//
+					// Height and octave are saved together
+					//
+					int height = ( note.height == PAUSE ) ? -1 : note.height + ( note.octave + 2 ) * CS_NUMBERNOTE;
+					writer.writeEmptyElement( "note" );
+					writer.writeAttribute( "height", QString::number( height ) );
+					writer.writeAttribute( "duration", QString::number( note.duration ) );
+				}
+				writer.writeEndElement();
+			}
+			writer.writeEndElement();
+			writer.writeEndDocument();
+		}
+		return !writer.hasError();
+	}
+
+/*!
+	Converts \a text to an integer in \a value, without creating a string.
+
+	Returns false if \a text is not an integer.
+*/
+	bool ScoreXml::toInt( const QStringRef& text, int* value )
+	{
+		const QChar* c = text.unicode();
+		int size = text.size();
+		int i = 0;
+		while( i < size && c[i].isSpace() )
+		{
+			++i;
+		}
+		while( size > i && c[size - 1].isSpace() )
+		{
+			--size;
+		}
+		bool negative = false;
+		if( i < size && ( c[i] == QLatin1Char( '-' ) || c[i] == QLatin1Char( '+' ) ) )
+		{
+			negative = ( c[i] == QLatin1Char( '-' ) );
+			++i;
+		}
+		if( i >= size )
+		{
+			return false;
+		}
+		int result = 0;
+		for( ; i < size; ++i )
+		{
+			ushort digit = c[i].unicode() - '0';
+			if( digit > 9 || result > 99999999 )
+			{
+				return false;
+			}
+			result = result * 10 + digit;
+		}
+		*value = negative ? -result : result;
+		return true;
+	}
+
+/*!
+	Reads the attribute \a name of \a atts to \a value. If it doesn't exist \a value is kept,
+	unless it is \a required.
+
+	Returns false, raising the error in \a reader, if the attribute is not valid.
+*/
+	bool ScoreXml::attribute( QXmlStreamReader& reader, const QXmlStreamAttributes& atts, const char* name,
+							  int* value, bool required )
+	{
+		QStringRef text = atts.value( QLatin1String( name ) );
+		if( text.isEmpty() )
+		{
+			if( required )
+			{
+				reader.raiseError( QString( "Attribute %1 of %2 is missing" ).arg( name ).arg( reader.name().toString() ) );
+				return false;
+			}
+			return true;
+		}
+		if( !toInt( text, value ) )
+		{
+			reader.raiseError( QString( "Attribute %1 of %2 is not a number: %3" ).arg( name )
+																				  .arg( reader.name().toString() )
+																				  .arg( text.toString() ) );
+			return false;
+		}
+		return true;
+	}
+
+/*!
+	Reads a sound file.
+*/
+	bool ScoreXml::readSound( QXmlStreamReader& reader, ScoreData* score )
+	{
+		bool hasMusic = false;
+		while( !reader.atEnd() )
+		{
+			if( reader.readNext() != QXmlStreamReader::StartElement )
+			{
+				continue;
+			}
+			QStringRef tag = reader.name();
+			QXmlStreamAttributes atts = reader.attributes();
+			if( tag == QLatin1String( "music" ) )
+			{
+				int tempo = 0;
+				score->name = atts.value( QLatin1String( "name" ) ).toString();
+				if( score->name.isEmpty() )
+				{
+					reader.raiseError( "Attribute name of music is missing" );
+					return false;
+				}
+				if( !attribute( reader, atts, "tempo", &tempo, true ) ||
+					!attribute( reader, atts, "duration", &score->duration, false ) )
+				{
+					return false;
+				}
+				score->tempo = (TempoType)tempo;
+				hasMusic = true;
+			}
+			else if( tag == QLatin1String( "melody" ) )
+			{
+				int instrument = 0;
+				int compass = 0;
+				if( !attribute( reader, atts, "instrument", &instrument, true ) ||
+					!attribute( reader, atts, "compass", &compass, true ) )
+				{
+					return false;
+				}
+				score->melodies.append( ScoreMelody( (EnumInstrument)instrument, (CompassType)compass ) );
+			}
+			else if( tag == QLatin1String( "note" ) )
+			{
+				if( score->melodies.isEmpty() )
+				{
+					reader.raiseError( "Note outside of a melody" );
+					return false;
+				}
+				int height = 0;
+				int duration = 0;
+				ScoreNote note;
+				if( !attribute( reader, atts, "height", &height, true ) ||
+					!attribute( reader, atts, "duration", &duration, true ) ||
+					!attribute( reader, atts, "intensity", &note.intensity, false ) ||
+					!attribute( reader, atts, "position", &note.position, false ) )
+				{
+					return false;
+				}
+				note.duration = (DurationType)duration;
+				//
+				// Height and octave are saved together
+				//
+				if( height <= 0 )
+				{
+					note.height = PAUSE;
+					note.octave = OCTAVE_C3;
+				}
+				else
+				{
+					note.height = (NoteType)( height % CS_NUMBERNOTE );
+					note.octave = height / CS_NUMBERNOTE - 2;
+				}
+				score->melodies.last().notes.append( note );
+			}
+		}
+		if( !reader.hasError() && !hasMusic )
+		{
+			reader.raiseError( "Element music not found" );
+		}
+		return !reader.hasError();
+	}
+
+/*!
+	Reads a music file.
+*/
+	bool ScoreXml::readMusic( QXmlStreamReader& reader, ScoreData* score )
+	{
+		bool hasMusic = false;
+		while( !reader.atEnd() )
+		{
+			if( reader.readNext() != QXmlStreamReader::StartElement )
+			{
+				continue;
+			}
+			QStringRef tag = reader.name();
+			QXmlStreamAttributes atts = reader.attributes();
+			if( tag == QLatin1String( "music" ) )
+			{
+				int tempo = 0;
+				score->name = atts.value( QLatin1String( "name" ) ).toString();
+				if( !attribute( reader, atts, "tempo", &tempo, false ) ||
+					!attribute( reader, atts, "representation", &score->representation, false ) )
+				{
+					return false;
+				}
+				score->tempo = SoundManager::convertIntToTempo( tempo );
+				if( score->tempo == TEMPO_UNKNOWN )
+				{
+					reader.raiseError( "Unknown tempo" );
+					return false;
+				}
+				hasMusic = true;
+			}
+			else if( tag == QLatin1String( "melody" ) )
+			{
+				int instrument = 0;
+				if( !attribute( reader, atts, "instrument", &instrument, false ) )
+				{
+					return false;
+				}
+				ScoreMelody melody( SoundManager::convertIntToInstrument( instrument ) );
+				if( melody.instrument == INSTRUMENT_UNKNOWN )
+				{
+					reader.raiseError( "Unknown instrument" );
+					return false;
+				}
+				score->melodies.append( melody );
+			}
+			else if( tag == QLatin1String( "note" ) )
+			{
+				if( score->melodies.isEmpty() )
+				{
+					reader.raiseError( "Note outside of a melody" );
+					return false;
+				}
+				int height = 0;
+				int duration = 0;
+				int octave = 0;
+				if( !attribute( reader, atts, "height", &height, false ) ||
+					!attribute( reader, atts, "duration", &duration, false ) ||
+					!attribute( reader, atts, "octave", &octave, false ) )
+				{
+					return false;
+				}
+				ScoreNote note( SoundManager::convertIntToDuration( duration ),
+								SoundManager::convertIntToHeight( height ),
+								SoundManager::convertIntToOctave( octave ) );
+				if( note.height == UNKNOWN_NOTE )
+				{
+					reader.raiseError( "Unknown note" );
+					return false;
+				}
+				if( note.duration == UNKNOWN_DURATION )
+				{
+					reader.raiseError( "Unknown duration" );
+					return false;
+				}
+				if( note.octave == OCTAVE_UNKNOWN )
+				{
+					reader.raiseError( "Unknown octave" );
+					return false;
+				}
+				score->melodies.last().notes.append( note );
+			}
+			else if( tag == QLatin1String( "rhythm" ) )
+			{
+				int instrument = 0;
+				int variation = 0;
+				if( !attribute( reader, atts, "instrument", &instrument, false ) ||
+					!attribute( reader, atts, "variation", &variation, false ) )
+				{
+					return false;
+				}
+				ScoreRhythm rhythm( SoundManager::convertIntToRhythmInstrument( instrument ),
+									SoundManager::convertIntToRhythmVariation( variation ) );
+				if( rhythm.instrument == RHYTHM_INST_UNKNOWN )
+				{
+					reader.raiseError( "Unknown rhythm" );
+					return false;
+				}
+				if( rhythm.variation == RHYTHM_UNKNOWN )
+				{
+					reader.raiseError( "Unknown rhythm variation" );
+					return false;
+				}
+				score->rhythms.append( rhythm );
+			}
+		}
+		if( !reader.hasError() )
+		{
+			if( !hasMusic )
+			{
+				reader.raiseError( "Element music not found" );
+			}
+			else if( score->melodies.isEmpty() )
+			{
+				reader.raiseError( "Element melody not found" );
+			}
+		}
+		return !reader.hasError();
+	}
+}
@@ -0,0 +1,56 @@
+/*!
+ \class CnotiAudio::ScoreXml
+ \brief The ScoreXml class reads and writes the xml files of the Sound and Music scores.
+
+ The files are read in a single pass with QXmlStreamReader, the attributes are converted
+ straight to the enums of the score, without building a document. When the file is not
+ valid the error is reported with its line and column.
+
+ Both formats have a music element as root:
+
+ \list
+ \o Sound files have several melodies, with instrument and compass, and the notes
+	have the height and the octave combined in one value, height + (octave + 2) * 12,
+	or -1 for a pause.
+ \o Music files have one melody, with the instrument, and the notes have height,
+	duration and octave. The rhythms are after the melody.
+ \endlist
+
+ \version 2.2
+ \date 19-10-2026
+ \file ScoreXml.h
+*/
+#if !defined(_SCOREXML_H)
+#define _SCOREXML_H
+
+#include <QString>
+#include <QStringRef>
+
+#include "Score.h"
+#include "soundmanager_global.h"
+
+class QIODevice;
+class QXmlStreamReader;
+class QXmlStreamAttributes;
+
+namespace CnotiAudio
+{
+	class SOUNDMANAGER_EXPORT ScoreXml
+	{
+	public:
+		static bool read( const QString& filename, EnumScoreKind kind, ScoreData* score, QString* error = 0 );
+		static bool read( QIODevice* device, EnumScoreKind kind, ScoreData* score, QString* error = 0 );
+		static bool write( const QString& filename, const ScoreData& score );
+		static bool write( QIODevice* device, const ScoreData& score );
+
+		static bool toInt( const QStringRef& text, int* value );
+
+	private:
+		static bool readSound( QXmlStreamReader& reader, ScoreData* score );
+		static bool readMusic( QXmlStreamReader& reader, ScoreData* score );
+		static bool attribute( QXmlStreamReader& reader, const QXmlStreamAttributes& atts, const char* name,
+							   int* value, bool required );
+	};
+}
+
+#endif //_SCOREXML_H
@@ -1,30 +1,46 @@
 #include <QString>
 #include <QFile>
-#include <QtXml/QDomDocument>
-#include <QtXml/QXmlSimpleReader>
-#include <QtXml/QXmlInputSource>
 #include <QDebug>
 #include <QListIterator>
+#include <QElapsedTimer>
+#include <QtConcurrentMap>
 
 #include "math.h"
 
-#include "XmlSoundHandler.h"
+#include "ScoreXml.h"
+#include "ScoreBinary.h"
+#include "ScoreMidi.h"
 #include "SoundManager.h"
 #include "Sound.h"
 #include "Melody.h"
 #include "Note.h"
 #include "LogManager.h"
+#include "PerfCounters.h"
+#include "MixBus.h"
+#include "DspGraph.h"
+#include "SoundLog.h"
 
 #include <QDebug>
 
 namespace CnotiAudio
 {
+	//
+	// Joins the notes fetched by a melody, for QtConcurrent
+	//
+	static void joinMelody( Melody*& melody )
+	{
+		melody->joinRender();
+	}
+
 /*!
 	Constructs an empty sound with the name \a name, with the duration \a duration and with tempo \a tempo.
 */
 	Sound::Sound(const QString name, int duration, TempoType tempo)
 	{
 		Sound( name, tempo );
+		_rangeFrom = 0;
+		_rangeTo = -1;
+		_mixMode = MIX_MODE_LEGACY;
 		_musicDuration = duration;
 		_totalDuration = 0;
 	}
@@ -39,6 +55,9 @@ namespace CnotiAudio
 
 		// default is play all melody
 		_playMelody		= -1;
+		_rangeFrom		= 0;
+		_rangeTo		= -1;
+		_mixMode		= MIX_MODE_LEGACY;
 		_iFrequency		= 0;
 
 		_musicDuration	= 0;
@@ -53,6 +72,9 @@ namespace CnotiAudio
 	{
 		_tempo       = other._tempo;
 		_playMelody	 = other._playMelody;
+		_rangeFrom	 = 0;
+		_rangeTo	 = -1;
+		_mixMode	 = MIX_MODE_LEGACY;
 		_soundMgr    = other._soundMgr;
 
 		_musicDuration	= other._musicDuration;
@@ -75,6 +97,9 @@ namespace CnotiAudio
 	{
 		_tempo			= other._tempo;
 		_playMelody		= other._playMelody;
+		_rangeFrom		= 0;
+		_rangeTo		= -1;
+		_mixMode		= MIX_MODE_LEGACY;
 		_soundMgr = other._soundMgr;
 
 		for(int i=0; i < other._melodyList.size(); i++)
@@ -105,11 +130,17 @@ namespace CnotiAudio
 //		_flagThreadSoundStopped = true;
 		_stopped = true;
 		//alDeleteSources(1, &_uiSource);
+		//
+		// No voice can be stolen from the melodies while they are deleted
+		//
+		_soundMgr->checkInSources( this );
 		for( int i = 0; i < _melodyList.size(); i++ )
 		{
 			delete( _melodyList[i]);
 		}
 		_melodyList.clear();
+		_data.clear();
+		_mixMelodies.clear();
 		_lastError = CS_NO_ERROR;
 	}
 
@@ -135,46 +166,55 @@ namespace CnotiAudio
 	}
 
 /*!
-	Loads a sound from the XML file \a filename.
+	Loads a sound from the XML file \a filename, from the binary file if it has the .csb
+	extension, or from the MIDI file if it has the .mid extension.
 
 	Parses the file to get the information about the sound, melodies and notes.
 */
 	bool Sound::load( const QString filename )
 	{
 		QFile f( filename );
-
-		XmlSoundHandler *handler = new XmlSoundHandler();
-		QXmlInputSource source( &f );
-		if( source.data() == "" )
+		if( !f.exists() || f.size() == 0 )
 		{
 			_lastError = CS_FILE_NOT_EXISTE;
 			return false;
 		}
-		QXmlSimpleReader reader;
-		reader.setContentHandler( handler );
 		//
 		// Retrives data from file
 		//
-		if( reader.parse( source ) )
+		ScoreData data;
+		QString error;
+		bool result;
+		if( ScoreBinary::isBinary( filename ) )
 		{
-			//
-			// Retrives data from handler
-			//
-			if(recoverDataToHandler(handler))
-			{
-				_lastError = CS_NO_ERROR;
-				return true;
-			}
-			else
-			{
-				_lastError = CS_PARSER_ERROR;
-			}
+			result = ScoreBinary::read( filename, &data, &error );
+		}
+		else if( ScoreMidi::isMidi( filename ) )
+		{
+			result = ScoreMidi::read( filename, SCORE_SOUND, &data, &error );
 		}
 		else
 		{
+			result = ScoreXml::read( filename, SCORE_SOUND, &data, &error );
+		}
+		if( result && data.kind != SCORE_SOUND )
+		{
+			error = "The file has a music, not a sound";
+			result = false;
+		}
+		if( !result )
+		{
+			csWarning() << "[Sound::load]" << filename << error;
 			_lastError = CS_PARSER_ERROR;
+			return false;
 		}
-		return false;
+		if( !setScore( data ) )
+		{
+			_lastError = CS_PARSER_ERROR;
+			return false;
+		}
+		_lastError = CS_NO_ERROR;
+		return true;
 	}
 
 /*!
@@ -193,7 +233,7 @@ namespace CnotiAudio
 */
 	bool Sound::playSound( bool loop, bool blockSignal )
 	{
-		qDebug() << "[Sound::playSound] - Loop:" << loop << "blockSignal" << blockSignal;
+		csDebug() << "[Sound::playSound] - Loop:" << loop << "blockSignal" << blockSignal;
 		_loop = loop;
 		blockSignals( blockSignal );
 		int numberNotes = 0;
@@ -205,10 +245,19 @@ namespace CnotiAudio
 			if( _melodyList[i]->getNumberNotes() > 0 )
 			{
 				numberNotes += _melodyList[i]->getNumberNotes();
+				ALuint source = checkOutMelodySource( i );
+				if( source == 0 && i > 0 )
+				{
+					//
+					// The other melodies keep on playing without this one
+					//
+					csWarning() << "[Sound::playSound] - No sound source available for melody" << i << "of sound:" << _name;
+					continue;
+				}
 				//
 				// PLAY melody
 				//
-				if( !_melodyList[i]->playSound( _soundMgr->checkOutSource(), loop, blockSignal ) )
+				if( !_melodyList[i]->playRange( source, _rangeFrom, _rangeTo, loop, blockSignal ) )
 				{
 					_lastError = _melodyList[i]->getLastError();
 					_stopped = false; // To do everything in the stopSound()
@@ -228,7 +277,7 @@ namespace CnotiAudio
 
 		_playMelody = -1;
 
-		qDebug() << "[Sound::playSound] - Emit soundPlaying of sound:" << _name;
+		csDebug() << "[Sound::playSound] - Emit soundPlaying of sound:" << _name;
 		emit soundPlaying( _name );
 		_currTime = 0;
 		_pauseTime = 0;
@@ -258,13 +307,13 @@ namespace CnotiAudio
 */
 	bool Sound::playSound( int melodyId, bool loop, bool blockSignal )
 	{
-		qDebug() << "[Sound::playSound] - Melody ID:" << melodyId << "loop:" << "blockSignal" << blockSignal;
+		csDebug() << "[Sound::playSound] - Melody ID:" << melodyId << "loop:" << "blockSignal" << blockSignal;
 		if( melodyId < 0 )
 		{
 			//
 			// play all melodies
 			//
-			qDebug() << "[Sound::playSound] - Play all melodies";
+			csDebug() << "[Sound::playSound] - Play all melodies";
 			return playSound( loop, blockSignal );
 		}
 		_loop = loop;
@@ -277,16 +326,16 @@ namespace CnotiAudio
 			if( _melodyList[melodyId]->getNumberNotes() == 0)
 			{
 				_lastError = CS_MELODY_EMPTY;
-				qWarning() << "[Sound::playSound] - melody empty";
+				csWarning() << "[Sound::playSound] - melody empty";
 				return false;
 			}
 			//
 			// PLAY melody
 			//
-			if( !_melodyList[melodyId]->playSound( _soundMgr->checkOutSource(), loop, blockSignal ) )
+			if( !_melodyList[melodyId]->playRange( checkOutMelodySource( melodyId ), _rangeFrom, _rangeTo, loop, blockSignal ) )
 			{
 				_lastError = _melodyList[melodyId]->getLastError();
-				qWarning() << "[Sound::playSound] - Melody:" << melodyId << "Trying to play error:" << _lastError;
+				csWarning() << "[Sound::playSound] - Melody:" << melodyId << "Trying to play error:" << _lastError;
 				stopSound();
 				return false;
 			}
@@ -298,7 +347,7 @@ namespace CnotiAudio
 			return false;
 		}
 
-		qDebug() << "[Sound::playSound] - emit soundPlaying of sound: " << _name;
+		csDebug() << "[Sound::playSound] - emit soundPlaying of sound: " << _name;
 		emit soundPlaying( _name );
 		_currTime = 0;
 		_pauseTime = 0;
@@ -311,6 +360,88 @@ namespace CnotiAudio
 		return true;
 	}
 
+/*!
+	Plays the part of the sound from the position \a from to the position \a to, or to the end
+	if -1, of all the melodies (\a melodyId = -1) or only of one melody. The positions are in
+	the units of the note durations.
+
+	Each melody starts at the note playing at \a from, in the middle of it if needed, without
+	playing the notes before. When played in \a loop, the same part is played again.
+
+	\sa playFrom() and playBars().
+*/
+	bool Sound::playRange( int melodyId, int from, int to, bool loop, bool blockSignal )
+	{
+		_rangeFrom = qMax( from, 0 );
+		_rangeTo = to;
+		bool result = playSound( melodyId, loop, blockSignal );
+		_rangeFrom = 0;
+		_rangeTo = -1;
+		return result;
+	}
+
+/*!
+	Plays the sound from the note \a note of the melody \a melodyId. If \a melodyId is -1 all
+	the melodies are played from the position of the note in the first melody.
+*/
+	bool Sound::playFrom( int melodyId, int note, bool loop, bool blockSignal )
+	{
+		int melody = qMax( melodyId, 0 );
+		if( !checkIdMelody( melody ) )
+		{
+			return false;
+		}
+		int position = _melodyList[melody]->getNotePosition( note );
+		if( position < 0 )
+		{
+			_lastError = CS_NOTE_NOT_EXISTE;
+			return false;
+		}
+		return playRange( melodyId, position, -1, loop, blockSignal );
+	}
+
+/*!
+	Plays the bars from \a firstBar to \a lastBar, counting from 0, of the melody \a melodyId,
+	or of all the melodies if -1. The bars are measured with the compass of the first melody
+	when all are played.
+
+	With \a loop true the bars are repeated, for example to practice a passage.
+*/
+	bool Sound::playBars( int melodyId, int firstBar, int lastBar, bool loop, bool blockSignal )
+	{
+		int melody = qMax( melodyId, 0 );
+		if( !checkIdMelody( melody ) || lastBar < firstBar )
+		{
+			return false;
+		}
+		Melody* m = _melodyList[melody];
+		return playRange( melodyId, m->getBarPosition( firstBar ), m->getBarPosition( lastBar + 1 ), loop, blockSignal );
+	}
+
+/*!
+	Moves the melodies being played to the sample frame \a frame, counted from the beginning
+	of the sound. The melodies that already ended are not played again.
+
+	Returns false if the sound is stopped.
+*/
+	bool Sound::seek( qint64 frame )
+	{
+		if( _stopped )
+		{
+			_lastError = CS_IS_ALREADY_STOPPED;
+			return false;
+		}
+		bool result = false;
+		for( int i = 0; i < _melodyList.size(); i++ )
+		{
+			if( ( _playMelody < 0 || _playMelody == i ) && !_melodyList[i]->isStopped() )
+			{
+				result = _melodyList[i]->seek( frame ) || result;
+			}
+		}
+		return result;
+	}
+
 /*!
 	Plays the sound previously loaded.
 
@@ -322,7 +453,7 @@ namespace CnotiAudio
 */
 	bool Sound::playSound()
 	{
-		qDebug() << "[Sound::playSound]";
+		csDebug() << "[Sound::playSound]";
 		return playSound( false, false);
 	}
 
@@ -370,14 +501,14 @@ namespace CnotiAudio
 			if( playing )
 			{
 				_pauseTime += _timer->elapsed();
-				qDebug() << "[Sound::pauseSound] - Emit soundPaused of sound:" << _name;
+				csDebug() << "[Sound::pauseSound] - Emit soundPaused of sound:" << _name;
 				emit soundPaused( _name );
 			}
 			else
 			{
 				_timer->restart();
 				start();
-				qDebug() << "[Sound::pauseSound] - Emit soundPlaying of sound:" << _name;
+				csDebug() << "[Sound::pauseSound] - Emit soundPlaying of sound:" << _name;
 				emit soundPlaying( _name );
 			}
 			return true;
@@ -408,13 +539,13 @@ namespace CnotiAudio
 		for( int i=0; i < _melodyList.size(); i++ )
 		{
 			_melodyList[i]->stopSound();
-			_soundMgr->checkInSource( _melodyList[i]->getSource() );
+			_soundMgr->checkInSource( _melodyList[i]->getSource(), this );
 			_melodyList[i]->setSource( 0 );
 		}
 
 		_flagThreadSoundStopped = true;
 		_stopped = true;
-		qDebug() << "[Sound::stopSound] - Emit soundStopped of sound:" << _name;
+		csDebug() << "[Sound::stopSound] - Emit soundStopped of sound:" << _name;
 		emit soundStopped( _name );
 
 		return true;
@@ -427,7 +558,7 @@ namespace CnotiAudio
 */
 	int Sound::addMelody(EnumInstrument instrument, CompassType compass)
 	{
-		qDebug() << "[Sound::addMelody] - Instrument:" << instrument << "Compass:" << compass;
+		csDebug() << "[Sound::addMelody] - Instrument:" << instrument << "Compass:" << compass;
 		int numberExistingMelodies = _melodyList.size();
 		//
 		// Creates melody
@@ -454,12 +585,12 @@ namespace CnotiAudio
 			{
 				// connect only the first melody, used in instruments
 				connectMelody(numberExistingMelodies);
-				qDebug() << "[Sound::addMelody] - Melody connected:" << numberExistingMelodies;
+				csDebug() << "[Sound::addMelody] - Melody connected:" << numberExistingMelodies;
 			}
 
 			// Sets the melody volume
 			mel->setIntensity( _intensity );
-			qDebug() << "[Sound::addMelody] - Melody added";
+			csDebug() << "[Sound::addMelody] - Melody added";
 
 			return( numberExistingMelodies );
 		}
@@ -479,7 +610,7 @@ namespace CnotiAudio
 		// Test if the melody already exist for this instrument
 		if( melodyId != -1)
 		{
-			qDebug() << "[Sound::addRhythm] - Rhythm already present.";
+			csDebug() << "[Sound::addRhythm] - Rhythm already present.";
 			return -1;
 		}
 
@@ -499,7 +630,7 @@ namespace CnotiAudio
 		// TODO: each rhythm has different intensity
 		//
 		m->setIntensity( _intensity );
-		qDebug() << "[Sound::addRhythm] - New rhythm added. ID:" << melodyId;
+		csDebug() << "[Sound::addRhythm] - New rhythm added. ID:" << melodyId;
 		return melodyId;
 	}
 
@@ -570,11 +701,11 @@ namespace CnotiAudio
 */
 	bool Sound::changeRhythm( EnumInstrument instrument, int rhythmId )
 	{
-		qDebug() << "[Sound::changeRhythm] - Instrument:" << instrument << "Rhythm:" << rhythmId;
+		csDebug() << "[Sound::changeRhythm] - Instrument:" << instrument << "Rhythm:" << rhythmId;
 
 		// Search for a melody with the instrument
 		int melodyId = getMelodyId( instrument );
-		qDebug() << "[Sound::changeRythm] - Instrument:" << instrument << "melodyID:" << melodyId;
+		csDebug() << "[Sound::changeRythm] - Instrument:" << instrument << "melodyID:" << melodyId;
 		if( rhythmId == RHYTHM_UNKNOWN )
 		{
 			//
@@ -584,9 +715,9 @@ namespace CnotiAudio
 			{
 				_melodyList[melodyId]->clear();
 				_melodyList.removeAt(melodyId);
-				qDebug() << "[Sound::changeRythm] - remove rhythm";
+				csDebug() << "[Sound::changeRythm] - remove rhythm";
 			}
-			qDebug() << "[Sound::changeRythm] - remove rhythm";
+			csDebug() << "[Sound::changeRythm] - remove rhythm";
 			_lastError = CS_NO_ERROR;
 			return true;
 		}
@@ -594,13 +725,13 @@ namespace CnotiAudio
 		if( melodyId == -1 )
 		{
 			// Doesn't exist so adds new rhythm
-			qDebug() << "[Sound::changeRythm] - Add new rhythm";
+			csDebug() << "[Sound::changeRythm] - Add new rhythm";
 			melodyId = addRhythm(instrument);
 		}
 		else
 		{
 			// Deletes all "notes"
-			qDebug() << "[Sound::changeRythm] - clean rhythm";
+			csDebug() << "[Sound::changeRythm] - clean rhythm";
 			_melodyList[melodyId]->deleteAllNote();
 		}
 
@@ -623,7 +754,7 @@ namespace CnotiAudio
 		//
 		for( int i = 0; i < numberCompass; i++ )
 		{
-			qDebug() << "[Sound::changeRythm] - Add note" << rhythmId << "duration:" << duration << "melody:" << melodyId;
+			csDebug() << "[Sound::changeRythm] - Add note" << rhythmId << "duration:" << duration << "melody:" << melodyId;
 			addNote( duration, (NoteType)(rhythmId), 3, 127, melodyId );
 		}
 
@@ -673,7 +804,7 @@ namespace CnotiAudio
 	{
 		if( !checkIdMelody( melody ) )
 		{
-			qWarning() << "[Sound::addNote] - Melody:" << melody << "not found";
+			csWarning() << "[Sound::addNote] - Melody:" << melody << "not found";
 			return false;
 		}
 		//
@@ -682,7 +813,7 @@ namespace CnotiAudio
 		if( !_melodyList[melody]->addNote( duration, height, octave, intensity ) )
 		{
 			_lastError = _melodyList[melody]->getLastError();
-			qWarning() << "[Sound::addNote] - Trying to add note error:" << _lastError;
+			csWarning() << "[Sound::addNote] - Trying to add note error:" << _lastError;
 			return false;
 		}
 		//
@@ -907,90 +1038,150 @@ namespace CnotiAudio
 */
 	float Sound::percentPlay()
 	{
-		if( isStopped() || _totalDuration <=0 )
+		if( isStopped() )
 		{
 			return 0;
 		}
+		return playPosition().percent();
+	}
 
-		if( _playMelody < 0 )
+/*!
+	Returns the position of the sound being played.
+
+	When all the melodies are playing, the position is the one of the longest melody, that
+	ends the sound.
+*/
+	PlayPosition Sound::playPosition()
+	{
+		if( _playMelody >= 0 )
 		{
-			return (_currTime*1.0) / (_totalDuration*1.0);
+			return checkIdMelody( _playMelody ) ? _melodyList[_playMelody]->playPosition() : PlayPosition();
 		}
-		else if( checkIdMelody( _playMelody ) )
+		PlayPosition position;
+		for( int i = 0; i < _melodyList.size(); i++ )
 		{
-			return (_currTime*1.0) / (_melodyList[_playMelody]->getTotalDuration()*1.0);
+			PlayPosition melody = _melodyList[i]->playPosition();
+			if( melody.frames > position.frames )
+			{
+				position = melody;
+			}
 		}
-
-		return 0;
+		return position;
 	}
 
 /*!
-	Saves the sound into a XML file.
+	Saves the sound into a XML file, into a binary file if \a filename has the .csb extension,
+	or into a MIDI file if it has the .mid extension.
+
+	The notes of the melodies after the first are written a semitone higher than they play,
+	as load() reads them. The files saved before had them as they play, so they were lowered a
+	semitone by each save and load.
 */
 	bool Sound::save( const QString filename )
 	{
+		if( ScoreBinary::isBinary( filename ) )
+		{
+			_lastError = ScoreBinary::write( filename, score() ) ? CS_NO_ERROR : CS_FILE_ERROR;
+			return _lastError == CS_NO_ERROR;
+		}
+		if( ScoreMidi::isMidi( filename ) )
+		{
+			_lastError = ScoreMidi::write( filename, score() ) ? CS_NO_ERROR : CS_FILE_ERROR;
+			return _lastError == CS_NO_ERROR;
+		}
 		QString newSoundName = filename;
 		if(!newSoundName.contains(".xml"))
 		{
 			newSoundName.append(".xml");
 		}
-		//filename += ".xml";
-		QDomDocument doc("music [ <!ELEMENT music (melody)> <!ELEMENT melody  (note)> <!ELEMENT note  (#PCDATA)>]");
-		QFile file( newSoundName );
-		if( file.open( QIODevice::WriteOnly ) ) {
-
-			QTextStream stream( &file );
+		if( ScoreXml::write( newSoundName, score() ) )
+		{
+			_lastError = CS_NO_ERROR;
+			return true;
+		}
+		_lastError = CS_FILE_ERROR;
+		return false;
+	}
 
-			QDomElement root = doc.createElement( "music" );
-			root.setAttribute( "name", _name );
-			doc.appendChild(root);
+/*!
+	Replaces the melodies and notes of the sound by the ones of \a score. The notes of the
+	melodies after the first are a semitone lower than in the score.
 
-			root.setAttribute( "tempo", QString::number( _tempo ) );
-			if( _musicDuration != 0 )
-			{
-				root.setAttribute( "duration", QString::number( _musicDuration ) );
-			}
-			//
-			// Saves the melodies information
-			//
-			for(int i=0; i < _melodyList.size(); i++ )
+	Returns false if some note is not valid.
+*/
+	bool Sound::setScore( const ScoreData& score )
+	{
+		this->release();
+		_tempo = score.tempo;
+		_musicDuration = score.duration;
+		//
+		// Gets info for each melody
+		//
+		for( int i=0; i < score.melodies.size(); i++ )
+		{
+			const ScoreMelody& melody = score.melodies[i];
+			int id = addMelody( melody.instrument, melody.compass );
+			if(id != -1)
 			{
-				QDomElement melody = doc.createElement( "melody" );
-				root.appendChild( melody );
-
-				QList<Note*> noteList = _melodyList[i]->getNotes();
-				melody.setAttribute( "instrument", _melodyList[i]->getInstrument());
-				melody.setAttribute( "compass", QString::number( _melodyList[i]->getCompass()));
+				_iFrequency = 0;
 				//
-				// Saves the notes information
+				// Gets info for each note
 				//
-				for( int j=0; j < noteList.size(); j++ )
+				for( int j=0; j < melody.notes.size(); j++ )
 				{
-					QDomElement note = doc.createElement( "note" );
-					melody.appendChild( note );
-
-					if( noteList[j]->getHeight() == PAUSE )
+					ScoreNote note = melody.notes[j];
+					//
+					// The notes of the melodies after the first are a semitone higher in the score
+					//
+					if(id > 0)
 					{
-						note.setAttribute("height",-1);
+						note.transpose( -1 );
 					}
-					else
+					if( !Melody::checkOctave( note.octave ) )
 					{
-						note.setAttribute("height",QString::number(noteList[j]->getHeight() + (noteList[j]->getOctave()+2)*CS_NUMBERNOTE));
+						_lastError = CS_VALUE_OCTAVE_ERROR;
+						return false;
 					}
-					note.setAttribute("duration",QString::number(noteList[j]->getDuration()));
-//					note.setAttribute("position",QString::number(noteList[j]->getPosition()));
-//					note.setAttribute("intensity",QString::number(noteList[j]->getIntensity()));
+					insertNote(note.position, note.duration, note.height, note.octave, note.intensity, id);
 				}
+				_melodyList[id]->setGraphicBreakLines( melody.breakLines );
 			}
+			else
+			{
+				csWarning() << "[Sound::setScore] - Couldn't create melody number:" << i ;
+			}
+		}
+		return true;
+	}
 
-			doc.save(stream,4);
-
-			file.close();
-			_lastError = CS_NO_ERROR;
-			return true;
+/*!
+	Returns the melodies and notes of the sound, with the notes of the melodies after the
+	first a semitone higher, as given to setScore().
+*/
+	ScoreData Sound::score()
+	{
+		ScoreData data( SCORE_SOUND );
+		data.name = _name;
+		data.tempo = _tempo;
+		data.duration = _musicDuration;
+		for( int i=0; i < _melodyList.size(); i++ )
+		{
+			ScoreMelody melody( _melodyList[i]->getInstrument(), _melodyList[i]->getCompass() );
+			QList<Note*> noteList = _melodyList[i]->getNotes();
+			melody.notes.reserve( noteList.size() );
+			for( int j=0; j < noteList.size(); j++ )
+			{
+				ScoreNote note( noteList[j]->getDuration(), noteList[j]->getHeight(), noteList[j]->getOctave() );
+				if( i > 0 )
+				{
+					note.transpose( 1 );
+				}
+				melody.notes.append( note );
+			}
+			melody.breakLines = _melodyList[i]->getGraphicBreakLines();
+			data.melodies.append( melody );
 		}
-		_lastError = CS_FILE_ERROR;
-		return false;
+		return data;
 	}
 
 /*!
@@ -1112,7 +1303,7 @@ namespace CnotiAudio
 */
 	bool Sound::setInstrument(EnumInstrument instrument, int melody)
 	{
-		qDebug() << "[Sound::setInstrument]"<< "--------------------  Sound::setInstrument(" << CnotiLogManager::number((int)instrument) <<", "<<CnotiLogManager::number(melody)<<")";
+		csDebug() << "[Sound::setInstrument]"<< "--------------------  Sound::setInstrument(" << CnotiLogManager::number((int)instrument) <<", "<<CnotiLogManager::number(melody)<<")";
 		if( checkIdMelody( melody ) )
 		{
 			bool result = _melodyList[melody]->setInstrument( instrument );
@@ -1129,7 +1320,7 @@ namespace CnotiAudio
 */
 	bool Sound::setMelodyTempo(TempoType tempo, int melody)
 	{
-		qDebug() << "[Sound::setMelodyTempo]"<< "--------------------  Sound::setMelodyTempo(" << CnotiLogManager::number(tempo) <<", "<<CnotiLogManager::number(melody)<<")";
+		csDebug() << "[Sound::setMelodyTempo]"<< "--------------------  Sound::setMelodyTempo(" << CnotiLogManager::number(tempo) <<", "<<CnotiLogManager::number(melody)<<")";
 		if( checkIdMelody(melody) )
 		{
 			bool result = _melodyList[melody]->setTempo(tempo);
@@ -1147,7 +1338,7 @@ namespace CnotiAudio
 */
 	bool Sound::setTempo(TempoType tempo)
 	{
-		qDebug() << "[Sound::setTempo]"<< "--------------------  Sound::setTempo(" << CnotiLogManager::number(tempo) <<", "<<CnotiLogManager::number(tempo)<<")";
+		csDebug() << "[Sound::setTempo]"<< "--------------------  Sound::setTempo(" << CnotiLogManager::number(tempo) <<", "<<CnotiLogManager::number(tempo)<<")";
 
 		for( int i=0; i < _melodyList.size(); i++ )
 		{
@@ -1339,68 +1530,187 @@ namespace CnotiAudio
 /*!
 	Returns the data buffer of the sound.
 
-	Mixes all the melodies into one buffer.
+	Mixes all the melodies into one buffer. The mix is kept, and only the samples changed in
+	the melodies since the last call are mixed again. The samples are shared with the sound,
+	a change of the sound doesn't change the buffers already returned.
 */
-	short* Sound::getData()
+	PcmBuffer Sound::getData()
 	{
-		if(_melodyList.size()>0){
+		QElapsedTimer renderTimer;
+		renderTimer.start();
 
-			_data = new short[getSize()];
-			int auxSize = _melodyList[0]->getSize();
-			memcpy(_data, _melodyList[0]->getData(), auxSize);
-			long maxA, maxB = -999999;
-			long minA, minB = 999999;
-
-			/**
-			* mix's every track to one monoral track
-			*/
-			for( int i=1; i<_melodyList.size(); i++ )
+		if( _melodyList.isEmpty() )
+		{
+			_data.clear();
+			_mixMelodies.clear();
+			return _data;
+		}
+		preloadScoreSamples();
+		//
+		// Joins the notes of the melodies changed, each melody in a thread of the pool
+		//
+		QList<Melody*> joinMelodies;
+		for( int i=0; i < _melodyList.size(); i++ )
+		{
+			if( _melodyList[i]->fetchRender() )
 			{
-				if( _melodyList[i]->isEmpty() )
-				{
-					continue;
-				}
+				joinMelodies.append( _melodyList[i] );
+			}
+		}
+		if( joinMelodies.size() > 1 )
+		{
+			QtConcurrent::blockingMap( joinMelodies, joinMelody );
+		}
+		else if( joinMelodies.size() == 1 )
+		{
+			joinMelodies[0]->joinRender();
+		}
+		//
+		// First sample changed in any melody, all if the melodies, their intensity or the mix changed
+		//
+		QList<float> intensities;
+		for( int i=0; i < _melodyList.size(); i++ )
+		{
+			intensities.append( _melodyList[i]->getIntensity() );
+		}
+		EnumMixMode mixMode = _soundMgr->getMixMode();
+		DspEffects mixEffects = _soundMgr->getMixEffects();
+		int size = getSize() / sizeof(short);
+		int from = ( _mixMelodies != _melodyList || _mixIntensities != intensities || _mixMode != mixMode ||
+					 ( mixMode == MIX_MODE_GRAPH && _mixEffects != mixEffects ) ) ? 0 : qMin( _data.samples(), size );
+		for( int i=0; i < _melodyList.size(); i++ )
+		{
+			int changed = _melodyList[i]->takeChangedSample();
+			if( changed >= 0 && changed < from )
+			{
+				from = changed;
+			}
+		}
+		if( mixMode == MIX_MODE_BUS )
+		{
+			from = qMax( from - MixBus::reach(), 0 );		// The limiter changes the samples before
+		}
+		else if( mixMode == MIX_MODE_GRAPH && from < size )
+		{
+			from = 0;		// The filters keep the samples before, the whole sound is mixed again
+		}
+		_mixMelodies = _melodyList;
+		_mixIntensities = intensities;
+		_mixMode = mixMode;
+		_mixEffects = mixEffects;
 
-				int sizeMelody = (_melodyList[i]->getSize())/sizeof(short); //size of the Melody
-				short *readMelody = _melodyList[i]->getData(); //data of the Melody
+		_data.resize( size );
+		mixSamples( from, size );
 
-				int a, b, result;
-				float fa, fb, fresult;
-				int scaleWave = 1;
-				//
-				// Do  mix ( integer computation for accuracy)
-				//
-				for( int j=0; j < sizeMelody; j++ )
-				{
-					if( i == 1 )
-					{
-						fa = (((_data[j] * _melodyList[0]->getIntensity()) + 32768) / 65536.0);
-					}
-					else
-					{
-						fa = ((_data[j] + 32768) / 65536.0);
-					}
+		if( !_data.isEmpty() )
+		{
+			PerfCounters::add( PERF_RENDERED_FRAMES, size - from );
+			PerfCounters::add( PERF_RENDER_TIME_US, (int)( renderTimer.nsecsElapsed() / 1000 ) );
+		}
+		return _data;
+	}
 
-					fb = (((readMelody[j] * _melodyList[i]->getIntensity()) + 32768) / 65536.0);
-					if( fa < 0.5 || fb < 0.5 )
-					{
-						fresult = (((fa*fb)*2.0));
-					}
-					else
-					{
-						fresult = (2 * (fa + fb) - ((fa * fb) * 2.0) - 1);
-					}
+/*!
+	Returns a track for each melody, to be mixed as getData() does by a RenderDevice.
+*/
+	QList<TrackCursor> Sound::renderTracks()
+	{
+		QList<TrackCursor> tracks;
+		for( int i=0; i < _melodyList.size(); i++ )
+		{
+			tracks.append( _melodyList[i]->trackCursor() );
+		}
+		return tracks;
+	}
 
-					_data[j] = (short)((fresult * 65536) - 32768);
-				}
+/*!
+	Returns the names of the samples of \a count notes from \a fromNote of every melody, or of
+	all the notes after \a fromNote if \a count is -1.
+*/
+	QStringList Sound::sampleNames( int fromNote, int count )
+	{
+		QStringList names;
+		for( int i=0; i < _melodyList.size(); i++ )
+		{
+			names << _melodyList[i]->sampleNames( fromNote, count );
+		}
+		return names;
+	}
+
+/*!
+	Mixes the samples from \a from to \a to of all the melodies into the mix buffer.
+
+	Each sample only depends on the same sample of the melodies, so a part of the buffer
+	can be mixed again without the others. The buffer is mixed in blocks by the thread pool,
+	with the same result as mixed by one thread.
+
+	In MIX_MODE_BUS the melodies are mixed by MixBus, a sample depends also on the
+	MixBus::reach() samples around it. In MIX_MODE_GRAPH they are mixed by a DspGraph from
+	the first sample, \a from must be 0.
+*/
+	void Sound::mixSamples(int from, int to)
+	{
+		if( from >= to )
+		{
+			return;
+		}
+		short* data = _data.data();
+		QVector<PcmBuffer> melodyData;		// Keeps the samples while mixing
+		QVector<MixTrack> tracks;
+		melodyData.reserve( _melodyList.size() );
+		if( _mixMode == MIX_MODE_BUS )
+		{
+			for( int i=0; i<_melodyList.size(); i++ )
+			{
+				melodyData.append( _melodyList[i]->getData() );
+				tracks.append( MixTrack( melodyData.last().constData(), melodyData.last().samples(),
+					_melodyList[i]->getIntensity() ) );
 			}
+			MixBus::mix( data + from, tracks, to, from, to );
+			return;
 		}
-		else
+		if( _mixMode == MIX_MODE_GRAPH )
 		{
-			_data = 0;
+			QList<TrackCursor> melodyTracks;
+			for( int i=0; i<_melodyList.size(); i++ )
+			{
+				melodyTracks.append( TrackCursor( _melodyList[i]->getData(), _melodyList[i]->getIntensity() ) );
+			}
+			DspGraph::renderTracks( data, to, melodyTracks, getFrequency(), _mixEffects );
+			return;
 		}
-
-		return _data;
+		//
+		// First melody as it is, silence after its end
+		//
+		int sizeFirst = qBound( from, (int)( _melodyList[0]->getSize() / sizeof(short) ), to );
+		PcmBuffer first = _melodyList[0]->getData();
+		if( sizeFirst > from )
+		{
+			memcpy( data + from, first.constData() + from, ( sizeFirst - from ) * sizeof(short) );
+		}
+		if( to > sizeFirst )
+		{
+			memset( data + sizeFirst, 0, ( to - sizeFirst ) * sizeof(short) );
+		}
+		/**
+		* mix's every track to one monoral track
+		*/
+		for( int i=1; i<_melodyList.size(); i++ )
+		{
+			//
+			// An empty melody is kept as a track without samples, only the second
+			// melody mixes the first one with its intensity
+			//
+			MixTrack track;
+			if( !_melodyList[i]->isEmpty() )
+			{
+				melodyData.append( _melodyList[i]->getData() );
+				track = MixTrack( melodyData.last().constData(), (int)( _melodyList[i]->getSize() / sizeof(short) ),
+					_melodyList[i]->getIntensity() );
+			}
+			tracks.append( track );
+		}
+		mixTracks( data, tracks, _melodyList[0]->getIntensity(), from, to );
 	}
 
 /*!
@@ -1421,14 +1731,15 @@ namespace CnotiAudio
 /*!
 	Returns the data buffer of a melody indicated by \a i.
 */
-	short* Sound::getData(int i)
+	PcmBuffer Sound::getData(int i)
 	{
 		if( checkIdMelody(i) )
 		{
+			preloadScoreSamples();
 			return _melodyList[i]->getData();
 		}
 
-		return 0;
+		return PcmBuffer();
 	}
 
 /*!
@@ -1455,6 +1766,54 @@ namespace CnotiAudio
 		SoundBase::connectToSoundManager();
 	}
 
+/*!
+	Called by the voice manager when the sound source \a uiSource was stolen
+	to play another sound.
+
+	The melody using the source stops, the other melodies keep on playing.
+*/
+	void Sound::voiceStolen( ALuint uiSource )
+	{
+		for( int i=0; i < _melodyList.size(); i++ )
+		{
+			if( _melodyList[i]->sourceStolen( uiSource ) )
+			{
+				return;
+			}
+		}
+	}
+
+/*!
+	Emits the signal of the note \a event queued by the sound thread.
+*/
+	void Sound::deliverNoteEvent( const NoteEvent& event )
+	{
+		if( event.event == NOTE_EVENT_STOPPED )
+		{
+			emit noteStopped( _name, event.melody, event.note );
+		}
+		else
+		{
+			emit notePlaying( _name, event.melody, event.note );
+		}
+	}
+
+/*!
+	Returns a sound source to play the melody \a melodyId.
+
+	The source previously used by the melody is returned to the pool.
+*/
+	ALuint Sound::checkOutMelodySource(int melodyId)
+	{
+		ALuint previous = _melodyList[melodyId]->getSource();
+		if( previous != 0 )
+		{
+			_soundMgr->checkInSource( previous, this );
+			_melodyList[melodyId]->setSource( 0 );
+		}
+		return _soundMgr->checkOutSource( this );
+	}
+
 /*!
 	Makes the connections of the melody \a melodyId with this sound.
 */
@@ -1462,7 +1821,7 @@ namespace CnotiAudio
 	{
 		if(melodyId < 0 || melodyId >= _melodyList.size())
 		{
-			qWarning() << "[Sound::connectMelody] - Melody not found. Id:" << melodyId;
+			csWarning() << "[Sound::connectMelody] - Melody not found. Id:" << melodyId;
 			return;
 		}
 		connect(_melodyList[melodyId], SIGNAL(noteStopped(int,int)), this, SLOT(noteStopped(int,int)), Qt::DirectConnection);
@@ -1480,7 +1839,7 @@ namespace CnotiAudio
 	{
 		if(melodyId < 0 || melodyId >= _melodyList.size())
 		{
-			qWarning() << "[Sound::disconnectMelody] - Melody not found. Id:" << melodyId;
+			csWarning() << "[Sound::disconnectMelody] - Melody not found. Id:" << melodyId;
 			return;
 		}
 		disconnect(_melodyList[melodyId], SIGNAL(noteStopped(int,int)), this, SLOT(noteStopped(int,int)));
@@ -1558,19 +1917,29 @@ namespace CnotiAudio
 //                      SLOTS                          //
 //=====================================================//
 /*!
-	Emits noteStopped() signal.
+	Emits noteStopped() signal, or queues it if the SoundManager delivers the note events later.
 */
 	void Sound::noteStopped(int melody, int id)
 	{
-		qDebug() << "[Sound::noteStopped] - Emit noteStopped of sound:" << _name << "Melody:" << melody << "Note:" << id;
+		qint64 sample = checkIdMelody(melody) ? _melodyList[melody]->playedSamples() : 0;
+		if( queueNoteEvent( melody, id, NOTE_EVENT_STOPPED, sample ) )
+		{
+			return;
+		}
+		csDebug() << "[Sound::noteStopped] - Emit noteStopped of sound:" << _name << "Melody:" << melody << "Note:" << id;
 		emit noteStopped( _name, melody, id);
 	}
 /*!
-	Emits notePlaying() signal.
+	Emits notePlaying() signal, or queues it if the SoundManager delivers the note events later.
 */
 	void Sound::notePlaying(int melody, int id)
 	{
-		qDebug() << "[Sound::notePlaying] - Emit notePlaying of sound:" << _name << "Melody:" << melody << "Note:" << id;
+		qint64 sample = checkIdMelody(melody) ? _melodyList[melody]->playedSamples() : 0;
+		if( queueNoteEvent( melody, id, NOTE_EVENT_PLAYING, sample ) )
+		{
+			return;
+		}
+		csDebug() << "[Sound::notePlaying] - Emit notePlaying of sound:" << _name << "Melody:" << melody << "Note:" << id;
 		emit notePlaying( _name, melody, id);
 	}
 /*!
@@ -1578,7 +1947,7 @@ namespace CnotiAudio
 */
 	void Sound::melodyStopped(int melody)
 	{
-		qDebug() << "[Sound::melodyStopped] - Emit melodyStopped of sound:" << _name << "Melody:" << melody;
+		csDebug() << "[Sound::melodyStopped] - Emit melodyStopped of sound:" << _name << "Melody:" << melody;
 		emit melodyStopped( _name, melody);
 	}
 /*!
@@ -1586,7 +1955,7 @@ namespace CnotiAudio
 */
 	void Sound::melodyPlaying(int melody)
 	{
-		qDebug() << "[Sound::melodyPlaying] - Emit melodyPlaying of sound:" << _name << "Melody:" << melody;
+		csDebug() << "[Sound::melodyPlaying] - Emit melodyPlaying of sound:" << _name << "Melody:" << melody;
 		emit melodyPlaying( _name, melody);
 	}
 /*!
@@ -1594,7 +1963,7 @@ namespace CnotiAudio
 */
 	void Sound::melodyPaused(int melody)
 	{
-		qDebug() << "[Sound::melodyPaused] - Emit melodyPaused of sound:" << _name << "Melody:" << melody;
+		csDebug() << "[Sound::melodyPaused] - Emit melodyPaused of sound:" << _name << "Melody:" << melody;
 		emit melodyPaused( _name, melody);
 	}
 
@@ -1631,10 +2000,20 @@ namespace CnotiAudio
 					{
 						for( int i=0; i < _melodyList.size(); i++ )
 						{
+							if( _melodyList[i]->getNumberNotes() == 0 )
+							{
+								continue;
+							}
+							ALuint source = checkOutMelodySource( i );
+							if( source == 0 && i > 0 )
+							{
+								csWarning() << "[Sound::update] - No sound source available for melody" << i << "of sound:" << _name;
+								continue;
+							}
 							//
 							// Restart sound (melodies)
 							//
-							bool value = _melodyList[i]->playSound( _soundMgr->checkOutSource(), _loop, signalsBlocked() );
+							bool value = _melodyList[i]->replay( source, signalsBlocked() );
 							if( !value )
 							{
 								_lastError = _melodyList[i]->getLastError();
@@ -1671,7 +2050,7 @@ namespace CnotiAudio
 					//
 					// PLAY
 					//
-					bool value = _melodyList[_playMelody]->playSound( _soundMgr->checkOutSource(), _loop, signalsBlocked() );
+					bool value = _melodyList[_playMelody]->replay( checkOutMelodySource( _playMelody ), signalsBlocked() );
 					if( !value )
 					{
 						_lastError = _melodyList[_playMelody]->getLastError();
@@ -1685,7 +2064,7 @@ namespace CnotiAudio
 				}
 				else
 				{
-					qDebug() << "[Sound::update]"<< "emit soundStopped of sound: " << _name;
+					csDebug() << "[Sound::update]"<< "emit soundStopped of sound: " << _name;
 
 					emit soundStopped( _name );
 					stopSound();
@@ -1694,74 +2073,6 @@ namespace CnotiAudio
 		}
 	}
 
-/*!
-	Retrives data from xml.
-
-	Returns true if no error ocurred, otherwise false.
-*/
-	bool Sound::recoverDataToHandler(XmlSoundHandler *handler)
-	{
-		this->release();
-		_tempo = handler->getMusicTempo();
-		_musicDuration = handler->getMusicDuration();
-		//
-		// Gets info for each melody
-		//
-		int nbMelody = handler->getMelodySize();
-		for( int i=0; i < nbMelody; i++ )
-		{
-			EnumInstrument instrument = handler->getMelodyInstrument( i );
-			CompassType compass = handler->getMelodyCompass( i );
-			int id = addMelody(instrument, compass);
-			if(id != -1)
-			{
-				int nbNotes = handler->getNoteListSize( i );
-				_iFrequency = 0;
-				//
-				// Gets info for each note
-				//
-				for( int j=0; j < nbNotes; j++ )
-				{
-					DurationType duration = handler->getNoteDuration( i, j );
-					int heightInt = handler->getNoteHeight( i, j );
-					NoteType height;
-					int octave;
-					if( heightInt <= 0 )
-					{
-						height = PAUSE;
-						octave = 3;
-					}
-					else
-					{
-						height = (NoteType)(heightInt % CS_NUMBERNOTE);
-						octave = heightInt / CS_NUMBERNOTE - 2;
-					}
-					if( !Melody::checkOctave( octave ) )
-					{
-						_lastError = CS_VALUE_OCTAVE_ERROR;
-						return false;
-					}
-					// Para já não é utilizado	//
-					int intensity = handler->getNoteIntensity( i, j );
-					// Para já não é utilizado	//
-					int position = handler->getNotePosition( i, j );
-
-					if(id > 0)
-					{
-						height = (NoteType)(height - 1);
-					}
-					insertNote(position, duration, height, octave, intensity, id);
-				}
-			}
-			else
-			{
-				qWarning() << "[Sound::recoverDataToHandler] - Couldnt create melody number:" << i ;
-			}
-			//_melodyList[i]->setGraphicBreakLines( handler->getBreakLineList() );
-		}
-		return true;
-	}
-
 /*!
 	Returns the melody list.
 */
@@ -0,0 +1,25 @@
+/**
+	\file SoundLog.cpp
+*/
+#include "SoundLog.h"
+
+namespace CnotiAudio
+{
+	QAtomicInt SoundLog::_level( LOG_LEVEL_DEBUG );
+
+/*!
+	Changes the level of the messages written to \a level.
+*/
+	void SoundLog::setLevel( EnumLogLevel level )
+	{
+		_level.fetchAndStoreRelaxed( level );
+	}
+
+/*!
+	Returns the level of the messages written.
+*/
+	EnumLogLevel SoundLog::level()
+	{
+		return (EnumLogLevel)(int)_level;
+	}
+}
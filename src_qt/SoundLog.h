@@ -0,0 +1,53 @@
+/*!
+ \class CnotiAudio::SoundLog
+ \brief The SoundLog class keeps the level of the debug messages of the sound engine.
+
+ The debug messages are written with csDebug(), used like qDebug(). When the level is
+ lower than LOG_LEVEL_DEBUG the statement is skipped before any of its arguments is
+ formatted, so a disabled message only costs one relaxed read.
+
+ Defining CS_NO_DEBUG_OUTPUT removes the messages at compile time.
+
+ Use SoundManager::setLogLevel() to change the level.
+
+ \version 2.2
+ \date 19-10-2026
+ \file SoundLog.h
+*/
+#if !defined(_SOUNDLOG_H)
+#define _SOUNDLOG_H
+
+#include <QAtomicInt>
+#include <QDebug>
+
+#include "soundmanager_global.h"
+
+namespace CnotiAudio
+{
+	enum EnumLogLevel{
+		LOG_LEVEL_NONE = 0,		// No messages
+		LOG_LEVEL_WARNING,		// Only warnings
+		LOG_LEVEL_DEBUG			// All messages
+	};
+
+	class SOUNDMANAGER_EXPORT SoundLog
+	{
+	public:
+		static inline bool enabled( EnumLogLevel level ) { return level <= (int)_level; }
+		static void setLevel( EnumLogLevel level );
+		static EnumLogLevel level();
+
+	private:
+		static QAtomicInt _level;
+	};
+}
+
+#if defined(CS_NO_DEBUG_OUTPUT)
+#define csDebug() if( true ) {} else qDebug()
+#else
+#define csDebug() if( !CnotiAudio::SoundLog::enabled( CnotiAudio::LOG_LEVEL_DEBUG ) ) {} else qDebug()
+#endif
+
+#define csWarning() if( !CnotiAudio::SoundLog::enabled( CnotiAudio::LOG_LEVEL_WARNING ) ) {} else qWarning()
+
+#endif //_SOUNDLOG_H
@@ -1,5 +1,11 @@
 #include <QFile>
 #include <QSettings>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QDirIterator>
+#include <QFileSystemWatcher>
+#include <QSet>
+#include <QtConcurrentMap>
 #include <string>
 
 #include "SoundManager.h"
@@ -8,11 +14,15 @@
 #include "Stream.h"
 #include "Sound.h"
 #include "Music.h"
+#include "ScoreBinary.h"
+#include "ScoreMidi.h"
 #include "Note.h"
 
 #include "capturethread.h"
 #include "SourcePool.h"
+#include "VoiceManager.h"
 #include "notemisc.h"
+#include "RenderDevice.h"
 
 //#include <windows.h>
 #include <stdio.h>
@@ -49,6 +59,74 @@ BEWRITEINFOTAG		beWriteInfoTag=NULL;
 
 namespace CnotiAudio
 {
+	//
+	// Sample read from its file or synthesized by the thread pool, for preloadSamples()
+	//
+	struct DecodedSample
+	{
+		QString    name;
+		QString    filename;		// Empty if synthesized
+		PcmBuffer  data;
+		ALenum     format;
+		ALint      frequency;
+		int        decodeTime;		// Microseconds spent reading the file or rendering the note
+		bool       synthesize;
+		bool       ok;
+
+		DecodedSample() : format(0), frequency(0), decodeTime(0), synthesize(false), ok(false) {}
+	};
+
+	struct SampleDecoder
+	{
+		typedef DecodedSample result_type;
+
+		const Synthesizer* synthesizer;
+
+		SampleDecoder( const Synthesizer* s ) : synthesizer(s) {}
+
+		DecodedSample operator()( const DecodedSample& request ) const
+		{
+			QElapsedTimer decodeTimer;
+			decodeTimer.start();
+			DecodedSample d = request;
+			if( d.synthesize )
+			{
+				d.data = synthesizer->render( NoteKey::fromName( d.name ) );
+				d.format = AL_FORMAT_MONO16;
+				d.frequency = synthesizer->frequency();
+				d.ok = !d.data.isEmpty();
+			}
+			else
+			{
+				d.ok = Sample::decodeFile( d.filename, &d.data, &d.format, &d.frequency );
+			}
+			d.decodeTime = (int)( decodeTimer.nsecsElapsed() / 1000 );
+			return d;
+		}
+	};
+
+	//
+	// Reads the data of a sample kept only in its AL buffer, for prefetchSamples()
+	//
+	struct SampleFetcher
+	{
+		typedef PcmBuffer result_type;
+
+		const SoundRegistry* registry;
+
+		SampleFetcher( const SoundRegistry* r ) : registry(r) {}
+
+		PcmBuffer operator()( const QString& name ) const
+		{
+			//
+			// The sample is looked up again, it can be released while the name waits
+			//
+			SoundRegistry::ReadGuard guard( *registry );
+			Sample* sample = dynamic_cast<Sample*>(registry->value( name ));
+			return ( sample != 0 ) ? sample->getData() : PcmBuffer();
+		}
+	};
+
 /*!
 	Constructs a soundManager.
 
@@ -57,9 +135,27 @@ namespace CnotiAudio
 	\sa init()
 */
 	SoundManager::SoundManager():
-		_sourcePool(NULL)
-	{
+		_sourcePool(NULL),
+		_voiceManager(NULL),
+		_countersTimer(NULL),
+		_sampleResidency(SAMPLE_RESIDENT_BOTH),
+		_mixMode(MIX_MODE_LEGACY),
+		_sampleLoading(SAMPLE_LOADING_INSTRUMENT),
+		_prefetchNotes(0),
+		_noteEvents(new NoteEventQueue()),
+		_noteEventsTimer(NULL),
+		_noteEventDelivery(NOTE_EVENTS_DIRECT),
+		_noteEventCoalescing(false),
+		_sampleIndexDirty(false),
+		_samplePathWatcher(NULL)
+	{
+		for( int i = 0; i < PERF_COUNTER_COUNT; ++i )
+		{
+			_lastCounters[i] = 0;
+		}
 		_lastError	= CS_NO_ERROR;
+		_samplesResetGeneration = 0;
+		_collectTimer = NULL;
 		_pDevice = NULL;
 		_hopBuffer = NULL;
 		_bigBuffer = NULL;
@@ -75,12 +171,13 @@ namespace CnotiAudio
 */
 	SoundManager::~SoundManager()
 	{
-		qDebug() << "[SoundManager::~SoundManager()]";
+		csDebug() << "[SoundManager::~SoundManager()]";
 		if( !isReleased )
 		{
 			release();
 		}
-		qDebug() << "[SoundManager delete]";
+		delete _noteEvents;
+		csDebug() << "[SoundManager delete]";
 	}
 
 /*!
@@ -110,7 +207,7 @@ namespace CnotiAudio
 		QDir pathResources( s + "/.Imagina/" );
 #endif
 		QString logFile = getLogFile();
-		qDebug() << "[SoundManager::init]";
+		csDebug() << "[SoundManager::init]";
 	}
 
 /*!
@@ -118,10 +215,10 @@ namespace CnotiAudio
 */
 	bool SoundManager::release()
 	{
-		qDebug() << "[SoundManager::release]";
+		csDebug() << "[SoundManager::release]";
 		if( isReleased )
 		{
-			qDebug() << "[SoundManager::release] Already released.";
+			csDebug() << "[SoundManager::release] Already released.";
 			return isReleased;
 		}
 
@@ -155,6 +252,19 @@ namespace CnotiAudio
 		}
 
 		releaseAllSound();
+		_soundList.collect( true );
+
+		if( _voiceManager != NULL )
+		{
+			delete( _voiceManager );
+			_voiceManager = NULL;
+		}
+
+		if( _sourcePool != NULL )
+		{
+			delete( _sourcePool );
+			_sourcePool = NULL;
+		}
 
 		isReleased = true;
 		return isReleased;
@@ -166,7 +276,7 @@ namespace CnotiAudio
 */
 	bool SoundManager::lameMp3(const QString& filename, int minimumRate, int frequency)
 	{
-		qDebug() << "[SoundManager::lameMp3()]";
+		csDebug() << "[SoundManager::lameMp3()]";
 
 #if defined(__WIN32__) || defined(_WIN32) || defined(Q_WS_WIN) || defined(Q_WS_WIN32)
                 QFile		pFileOut		=NULL;
@@ -190,8 +300,8 @@ namespace CnotiAudio
 		QString mp3Filename = filename + ".mp3";
 		QString wavFilename = filename + ".wav";
 
-		qDebug() << wavFilename;
-		qDebug() << mp3Filename;
+		csDebug() << wavFilename;
+		csDebug() << mp3Filename;
 
 		//
 		// Load lame_enc.dll library (Make sure though that you set the
@@ -202,7 +312,7 @@ namespace CnotiAudio
 		if( NULL == hDLL )
 		{
 			fprintf(stderr,"Error loading lame_enc.DLL");
-			qWarning() << "[SoundManager::lameMp3] - lame_enc.dll not found";
+			csWarning() << "[SoundManager::lameMp3] - lame_enc.dll not found";
 			return false;
 		}
 		//
@@ -221,7 +331,7 @@ namespace CnotiAudio
 		//
 		if(!beInitStream || !beEncodeChunk || !beDeinitStream || !beCloseStream || !beVersion || !beWriteVBRHeader)
 		{
-			qWarning() << "[SoundManager::lameMp3] - Unable to get LAME interfaces";
+			csWarning() << "[SoundManager::lameMp3] - Unable to get LAME interfaces";
 			return false;
 		}
 		//
@@ -234,7 +344,7 @@ namespace CnotiAudio
 		pFileIn.setFileName( wavFilename );
 		if(!pFileIn.open( QIODevice::ReadOnly ) )
 		{
-			qWarning() << "[SoundManager::lameMp3] - Error opening" << wavFilename;
+			csWarning() << "[SoundManager::lameMp3] - Error opening" << wavFilename;
 			return false;
 		}
 		//
@@ -243,7 +353,7 @@ namespace CnotiAudio
 		pFileOut.setFileName( mp3Filename );
 		if(!pFileOut.open( QIODevice::WriteOnly ))
 		{
-			qWarning() << "[SoundManager::lameMp3] - Error creating" << mp3Filename;
+			csWarning() << "[SoundManager::lameMp3] - Error creating" << mp3Filename;
 			return false;
 		}
 
@@ -289,7 +399,7 @@ namespace CnotiAudio
 		err = beInitStream(&beConfig, &dwSamples, &dwMP3Buffer, &hbeStream);
 		if(err != BE_ERR_SUCCESSFUL)
 		{
-			qWarning() << "[SoundManager::lameMp3] - Error opening encoding stream";
+			csWarning() << "[SoundManager::lameMp3] - Error opening encoding stream";
 			return false;
 		}
 		//
@@ -305,7 +415,7 @@ namespace CnotiAudio
 		//
 		if(!pMP3Buffer || !pWAVBuffer)
 		{
-			qWarning() << "[SoundManager::lameMp3] - Out of memory";
+			csWarning() << "[SoundManager::lameMp3] - Out of memory";
 			return false;
 		}
 
@@ -336,7 +446,7 @@ namespace CnotiAudio
 			if(err != BE_ERR_SUCCESSFUL)
 			{
 				beCloseStream(hbeStream);
-				qWarning() << "[SoundManager::lameMp3] - beEncodeChunk() failed";
+				csWarning() << "[SoundManager::lameMp3] - beEncodeChunk() failed";
 				return false;
 			}
 			//
@@ -344,7 +454,7 @@ namespace CnotiAudio
 			//
 			if(pFileOut.write( (char*) pMP3Buffer, dwWrite ) != dwWrite)
 			{
-				qWarning() << "[SoundManager::lameMp3] - Output file write error";
+				csWarning() << "[SoundManager::lameMp3] - Output file write error";
 				return false;
 			}
 
@@ -356,7 +466,7 @@ namespace CnotiAudio
 		err = beDeinitStream(hbeStream, pMP3Buffer, &dwWrite);
 		if(err != BE_ERR_SUCCESSFUL)
 		{
-			qDebug() << "[beExitStream failed]";
+			csDebug() << "[beExitStream failed]";
 			beCloseStream(hbeStream);
 			//fprintf(stderr,"beExitStream failed (%lu)", err);
 			return false;
@@ -369,7 +479,7 @@ namespace CnotiAudio
 		{
 			if( pFileOut.write( (char*) pMP3Buffer, dwWrite ) != dwWrite )
 			{
-				qWarning() << "[SoundManager::lameMp3] - Output file write error";
+				csWarning() << "[SoundManager::lameMp3] - Output file write error";
 				return false;
 			}
 		}
@@ -418,7 +528,7 @@ namespace CnotiAudio
 		gfp = lame_init();
 		if( gfp == NULL )
 		{
-			qWarning() << "[SoundManager::lameMp3] - Error initialising lame";
+			csWarning() << "[SoundManager::lameMp3] - Error initialising lame";
 			return false;
 		}
 		//
@@ -437,7 +547,7 @@ namespace CnotiAudio
 		pFileOut= fopen(strFileOut,"wb+");
 		if(pFileOut == NULL)
 		{
-			qWarning() << "[SoundManager::lameMp3] - Error creating" << QString(strFileOut);
+			csWarning() << "[SoundManager::lameMp3] - Error creating" << QString(strFileOut);
 			return false;
 		}
 		//
@@ -455,7 +565,7 @@ namespace CnotiAudio
 		//
 		if( lame_init_params(gfp) < 0 )
 		{
-			qWarning() << "[SoundManager::lameMp3] - Error initialising parameters";
+			csWarning() << "[SoundManager::lameMp3] - Error initialising parameters";
 			lame_close(gfp);
 			return false;
 		}
@@ -464,7 +574,7 @@ namespace CnotiAudio
 		SF_INFO	sfInfo;
 		if( !( sndFileIn = sf_open( strFileIn, SFM_READ, &sfInfo ) ) )
 		{
-			qWarning() << "[SoundManager::lameMp3] - Error opening file";
+			csWarning() << "[SoundManager::lameMp3] - Error opening file";
 			return false;
 		}
 
@@ -487,7 +597,7 @@ namespace CnotiAudio
 
 		if( ret_bytes < 0 )
 		{
-			qWarning() << "[SoundManager::lameMp3] - Error encoding";
+			csWarning() << "[SoundManager::lameMp3] - Error encoding";
 			lame_close(gfp);
 			return false;
 		}
@@ -497,7 +607,7 @@ namespace CnotiAudio
 		int ret_write = fwrite( mp3Buffer, 1, ret_bytes, pFileOut );
 		if( ret_write != ret_bytes )
 		{
-			qWarning() << "[SoundManager::lameMp3] - Error saving to " << QString(strFileOut);
+			csWarning() << "[SoundManager::lameMp3] - Error saving to " << QString(strFileOut);
 			return false;
 		}
 		//
@@ -512,7 +622,7 @@ namespace CnotiAudio
 			ret_write = fwrite( mp3Buffer, 1, ret_bytes, pFileOut );
 			if( ret_write != ret_bytes )
 			{
-				qWarning() << "[SoundManager::lameMp3] - Error saving flush data to " << QString(strFileOut);
+				csWarning() << "[SoundManager::lameMp3] - Error saving flush data to " << QString(strFileOut);
 				return false;
 			}
 		}
@@ -537,12 +647,12 @@ namespace CnotiAudio
 */
 	bool SoundManager::initOpenAl(int sourcePoolSize)
 	{
-		qDebug() << "[SoundManager::initOpenAl]";
+		csDebug() << "[SoundManager::initOpenAl]";
 		if( !isInitAl )
 		{
 #ifdef _WIN32
 			ALFWInit();
-			qDebug() << "[SoundManager::initOpenAl] - ALFWInit()";
+			csDebug() << "[SoundManager::initOpenAl] - ALFWInit()";
 
 			ALDeviceList *pDeviceList = NULL;
 			ALCcontext *pContext = NULL;
@@ -554,8 +664,8 @@ namespace CnotiAudio
 			//
 			pDeviceList = new ALDeviceList();
 			ALint numDevices = pDeviceList->GetNumDevices();
-			qDebug() << "[SoundManager::initOpenAl] - numDevices =" << QString::number(numDevices);
-			qDebug() << "[SoundManager::initOpenAl] - Default DeviceName:" << QString( alcGetString( NULL, ALC_DEFAULT_DEVICE_SPECIFIER ) );
+			csDebug() << "[SoundManager::initOpenAl] - numDevices =" << QString::number(numDevices);
+			csDebug() << "[SoundManager::initOpenAl] - Default DeviceName:" << QString( alcGetString( NULL, ALC_DEFAULT_DEVICE_SPECIFIER ) );
 
 			if( pDeviceList && pDeviceList->GetNumDevices() )
 			{
@@ -573,7 +683,7 @@ namespace CnotiAudio
 					}
 					else
 					{
-						qDebug() << "[SoundManager::initOpenAl] -Can't create the context for device";
+						csDebug() << "[SoundManager::initOpenAl] -Can't create the context for device";
 						alcCloseDevice( _pDevice );
 					}
 				}
@@ -584,7 +694,7 @@ namespace CnotiAudio
 			{
 				ALFWShutdown();
 				_lastError = CS_INIT_OPENAL;
-				qDebug() << "[SoundManager::initOpenAl] -Openal init failed";
+				csDebug() << "[SoundManager::initOpenAl] -Openal init failed";
 				return false;
 			}
 			else
@@ -616,15 +726,15 @@ namespace CnotiAudio
 				}
 				else
 				{
-					qWarning() << "[SoundManager::initOpenAl] - Can't create the context for device";
+					csWarning() << "[SoundManager::initOpenAl] - Can't create the context for device";
 					_lastError = CS_INIT_OPENAL;
-					qWarning() << "[SoundManager::initOpenAl] - Openal init failed";
+					csWarning() << "[SoundManager::initOpenAl] - Openal init failed";
 					return false;
 				}
 			}
 			else
 			{
-				qWarning() << "[SoundManager::initOpenAl] - Can't create a new OpenAL Device]";
+				csWarning() << "[SoundManager::initOpenAl] - Can't create a new OpenAL Device]";
 				return false;
 			}
 #endif
@@ -632,22 +742,66 @@ namespace CnotiAudio
 			if (isInitAl)
 			{
 				//
-				// Create Source Pool
+				// Create Source Pool, all the sources are created now
 				//
 				_sourcePool = new SourcePool( sourcePoolSize );
+				_voiceManager = new VoiceManager( _sourcePool );
 
-				qDebug() << "[SoundManager::initOpenAl] - openal initialized successful";
+				csDebug() << "[SoundManager::initOpenAl] - openal initialized successful";
 				return true;
 			}
 		}
 		else
 		{
-			qWarning() << "[SoundManager::initOpenAl] - openal already initialized";
+			csWarning() << "[SoundManager::initOpenAl] - openal already initialized";
 		}
 
 		return false;
 	}
 
+/*!
+	Inits the openal in the device \a device, already opened by the application, for example a
+	loopback device used to render the sound without hardware.
+
+	The context is created with the attributes \a attributes, and the pool is created to contain
+	a max of \a sourcePoolSize sources.
+
+	Returns true if it was successful, otherwise false.
+*/
+	bool SoundManager::initOpenAl(ALCdevice* device, const ALCint* attributes, int sourcePoolSize)
+	{
+		csDebug() << "[SoundManager::initOpenAl] - device";
+		if( isInitAl )
+		{
+			csWarning() << "[SoundManager::initOpenAl] - openal already initialized";
+			return false;
+		}
+		if( device == NULL )
+		{
+			_lastError = CS_INIT_OPENAL;
+			csWarning() << "[SoundManager::initOpenAl] - No device given";
+			return false;
+		}
+		ALCcontext* pContext = alcCreateContext( device, attributes );
+		if( pContext == NULL )
+		{
+			_lastError = CS_INIT_OPENAL;
+			csWarning() << "[SoundManager::initOpenAl] - Can't create the context for device";
+			return false;
+		}
+		alcMakeContextCurrent( pContext );
+		_pDevice = device;
+		isInitAl = true;
+		//
+		// Create Source Pool, all the sources are created now
+		//
+		_sourcePool = new SourcePool( sourcePoolSize );
+		_voiceManager = new VoiceManager( _sourcePool );
+
+		csDebug() << "[SoundManager::initOpenAl] - openal initialized successful";
+		return true;
+	}
+
 /*!
 	Init functions for Ogg and vorbis files.
 	The openAL must be initialized before ogg. Almost is not the returns an error.
@@ -658,17 +812,17 @@ namespace CnotiAudio
 */
 	bool SoundManager::initOgg()
 	{
-		qDebug() << "[SoundManager::initOgg()]";
+		csDebug() << "[SoundManager::initOgg()]";
 		if( !isInitAl )
 		{
-			qDebug() << "[SoundManager::initOgg] - openal is not initialized";
+			csDebug() << "[SoundManager::initOgg] - openal is not initialized";
 			_lastError = CS_OPENAL_NOT_INIT;
 			return false;
 		}
 
 		if( isInitOgg )
 		{
-			qDebug() << "[SoundManager::initOgg] - ogg already initialized";
+			csDebug() << "[SoundManager::initOgg] - ogg already initialized";
 			_lastError = CS_NO_ERROR;
 			return true;
 		}
@@ -687,13 +841,13 @@ namespace CnotiAudio
 			fn_ov_open_callbacks = (LPOVOPENCALLBACKS)GetProcAddress(_g_hVorbisFileDLL, "ov_open_callbacks");
 			isInitOgg = true;
 			_lastError = CS_NO_ERROR;
-			qDebug() << "[SoundManager::initOgg] - ogg initialized successful";
+			csDebug() << "[SoundManager::initOgg] - ogg initialized successful";
 			return true;
 		}
-		qDebug() << "[SoundManager::initOgg] - libvorbisfile.dll not found";
+		csDebug() << "[SoundManager::initOgg] - libvorbisfile.dll not found";
 		_lastError = CS_MISSING_VORBISDLL;
 #else
-		qDebug() << "[SoundManager::initOgg] -   FALTA IMPLEMENTAR";
+		csDebug() << "[SoundManager::initOgg] -   FALTA IMPLEMENTAR";
 #endif
 		return false;
 	}
@@ -706,7 +860,7 @@ namespace CnotiAudio
 */
 	bool SoundManager::copySound(const QString soundNameToCopy, const QString newSoundName)
 	{
-		qDebug() << "[SoundManager::copySound] - Copy:" << soundNameToCopy << "New:" << newSoundName;
+		csDebug() << "[SoundManager::copySound] - Copy:" << soundNameToCopy << "New:" << newSoundName;
 		if( checkSoundName(soundNameToCopy) )
 		{
 			if( !checkSoundName(newSoundName) )
@@ -715,14 +869,19 @@ namespace CnotiAudio
 				// COPY
 				//
 				SoundBase* s;
-				if( dynamic_cast<Sample*>(_soundList[soundNameToCopy]) != 0 )
-					s = new Sample( *((Sample*)(_soundList[soundNameToCopy])), newSoundName );
+				if( dynamic_cast<Sample*>(_soundList.value(soundNameToCopy)) != 0 )
+					s = new Sample( *((Sample*)(_soundList.value(soundNameToCopy))), newSoundName );
 				else
-					s = new Sound( *((Sound*)(_soundList[soundNameToCopy])), newSoundName );
+					s = new Sound( *((Sound*)(_soundList.value(soundNameToCopy))), newSoundName );
 				//
 				// Insert new into sound list
 				//
-				_soundList.insert( std::make_pair(newSoundName, s));
+				_soundList.insert( newSoundName, s );
+				_noteKeys.insert( newSoundName );
+				if( dynamic_cast<Sample*>(s) != 0 )
+				{
+					samplesChanged( newSoundName );
+				}
 				_lastError = CS_NO_ERROR;
 				//
 				// Initialize conections for new sound
@@ -733,14 +892,14 @@ namespace CnotiAudio
 			}
 			else
 			{
-				qDebug() << "[SoundManager::copySound] -  is already used";
+				csDebug() << "[SoundManager::copySound] -  is already used";
 				_lastError = CS_NAME_ALREADY_USED;
 				return false;
 			}
 		}
 		else
 		{
-			qDebug() << "[SoundManager::copySound] - don't exist to copySound";
+			csDebug() << "[SoundManager::copySound] - don't exist to copySound";
 			_lastError = CS_SOUND_UNKNOW;
 			return false;
 		}
@@ -756,10 +915,10 @@ namespace CnotiAudio
 	Sound* SoundManager::createSound(const QString soundName, TempoType tempo,
 					EnumInstrument instrument, CompassType compass)
 	{
-		qDebug() << "[SoundManager::createSound] Name:" << soundName << "Tempo:" << tempo;
+		csDebug() << "[SoundManager::createSound] Name:" << soundName << "Tempo:" << tempo;
 		if( checkSoundName(soundName) )
 		{
-			qDebug() << "[SoundManager::createSound]" << soundName << "already exist.";
+			csDebug() << "[SoundManager::createSound]" << soundName << "already exist.";
 			_lastError = CS_NAME_ALREADY_USED;
 			return NULL;
 		}
@@ -775,9 +934,10 @@ namespace CnotiAudio
 		//
 		// Insert into sound list
 		//
-		_soundList.insert( std::make_pair(soundName, s));
+		_soundList.insert( soundName, s );
+		_noteKeys.insert( soundName );
 
-		qDebug() << "[SoundManager::createSound]" << soundName << " added to sound list.";
+		csDebug() << "[SoundManager::createSound]" << soundName << " added to sound list.";
 		_lastError = CS_NO_ERROR;
 		//
 		// Initialize conections for new sound
@@ -796,10 +956,10 @@ namespace CnotiAudio
 	*/
 		Music* SoundManager::createMusic(const QString soundName, TempoType tempo, EnumInstrument instrument)
 		{
-			qDebug() << "[SoundManager::createMusic] Name:" << soundName << "Tempo:" << tempo;
+			csDebug() << "[SoundManager::createMusic] Name:" << soundName << "Tempo:" << tempo;
 			if( checkSoundName(soundName) )
 			{
-				qDebug() << "[SoundManager::createMusic]" << soundName << "already exist.";
+				csDebug() << "[SoundManager::createMusic]" << soundName << "already exist.";
 				_lastError = CS_NAME_ALREADY_USED;
 				return NULL;
 			}
@@ -815,9 +975,10 @@ namespace CnotiAudio
 			//
 			// Insert into sound list
 			//
-			_soundList.insert( std::make_pair(soundName, s));
+			_soundList.insert( soundName, s );
+			_noteKeys.insert( soundName );
 
-			qDebug() << "[SoundManager::createMusic]" << soundName << " added to sound list.";
+			csDebug() << "[SoundManager::createMusic]" << soundName << " added to sound list.";
 			_lastError = CS_NO_ERROR;
 			//
 			// Initialize conections for new sound
@@ -839,23 +1000,23 @@ namespace CnotiAudio
 */
 	bool SoundManager::editRythms(const QString soundName, EnumInstrument instrument, int id, CompassType compass)
 	{
-		qDebug() << "[SoundManager::editRythms]" << soundName << ", " << instrument << "," <<  id + "," << compass;
+		csDebug() << "[SoundManager::editRythms]" << soundName << ", " << instrument << "," <<  id + "," << compass;
 		if(!checkSoundName(soundName)){
-			qDebug() << "[SoundManager::editRythms]" << soundName + "don't exist to editRythms";
+			csDebug() << "[SoundManager::editRythms]" << soundName + "don't exist to editRythms";
 			return false;
 		}
 
-		if( dynamic_cast<Sound*>(_soundList[soundName]) == 0 )
+		if( dynamic_cast<Sound*>(_soundList.value(soundName)) == 0 )
 		{
-			qDebug() << "[SoundManager::editRythms]" << soundName << " is not a sound with notes";
+			csDebug() << "[SoundManager::editRythms]" << soundName << " is not a sound with notes";
 			_lastError = CS_IS_NOT_XMLSOUND;
 			return false;
 		}
 		//
 		// Change the rythm
 		//
-		bool result = ((Sound*)(_soundList[soundName]))->changeRhythm(instrument, id);
-		_lastError = _soundList[soundName]->getLastError();
+		bool result = ((Sound*)(_soundList.value(soundName)))->changeRhythm(instrument, id);
+		_lastError = _soundList.value(soundName)->getLastError();
 		return result;
 	}
 
@@ -868,17 +1029,21 @@ namespace CnotiAudio
 */
 	bool SoundManager::playSound(const QString soundName, bool loop, bool blockSignals)
 	{
-		qDebug() << "[SoundManager::playSound]" << soundName << ", " << loop;
+		csDebug() << "[SoundManager::playSound]" << soundName << ", " << loop;
 		if( !checkSoundName(soundName) )
 		{
-			qDebug() << "[SoundManager::playSound]" << soundName << " don't exist to playSound";
+			csDebug() << "[SoundManager::playSound]" << soundName << " don't exist to playSound";
 			return false;
 		}
+		if( _sampleLoading == SAMPLE_LOADING_SCORE )
+		{
+			preloadSound( soundName );
+		}
 		//
 		// PLAY
 		//
-		bool result = _soundList[soundName]->playSound(loop, blockSignals);
-		_lastError = _soundList[soundName]->getLastError();
+		bool result = _soundList.value(soundName)->playSound(loop, blockSignals);
+		_lastError = _soundList.value(soundName)->getLastError();
 		return result;
 	}
 
@@ -888,11 +1053,11 @@ namespace CnotiAudio
 */
 	bool SoundManager::stopAllSound()
 	{
-		qDebug() << "[SoundManager::stopAllSound]";
-		SoundList::iterator it;
-		for( it = _soundList.begin(); it != _soundList.end(); it++ )
+		csDebug() << "[SoundManager::stopAllSound]";
+		QListIterator<SoundBase*> it( _soundList.sounds() );
+		while( it.hasNext() )
 		{
-			it->second->stopSound();
+			it.next()->stopSound();
 		}
 		return true;
 	}
@@ -904,22 +1069,22 @@ namespace CnotiAudio
 */
 	bool SoundManager::stopSound(const QString soundName)
 	{
-		qDebug() << "[SoundManager::stopSound]" << soundName ;
+		csDebug() << "[SoundManager::stopSound]" << soundName ;
 		if( !checkSoundName(soundName) )
 		{
-			qDebug() << "[SoundManager::stopSound]" << soundName << "don't exist to stopSound";
+			csDebug() << "[SoundManager::stopSound]" << soundName << "don't exist to stopSound";
 			return false;
 		}
 		if( isSoundStopped(soundName) )
 		{
-			qDebug() << "[SoundManager::stopSound]" << soundName << "is too stopped";
+			csDebug() << "[SoundManager::stopSound]" << soundName << "is too stopped";
 			return false;
 		}
 		//
 		// STOP
 		//
-		bool result = _soundList[soundName]->stopSound();
-		_lastError = _soundList[soundName]->getLastError();
+		bool result = _soundList.value(soundName)->stopSound();
+		_lastError = _soundList.value(soundName)->getLastError();
 		return result;
 	}
 
@@ -930,17 +1095,17 @@ namespace CnotiAudio
 */
 	bool SoundManager::pauseSound(const QString soundName)
 	{
-		qDebug() << "[SoundManager::pauseSound]" << soundName;
+		csDebug() << "[SoundManager::pauseSound]" << soundName;
 		if( !checkSoundName(soundName) )
 		{
-			qDebug() << "[SoundManager::pauseSound]" << soundName << "don't exist to pauseSound";
+			csDebug() << "[SoundManager::pauseSound]" << soundName << "don't exist to pauseSound";
 			return false;
 		}
 		//
 		// Pause
 		//
-		bool result = _soundList[soundName]->pauseSound();
-		_lastError = _soundList[soundName]->getLastError();
+		bool result = _soundList.value(soundName)->pauseSound();
+		_lastError = _soundList.value(soundName)->getLastError();
 		return result;
 	}
 
@@ -952,11 +1117,11 @@ namespace CnotiAudio
 */
 	bool SoundManager::playMelodyOfSound(const QString soundName, int melody)
 	{
-		qDebug() << "[SoundManager::playMelodyOfSound]" << soundName << ", " + melody;
+		csDebug() << "[SoundManager::playMelodyOfSound]" << soundName << ", " + melody;
 		if(!checkSoundName(soundName)){
 			return false;
 		}
-		if( dynamic_cast<Sound*>(_soundList[soundName]) == 0 )
+		if( dynamic_cast<Sound*>(_soundList.value(soundName)) == 0 )
 		{
 			_lastError = CS_IS_NOT_XMLSOUND;
 			return false;
@@ -964,8 +1129,8 @@ namespace CnotiAudio
 		//
 		// PLAY melody
 		//
-		bool value = ((Sound*)(_soundList[soundName]))->playSound(false, melody);
-		_lastError = _soundList[soundName]->getLastError();
+		bool value = ((Sound*)(_soundList.value(soundName)))->playSound(false, melody);
+		_lastError = _soundList.value(soundName)->getLastError();
 		return value;
 	}
 
@@ -977,10 +1142,14 @@ namespace CnotiAudio
 	If the file is a xml the sound who has create is an instance of Sound, if the file is wav, the sound is an
 	instance of Sample and if the file is an ogg, the sound is an instance of Stream. The file is loaded on
 	memory unless if is an ogg file, because the ogg file is play in streaming.
+	If the file is a binary score (.csb) the sound is an instance of Sound or Music, as given by the score.
+	A MIDI file (.mid) is a Music if it has one melody and rhythms, otherwise a Sound, and it is only read once.
 
 	Before load any file the openal must be initialized and if the file is ogg the ogg must be initialized. If the
 	file is an ogg even if the file does not exist or is not valid than the sound will be created and will not give error.
 
+	A relative \a fileName is looked for in the sample paths before the current directory.
+
 	If \a toOverride is true, even if sound already exists it is loaded again.
 	If \a connectSound is false, the signal of the sound will not be initialized.
 
@@ -990,26 +1159,27 @@ namespace CnotiAudio
         {
                 if( checkSoundName(soundName) && !toOverride )
                 {
+			PerfCounters::add( PERF_CACHE_HITS );
 			return true;
                 }
+		PerfCounters::add( PERF_CACHE_MISSES );
 		//
-		// Verifies if files exists
+		// Looks for the file in the sample index first, the disk is only accessed for the
+		// absolute names and the names not indexed, relative to the current directory
 		//
-		QString filenamePath = filename;
-		QFile f;
-		f.setFileName( filenamePath );
-		if( !f.exists() )
-                {
-			filenamePath = samplePath(filenamePath);
-			if(filenamePath.isEmpty())
-                        {
-				qDebug() << "[SoundManager::load]" << filenamePath << " doesn't exist";
+		QString filenamePath = QDir::isRelativePath( filename ) ? samplePath( filename ) : QString();
+		if( filenamePath.isEmpty() )
+		{
+			if( !QFile::exists( filename ) )
+			{
+				csDebug() << "[SoundManager::load]" << filename << " doesn't exist";
 				_lastError = CS_FILE_NOT_FOUND;
 				return false;
 			}
+			filenamePath = filename;
 		}
 
-		qDebug() << "[SoundManager::load]" << filenamePath <<  ", " << soundName;
+		csDebug() << "[SoundManager::load]" << filenamePath <<  ", " << soundName;
 		QString newSoundName;
 		//
 		// If not given a sound name uses the file name as the sound name
@@ -1020,23 +1190,71 @@ namespace CnotiAudio
 		//
 		if( !isInitAl )
 		{
-			qDebug() << "[SoundManager::load]Open Al is not initialized";
+			csDebug() << "[SoundManager::load]Open Al is not initialized";
 			_lastError = CS_OPENAL_NOT_INIT;
 			return false;
 		}
 		//
 		// Creates the new sound
                 //
+		QElapsedTimer loadTimer;
+		loadTimer.start();
 		SoundBase* s;
 		bool result;
+		ScoreData midiScore;		// Score of a MIDI file, read once to find its kind
+		bool midi = false;
 		if ( filenamePath. contains( ".wav", Qt::CaseInsensitive ) )
                 {
 			s = new Sample(newSoundName);
+			((Sample*)s)->setResidency( _sampleResidency );
 		}
 		else if( filenamePath. contains( ".xml", Qt::CaseInsensitive ) )
                 {
 			s = new Sound(newSoundName);
 		}
+		else if( ScoreBinary::isBinary( filenamePath ) )
+		{
+			//
+			// Binary scores have a sound or a music, given in the header
+			//
+			EnumScoreKind kind;
+			if( !ScoreBinary::peekKind( filenamePath, &kind ) )
+			{
+				csDebug() << "[SoundManager::load]" << filenamePath << "is not a binary score";
+				_lastError = CS_PARSER_ERROR;
+				return false;
+			}
+			if( kind == SCORE_MUSIC )
+			{
+				s = new Music(newSoundName);
+			}
+			else
+			{
+				s = new Sound(newSoundName);
+			}
+		}
+		else if( ScoreMidi::isMidi( filenamePath ) )
+		{
+			//
+			// MIDI files with one melody and rhythms are musics, the score read is given to the sound
+			//
+			QString error;
+			if( !ScoreMidi::read( filenamePath, &midiScore, &error ) )
+			{
+				csDebug() << "[SoundManager::load]" << filenamePath << "is not a MIDI file:" << error;
+				_lastError = CS_PARSER_ERROR;
+				return false;
+			}
+			midi = true;
+			if( midiScore.kind == SCORE_MUSIC )
+			{
+				s = new Music(newSoundName);
+			}
+			else
+			{
+				s = new Sound(newSoundName);
+			}
+		}
 		else if( filenamePath. contains( ".ogg", Qt::CaseInsensitive ) )
                 {
 			//
@@ -1044,7 +1262,7 @@ namespace CnotiAudio
 			//
 			if( !isInitOgg )
                         {
-				qDebug() << "[SoundManager::load]Ogg is not initialized";
+				csDebug() << "[SoundManager::load]Ogg is not initialized";
 				_lastError = CS_OGG_NOT_INIT;
 				return false;
 			}
@@ -1058,19 +1276,40 @@ namespace CnotiAudio
 		//
 		// Loads sound
                 //
-		result = s->load( filenamePath );
+		if( !midi )
+		{
+			result = s->load( filenamePath );
+		}
+		else if( midiScore.kind == SCORE_MUSIC )
+		{
+			result = ((Music*)s)->setScore( midiScore );
+		}
+		else
+		{
+			result = ((Sound*)s)->setScore( midiScore );
+		}
+		int loadTime = (int)( loadTimer.nsecsElapsed() / 1000 );
+		s->setLoadTime( loadTime );
+		PerfCounters::add( PERF_LOADS );
+		PerfCounters::add( PERF_LOAD_TIME_TOTAL_US, loadTime );
+		PerfCounters::raise( PERF_LOAD_TIME_MAX_US, loadTime );
 		if( result )
                 {
 			_lastError = CS_NO_ERROR;
 			if( checkSoundName( newSoundName ) )
 			{
-				qDebug() << "[SoundManager::load]" << newSoundName << " already exists so it is release";
+				csDebug() << "[SoundManager::load]" << newSoundName << " already exists so it is release";
 				releaseSound( newSoundName );
 			}
 			//
 			// Adds to sound list
 			//
-			_soundList.insert( std::make_pair(newSoundName, s) );
+			_soundList.insert( newSoundName, s );
+			_noteKeys.insert( newSoundName );
+			if( dynamic_cast<Sample*>(s) != 0 )
+			{
+				samplesChanged( newSoundName );
+			}
 			if( connectSound )
 			{
 				//
@@ -1081,13 +1320,13 @@ namespace CnotiAudio
 		}
 		else
 		{
-			qDebug() << "[SoundManager::load] Error loading sound.";
+			csDebug() << "[SoundManager::load] Error loading sound.";
 			_lastError = s->getLastError();
 			delete(s);
 		}
 		if( !result )
 		{
-			qDebug() << "[SoundManager::load] '" + filenamePath + "' - failed";
+			csDebug() << "[SoundManager::load] '" + filenamePath + "' - failed";
 		}
 		return result;
 	}
@@ -1096,29 +1335,36 @@ namespace CnotiAudio
 	Release the sound \a soundName.
 	Before releasing a sound, he's stopped.
 
+	The sound is deleted at once, or later if another thread is using it.
+
 	Returns true if sound was released, otherwise false.
 */
 	bool SoundManager::releaseSound(const QString soundName)
 	{
 		if( !checkSoundName(soundName) )
 		{
-			qDebug() << "[SoundManager::releaseSound]" << soundName << "don't exist to releaseSound";
+			csDebug() << "[SoundManager::releaseSound]" << soundName << "don't exist to releaseSound";
 			return false;
 		}
 		//
 		// STOP sound
 		//
-		// stopSound( soundName ); // It's done in the destructor.
+		SoundBase* s = _soundList.take(soundName);
+		s->stopSound();
+		if( dynamic_cast<Sample*>(s) != 0 )
+		{
+			samplesChanged( soundName );
+		}
 		//
-		// DELETE sound
+		// DELETE sound, when no other thread uses it
 		//
-		delete(_soundList[soundName]);
-		_soundList[soundName] = 0;
-		_soundList.erase(soundName);
+		_soundList.retire( s );
+		collectSounds();
+		_noteKeys.remove(soundName);
 
 		_lastError = CS_NO_ERROR;
 
-		qDebug() << "[SoundManager::releaseSound] Released:" << soundName;
+		csDebug() << "[SoundManager::releaseSound] Released:" << soundName;
 		return true;
 	}
 
@@ -1129,25 +1375,53 @@ namespace CnotiAudio
 */
 	bool SoundManager::releaseAllSound()
 	{
-		qDebug() << "[SoundManager::releaseAllSound]";
-		SoundList::iterator it;
+		csDebug() << "[SoundManager::releaseAllSound]";
 		//
-		// Delete sounds
+		// Clear sound list, the sounds are deleted when no other thread uses them
 		//
-		for( it = _soundList.begin(); it != _soundList.end(); it++ )
+		QListIterator<SoundBase*> it( _soundList.takeAll() );
+		while( it.hasNext() )
 		{
-			delete(it->second);
-			it->second = 0;
+			SoundBase* s = it.next();
+			s->stopSound();
+			_soundList.retire( s );
 		}
-		//
-		// Clear sound list
-		//
-		_soundList.clear();
+		_noteKeys.clear();
+		collectSounds();
+		samplesChanged();
 
 		_lastError = CS_NO_ERROR;
 		return true;
 	}
 
+/*!
+	Deletes the sounds released that no other thread can be using.
+
+	While some sounds retired are left, it is called again every CS_REFRESH milliseconds,
+	so they are deleted when their readers leave and not at the next release.
+*/
+	void SoundManager::collectSounds()
+	{
+		_soundList.collect();
+		if( _soundList.retiredCount() == 0 )
+		{
+			if( _collectTimer != NULL )
+			{
+				_collectTimer->stop();
+			}
+			return;
+		}
+		if( _collectTimer == NULL )
+		{
+			_collectTimer = new QTimer( this );
+			connect( _collectTimer, SIGNAL(timeout()), this, SLOT(collectSounds()) );
+		}
+		if( !_collectTimer->isActive() )
+		{
+			_collectTimer->start( CS_REFRESH );
+		}
+	}
+
 /*!
 	Function to know if the sound \a soundName is playing or not.
 
@@ -1155,17 +1429,17 @@ namespace CnotiAudio
 */
 	bool SoundManager::isSoundPlaying(const QString soundName)
 	{
-		qDebug() << "[SoundManager::isSoundPlaying]" << soundName;
+		csDebug() << "[SoundManager::isSoundPlaying]" << soundName;
 		if( checkSoundName(soundName) )
 		{
-			bool result = _soundList[soundName]->isPlaying();
-			qDebug() << "[SoundManager::isSoundPlaying]"  << soundName << "isPlaying" << result;
+			bool result = _soundList.value(soundName)->isPlaying();
+			csDebug() << "[SoundManager::isSoundPlaying]"  << soundName << "isPlaying" << result;
 			return result;
 		}
 		else
 		{
 			_lastError = CS_SOUND_UNKNOW;
-			qDebug() << "[SoundManager::isSoundPlaying]"  << soundName << " don't exist to isSoundPlaying";
+			csDebug() << "[SoundManager::isSoundPlaying]"  << soundName << " don't exist to isSoundPlaying";
 			return false;
 		}
 	}
@@ -1177,17 +1451,17 @@ namespace CnotiAudio
 */
 	bool SoundManager::isSoundPaused(const QString soundName)
 	{
-		qDebug() <<"[SoundManager::isSoundPaused]" << soundName;
+		csDebug() <<"[SoundManager::isSoundPaused]" << soundName;
 		if(checkSoundName(soundName))
 		{
-			bool result = _soundList[soundName]->isPaused();
-			qDebug() <<"[SoundManager::isSoundPaused]" << soundName << "isPaused" << result;
+			bool result = _soundList.value(soundName)->isPaused();
+			csDebug() <<"[SoundManager::isSoundPaused]" << soundName << "isPaused" << result;
 			return result;
 		}
 		else
 		{
 			_lastError = CS_SOUND_UNKNOW;
-			qDebug() <<"[SoundManager::isSoundPaused]" << soundName << " don't exist to isSoundPaused";
+			csDebug() <<"[SoundManager::isSoundPaused]" << soundName << " don't exist to isSoundPaused";
 			return false;
 		}
 	}
@@ -1199,17 +1473,17 @@ namespace CnotiAudio
 */
 	bool SoundManager::isSoundStopped(const QString soundName)
 	{
-		qDebug() << "[SoundManager::isSoundStopped]" << soundName;
+		csDebug() << "[SoundManager::isSoundStopped]" << soundName;
 		if(checkSoundName(soundName))
 		{
-			bool result = _soundList[soundName]->isStopped();
-			qDebug() << "[SoundManager::isSoundStopped]" << soundName << " isSoundStopped " + result;
+			bool result = _soundList.value(soundName)->isStopped();
+			csDebug() << "[SoundManager::isSoundStopped]" << soundName << " isSoundStopped " + result;
 			return result;
 		}
 		else
 		{
 			_lastError = CS_SOUND_UNKNOW;
-			qDebug() << "[SoundManager::isSoundStopped]" << soundName << " don't exist to isSoundStopped";
+			csDebug() << "[SoundManager::isSoundStopped]" << soundName << " don't exist to isSoundStopped";
 			return false;
 		}
 	}
@@ -1221,17 +1495,17 @@ namespace CnotiAudio
 */
 	bool SoundManager::isSoundEmpty(const QString soundName)
 	{
-		qDebug() <<"SoundManager::isSoundEmpty(" << soundName;
+		csDebug() <<"SoundManager::isSoundEmpty(" << soundName;
 		if(checkSoundName(soundName))
 		{
-			bool result = _soundList[soundName]->isEmpty();
-			qDebug() << soundName << " isSoundEmpty "  << result;
+			bool result = _soundList.value(soundName)->isEmpty();
+			csDebug() << soundName << " isSoundEmpty "  << result;
 			return result;
 		}
 		else
 		{
 			_lastError = CS_SOUND_UNKNOW;
-			qDebug() <<soundName  <<  "don't exist to isSoundEmpty";
+			csDebug() <<soundName  <<  "don't exist to isSoundEmpty";
 			return false;
 		}
 	}
@@ -1245,23 +1519,23 @@ namespace CnotiAudio
 */
 	bool  SoundManager::compareSound(const QString soundOne, const QString soundTwo)
 	{
-		qDebug() <<"SoundManager::compareSound(" << soundOne << ", " << soundTwo;
+		csDebug() <<"SoundManager::compareSound(" << soundOne << ", " << soundTwo;
 		if( !checkSoundName(soundOne) )
 		{
-			qDebug() <<soundOne  <<  "don't exist to compareSound";
+			csDebug() <<soundOne  <<  "don't exist to compareSound";
 			return false;
 		}
 		if( !checkSoundName(soundTwo) )
 		{
-			qDebug() <<soundTwo  <<  "don't exist to compareSound";
+			csDebug() <<soundTwo  <<  "don't exist to compareSound";
 			return false;
 		}
 		else
 		{
-			bool result = _soundList[soundOne]->compareSound( _soundList[soundTwo] );
+			bool result = _soundList.value(soundOne)->compareSound( _soundList.value(soundTwo) );
 			if( !result )
 			{
-				_lastError = _soundList[soundOne]->getLastError();
+				_lastError = _soundList.value(soundOne)->getLastError();
 			}
 			else
 			{
@@ -1280,26 +1554,26 @@ namespace CnotiAudio
 */
 	int  SoundManager::compareMelody( const QString soundName, int firstMelody, int secondMelody )
 	{
-		qDebug() << "[SoundManager::compareMelody] " << soundName << "," << firstMelody << "," << secondMelody;
+		csDebug() << "[SoundManager::compareMelody] " << soundName << "," << firstMelody << "," << secondMelody;
 		if( !checkSoundName(soundName) )
 		{
-			qDebug() << "[SoundManager::compareMelody] " << soundName << " doesn't exist to compareMelody";
+			csDebug() << "[SoundManager::compareMelody] " << soundName << " doesn't exist to compareMelody";
 			return false;
 		}
 		else
 		{
-			if( dynamic_cast<Sound*>(_soundList[soundName]) != 0 )
+			if( dynamic_cast<Sound*>(_soundList.value(soundName)) != 0 )
 			{
-				int value = ((Sound*)(_soundList[soundName]))->compareMelody(firstMelody, secondMelody);
+				int value = ((Sound*)(_soundList.value(soundName)))->compareMelody(firstMelody, secondMelody);
 				if( value < 0 )
-					_lastError = _soundList[soundName]->getLastError();
+					_lastError = _soundList.value(soundName)->getLastError();
 				else
 					_lastError = CS_NO_ERROR;
 				return value;
 			}
 			else
 			{
-				qWarning() << "[SoundManager::compareMelody]" << soundName << " is not a sound with notes.";
+				csWarning() << "[SoundManager::compareMelody]" << soundName << " is not a sound with notes.";
 				_lastError = CS_IS_NOT_XMLSOUND;
 				return false;
 			}
@@ -1317,14 +1591,14 @@ namespace CnotiAudio
 */
 	bool SoundManager::save(const QString soundName, const QString filename, bool overwrite)
 	{
-		qDebug() << "[SoundManager::save]" << soundName << "," << filename << "," << overwrite;
+		csDebug() << "[SoundManager::save]" << soundName << "," << filename << "," << overwrite;
 		//
 		// Check if file exists
 		//
 		QFile f( filename + ".wav" );
 		if( overwrite == false && f.exists() )
 		{
-			qDebug() << "[SoundManager::save]" << filename << " already exist";
+			csDebug() << "[SoundManager::save]" << filename << " already exist";
 			_lastError = CS_FILE_EXISTS;
 			return false;
 		}
@@ -1333,11 +1607,11 @@ namespace CnotiAudio
 		//
 		if( checkSoundName(soundName) )
 		{
-			return _soundList[soundName]->save( filename );
+			return _soundList.value(soundName)->save( filename );
 		}
 		else
 		{
-			qDebug() << "[SoundManager::save]" <<  soundName + " don't exist to saveWav";
+			csDebug() << "[SoundManager::save]" <<  soundName + " don't exist to saveWav";
 			return false;
 		}
 	}
@@ -1351,14 +1625,14 @@ namespace CnotiAudio
 */
 	bool SoundManager::saveMelodyWav(const QString soundName, int melody, QString filename, bool overwrite)
 	{
-		qDebug() << "[SoundManager::saveMelodyWav]" << soundName << "," << melody << ", " << filename << "," << overwrite;
+		csDebug() << "[SoundManager::saveMelodyWav]" << soundName << "," << melody << ", " << filename << "," << overwrite;
 		//
 		// Chck if file exists
 		//
 		QFile f( filename + ".wav" );
 		if( overwrite == false && f.exists() )
 		{
-			qDebug() << "[SoundManager::saveMelodyWav]" << filename << " already exist.";
+			csDebug() << "[SoundManager::saveMelodyWav]" << filename << " already exist.";
 			_lastError = CS_FILE_EXISTS;
 			return false;
 		}
@@ -1367,20 +1641,20 @@ namespace CnotiAudio
 		//
 		if( checkSoundName(soundName) )
 		{
-			if( dynamic_cast<Sound*>(_soundList[soundName]) != 0 )
+			if( dynamic_cast<Sound*>(_soundList.value(soundName)) != 0 )
 			{
-				return ((Sound*)(_soundList[soundName]))->saveWav(filename);
+				return ((Sound*)(_soundList.value(soundName)))->saveWav(filename);
 			}
 			else
 			{
-				qDebug() << "[SoundManager::saveMelodyWav]" << soundName << " is not a sound with notes";
+				csDebug() << "[SoundManager::saveMelodyWav]" << soundName << " is not a sound with notes";
 				_lastError = CS_IS_NOT_XMLSOUND;
 				return false;
 			}
 		}
 		else
 		{
-			qDebug() << "[SoundManager::saveMelodyWav]" << soundName << " don't exist to saveMelodyWav";
+			csDebug() << "[SoundManager::saveMelodyWav]" << soundName << " don't exist to saveMelodyWav";
 			return false;
 		}
 	}
@@ -1401,14 +1675,14 @@ namespace CnotiAudio
 */
 	bool SoundManager::saveMp3(const QString soundName, const QString filename, int minimumRate,  bool deleteWav, bool overwrite)
 	{
-		qDebug() << "[SoundManager::saveMp3]" << soundName << "," << filename << "," << minimumRate << "," << deleteWav << "," << overwrite;
+		csDebug() << "[SoundManager::saveMp3]" << soundName << "," << filename << "," << minimumRate << "," << deleteWav << "," << overwrite;
 		//
 		// Check if file already exists
 		//
 		QFile f( filename + ".mp3" );
 		if( overwrite == false && f.exists() )
 		{
-			qDebug() << "[SoundManager::saveMp3]" << filename << " already exist";
+			csDebug() << "[SoundManager::saveMp3]" << filename << " already exist";
 			_lastError = CS_FILE_EXISTS;
 			return false;
 		}
@@ -1417,19 +1691,19 @@ namespace CnotiAudio
 		//
 		if( !checkSoundName(soundName) )
 		{
-			qDebug()  << "[SoundManager::saveMp3]" << soundName << " doesn't exist to saveMp3";
+			csDebug()  << "[SoundManager::saveMp3]" << soundName << " doesn't exist to saveMp3";
 			return false;
 		}
 		//
 		// SAVE MP3
 		//
-		return _soundList[soundName]->saveMp3(filename, minimumRate, deleteWav);
+		return _soundList.value(soundName)->saveMp3(filename, minimumRate, deleteWav);
 	}
 
 /*!
 	Returns the percent of the sound playing or 0.0 if the sound doesn't exist or is stopped.
 
-	This function is not implemented for wav and ogg sound.
+	Returns -1 for an ogg sound when the length of the file is not known.
 */
 	float SoundManager::percentPlay(const QString soundName)
 	{
@@ -1438,13 +1712,30 @@ namespace CnotiAudio
 		//
 		if( !checkSoundName(soundName) )
 		{
-			qDebug() << "[SoundManager::percentPlay] " << soundName << " dones't exist to percentPlay";
+			csDebug() << "[SoundManager::percentPlay] " << soundName << " dones't exist to percentPlay";
 			return 0.0;
 		}
 		//
 		// Get percent play for the sound
 		//
-		return _soundList[soundName]->percentPlay();
+		return _soundList.value(soundName)->percentPlay();
+	}
+
+/*!
+	Returns the position of the sound \a soundName being played, in sample frames, and the
+	note playing.
+
+	The position is read from the sound source and a table of the note lengths made when the
+	sound started, so it can be called on every frame of the GUI.
+*/
+	PlayPosition SoundManager::getPlayPosition(const QString soundName)
+	{
+		if( !checkSoundName(soundName) )
+		{
+			_lastError = CS_SOUND_UNKNOW;
+			return PlayPosition();
+		}
+		return _soundList.value(soundName)->playPosition();
 	}
 
 /*
@@ -1468,9 +1759,12 @@ namespace CnotiAudio
 */
 	bool SoundManager::loadSampleNote(NoteType height, int octave, DurationType duration, TempoType tempo, EnumInstrument instrument)
 	{
-		qDebug() << "[SoundManager::loadSampleNote] Height:" << height << "Duration:" << duration << "Tempo:" << tempo << "Intrument" << instrument;
+		csDebug() << "[SoundManager::loadSampleNote] Height:" << height << "Duration:" << duration << "Tempo:" << tempo << "Intrument" << instrument;
 		QString filename = nameNote( instrument, tempo, duration, octave, height );
-
+		if( _synthesizer.hasPatch( instrument ) )
+		{
+			return loadSynthesized( filename );
+		}
 		return load(filename, filename);
 	}
 
@@ -1526,7 +1820,14 @@ namespace CnotiAudio
 		// Load the pause
 		//
 		QString pause = pauseName + QString::number(tempo) + "_" + QString::number(duration) + ".wav";
-		result = load(pause, pause, false) && result;
+		if( _synthesizer.hasPatch( instrument ) )
+		{
+			result = loadSynthesized( pause ) && result;
+		}
+		else
+		{
+			result = load(pause, pause, false) && result;
+		}
 
 		if( !result )
 		{
@@ -1573,7 +1874,7 @@ namespace CnotiAudio
 	bool SoundManager::loadRhythms(EnumInstrument instrument, TempoType tempo)
 	{
 		_lastError = CS_NO_ERROR;
-		qDebug() << "[SoundManager::loadRhythms]" << instrument << "," << tempo;
+		csDebug() << "[SoundManager::loadRhythms]" << instrument << "," << tempo;
 		bool value = true;
 		int max = 0;
 		CnotiAudio::DurationType noteDuration;
@@ -1605,7 +1906,7 @@ namespace CnotiAudio
 			//
 			_lastError = CS_FILE_ERROR;
 			releaseSamplesInstrument( instrument );
-			qWarning() << "[SoundManager::loadRhythms] Error loading samples for a ryhtm";
+			csWarning() << "[SoundManager::loadRhythms] Error loading samples for a ryhtm";
 		}
 		return value;
 	}
@@ -1623,9 +1924,14 @@ namespace CnotiAudio
 	*/
 	bool SoundManager::loadRhythmSample(EnumRhythmInstrument instrument, TempoType tempo, EnumRhythmVariation variation)
 	{
-		qDebug() << "[SoundManager::loadSampleRhythm] Height:" << variation << "Tempo:" << tempo << "Rhythmic intrument" << instrument;
+		csDebug() << "[SoundManager::loadSampleRhythm] Height:" << variation << "Tempo:" << tempo << "Rhythmic intrument" << instrument;
 		QString filename = rhythmName( instrument, tempo, variation );
-		return load(filename, filename, false, false);
+		if( !load(filename, filename, false, false) )
+		{
+			return false;
+		}
+		_soundList.value(filename)->setPriority( VOICE_PRIORITY_RHYTHM );
+		return true;
 	}
 
 /*!
@@ -1635,9 +1941,7 @@ namespace CnotiAudio
 */
 	bool SoundManager::releaseSamplesInstrument(EnumInstrument instrument)
 	{
-		_lastError = CS_FILE_ERROR;
-		QString mask = QString::number((int)(instrument)) + "_???_??*.wav";	// So it doesn't unload rhythms
-		return releaseSamplesMask( mask );
+		return releaseSamples( SAMPLE_GROUP_INSTRUMENT, instrument );
 	}
 
 /*!
@@ -1650,22 +1954,23 @@ namespace CnotiAudio
 		_lastError = CS_FILE_ERROR;
 		// Get the name of the sound to be released
 		QStringList deleteList;
-		SoundList::iterator it;
 		try
 		{
 			QRegExp rx(mask);
 			rx.setPatternSyntax(QRegExp::Wildcard);
-			for(it = _soundList.begin(); it != _soundList.end(); it++ )
+			QStringListIterator it( _soundList.names() );
+			while( it.hasNext() )
 			{
-				if( it->first.contains( rx ) )
+				const QString& name = it.next();
+				if( name.contains( rx ) )
 				{
-					deleteList << it->first;
+					deleteList << name;
 				}
 			}
 		}
 		catch (...)
 		{
-			qWarning() << "[SoundManager::releaseSamplesMask] Exception occured on releasing samples";
+			csWarning() << "[SoundManager::releaseSamplesMask] Exception occured on releasing samples";
 			return false;
 		}
 
@@ -1680,145 +1985,694 @@ namespace CnotiAudio
 	}
 
 /*!
-	Plays a single note in \a instument, with a \a duration, a \an height, a \an octave
-	and an \a intensity.
+	Releases the samples of the \a group with \a value, like all the samples of the
+	instrument PIANO for SAMPLE_GROUP_INSTRUMENT.
 
-	Retunrs true if note played, otherwise false.
+	Only the samples of the group are visited. Returns always true.
 */
-	bool SoundManager::playNote( EnumInstrument instrument, TempoType tempo, DurationType duration, NoteType height, int octave, float intensity )
+	bool SoundManager::releaseSamples( EnumSampleGroup group, int value )
 	{
-		_lastError = CS_FILE_ERROR;
-		QString filename  = nameNote(instrument, tempo, duration, octave, height);
-		//
-		// Check if note exists (is loaded)
-		//
-		if( !checkSoundName(filename) )
+		QStringListIterator it( _noteKeys.names( group, value ) );
+		while( it.hasNext() )
 		{
-			qDebug() << "[SoundManager::playNote]" << filename << " don't exist to playNote";
-			return false;
+			releaseSound( it.next() );
 		}
-
-		_soundList[filename]->setVolume( intensity );
-		return _soundList[filename]->playSound();
+		_lastError = CS_NO_ERROR;
+		return true;
 	}
 
 /*!
-	Change the intensity of \a soundName to \a intensity.
-
-	The value of intensity can be change between 0 and 1.
-
-	Returns false if the sound doesn't exist.
+	Returns the names of the samples loaded of the \a group with \a value.
 */
-	bool SoundManager::setSoundIntensity(const QString soundName, float intensity)
+	QStringList SoundManager::getSamples( EnumSampleGroup group, int value )
 	{
-		_lastError = CS_FILE_ERROR;
-		//
-		// Check if sound exists
-		//
-		if( !checkSoundName(soundName) )
-		{
-			qDebug() << "[SoundManager::setSoundIntensity]" << soundName << " don't exist to setIntensitySound";
-			_lastError = CS_SOUND_UNKNOW;
-			return false;
-		}
-
-		_soundList[soundName]->setVolume(intensity);
-		qDebug() << "[SoundManager::setSoundIntensity]" << soundName << "Intensity:" << intensity;
-
-		return true;
+		return _noteKeys.names( group, value );
 	}
 
 /*!
-	Change the intensity of all the sound that in their names as \a mask.
-	Returns true no error occureed, otherwisse false.
+	Returns the bytes of sample data of the \a group with \a value.
 */
-	bool SoundManager::setSoundIntensityMask( const QString mask, float intensity )
+	unsigned long SoundManager::getSamplesMemory( EnumSampleGroup group, int value )
 	{
-		_lastError = CS_FILE_ERROR;
-		SoundList::iterator it;
-		try
+		unsigned long bytes = 0;
+		QStringListIterator it( _noteKeys.names( group, value ) );
+		while( it.hasNext() )
 		{
-			for( it = _soundList.begin(); it != _soundList.end(); it++ )
+			SoundBase* sound = _soundList.value( it.next() );
+			if( sound != 0 )
 			{
-				if( it->first.contains( mask ) )
-				{
-					setSoundIntensity( it->first, intensity );
-				}
+				bytes += sound->getSize();
 			}
 		}
-		catch (...)
-		{
-			return false;
-		}
-		return true;
+		return bytes;
 	}
 
 /*!
-	Change the intensity of a sound of all the melodies played by \a intrument
-	to \a intensity in the sound identified by \a soundName.
+	Loads the samples \a names that are not loaded yet, as loadSampleNote() or
+	loadRhythmSample() would. The names repeated are loaded once.
 
-	Returns true if no error occurred, otherwise false.
+	The files are read by the thread pool, at the same time, and then the samples are
+	added to the sound list in this thread. The notes of the synthesized instruments, and the
+	pauses without a file, are rendered by the thread pool instead.
+
+	Returns the number of samples loaded. If a sample can't be loaded the others are, and the
+	last error is set.
 */
-	bool SoundManager::setMelodyIntensity( const QString &soundName, const CnotiAudio::EnumInstrument inst, float intensity )
+	int SoundManager::preloadSamples( const QStringList& names )
 	{
-		_lastError = CS_FILE_ERROR;
-		QList<Melody*>::iterator it;
-		try
+		if( !isInitAl )
 		{
-			Sound* s = (Sound*)_soundList[soundName];
-			QList<Melody*> melodyList = s->getMelodyList();
-			//
-			// Checks every melody in the sound
-			//
-			for( it = melodyList.begin(); it != melodyList.end(); it++ )
+			csDebug() << "[SoundManager::preloadSamples]Open Al is not initialized";
+			_lastError = CS_OPENAL_NOT_INIT;
+			return 0;
+		}
+		_lastError = CS_NO_ERROR;
+		//
+		// Files of the samples missing, without accessing the disk if they are in the index
+		//
+		QSet<QString> found;
+		QList<DecodedSample> requests;
+		QStringListIterator it( names );
+		while( it.hasNext() )
+		{
+			QString name = it.next();
+			if( found.contains( name ) )
 			{
-				//
-				// Check if is the correct instrument
-				//
-				if((*it)->getInstrument() == inst )
-				{
-					//
-					// Changes volume
-					//
-					(*it)->setIntensity( intensity );
-				}
+				continue;
+			}
+			found.insert( name );
+			if( _soundList.contains( name ) )
+			{
+				PerfCounters::add( PERF_CACHE_HITS );
+				continue;
+			}
+			PerfCounters::add( PERF_CACHE_MISSES );
+			DecodedSample request;
+			request.name = name;
+			NoteKey key = NoteKey::fromName( name );
+			if( key.kind == NOTE_KEY_NOTE && _synthesizer.hasPatch( key.instrument ) )
+			{
+				request.synthesize = true;
+				requests.append( request );
+				continue;
+			}
+			request.filename = QDir::isRelativePath( name ) ? samplePath( name ) : QString();
+			if( request.filename.isEmpty() && QFile::exists( name ) )
+			{
+				request.filename = name;
+			}
+			if( request.filename.isEmpty() && key.kind == NOTE_KEY_PAUSE && _synthesizer.canRender( key ) )
+			{
+				request.synthesize = true;
+				requests.append( request );
+				continue;
+			}
+			if( request.filename.isEmpty() )
+			{
+				csDebug() << "[SoundManager::preloadSamples]" << name << " doesn't exist";
+				_lastError = CS_FILE_NOT_FOUND;
+				continue;
 			}
+			requests.append( request );
 		}
-		catch (...)
+		if( requests.isEmpty() )
 		{
-			return false;
+			return 0;
 		}
-
-		return true;
+		QList<DecodedSample> decoded = QtConcurrent::blockingMapped< QList<DecodedSample> >( requests,
+			SampleDecoder( &_synthesizer ) );
+		//
+		// Creates the samples, the AL buffers are created in this thread
+		//
+		int loaded = 0;
+		for( int i = 0; i < decoded.size(); i++ )
+		{
+			const DecodedSample& d = decoded[i];
+			if( !d.ok )
+			{
+				csDebug() << "[SoundManager::preloadSamples] '" + ( d.synthesize ? d.name : d.filename ) + "' - failed";
+				_lastError = CS_FILE_ERROR;
+				continue;
+			}
+			if( addSample( d.name, d.filename, d.data, d.format, d.frequency, d.decodeTime ) )
+			{
+				loaded++;
+			}
+		}
+		csDebug() << "[SoundManager::preloadSamples]" << loaded << "samples loaded of" << names.size();
+		return loaded;
 	}
 
-/*
-	Returns the intensity of sound named \a soundName.
+/*!
+	Adds to the sound list the sample \a name, with the \a data read from \a filename, or
+	rendered by the synthesizer if \a filename is empty, in \a decodeTime microseconds.
 
-	If the sound doesn't exist returns -1.
+	Returns true if the sample was added, otherwise false and the last error is set.
 */
-	float SoundManager::getIntensitySound(const QString soundName)
+	bool SoundManager::addSample( const QString& name, const QString& filename, const PcmBuffer& data, ALenum format,
+		ALint frequency, int decodeTime )
 	{
-		if( !checkSoundName(soundName) )
+		QElapsedTimer loadTimer;
+		loadTimer.start();
+		Sample* s = new Sample( name );
+		s->setResidency( _sampleResidency );
+		if( !s->load( filename, data, format, frequency ) )
 		{
-			qDebug() << soundName << " don't exist to getIntensitySound";
-			return -1;
+			csDebug() << "[SoundManager::addSample] '" + name + "' - failed";
+			_lastError = s->getLastError();
+			delete( s );
+			return false;
 		}
+		int loadTime = decodeTime + (int)( loadTimer.nsecsElapsed() / 1000 );
+		s->setLoadTime( loadTime );
+		PerfCounters::add( PERF_LOADS );
+		PerfCounters::add( PERF_LOAD_TIME_TOTAL_US, loadTime );
+		PerfCounters::raise( PERF_LOAD_TIME_MAX_US, loadTime );
 
-		return _soundList[soundName]->getIntensity();
+		_soundList.insert( name, (SoundBase*)s );
+		_noteKeys.insert( name );
+		samplesChanged( name );
+		if( NoteKey::fromName( name ).kind == NOTE_KEY_RHYTHM )
+		{
+			s->setPriority( VOICE_PRIORITY_RHYTHM );	// As loadRhythmSample()
+		}
+		else
+		{
+			s->connectToSoundManager();
+		}
+		return true;
 	}
 
 /*!
-	Changes the intensity of all the sounds to \a intensity.
+	Returns a number that changes each time a sample is loaded or released.
+
+	The melodies keep the samples of their notes joined, when it changed they look for the
+	notes whose samples changed with getSampleGeneration().
+*/
+	int SoundManager::getSamplesGeneration()
+	{
+		return _samplesGeneration;
+	}
+
+/*!
+	Returns the value of getSamplesGeneration() when the sample \a name was loaded or
+	released for the last time.
+
+	The melodies only join again the notes whose samples changed after they were joined.
+*/
+	int SoundManager::getSampleGeneration( const QString& name )
+	{
+		return _sampleGenerations.value( name, _samplesResetGeneration );
+	}
+
+/*!
+	Changes the number returned by getSamplesGeneration(), after all the samples were
+	released.
+*/
+	void SoundManager::samplesChanged()
+	{
+		_samplesResetGeneration = _samplesGeneration.fetchAndAddRelaxed( 1 ) + 1;
+		_sampleGenerations.clear();
+	}
+
+/*!
+	Changes the number returned by getSamplesGeneration(), after the sample \a name was
+	loaded or released.
+*/
+	void SoundManager::samplesChanged( const QString& name )
+	{
+		_sampleGenerations.insert( name, _samplesGeneration.fetchAndAddRelaxed( 1 ) + 1 );
+	}
+
+/*!
+	Loads the note or pause \a name rendered by the synthesizer, if it isn't loaded yet.
+
+	Returns true if the sample is loaded, otherwise false.
+*/
+	bool SoundManager::loadSynthesized( const QString& name )
+	{
+		if( checkSoundName( name ) )
+		{
+			PerfCounters::add( PERF_CACHE_HITS );
+			return true;
+		}
+		PerfCounters::add( PERF_CACHE_MISSES );
+		if( !isInitAl )
+		{
+			csDebug() << "[SoundManager::loadSynthesized]Open Al is not initialized";
+			_lastError = CS_OPENAL_NOT_INIT;
+			return false;
+		}
+		QElapsedTimer renderTimer;
+		renderTimer.start();
+		PcmBuffer data = _synthesizer.render( NoteKey::fromName( name ) );
+		if( data.isEmpty() )
+		{
+			csDebug() << "[SoundManager::loadSynthesized]" << name << "can't be synthesized";
+			_lastError = CS_FILE_NOT_FOUND;
+			return false;
+		}
+		return addSample( name, QString(), data, AL_FORMAT_MONO16, _synthesizer.frequency(),
+			(int)( renderTimer.nsecsElapsed() / 1000 ) );
+	}
+
+/*!
+	Loads the samples used by the notes of \a soundName, and only those, with
+	preloadSamples().
+
+	Returns the number of samples loaded, or -1 if the sound doesn't exist.
+*/
+	int SoundManager::preloadSound( const QString soundName )
+	{
+		if( !checkSoundName(soundName) )
+		{
+			csDebug() << "[SoundManager::preloadSound]" << soundName << "doesn't exist to preloadSound";
+			return -1;
+		}
+		return preloadSamples( _soundList.value(soundName)->sampleNames() );
+	}
+
+/*!
+	Reads again, in the thread pool, the data of the samples \a names kept only in their AL
+	buffer. The samples not loaded are not loaded, see preloadSamples().
+
+	The samples kept only in their AL buffer don't keep the data read, so it is given by the
+	future, a result for each name of \a fetched, in the same order. The samples released
+	before give an empty result.
+
+	Returns at once, the future finishes when all the data was read.
+*/
+	QFuture<PcmBuffer> SoundManager::prefetchSamples( const QStringList& names, QStringList* fetched )
+	{
+		QStringList samples;
+		QSet<QString> seen;
+		for( int i = 0; i < names.size(); i++ )
+		{
+			if( seen.contains( names[i] ) )
+			{
+				continue;
+			}
+			seen.insert( names[i] );
+			Sample* sample = dynamic_cast<Sample*>(_soundList.value( names[i] ));
+			if( sample != 0 && sample->getResidency() == SAMPLE_RESIDENT_AL )
+			{
+				samples.append( names[i] );
+			}
+		}
+		if( fetched != 0 )
+		{
+			*fetched = samples;
+		}
+		return QtConcurrent::mapped( samples, SampleFetcher( &_soundList ) );
+	}
+
+/*!
+	Changes the samples loaded when the instrument or the tempo of a music changes to
+	\a loading.
+
+	With SAMPLE_LOADING_SCORE only the samples used by the notes of the music are loaded, and
+	the samples missing are loaded when a sound is played by playSound(). When notes are
+	added to a sound, its samples are loaded by preloadSound().
+*/
+	void SoundManager::setSampleLoading( EnumSampleLoading loading )
+	{
+		_sampleLoading = loading;
+	}
+
+/*!
+	Returns the samples loaded when the instrument or the tempo of a music changes.
+*/
+	EnumSampleLoading SoundManager::getSampleLoading()
+	{
+		return _sampleLoading;
+	}
+
+/*!
+	Sets the number of \a notes read ahead of the notes read by a RenderDevice. The data of
+	the next \a notes is read, with prefetchSamples(), when the device reaches the half of the
+	notes read before. 0, the default, doesn't read ahead.
+
+	Only the samples kept in their AL buffer need to be read. Changes the devices opened after.
+*/
+	void SoundManager::setPrefetchNotes( int notes )
+	{
+		_prefetchNotes = qMax( notes, 0 );
+	}
+
+/*!
+	Returns the number of notes read ahead of the notes read by a RenderDevice.
+*/
+	int SoundManager::getPrefetchNotes()
+	{
+		return _prefetchNotes;
+	}
+
+/*!
+	Changes where the samples loaded from now on keep their data to \a residency.
+
+	SAMPLE_RESIDENT_AL halves the memory used when the samples are only played, their data
+	is read again from the file if it is needed, for example to save or mix a sound.
+	SAMPLE_RESIDENT_CPU doesn't use AL buffers, for offline rendering.
+*/
+	void SoundManager::setSampleResidency( EnumSampleResidency residency )
+	{
+		_sampleResidency = residency;
+	}
+
+/*!
+	Returns where the samples loaded keep their data.
+*/
+	EnumSampleResidency SoundManager::getSampleResidency()
+	{
+		return _sampleResidency;
+	}
+
+/*!
+	Changes how the tracks of the sounds and musics are mixed to \a mode.
+
+	MIX_MODE_LEGACY mixes the tracks two at a time with the 16 bits mix formula, the result
+	depends on the order of the tracks. MIX_MODE_BUS adds all the tracks, with their intensity,
+	in a float bus and keeps the peaks under full scale with a look-ahead limiter (MixBus).
+	MIX_MODE_GRAPH processes the tracks with a DspGraph, with the effects set by
+	setMixEffects(), and mixes the whole sound again when any part changes.
+
+	The sounds are mixed again in the new mode the next time their data is used.
+*/
+	void SoundManager::setMixMode( EnumMixMode mode )
+	{
+		_mixMode = mode;
+	}
+
+/*!
+	Returns how the tracks of the sounds are mixed.
+*/
+	EnumMixMode SoundManager::getMixMode()
+	{
+		return _mixMode;
+	}
+
+/*!
+	Changes the effects applied to the mix of the tracks in MIX_MODE_GRAPH to \a effects.
+
+	Changes the sounds mixed and the devices opened after.
+*/
+	void SoundManager::setMixEffects( const DspEffects& effects )
+	{
+		_mixEffects = effects;
+	}
+
+/*!
+	Returns the effects applied to the mix of the tracks in MIX_MODE_GRAPH.
+*/
+	DspEffects SoundManager::getMixEffects()
+	{
+		return _mixEffects;
+	}
+
+/*!
+	Changes where the sample \a soundName keeps its data to \a residency.
+
+	Returns false if the sound doesn't exist or is not a sample.
+*/
+	bool SoundManager::setSoundResidency( const QString soundName, EnumSampleResidency residency )
+	{
+		if( !checkSoundName(soundName) )
+		{
+			_lastError = CS_SOUND_UNKNOW;
+			return false;
+		}
+		Sample* sample = dynamic_cast<Sample*>(_soundList.value(soundName));
+		if( sample == 0 )
+		{
+			_lastError = CS_SOUND_UNKNOW;
+			return false;
+		}
+		sample->setResidency( residency );
+		return true;
+	}
+
+/*!
+	Changes where all the samples with a certain \a mask keep their data to \a residency.
+
+	Returns true if no exceptions occurred, otherwise false.
+*/
+	bool SoundManager::setSamplesResidencyMask( const QString mask, EnumSampleResidency residency )
+	{
+		try
+		{
+			QRegExp rx(mask);
+			rx.setPatternSyntax(QRegExp::Wildcard);
+			QHash<QString, SoundBase*> sounds = _soundList.snapshot();
+			QHash<QString, SoundBase*>::const_iterator it;
+			for( it = sounds.constBegin(); it != sounds.constEnd(); ++it )
+			{
+				Sample* sample = dynamic_cast<Sample*>(it.value());
+				if( sample != 0 && it.key().contains( rx ) )
+				{
+					sample->setResidency( residency );
+				}
+			}
+		}
+		catch (...)
+		{
+			csWarning() << "[SoundManager::setSamplesResidencyMask] Exception occured on changing the samples";
+			_lastError = CS_FILE_ERROR;
+			return false;
+		}
+		return true;
+	}
+
+/*!
+	Changes where all the samples of an \a instrument keep their data to \a residency.
+
+	Returns always true.
+*/
+	bool SoundManager::setInstrumentResidency( EnumInstrument instrument, EnumSampleResidency residency )
+	{
+		QStringListIterator it( _noteKeys.names( SAMPLE_GROUP_INSTRUMENT, instrument ) );
+		while( it.hasNext() )
+		{
+			Sample* sample = dynamic_cast<Sample*>(_soundList.value(it.next()));
+			if( sample != 0 )
+			{
+				sample->setResidency( residency );
+			}
+		}
+		return true;
+	}
+
+/*!
+	Renders the notes of \a instrument with the synthesizer if \a synthesized, instead of
+	reading them from the sample files, with the patch of SynthPatch::forInstrument().
+
+	The samples of the instrument loaded are loaded again, and the sounds already mixed join
+	their notes again when their data is needed.
+*/
+	void SoundManager::setInstrumentSynthesized( EnumInstrument instrument, bool synthesized )
+	{
+		if( synthesized == _synthesizer.hasPatch( instrument ) )
+		{
+			return;
+		}
+		if( synthesized )
+		{
+			_synthesizer.setPatch( instrument, SynthPatch::forInstrument( instrument ) );
+		}
+		else
+		{
+			_synthesizer.removePatch( instrument );
+		}
+		reloadInstrument( instrument );
+	}
+
+/*!
+	Replaces the samples loaded of \a instrument, after it changed from the sample files to
+	the synthesizer or its patch changed.
+*/
+	void SoundManager::reloadInstrument( EnumInstrument instrument )
+	{
+		QStringList names = _noteKeys.names( SAMPLE_GROUP_INSTRUMENT, instrument );
+		releaseSamples( SAMPLE_GROUP_INSTRUMENT, instrument );
+		preloadSamples( names );
+	}
+
+/*!
+	Returns true if the notes of \a instrument are rendered by the synthesizer.
+*/
+	bool SoundManager::isInstrumentSynthesized( EnumInstrument instrument )
+	{
+		return _synthesizer.hasPatch( instrument );
+	}
+
+/*!
+	Renders the notes of \a instrument with the synthesizer and \a patch.
+
+	The samples of the instrument loaded are loaded again, and the sounds already mixed join
+	their notes again when their data is needed.
+*/
+	void SoundManager::setInstrumentPatch( EnumInstrument instrument, const SynthPatch& patch )
+	{
+		_synthesizer.setPatch( instrument, patch );
+		reloadInstrument( instrument );
+	}
+
+/*!
+	Returns the patch of \a instrument, a sine if it isn't synthesized.
+*/
+	SynthPatch SoundManager::getInstrumentPatch( EnumInstrument instrument )
+	{
+		return _synthesizer.patch( instrument );
+	}
+
+/*!
+	Plays a single note in \a instument, with a \a duration, a \an height, a \an octave
+	and an \a intensity.
+
+	Retunrs true if note played, otherwise false.
+*/
+	bool SoundManager::playNote( EnumInstrument instrument, TempoType tempo, DurationType duration, NoteType height, int octave, float intensity )
+	{
+		_lastError = CS_FILE_ERROR;
+		QString filename  = nameNote(instrument, tempo, duration, octave, height);
+		//
+		// Check if note exists (is loaded)
+		//
+		if( !checkSoundName(filename) )
+		{
+			csDebug() << "[SoundManager::playNote]" << filename << " don't exist to playNote";
+			return false;
+		}
+
+		_soundList.value(filename)->setVolume( intensity );
+		//
+		// The note is played with the UI priority, the sample keeps its own priority
+		//
+		Sample* sample = dynamic_cast<Sample*>(_soundList.value(filename));
+		if( sample != 0 )
+		{
+			return sample->playSound( VOICE_PRIORITY_UI );
+		}
+		return _soundList.value(filename)->playSound();
+	}
+
+/*!
+	Change the intensity of \a soundName to \a intensity.
+
+	The value of intensity can be change between 0 and 1.
+
+	Returns false if the sound doesn't exist.
+*/
+	bool SoundManager::setSoundIntensity(const QString soundName, float intensity)
+	{
+		_lastError = CS_FILE_ERROR;
+		//
+		// Check if sound exists
+		//
+		if( !checkSoundName(soundName) )
+		{
+			csDebug() << "[SoundManager::setSoundIntensity]" << soundName << " don't exist to setIntensitySound";
+			_lastError = CS_SOUND_UNKNOW;
+			return false;
+		}
+
+		_soundList.value(soundName)->setVolume(intensity);
+		csDebug() << "[SoundManager::setSoundIntensity]" << soundName << "Intensity:" << intensity;
+
+		return true;
+	}
+
+/*!
+	Change the intensity of all the sound that in their names as \a mask.
+	Returns true no error occureed, otherwisse false.
+*/
+	bool SoundManager::setSoundIntensityMask( const QString mask, float intensity )
+	{
+		_lastError = CS_FILE_ERROR;
+		try
+		{
+			QStringListIterator it( _soundList.names() );
+			while( it.hasNext() )
+			{
+				const QString& name = it.next();
+				if( name.contains( mask ) )
+				{
+					setSoundIntensity( name, intensity );
+				}
+			}
+		}
+		catch (...)
+		{
+			return false;
+		}
+		return true;
+	}
+
+/*!
+	Change the intensity of a sound of all the melodies played by \a intrument
+	to \a intensity in the sound identified by \a soundName.
+
+	Returns true if no error occurred, otherwise false.
+*/
+	bool SoundManager::setMelodyIntensity( const QString &soundName, const CnotiAudio::EnumInstrument inst, float intensity )
+	{
+		_lastError = CS_FILE_ERROR;
+		QList<Melody*>::iterator it;
+		try
+		{
+			Sound* s = (Sound*)_soundList.value(soundName);
+			QList<Melody*> melodyList = s->getMelodyList();
+			//
+			// Checks every melody in the sound
+			//
+			for( it = melodyList.begin(); it != melodyList.end(); it++ )
+			{
+				//
+				// Check if is the correct instrument
+				//
+				if((*it)->getInstrument() == inst )
+				{
+					//
+					// Changes volume
+					//
+					(*it)->setIntensity( intensity );
+				}
+			}
+		}
+		catch (...)
+		{
+			return false;
+		}
+
+		return true;
+	}
+
+/*
+	Returns the intensity of sound named \a soundName.
+
+	If the sound doesn't exist returns -1.
+*/
+	float SoundManager::getIntensitySound(const QString soundName)
+	{
+		if( !checkSoundName(soundName) )
+		{
+			csDebug() << soundName << " don't exist to getIntensitySound";
+			return -1;
+		}
+
+		return _soundList.value(soundName)->getIntensity();
+	}
+
+/*!
+	Changes the intensity of all the sounds to \a intensity.
 
 	The value os intensity can be change between 0 and 1.
 */
 	void SoundManager::setIntensity( float intensity )
 	{
-		SoundList::iterator it;
-		for( it = _soundList.begin(); it != _soundList.end(); it++ )
+		QListIterator<SoundBase*> it( _soundList.sounds() );
+		while( it.hasNext() )
 		{
-			it->second->setVolume( intensity );
+			it.next()->setVolume( intensity );
 		}
 	}
 
@@ -1832,11 +2686,11 @@ namespace CnotiAudio
 	{
 		if( !checkSoundName(soundName) )
 		{
-			qDebug() << "[SoundManager::getSound]" << soundName << "don't exist to getSound";
+			csDebug() << "[SoundManager::getSound]" << soundName << "don't exist to getSound";
 			return NULL;
 		}
 
-		return ((Sound*)(_soundList[soundName]));
+		return ((Sound*)(_soundList.value(soundName)));
 	}
 
 /*!
@@ -1852,27 +2706,50 @@ namespace CnotiAudio
 		//
 		// Verifies if sound exists
 		//
-		if( !checkSoundName(filename) )
+		SoundRegistry::ReadGuard guard( _soundList );
+		Sample* sample = dynamic_cast<Sample*>(_soundList.value(filename));
+		if( sample == 0 )
 		{
-			qDebug() << "[SoundManager::getBufferFromNote]" <<  filename << " doesn't exist to getBufferFromNote";
+			csDebug() << "[SoundManager::getBufferFromNote]" <<  filename << " doesn't exist to getBufferFromNote";
+			_lastError = CS_SOUND_UNKNOW;
 			return 0;
 		}
 
-		return ((Sample*)(_soundList[filename]))->getBuffer();
+		return sample->getBuffer();
+	}
+
+/*!
+	Returns the data of \a soundName. The samples are shared with the sound, not copied.
+*/
+	PcmBuffer SoundManager::getData(const QString soundName)
+	{
+		SoundRegistry::ReadGuard guard( _soundList );
+		SoundBase* sound = _soundList.value(soundName);
+		if( sound == 0 )
+		{
+			csDebug() << "[SoundManager::getData]" << soundName << "doesn't exist to getData";
+			_lastError = CS_SOUND_UNKNOW;
+			return PcmBuffer();
+		}
+
+		return sound->getData();
 	}
 
 /*!
-	Returns the data of \a soundName.
+	Returns a new device to read the samples of \a soundName as they are mixed, not opened,
+	with the given \a parent. Returns 0 if the sound doesn't exist.
+
+	The device is deleted by its parent, or by the caller.
 */
-	short* SoundManager::getData(const QString soundName)
+	RenderDevice* SoundManager::createRenderDevice(const QString soundName, QObject* parent)
 	{
 		if( !checkSoundName(soundName) )
 		{
-			qDebug() << "[SoundManager::getData]" << soundName << "doesn't exist to getData";
+			csDebug() << "[SoundManager::createRenderDevice]" << soundName << "doesn't exist to createRenderDevice";
 			return 0;
 		}
 
-		return _soundList[soundName]->getData();
+		return new RenderDevice(_soundList.value(soundName), parent);
 	}
 
 /*!
@@ -1880,13 +2757,16 @@ namespace CnotiAudio
 */
 	unsigned long SoundManager::getSize(const QString soundName)
 	{
-		if( !checkSoundName(soundName) )
+		SoundRegistry::ReadGuard guard( _soundList );
+		SoundBase* sound = _soundList.value(soundName);
+		if( sound == 0 )
 		{
-			qDebug() << "[SoundManager::getSize]" <<  soundName << "doesn't exist to getSize";
+			csDebug() << "[SoundManager::getSize]" <<  soundName << "doesn't exist to getSize";
+			_lastError = CS_SOUND_UNKNOW;
 			return 0;
 		}
 
-		return _soundList[soundName]->getSize();
+		return sound->getSize();
 	}
 
 /*!
@@ -1895,13 +2775,16 @@ namespace CnotiAudio
 	ALint SoundManager::getFrequency(const QString soundName)
 	{
 		//qDebug() <<"SoundManager::getFrequency(" << soundName;
-		if( checkSoundName(soundName) )
+		SoundRegistry::ReadGuard guard( _soundList );
+		SoundBase* sound = _soundList.value(soundName);
+		if( sound != 0 )
 		{
-			return _soundList[soundName]->getFrequency();
+			return sound->getFrequency();
 		}
 		else
 		{
-			qDebug() << "[SoundManager::getFrequency]" << soundName << " doesn't exist to getFrequency";
+			csDebug() << "[SoundManager::getFrequency]" << soundName << " doesn't exist to getFrequency";
+			_lastError = CS_SOUND_UNKNOW;
 			return 0;
 		}
 	}
@@ -1911,13 +2794,35 @@ namespace CnotiAudio
 */
 	float SoundManager::getDuration(const QString soundName)
 	{
-		if( checkSoundName(soundName) )
+		SoundRegistry::ReadGuard guard( _soundList );
+		SoundBase* sound = _soundList.value(soundName);
+		if( sound != 0 )
+		{
+			return sound->getDuration();
+		}
+		else
+		{
+			csDebug() << "[SoundManager::getDuration]" << soundName << " doesn't exist to getDuration";
+			_lastError = CS_SOUND_UNKNOW;
+			return 0;
+		}
+	}
+
+/*!
+	Returns the time spent loading the file of \a soundName, in microseconds.
+*/
+	int SoundManager::getLoadTime(const QString soundName)
+	{
+		SoundRegistry::ReadGuard guard( _soundList );
+		SoundBase* sound = _soundList.value(soundName);
+		if( sound != 0 )
 		{
-			return _soundList[soundName]->getDuration();
+			return sound->getLoadTime();
 		}
 		else
 		{
-			qDebug() << "[SoundManager::getDuration]" << soundName << " doesn't exist to getDuration";
+			csDebug() << "[SoundManager::getLoadTime]" << soundName << " doesn't exist to getLoadTime";
+			_lastError = CS_SOUND_UNKNOW;
 			return 0;
 		}
 	}
@@ -1971,7 +2876,7 @@ namespace CnotiAudio
 */
 	bool SoundManager::checkSoundName(const QString soundName)
 	{
-		if( _soundList.find(soundName) != _soundList.end() && _soundList[soundName] != 0 )
+		if( _soundList.contains(soundName) )
 		{
 			_lastError = CS_NO_ERROR;
 			return true;
@@ -1981,65 +2886,458 @@ namespace CnotiAudio
 		return false;
 	}
 
+/*!
+	Adds \a path to the paths where the samples are searched, after the ones added before.
+
+	The files in \a path and its sub directories are added to the sample index, the files
+	with the name of a file in a path added before are ignored.
+*/
 	void SoundManager::addSamplePath(QString path)
 	{
 		_samplesPath << path;
+		indexSamplePath(path);
 	}
 
+/*!
+	Adds the \a paths to the paths where the samples are searched, in order.
+*/
 	void SoundManager::addSamplePaths(QStringList paths)
 	{
 		QStringListIterator it(paths);
 		while(it.hasNext())
 		{
-			_samplesPath << it.next();
+			addSamplePath(it.next());
 		}
 	}
 
+/*!
+	Returns the full path of the sample \a filename, relative to one of the sample paths, or
+	an empty string if it is in none. The first path with the file is used.
+
+	The path is taken from the sample index, without accessing the disk. The names are
+	compared without case, as the file systems of Windows and Mac OS do.
+*/
 	QString SoundManager::samplePath(QString filename)
 	{
-		QFile file;
+		if( _sampleIndexDirty )
+		{
+			rebuildSampleIndex();
+		}
+		return _sampleIndex.value( sampleIndexKey( filename ) );
+	}
+
+/*!
+	Builds again the sample index from the files in the sample paths.
+
+	Needed when files are added or removed from the sample paths and they are not watched.
+*/
+	void SoundManager::rebuildSampleIndex()
+	{
+		_sampleIndex.clear();
+		_sampleIndexDirty = false;
+		if( _samplePathWatcher != NULL && !_samplePathWatcher->directories().isEmpty() )
+		{
+			_samplePathWatcher->removePaths( _samplePathWatcher->directories() );
+		}
 		QStringListIterator it(_samplesPath);
 		while(it.hasNext())
 		{
-			file.setFileName(it.next() + filename);
-			if(file.exists())
+			indexSamplePath(it.next());
+		}
+	}
+
+/*!
+	If \a watch is true the sample paths are watched, and the sample index is built again
+	when files are added or removed. Otherwise rebuildSampleIndex() must be called.
+
+	Watching uses a file system watch for each directory of the sample paths.
+*/
+	void SoundManager::setSamplePathWatching(bool watch)
+	{
+		if( watch == ( _samplePathWatcher != NULL ) )
+		{
+			return;
+		}
+		if( watch )
+		{
+			_samplePathWatcher = new QFileSystemWatcher( this );
+			connect( _samplePathWatcher, SIGNAL(directoryChanged(const QString&)), this, SLOT(samplePathChanged(const QString&)) );
+			rebuildSampleIndex();
+		}
+		else
+		{
+			delete _samplePathWatcher;
+			_samplePathWatcher = NULL;
+		}
+	}
+
+/*!
+	Returns true if the sample paths are watched.
+*/
+	bool SoundManager::isSamplePathWatching()
+	{
+		return _samplePathWatcher != NULL;
+	}
+
+/*!
+	Marks the sample index to be built again, the directory \a path changed.
+*/
+	void SoundManager::samplePathChanged(const QString& path)
+	{
+		csDebug() << "[SoundManager::samplePathChanged]" << path;
+		_sampleIndexDirty = true;
+	}
+
+/*!
+	Adds to the sample index the files in \a path and its sub directories that are not in the
+	index yet.
+*/
+	void SoundManager::indexSamplePath(const QString& path)
+	{
+		QDir root( path );
+		if( !root.exists() )
+		{
+			csDebug() << "[SoundManager::indexSamplePath]" << path << "doesn't exist";
+			return;
+		}
+		QStringList directories;
+		directories << root.absolutePath();
+		int added = 0;
+		QDirIterator it( path, QDir::Files | QDir::Dirs | QDir::NoDotAndDotDot, QDirIterator::Subdirectories );
+		while( it.hasNext() )
+		{
+			it.next();
+			if( it.fileInfo().isDir() )
+			{
+				directories << it.fileInfo().absoluteFilePath();
+				continue;
+			}
+			QString name = root.relativeFilePath( it.filePath() );
+			QString key = sampleIndexKey( name );
+			if( !_sampleIndex.contains( key ) )
 			{
-				return file.fileName();
+				_sampleIndex.insert( key, root.filePath( name ) );
+				added++;
 			}
 		}
-		return QString();
+		if( _samplePathWatcher != NULL )
+		{
+			_samplePathWatcher->addPaths( directories );
+		}
+		csDebug() << "[SoundManager::indexSamplePath]" << path << added << "samples";
+	}
+
+/*!
+	Returns the key of the sample \a filename in the sample index: the path cleaned, with
+	'/' separators and in lower case.
+*/
+	QString SoundManager::sampleIndexKey(const QString& filename)
+	{
+		return QDir::cleanPath( QDir::fromNativeSeparators( filename ) ).toLower();
 	}
 
 	/*************
 	 *  SOURCES  *
 	 *************/
 /*!
-	Returns a sound source from pool.
+	Returns a sound source from pool, to be used by \a owner.
+
+	If there are no sources available, the source of a sound with lower priority
+	then \a owner is stolen. When \a owner is NULL the source can't be stolen.
+
+	Returns 0 if no source is available.
+*/
+	ALuint SoundManager::checkOutSource( SoundBase* owner )
+	{
+		if(_voiceManager)
+		{
+			if( owner == NULL )
+			{
+				return _voiceManager->checkOut( NULL, VOICE_PRIORITY_MELODY );
+			}
+			return _voiceManager->checkOut( owner, owner->getPriority() );
+		}
+
+		csWarning() << "[SoundManager::checkOutSource] SourcePool is NULL";
+		return 0;
+	}
+
+/*!
+	Returns a sound source from pool, to be used by \a owner with the priority \a priority
+	instead of the priority of \a owner.
+
+	Returns 0 if no source is available.
 */
-	ALuint SoundManager::checkOutSource()
+	ALuint SoundManager::checkOutSource( SoundBase* owner, EnumVoicePriority priority )
 	{
-		if(_sourcePool)
+		if(_voiceManager)
 		{
-			return _sourcePool->checkOut();
+			return _voiceManager->checkOut( owner, priority );
 		}
 
-		qWarning() << "[SoundManager::checkOutSource] SourcePool is NULL";
+		csWarning() << "[SoundManager::checkOutSource] SourcePool is NULL";
 		return 0;
 	}
 
 /*!
-	The sound source \source is returned to the pool.
+	The sound source \a uiSource used by \a owner is returned to the pool.
+
+	Nothing is done if the source was stolen from \a owner.
 */
-	void SoundManager::checkInSource( ALuint uiSource )
+	void SoundManager::checkInSource( ALuint uiSource, SoundBase* owner )
 	{
-		if(_sourcePool)
+		if(_voiceManager)
 		{
-			_sourcePool->checkIn( uiSource );
+			_voiceManager->checkIn( uiSource, owner );
 		}
 		else
 		{
-			qWarning() << "[SoundManager::checkInSource] SourcePool is NULL";
+			csWarning() << "[SoundManager::checkInSource] SourcePool is NULL";
+		}
+	}
+
+/*!
+	All the sound sources used by \a owner are returned to the pool.
+*/
+	void SoundManager::checkInSources( SoundBase* owner )
+	{
+		if(_voiceManager)
+		{
+			_voiceManager->checkInOwner( owner );
+		}
+	}
+
+/*!
+	Returns the voice manager that hands out the sound sources.
+
+	Used by the sounds to guard their source with a VoiceManager::SourceGuard.
+*/
+	VoiceManager* SoundManager::getVoiceManager()
+	{
+		return _voiceManager;
+	}
+
+/*!
+	Changes the priority of the sound sources used by \a soundName to \a priority.
+
+	Returns false if the sound doesn't exist.
+*/
+	bool SoundManager::setSoundPriority( const QString soundName, EnumVoicePriority priority )
+	{
+		if( !checkSoundName(soundName) )
+		{
+			_lastError = CS_SOUND_UNKNOW;
+			return false;
+		}
+		_soundList.value(soundName)->setPriority( priority );
+		return true;
+	}
+
+/*!
+	Returns the number of sound sources being used.
+*/
+	int SoundManager::getVoiceOccupancy()
+	{
+		return _voiceManager ? _voiceManager->occupancy() : 0;
+	}
+
+/*!
+	Returns the maximum number of sound sources.
+*/
+	int SoundManager::getVoiceCapacity()
+	{
+		return _voiceManager ? _voiceManager->capacity() : 0;
+	}
+
+/*!
+	Returns the number of sound sources stolen to play sounds with higher priority.
+*/
+	int SoundManager::getVoiceSteals()
+	{
+		return _voiceManager ? _voiceManager->stealCount() : 0;
+	}
+
+/*!
+	Returns the number of times a sound couldn't be played because there was no sound source available.
+*/
+	int SoundManager::getVoiceFailures()
+	{
+		return _voiceManager ? _voiceManager->failureCount() : 0;
+	}
+
+/*!
+	Returns the current value of the performance counter \a counter.
+
+	\sa getCounters(), resetCounters()
+*/
+	int SoundManager::getCounter( EnumPerfCounter counter )
+	{
+		return PerfCounters::value( counter );
+	}
+
+/*!
+	Returns all the performance counters, by name.
+*/
+	QMap<QString, int> SoundManager::getCounters()
+	{
+		QMap<QString, int> counters;
+		for( int i = 0; i < PERF_COUNTER_COUNT; ++i )
+		{
+			counters.insert( PerfCounters::name( (EnumPerfCounter)i ), PerfCounters::value( (EnumPerfCounter)i ) );
+		}
+		return counters;
+	}
+
+/*!
+	Resets the performance counters. The gauges, like the samples loaded and the sources
+	active, keep their values.
+*/
+	void SoundManager::resetCounters()
+	{
+		PerfCounters::reset();
+		for( int i = 0; i < PERF_COUNTER_COUNT; ++i )
+		{
+			_lastCounters[i] = PerfCounters::value( (EnumPerfCounter)i );
+		}
+	}
+
+/*!
+	Dumps the performance counters to the log every \a msec milliseconds.
+
+	Each counter is written with its change since the previous dump. If \a msec is 0 the
+	dump is stopped.
+*/
+	void SoundManager::setCountersDumpInterval( int msec )
+	{
+		if( msec <= 0 )
+		{
+			if( _countersTimer != NULL )
+			{
+				_countersTimer->stop();
+			}
+			return;
+		}
+		if( _countersTimer == NULL )
+		{
+			_countersTimer = new QTimer( this );
+			connect( _countersTimer, SIGNAL(timeout()), this, SLOT(dumpCounters()) );
+		}
+		_countersTimer->start( msec );
+	}
+
+/*!
+	Changes how the note events of the sounds, noteStopped() and notePlaying(), are delivered
+	to \a delivery.
+
+	With NOTE_EVENTS_DIRECT the signals are emitted by the sound threads, as soon as the note
+	changes, and the slots connected run in those threads. With NOTE_EVENTS_QUEUED the events
+	are queued and the signals are emitted in the thread of the SoundManager every \a msec
+	milliseconds. With NOTE_EVENTS_POLLED they are emitted when processNoteEvents() is
+	called, for example once per frame.
+
+	The events queued before changing to NOTE_EVENTS_DIRECT are delivered first.
+*/
+	void SoundManager::setNoteEventDelivery( EnumNoteEventDelivery delivery, int msec )
+	{
+		if( delivery == NOTE_EVENTS_QUEUED )
+		{
+			if( _noteEventsTimer == NULL )
+			{
+				_noteEventsTimer = new QTimer( this );
+				connect( _noteEventsTimer, SIGNAL(timeout()), this, SLOT(processNoteEvents()) );
+			}
+			_noteEventsTimer->start( qMax( msec, 1 ) );
+		}
+		else if( _noteEventsTimer != NULL )
+		{
+			_noteEventsTimer->stop();
+		}
+		_noteEventDelivery = delivery;
+		if( delivery == NOTE_EVENTS_DIRECT )
+		{
+			processNoteEvents();
+		}
+	}
+
+/*!
+	Returns how the note events are delivered.
+*/
+	EnumNoteEventDelivery SoundManager::getNoteEventDelivery()
+	{
+		return _noteEventDelivery;
+	}
+
+/*!
+	If \a coalesce is true, the notes that started and stopped between two deliveries are
+	not delivered, so a GUI showing the notes playing is not flooded when there are many notes.
+*/
+	void SoundManager::setNoteEventCoalescing( bool coalesce )
+	{
+		_noteEventCoalescing = coalesce;
+	}
+
+/*!
+	Queues the note \a event, to be delivered by processNoteEvents(). Can be called from any
+	thread.
+
+	Returns false if the queue is full, the event is lost.
+*/
+	bool SoundManager::postNoteEvent( const NoteEvent& event )
+	{
+		if( !_noteEvents->post( event ) )
+		{
+			PerfCounters::add( PERF_NOTE_EVENTS_DROPPED );
+			return false;
+		}
+		return true;
+	}
+
+/*!
+	Emits the signals of the note events queued, in the thread of the SoundManager. The events
+	of the sounds already released are discarded.
+
+	Returns the number of events delivered.
+*/
+	int SoundManager::processNoteEvents()
+	{
+		QVector<NoteEvent> events;
+		if( _noteEvents->takeAll( &events ) == 0 )
+		{
+			return 0;
+		}
+		if( _noteEventCoalescing )
+		{
+			PerfCounters::add( PERF_NOTE_EVENTS_COALESCED, NoteEventQueue::coalesce( &events ) );
+		}
+		int delivered = 0;
+		for( int i = 0; i < events.size(); ++i )
+		{
+			SoundBase* sound = _soundList.value( events[i].sound );
+			if( sound != NULL )
+			{
+				sound->deliverNoteEvent( events[i] );
+				delivered++;
+			}
+		}
+		return delivered;
+	}
+
+/*!
+	Writes the performance counters to the log, with csDebug(), as the other messages.
+*/
+	void SoundManager::dumpCounters()
+	{
+		QString line;
+		for( int i = 0; i < PERF_COUNTER_COUNT; ++i )
+		{
+			int value = PerfCounters::value( (EnumPerfCounter)i );
+			line += QString( " %1=%2(%3%4)" ).arg( PerfCounters::name( (EnumPerfCounter)i ) )
+											 .arg( value )
+											 .arg( value - _lastCounters[i] >= 0 ? "+" : "" )
+											 .arg( value - _lastCounters[i] );
+			_lastCounters[i] = value;
 		}
+		csDebug() << "[SoundManager::dumpCounters]" << line;
 	}
 
 /*!
@@ -2057,7 +3355,7 @@ namespace CnotiAudio
 			error = alGetError();
 			if( error != AL_NO_ERROR )
 			{
-				qWarning() << "[SoundManager::stopSound] ERROR stop playing " << error;
+				csWarning() << "[SoundManager::stopSound] ERROR stop playing " << error;
 				return false;
 			}
 			return true;
@@ -2076,6 +3374,25 @@ namespace CnotiAudio
 		return _appName + " - Sound.log";
 	}
 
+/*!
+	Changes the level of the messages written by the sound engine to \a level.
+
+	With LOG_LEVEL_WARNING only the warnings are written, with LOG_LEVEL_NONE nothing is written.
+	The messages disabled are not even formatted.
+*/
+	void SoundManager::setLogLevel( EnumLogLevel level )
+	{
+		SoundLog::setLevel( level );
+	}
+
+/*!
+	Returns the level of the messages written by the sound engine.
+*/
+	EnumLogLevel SoundManager::getLogLevel()
+	{
+		return SoundLog::level();
+	}
+
 	/*******************
 	 *  SOUND CAPTURE  *
 	 *******************/
@@ -40,12 +40,25 @@
 //
 #include <QObject>
 #include <QStringList>
-//
-#include <map>
+#include <QMap>
+#include <QHash>
+#include <QFuture>
+#include <QAtomicInt>
 //
 #include "CnotiAudio.h"
 #include "singleton.h"
 #include "soundmanager_global.h"
+#include "PcmBuffer.h"
+#include "PerfCounters.h"
+#include "NoteEventQueue.h"
+#include "NoteKey.h"
+#include "SoundRegistry.h"
+#include "DspGraph.h"
+#include "Synthesizer.h"
+#include "SoundLog.h"
+
+class QTimer;
+class QFileSystemWatcher;
 
 namespace CnotiAudio
 {
@@ -54,7 +67,9 @@ namespace CnotiAudio
 	class Music;
 	class CaptureThread;
 	class SourcePool;
+	class VoiceManager;
 	class NoteMisc;
+	class RenderDevice;
 
 	class SOUNDMANAGER_EXPORT SoundManager: public QObject, public Singleton<SoundManager>
 	{
@@ -74,6 +89,7 @@ namespace CnotiAudio
 		bool lameMp3(const QString& filename, int minimumRate, int frequency);
 
 		bool initOpenAl(int sourcePoolSize = 16);
+		bool initOpenAl(ALCdevice* device, const ALCint* attributes = NULL, int sourcePoolSize = 16);
 		bool initOgg();
 
 		bool copySound(const QString soundNameToCopy, const QString newSoundName);
@@ -115,6 +131,7 @@ namespace CnotiAudio
 		bool saveMp3(const QString soundName, const QString filename, int minimumRate, bool deleteWav=true, bool overwrite=true);
 
 		float percentPlay(const QString soundName);
+		PlayPosition getPlayPosition(const QString soundName);
 
 		CnotiErrorSound getLastError();
 
@@ -124,6 +141,37 @@ namespace CnotiAudio
 		void releaseSampleNote(NoteType height, int octave, DurationType duration, TempoType tempo, EnumInstrument instrument);
 		bool releaseSamplesInstrument(EnumInstrument instrument);
 		bool releaseSamplesMask( QString mask );
+		bool releaseSamples( EnumSampleGroup group, int value );
+		QStringList getSamples( EnumSampleGroup group, int value );
+		unsigned long getSamplesMemory( EnumSampleGroup group, int value );
+
+		int preloadSamples( const QStringList& names );
+		int getSamplesGeneration();
+		int getSampleGeneration( const QString& name );
+		int preloadSound( const QString soundName );
+		QFuture<PcmBuffer> prefetchSamples( const QStringList& names, QStringList* fetched = 0 );
+		void setSampleLoading( EnumSampleLoading loading );
+		EnumSampleLoading getSampleLoading();
+		void setPrefetchNotes( int notes );
+		int getPrefetchNotes();
+
+		// Sample residency
+		void setSampleResidency( EnumSampleResidency residency );
+		EnumSampleResidency getSampleResidency();
+		bool setSoundResidency( const QString soundName, EnumSampleResidency residency );
+		bool setSamplesResidencyMask( const QString mask, EnumSampleResidency residency );
+		bool setInstrumentResidency( EnumInstrument instrument, EnumSampleResidency residency );
+
+		// Synthesized instruments
+		void setInstrumentSynthesized( EnumInstrument instrument, bool synthesized );
+		bool isInstrumentSynthesized( EnumInstrument instrument );
+		void setInstrumentPatch( EnumInstrument instrument, const SynthPatch& patch );
+		SynthPatch getInstrumentPatch( EnumInstrument instrument );
+
+		void setMixMode( EnumMixMode mode );
+		EnumMixMode getMixMode();
+		void setMixEffects( const DspEffects& effects );
+		DspEffects getMixEffects();
 
 		bool playNote(EnumInstrument instrument, TempoType tempo, DurationType duration, NoteType height, int octave = 3, float intensity=0.5);
 
@@ -134,17 +182,39 @@ namespace CnotiAudio
 		void setIntensity( float intensity );
 		Sound* getSound(const QString soundName);
 		ALuint getBufferFromNote(DurationType duration, NoteType height, int octave, TempoType tempo, EnumInstrument instrument);
-		short* getData(const QString soundName);
+		PcmBuffer getData(const QString soundName);
+		RenderDevice* createRenderDevice(const QString soundName, QObject* parent = 0);
 		unsigned long getSize(const QString soundName);
 		ALint getFrequency(const QString soundName);
 		float getDuration(const QString soundName);
+		int getLoadTime(const QString soundName);
 
 		static QString nameNote(EnumInstrument instrument, TempoType tempo, DurationType duration, int octave, NoteType height);
 
 		// Sources
-		ALuint checkOutSource();
-		void checkInSource( ALuint uiSource );
+		ALuint checkOutSource( SoundBase* owner = NULL );
+		ALuint checkOutSource( SoundBase* owner, EnumVoicePriority priority );
+		void checkInSource( ALuint uiSource, SoundBase* owner = NULL );
+		void checkInSources( SoundBase* owner );
+		VoiceManager* getVoiceManager();
 		bool stopSound( ALuint uiSource );
+		bool setSoundPriority( const QString soundName, EnumVoicePriority priority );
+		int getVoiceOccupancy();
+		int getVoiceCapacity();
+		int getVoiceSteals();
+		int getVoiceFailures();
+
+		// Performance counters
+		int getCounter( EnumPerfCounter counter );
+		QMap<QString, int> getCounters();
+		void resetCounters();
+		void setCountersDumpInterval( int msec );
+
+		// Note events
+		void setNoteEventDelivery( EnumNoteEventDelivery delivery, int msec = 16 );
+		EnumNoteEventDelivery getNoteEventDelivery();
+		void setNoteEventCoalescing( bool coalesce );
+		bool postNoteEvent( const NoteEvent& event );
 
 		// Capture
 		void initCapture();
@@ -164,6 +234,8 @@ namespace CnotiAudio
 
 		// Log
 		const QString getLogFile();
+		void setLogLevel( EnumLogLevel level );
+		EnumLogLevel getLogLevel();
 
 		// Note Information
 		QString midiNoteToName( int midiValue );
@@ -176,6 +248,9 @@ namespace CnotiAudio
 		void addSamplePath(QString path);
 		void addSamplePaths(QStringList paths);
 		QString samplePath(QString filename);
+		void rebuildSampleIndex();
+		void setSamplePathWatching(bool watch);
+		bool isSamplePathWatching();
 
 	signals:
 /*!
@@ -202,12 +277,36 @@ namespace CnotiAudio
 		void signalSampleCaptured();
 		void signalCaptureStopped();
 
+	public slots:
+		int processNoteEvents();
+
+	private slots:
+		void dumpCounters();
+		void samplePathChanged(const QString& path);
+		void collectSounds();
+
 	private:
 		SourcePool*  _sourcePool;	// To handle source pool
+		VoiceManager* _voiceManager;	// To hand out the sources by priority
 		NoteMisc*    _noteMisc;		// To handle note misc functions
-
-		typedef std::map<QString, SoundBase*>SoundList;
-		SoundList _soundList;
+		QTimer*      _countersTimer;	// To dump the performance counters periodically
+		int          _lastCounters[PERF_COUNTER_COUNT];	// Counters in the previous dump
+		EnumSampleResidency _sampleResidency;	// Residency of the samples loaded
+		EnumMixMode         _mixMode;			// How the tracks of the sounds are mixed
+		DspEffects          _mixEffects;		// Effects of the mix in MIX_MODE_GRAPH
+		Synthesizer         _synthesizer;		// Renders the notes of the instruments without sample files
+		EnumSampleLoading   _sampleLoading;		// Samples loaded when the instrument or tempo of a music changes
+		int                 _prefetchNotes;		// Notes loaded ahead of the samples read, 0 if none
+		NoteEventQueue*     _noteEvents;		// Note events posted by the sound threads
+		QTimer*             _noteEventsTimer;	// To deliver the note events periodically
+		volatile EnumNoteEventDelivery _noteEventDelivery;
+		bool                _noteEventCoalescing;	// Removes the notes started and stopped between deliveries
+
+		SoundRegistry _soundList;			// Sounds by name, read by the sound threads
+		QTimer*       _collectTimer;		// To delete the sounds retired, while some are left
+		QAtomicInt    _samplesGeneration;	// Changed when a sample is loaded or released
+		QHash<QString, int> _sampleGenerations;	// _samplesGeneration when each sample changed
+		int           _samplesResetGeneration;	// _samplesGeneration when all the samples changed
 
 		CnotiErrorSound _lastError;
 #ifdef _WIN32
@@ -227,6 +326,19 @@ namespace CnotiAudio
 		bool        _saveWaveFile;
 
 		QStringList _samplesPath;
+		NoteKeyIndex _noteKeys;				// Names of the samples loaded by instrument, tempo, duration and rhythm
+		QHash<QString, QString> _sampleIndex;	// Full path of the files in the sample paths, by sampleIndexKey()
+		bool        _sampleIndexDirty;			// The sample paths changed, the index is built again when used
+		QFileSystemWatcher* _samplePathWatcher;	// To know when the sample paths change, NULL if not watched
+
+		void indexSamplePath(const QString& path);
+		static QString sampleIndexKey(const QString& filename);
+		bool addSample( const QString& name, const QString& filename, const PcmBuffer& data, ALenum format,
+			ALint frequency, int decodeTime );
+		bool loadSynthesized( const QString& name );
+		void samplesChanged();
+		void samplesChanged( const QString& name );
+		void reloadInstrument( EnumInstrument instrument );
 
 		QString     _appName;	// Name of the application using Sound Manager
 		//SoundCapture*    _soundCapture; // Sound capture
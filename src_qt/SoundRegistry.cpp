@@ -0,0 +1,306 @@
+/**
+	\file SoundRegistry.cpp
+*/
+#include "SoundRegistry.h"
+#include "SoundBase.h"
+// Qt
+#include <QReadLocker>
+#include <QWriteLocker>
+#include <QtAlgorithms>
+
+namespace CnotiAudio
+{
+/*!
+	Enters the current epoch of \a registry, the sounds looked up are not deleted until the
+	guard is destroyed.
+*/
+	SoundRegistry::ReadGuard::ReadGuard( const SoundRegistry& registry ) :
+		_registry (registry),
+		_slot (registry.enter())
+	{
+	}
+
+/*!
+	Leaves the epoch entered.
+*/
+	SoundRegistry::ReadGuard::~ReadGuard()
+	{
+		_registry.leave( _slot );
+	}
+
+/*!
+	Constructs an empty registry.
+*/
+	SoundRegistry::SoundRegistry() :
+		_epoch (0)
+	{
+		for( int i = 0; i < CS_REGISTRY_EPOCHS; ++i )
+		{
+			_readers[i] = 0;
+		}
+	}
+
+/*!
+	Destroyes the registry. The sounds retired are deleted, the sounds still in the registry
+	are not.
+*/
+	SoundRegistry::~SoundRegistry()
+	{
+		collect( true );
+	}
+
+/*!
+	Returns the sound \a name, or 0 if there is none. Can be called from any thread.
+
+	The sound can only be used, out of the thread of the SoundManager, while a ReadGuard is
+	held.
+*/
+	SoundBase* SoundRegistry::value( const QString& name ) const
+	{
+		const Shard& s = shard( name );
+		QReadLocker locker( &s.lock );
+		return s.sounds.value( name, 0 );
+	}
+
+/*!
+	Returns true if there is a sound \a name. Can be called from any thread.
+*/
+	bool SoundRegistry::contains( const QString& name ) const
+	{
+		return value( name ) != 0;
+	}
+
+/*!
+	Adds \a sound with the given \a name.
+
+	Returns false, and the sound is not added, if there is already a sound \a name or
+	\a sound is 0.
+*/
+	bool SoundRegistry::insert( const QString& name, SoundBase* sound )
+	{
+		if( sound == 0 )
+		{
+			return false;
+		}
+		Shard& s = shard( name );
+		QWriteLocker locker( &s.lock );
+		if( s.sounds.contains( name ) )
+		{
+			return false;
+		}
+		s.sounds.insert( name, sound );
+		return true;
+	}
+
+/*!
+	Removes the sound \a name from the registry and returns it, or 0 if there is none.
+
+	The sound is not deleted, it must be retired if other threads can still use it.
+*/
+	SoundBase* SoundRegistry::take( const QString& name )
+	{
+		Shard& s = shard( name );
+		QWriteLocker locker( &s.lock );
+		return s.sounds.take( name );
+	}
+
+/*!
+	Removes all the sounds from the registry and returns them.
+*/
+	QList<SoundBase*> SoundRegistry::takeAll()
+	{
+		QList<SoundBase*> taken;
+		for( int i = 0; i < CS_REGISTRY_SHARDS; ++i )
+		{
+			QWriteLocker locker( &_shards[i].lock );
+			taken += _shards[i].sounds.values();
+			_shards[i].sounds.clear();
+		}
+		return taken;
+	}
+
+/*!
+	Returns the names of the sounds, sorted.
+*/
+	QStringList SoundRegistry::names() const
+	{
+		QStringList list;
+		for( int i = 0; i < CS_REGISTRY_SHARDS; ++i )
+		{
+			QReadLocker locker( &_shards[i].lock );
+			list += _shards[i].sounds.keys();
+		}
+		list.sort();
+		return list;
+	}
+
+/*!
+	Returns the sounds of the registry.
+*/
+	QList<SoundBase*> SoundRegistry::sounds() const
+	{
+		QList<SoundBase*> list;
+		for( int i = 0; i < CS_REGISTRY_SHARDS; ++i )
+		{
+			QReadLocker locker( &_shards[i].lock );
+			list += _shards[i].sounds.values();
+		}
+		return list;
+	}
+
+/*!
+	Returns a copy of the sounds of the registry by name, to be walked while the registry
+	changes.
+*/
+	QHash<QString, SoundBase*> SoundRegistry::snapshot() const
+	{
+		QHash<QString, SoundBase*> copy;
+		for( int i = 0; i < CS_REGISTRY_SHARDS; ++i )
+		{
+			QReadLocker locker( &_shards[i].lock );
+			copy.unite( _shards[i].sounds );
+		}
+		return copy;
+	}
+
+/*!
+	Returns the number of sounds of the registry.
+*/
+	int SoundRegistry::count() const
+	{
+		int total = 0;
+		for( int i = 0; i < CS_REGISTRY_SHARDS; ++i )
+		{
+			QReadLocker locker( &_shards[i].lock );
+			total += _shards[i].sounds.size();
+		}
+		return total;
+	}
+
+/*!
+	Deletes \a sound, already taken from the registry, when no reader can be using it.
+
+	\sa collect()
+*/
+	void SoundRegistry::retire( SoundBase* sound )
+	{
+		if( sound == 0 )
+		{
+			return;
+		}
+		QMutexLocker locker( &_retiredMutex );
+		_retired.append( qMakePair( sound, (int)_epoch ) );
+	}
+
+/*!
+	Deletes the sounds retired that no reader can be using, advancing the epoch when the
+	readers of the one before left. With \a force all the sounds retired are deleted, only
+	when no other thread can read the registry.
+
+	Returns the number of sounds deleted.
+*/
+	int SoundRegistry::collect( bool force )
+	{
+		QList<SoundBase*> deleted;
+		{
+			QMutexLocker locker( &_retiredMutex );
+			if( _retired.isEmpty() )
+			{
+				return 0;
+			}
+			//
+			// The sounds retired in this epoch can be deleted two epochs later
+			//
+			if( !force && advance() )
+			{
+				advance();
+			}
+			int epoch = _epoch;
+			for( int i = 0; i < _retired.size(); )
+			{
+				if( force || int( (unsigned int)epoch - (unsigned int)_retired[i].second ) >= 2 )
+				{
+					deleted.append( _retired[i].first );
+					_retired.removeAt( i );
+				}
+				else
+				{
+					++i;
+				}
+			}
+		}
+		//
+		// Deleted out of the lock, a sound can release others when destroyed
+		//
+		qDeleteAll( deleted );
+		return deleted.size();
+	}
+
+/*!
+	Returns the number of sounds retired and not deleted yet.
+*/
+	int SoundRegistry::retiredCount()
+	{
+		QMutexLocker locker( &_retiredMutex );
+		return _retired.size();
+	}
+
+/*!
+	Returns the shard of \a name.
+*/
+	SoundRegistry::Shard& SoundRegistry::shard( const QString& name )
+	{
+		return _shards[qHash( name ) % CS_REGISTRY_SHARDS];
+	}
+
+/*!
+	Returns the shard of \a name.
+*/
+	const SoundRegistry::Shard& SoundRegistry::shard( const QString& name ) const
+	{
+		return _shards[qHash( name ) % CS_REGISTRY_SHARDS];
+	}
+
+/*!
+	Counts a reader in the current epoch and returns its slot. If the epoch advances before
+	the reader is counted it tries again, so no reader is left in an old epoch.
+*/
+	int SoundRegistry::enter() const
+	{
+		forever
+		{
+			int epoch = _epoch;
+			int slot = int( (unsigned int)epoch % CS_REGISTRY_EPOCHS );
+			_readers[slot].ref();
+			if( _epoch.testAndSetOrdered( epoch, epoch ) )
+			{
+				return slot;
+			}
+			_readers[slot].deref();
+		}
+	}
+
+/*!
+	Removes a reader from \a slot.
+*/
+	void SoundRegistry::leave( int slot ) const
+	{
+		_readers[slot].deref();
+	}
+
+/*!
+	Advances the epoch if no reader is left in the epoch before the current one.
+
+	Returns true if the epoch advanced.
+*/
+	bool SoundRegistry::advance()
+	{
+		int epoch = _epoch;
+		int before = int( ( (unsigned int)epoch + CS_REGISTRY_EPOCHS - 1 ) % CS_REGISTRY_EPOCHS );
+		if( _readers[before].fetchAndAddOrdered( 0 ) != 0 )
+		{
+			return false;
+		}
+		return _epoch.testAndSetOrdered( epoch, int( (unsigned int)epoch + 1 ) );
+	}
+}
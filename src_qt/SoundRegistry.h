@@ -0,0 +1,100 @@
+/*!
+ \class CnotiAudio::SoundRegistry
+ \brief The SoundRegistry class keeps the sounds of the SoundManager by name.
+
+ The sounds are read by the sound threads and the thread pool, while the thread of the
+ SoundManager loads and releases them. The names are split in CS_REGISTRY_SHARDS shards, each
+ one with its own read-write lock: the readers only lock the shard of the name they look for,
+ and never wait for each other.
+
+ A sound taken from the registry is not deleted at once, but retired. A thread that uses a
+ sound after looking it up holds a ReadGuard, that marks the epoch in which it entered. The
+ retired sounds are deleted by collect() when the epoch advanced twice after they were
+ retired, when no reader that could have seen them is left (epoch-based reclamation).
+
+ Only the thread of the SoundManager changes the registry and deletes the sounds, the
+ others only read it.
+
+ \version 2.2
+ \date 19-10-2026
+ \file SoundRegistry.h
+*/
+#if !defined(_SOUNDREGISTRY_H)
+#define _SOUNDREGISTRY_H
+
+#include <QAtomicInt>
+#include <QHash>
+#include <QList>
+#include <QMutex>
+#include <QPair>
+#include <QReadWriteLock>
+#include <QString>
+#include <QStringList>
+
+#include "soundmanager_global.h"
+
+namespace CnotiAudio
+{
+	#define CS_REGISTRY_SHARDS		(16)		// Shards of the registry, each one with its lock
+	#define CS_REGISTRY_EPOCHS		(3)			// Epochs that can have readers at the same time
+
+	class SoundBase;
+
+	class SOUNDMANAGER_EXPORT SoundRegistry
+	{
+	public:
+		class SOUNDMANAGER_EXPORT ReadGuard
+		{
+		public:
+			ReadGuard( const SoundRegistry& registry );
+			~ReadGuard();
+
+		private:
+			Q_DISABLE_COPY( ReadGuard )
+
+			const SoundRegistry&  _registry;
+			int                   _slot;		// Reader count of the epoch entered
+		};
+
+		SoundRegistry();
+		~SoundRegistry();
+
+		SoundBase* value( const QString& name ) const;
+		bool contains( const QString& name ) const;
+		bool insert( const QString& name, SoundBase* sound );
+		SoundBase* take( const QString& name );
+		QList<SoundBase*> takeAll();
+
+		QStringList names() const;
+		QList<SoundBase*> sounds() const;
+		QHash<QString, SoundBase*> snapshot() const;
+		int count() const;
+
+		void retire( SoundBase* sound );
+		int collect( bool force = false );
+		int retiredCount();
+
+	private:
+		Q_DISABLE_COPY( SoundRegistry )
+
+		struct Shard
+		{
+			mutable QReadWriteLock        lock;
+			QHash<QString, SoundBase*>    sounds;
+		};
+
+		Shard& shard( const QString& name );
+		const Shard& shard( const QString& name ) const;
+		int enter() const;
+		void leave( int slot ) const;
+		bool advance();
+
+		Shard                              _shards[CS_REGISTRY_SHARDS];
+		mutable QAtomicInt                 _epoch;
+		mutable QAtomicInt                 _readers[CS_REGISTRY_EPOCHS];	// Readers in each epoch, by epoch % CS_REGISTRY_EPOCHS
+		QMutex                             _retiredMutex;
+		QList< QPair<SoundBase*, int> >    _retired;		// Sounds retired and the epoch when they were
+	};
+}
+
+#endif //_SOUNDREGISTRY_H
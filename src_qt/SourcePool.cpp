@@ -2,162 +2,219 @@
 	\file SourcePool.cpp
 */
 #include "SourcePool.h"
+#include "SoundLog.h"
 // Qt
 #include <QDebug>
 
 namespace CnotiAudio
 {
+	//
+	// The head of the free list keeps the slot in the low bits and a tag, incremented
+	// on every change, in the high bits. The tag avoids the ABA problem when a slot
+	// is checked out and checked in again between the read and the swap of the head.
+	//
+	static const int          CS_SLOT_MASK  = 0xFFFF;
+	static const int          CS_SLOT_EMPTY = 0xFFFF;
+	static const unsigned int CS_TAG_MASK   = 0xFFFF0000u;
+	static const unsigned int CS_TAG_ONE    = 0x00010000u;
+
 /*!
-	Constructs an empty pool that will have \a maxSize sound sources.
+	Constructs a pool with \a size sound sources.
+
+	All the sources are created in one batch. If the OpenAL implementation can't create
+	that many sources, the pool is created with the maximum number of sources possible.
 */
-	SourcePool::SourcePool( int maxSize, int startSize ) :
-		_maxSize (maxSize)
+	SourcePool::SourcePool( int size ) :
+		_size (0),
+		_sources (NULL),
+		_next (NULL),
+		_inUse (NULL),
+		_head (CS_SLOT_EMPTY),
+		_available (0)
 	{
-		for (int i = 0; i < startSize; ++i)
+		if( size > CS_SLOT_MASK - 1 )
 		{
-			createItem();
+			size = CS_SLOT_MASK - 1;
 		}
-	}
-
-/*!
-	Destroyes the source pool.
-*/
-	SourcePool::~SourcePool() 
-	{
-		int counter = 0;
-		ALuint* sourceArray = new ALuint[_maxSize];	
-		
-		_mutex.lock();	
+		_sources = new ALuint[size > 0 ? size : 1];
 		//
-		// Delete PoolItens
+		// Creates the sources, trying with less sources if the batch fails
 		//
-		while( !_checkedOut.empty() )
+		int count = size;
+		while( count > 0 )
+		{
+			alGetError(); // clear AL error
+			alGenSources( count, _sources );
+			int error = alGetError();
+			if( error == AL_NO_ERROR )
+			{
+				break;
+			}
+			if(error == AL_OUT_OF_MEMORY)
+			{
+				csWarning() << "[SourcePool::SourcePool] There is not enough memory to generate" << count << "sources.";
+			}
+			else if (error == AL_INVALID_VALUE)
+			{
+				csWarning() << "[SourcePool::SourcePool] There are not enough non-memory resources to create" << count << "sources.";
+			}
+			else if (error == AL_INVALID_OPERATION)
+			{
+				csWarning() << "[SourcePool::SourcePool] There is no context to create sources in.";
+				count = 0;
+				break;
+			}
+			else
+			{
+				csWarning() << "[SourcePool::SourcePool] Unknown error.";
+			}
+			count /= 2;
+		}
+		if( count < size )
 		{
-			sourceArray[counter++] = _checkedOut[0];
+			csWarning() << "[SourcePool::SourcePool] Pool created with" << count << "of" << size << "sources.";
 		}
+		_size = count;
 		//
-		// Delete sources
+		// Links all the slots in the free list
 		//
-		alDeleteSources( counter, sourceArray );
+		_next = new QAtomicInt[_size > 0 ? _size : 1];
+		_inUse = new QAtomicInt[_size > 0 ? _size : 1];
+		for( int i = 0; i < _size; ++i )
+		{
+			_slots.insert( _sources[i], i );
+			_next[i] = ( i + 1 < _size ) ? i + 1 : CS_SLOT_EMPTY;
+			_inUse[i] = 0;
+		}
+		_head = ( _size > 0 ) ? 0 : CS_SLOT_EMPTY;
+		_available = _size;
+	}
 
-		_mutex.unlock();
+/*!
+	Destroyes the source pool, deleting all the sources.
+*/
+	SourcePool::~SourcePool()
+	{
+		if( _size > 0 )
+		{
+			alDeleteSources( _size, _sources );
+		}
+		delete[] _sources;
+		delete[] _next;
+		delete[] _inUse;
 	}
 
 /*!
 	Checkout Source from pool.
+
+	Returns 0 if there are no sources available.
 */
 	ALuint SourcePool::checkOut()
 	{
-		QMutexLocker mLocker( &_mutex );
-
-		ALuint source= findFreeItem();
-		if( source != 0 )
+		int slot = pop();
+		if( slot < 0 )
 		{
-			_checkedOut << source;
+			return 0;
 		}
-		qDebug() << "[SourcePool::checkOut] out:" << _checkedOut.size() << "in:" << _queue.size();
-		return source;
+		_inUse[slot].fetchAndStoreAcquire( 1 );
+		_available.fetchAndAddRelaxed( -1 );
+		return _sources[slot];
 	}
+
 /*!
-	Checkin Source into pool      
+	Checkin Source into pool.
+
+	Sources that don't belong to the pool or that are not checked out are ignored.
 */
-	void SourcePool::checkIn( ALuint source ) 
+	void SourcePool::checkIn( ALuint source )
 	{
-		_mutex.lock();
-
-		for( int i = 0; i < _checkedOut.size(); ++i )
+		int slot = slotOf( source );
+		if( slot < 0 )
 		{
-			if( _checkedOut[i] == source )
-			{
-				resetSourceToDefaultValues( _checkedOut[i] );
-				_queue.enqueue(_checkedOut[i]);
-				_checkedOut.removeAt(i);
-//				qDebug() << "[SourcePool::checkIn] Source:" << source;
-				break;
-			}
+			return;
+		}
+		//
+		// Only one check in of the source is accepted
+		//
+		if( !_inUse[slot].testAndSetRelaxed( 1, 0 ) )
+		{
+			return;
 		}
+		resetSourceToDefaultValues( source );
+		push( slot );
+		_available.fetchAndAddRelaxed( 1 );
+	}
 
-		qDebug() << "[SourcePool::checkIn] out:" << _checkedOut.size() << "in:" << _queue.size();
-		_mutex.unlock();
+/*!
+	Returns the number of sources in the pool.
+*/
+	int SourcePool::maxSize()
+	{
+		return _size;
 	}
 
 /*!
-	Find Source from available sources. If none is availabre tries to create a new one.
+	Returns the number of sources available to be checked out.
 */
-	ALuint SourcePool::findFreeItem()
+	int SourcePool::available()
 	{
-		// Check if queue is not empty
-		if(_queue.isEmpty())
-		{
-			// Creates a new item
-			if(!createItem())
-			{
-				return 0;
-			}
-		}
-		// Return
-		return _queue.dequeue();
+		return _available;
 	}
 
 /*!
-	Create a source and adds it to the queque
+	Returns the slot of \a source in the pool, or -1 if it doesn't belong to the pool.
 */
-	bool SourcePool::createItem()
+	int SourcePool::slotOf( ALuint source ) const
 	{
-		ALuint uiSource = 0;
-		if( _checkedOut.size() + _queue.size() >= _maxSize )
-		{
-			qWarning() << "[SourcePool::createItem] Number of maximum sources (" << _maxSize << ") reached." ;
-			return false;
-		}
+		return _slots.value( source, -1 );
+	}
 
-		//
-		// Creates a new source
-		//
-		bool created = false;
-		while(!created)
+/*!
+	Returns the source in the \a slot of the pool.
+*/
+	ALuint SourcePool::sourceAt( int slot ) const
+	{
+		return _sources[slot];
+	}
+
+/*!
+	Removes the first slot from the free list.
+
+	Returns the slot, or -1 if the list is empty.
+*/
+	int SourcePool::pop()
+	{
+		forever
 		{
-			alGetError(); // clear AL error
-			alGenSources( 1, &uiSource );
-			int error = alGetError();
-			// Check for errors on creating the source
-			if( error != AL_NO_ERROR )
+			int head = _head;
+			int slot = head & CS_SLOT_MASK;
+			if( slot == CS_SLOT_EMPTY )
 			{
-				if(error == AL_OUT_OF_MEMORY)
-				{
-					qWarning() << "[SourcePool::createItem] There is not enough memory to generate all the requested sources.";
-				}
-				else if (error == AL_INVALID_VALUE)
-				{
-					qWarning() << "[SourcePool::createItem] There are not enough non-memory resources to create all the requested sources, or the array pointer is not valid.";
-				}
-				else if (error == AL_INVALID_OPERATION)
-				{
-					qWarning() << "[SourcePool::createItem] There is no context to create sources in.";
-				}
-				else
-				{
-					qWarning() << "[SourcePool::createItem] Unknown error.";
-				}
-				return false;
+				return -1;
 			}
-			else if (uiSource == 0)
+			int newHead = int( ( ( (unsigned int)head & CS_TAG_MASK ) + CS_TAG_ONE ) | (unsigned int)int(_next[slot]) );
+			if( _head.testAndSetAcquire( head, newHead ) )
 			{
-				qWarning() << "[SourcePool::createItem] Unknown error.";
-				return false;
+				return slot;
 			}
-			else
+		}
+	}
+
+/*!
+	Adds \a slot to the beginning of the free list.
+*/
+	void SourcePool::push( int slot )
+	{
+		forever
+		{
+			int head = _head;
+			_next[slot] = head & CS_SLOT_MASK;
+			int newHead = int( ( ( (unsigned int)head & CS_TAG_MASK ) + CS_TAG_ONE ) | (unsigned int)slot );
+			if( _head.testAndSetRelease( head, newHead ) )
 			{
-				// Check if exists one with the same id (it shouldn't happen)
-				if (!_checkedOut.contains(uiSource) && !_queue.contains(uiSource))
-				{
-					// Add the source to the queue
-					_queue.enqueue(uiSource);
-					created = true;
-				}
+				return;
 			}
 		}
-		return true;
 	}
 
 /*!
@@ -1,13 +1,17 @@
 /*!
  \class CnotiAudio::SourcePool
- \brief The SourcePool class manages the pool of sound sources. 
- 
+ \brief The SourcePool class manages the pool of sound sources.
+
  The sound sources will be used to play the sounds.
 
+ All the sources are created at once when the pool is constructed, and kept
+ in an indexed free list. Checking out and checking in a source is lock-free
+ and takes constant time, so it can be done from the sound threads.
+
  Case there are no sources available, no valid source will be returned.
 
- \version 2.1
- \date 10-11-2008
+ \version 2.2
+ \date 19-10-2026
  \file SourcePool.h
 */
 #if !defined(_SOURCEPOOL_H)
@@ -24,31 +28,37 @@
 //
 // Qt
 //
-#include <QMutex>
-#include <QList>
-#include <QQueue>
+#include <QAtomicInt>
+#include <QHash>
 
 namespace CnotiAudio
 {
 	class SourcePool
 	{
 	public:
-		SourcePool( int maxSize = 8, int startSize = 4 );
+		SourcePool( int size = 16 );
 		~SourcePool();
 
 		ALuint checkOut();
 		void checkIn( ALuint source );
 
+		int maxSize();
+		int available();
+		int slotOf( ALuint source ) const;
+		ALuint sourceAt( int slot ) const;
+		void resetSourceToDefaultValues( ALuint source );
+
 	private:
-		int               _maxSize;		// Pool maximum size
-		ALuint            _lastSource;	// Used because in mac, in some cases, it was not working correctly when the last was used
-		QList<ALuint>     _checkedOut;	// Pool of sources being used
-		QQueue<ALuint>    _queue;		// Available sources
-		QMutex            _mutex;
+		int               _size;		// Number of sources created
+		ALuint*           _sources;		// Sources, indexed by slot
+		QAtomicInt*       _next;		// Next free slot of each free slot
+		QAtomicInt*       _inUse;		// 1 if the slot is checked out
+		QAtomicInt        _head;		// First free slot (low 16 bits) and ABA tag (high 16 bits)
+		QAtomicInt        _available;	// Number of free slots
+		QHash<ALuint, int> _slots;		// Slot of each source, only written in the constructor
 		// Methods
-		bool createItem();
-		ALuint findFreeItem();
-		void resetSourceToDefaultValues( ALuint source );
+		int pop();
+		void push( int slot );
 	};
 }
 
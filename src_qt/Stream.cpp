@@ -2,6 +2,7 @@
 	\file Stream.cpp
 */
 #include "Stream.h"
+#include "SoundLog.h"
 
 //
 // Qt
@@ -11,7 +12,9 @@
 #include <QDebug>
 
 #include "SoundManager.h"
+#include "VoiceManager.h"
 #include "LogManager.h"
+#include "PerfCounters.h"
 
 //
 // OGG 
@@ -42,14 +45,17 @@ namespace CnotiAudio
 		_sCallbacks.close_func = ov_close_func;
 		_sCallbacks.tell_func = ov_tell_func;
 
-		_data			= 0;
+		_data.clear();
 		_size			= 0;
 		_ulFrequency	= 0;
 		_ulBufferSize	= 0;
 		_ulChannels		= 0;
 		_ulFormat		= 0;
+		_framesUnqueued	= 0;
+		_streamFrames	= 0;
 
         _uiSource       = 0;
+		_priority		= VOICE_PRIORITY_AMBIENCE;
 
 		_filename		= "";
 		_streamingStarted	= false;
@@ -70,12 +76,14 @@ namespace CnotiAudio
 		_sCallbacks.close_func = ov_close_func;
 		_sCallbacks.tell_func = ov_tell_func;
 
-		_data			= 0;
+		_data.clear();
 		_size			= 0;
 		_ulFrequency	= 0;
 		_ulBufferSize	= 0;
 		_ulChannels		= 0;
 		_ulFormat		= 0;
+		_framesUnqueued	= 0;
+		_streamFrames	= 0;
 
         _uiSource       = 0;
 
@@ -97,12 +105,14 @@ namespace CnotiAudio
 		_sCallbacks.close_func = ov_close_func;
 		_sCallbacks.tell_func = ov_tell_func;
 
-		_data			= 0;
+		_data.clear();
 		_size			= 0;
 		_ulFrequency	= 0;
 		_ulBufferSize	= 0;
 		_ulChannels		= 0;
 		_ulFormat		= 0;
+		_framesUnqueued	= 0;
+		_streamFrames	= 0;
 
         _uiSource       = 0;
 
@@ -118,6 +128,7 @@ namespace CnotiAudio
 */
 	Stream::~Stream()
 	{
+		_soundMgr->checkInSources( this );
 		if( isPlaying() )
 		{
 			stopSound();
@@ -173,13 +184,13 @@ namespace CnotiAudio
 		_loop = loop;
 		blockSignals( blockSignal );
 		
-		qDebug() << "[Stream::playSound]"<< "------------  Stream::playSound( File: " << _filename << " Loop: " << CnotiLogManager::boolean(loop) << ")";
+		csDebug() << "[Stream::playSound]"<< "------------  Stream::playSound( File: " << _filename << " Loop: " << CnotiLogManager::boolean(loop) << ")";
 		
 		int error = alGetError();
 
 		if( isPlaying() )
 		{
-			qDebug() << "[Stream::playSound]"<< "----------------------------- ERROR sound stream is too playing... Restarting";
+			csDebug() << "[Stream::playSound]"<< "----------------------------- ERROR sound stream is too playing... Restarting";
 			
 			_lastError = CS_IS_ALREADY_PLAYING;
             this->stopSound();
@@ -194,7 +205,13 @@ namespace CnotiAudio
 		//
 		// Gets a new source & set source volume
 		//
-		_uiSource = _soundMgr->checkOutSource();
+		_uiSource = _soundMgr->checkOutSource( this );
+		if( _uiSource == 0 )
+		{
+			csWarning() << "[Stream::playSound]" << "No sound source available to play" << _name;
+			_lastError = CS_AL_ERROR;
+			return false;
+		}
 		alSourcef( _uiSource, AL_GAIN, _intensity);
 		
 		if( !_streamingStarted )
@@ -206,37 +223,37 @@ namespace CnotiAudio
 			{
 				alDeleteBuffers( NUMBUFFERSOGG, _uiBuffers );
 				_streamingStarted = false;
-				qDebug() << "[Stream::playSound]" << " ERROR streaming start failed";
+				csDebug() << "[Stream::playSound]" << " ERROR streaming start failed";
 				return false;
 			}
 		}
 		else
 		{
-			qDebug() << "[Stream::playSound]" << "  ----------------------------- streaming already started";
+			csDebug() << "[Stream::playSound]" << "  ----------------------------- streaming already started";
 		}
 		//
 		// PLAY 
 		//
-        qDebug() << "[Stream::playSound]" << "  ----------------------------- play source";
+        csDebug() << "[Stream::playSound]" << "  ----------------------------- play source";
 		_flagThreadSoundStopped = false;
         alSourcePlay( _uiSource );
 		error = alGetError();
 	    if( error != AL_NO_ERROR )
 		{
-            qDebug() << "[Stream::playSound]" << "  ----------------------------- ERROR openal failed";
+            csDebug() << "[Stream::playSound]" << "  ----------------------------- ERROR openal failed";
 		    alDeleteBuffers( NUMBUFFERSOGG, _uiBuffers );
 		    stopSound();
 			_lastError = CS_AL_ERROR;
 		    return false;
         }
 		emit soundPlaying( _name );
-        qDebug() << "[Stream::playSound]" << "  ----------------------------- emit soundPlaying of sound: " << _name;
+        csDebug() << "[Stream::playSound]" << "  ----------------------------- emit soundPlaying of sound: " << _name;
 		//
 		// THREAD
 		//
 		_timer->restart();
 		start();
-		qDebug() << "[Stream::playSound]" << "  ----------------------------- thread start";
+		csDebug() << "[Stream::playSound]" << "  ----------------------------- thread start";
 
 		return true;
 	}
@@ -275,16 +292,19 @@ namespace CnotiAudio
 			//
 			if( _uiSource )
 			{
-				if( !isStopped() )
 				{
-					alSourceStop( _uiSource );
+					VoiceManager::SourceGuard guard( _soundMgr->getVoiceManager(), _uiSource, this );
+					if( guard.source() && !isStopped() )
+					{
+						alSourceStop( guard.source() );
+					}
 				}
-				_soundMgr->checkInSource( _uiSource );
+				_soundMgr->checkInSource( _uiSource, this );
 				_uiSource = 0;
 			}
 
 		    _flagThreadSoundStopped = true;
-		    qDebug() << "[Stream::playSound]"<< " --------- emit soundStopped of sound: "<< _name;
+		    csDebug() << "[Stream::playSound]"<< " --------- emit soundStopped of sound: "<< _name;
 		    emit soundStopped( _name );
 
 		    if( _pDecodeBuffer )
@@ -292,12 +312,12 @@ namespace CnotiAudio
 			    free( _pDecodeBuffer );
 			    _pDecodeBuffer = NULL;
 		    }
-		    qDebug() << "[Stream::stopSound]" << " _pDecodeBuffer release";
+		    csDebug() << "[Stream::stopSound]" << " _pDecodeBuffer release";
 		    if( _sOggVorbisFile )
 			{
 			    fn_ov_clear( _sOggVorbisFile );
 			}
-		    qDebug() << "[Stream::stopSound]" << " sOggVorbisFile clear";
+		    csDebug() << "[Stream::stopSound]" << " sOggVorbisFile clear";
 		    
 			_streamingStarted = false;
 			_iTotalBuffersProcessed = 0;
@@ -335,7 +355,7 @@ namespace CnotiAudio
 
 		if( fn_ov_open_callbacks( pOggVorbisFile, _sOggVorbisFile, NULL, 0, _sCallbacks ) != 0 ){
             
-            qDebug() << "[Stream::startStreaming()]"<< " --------- ERROR: fn_ov_open_callbacks failed --- FILE: "<< _filename;
+            csDebug() << "[Stream::startStreaming()]"<< " --------- ERROR: fn_ov_open_callbacks failed --- FILE: "<< _filename;
             
 			_lastError = CS_ERROR_FILE_OGG;
 			return false;
@@ -381,14 +401,14 @@ namespace CnotiAudio
 			}
 		}
 		else{
-			qDebug() << "[Stream::startStreaming()]"<< " --------- ERROR: psVorbisInfo failed";
+			csDebug() << "[Stream::startStreaming()]"<< " --------- ERROR: psVorbisInfo failed";
 			_lastError = CS_ERROR_FILE_OGG;
 			return false;
 		}
 
 		error = alGetError();
 		if (_ulFormat == 0){
-			qDebug() << "[Stream::startStreaming()]"<< " --------- ERROR: formal unknow";
+			csDebug() << "[Stream::startStreaming()]"<< " --------- ERROR: formal unknow";
 			_lastError = CS_ERROR_FILE_OGG;
 			return false;
 		}
@@ -401,9 +421,9 @@ namespace CnotiAudio
 		_pDecodeBuffer = (char*)malloc(_ulBufferSize);
 		if (!_pDecodeBuffer)
 		{
-			qDebug() << "[Stream::startStreaming()]"<< " --------- ERROR: DecodeBuffer failed to alocate memory";
+			csDebug() << "[Stream::startStreaming()]"<< " --------- ERROR: DecodeBuffer failed to alocate memory";
 			fn_ov_clear( _sOggVorbisFile );
-			qDebug() << "[Stream::startStreaming()]"<< " -------------------- clear ogg file";
+			csDebug() << "[Stream::startStreaming()]"<< " -------------------- clear ogg file";
 			_lastError = CS_ERROR_FILE_OGG;
 			return false;
 		}
@@ -421,6 +441,9 @@ namespace CnotiAudio
 		}
 		//CnotiLogManager::getSingleton().getLog(soundLog)->logMessage("first 4 buffer is decoded");
 		_iTotalBuffersProcessed = 0;
+		_framesUnqueued = 0;
+		ogg_int64_t total = fn_ov_pcm_total( _sOggVorbisFile, -1 );
+		_streamFrames = ( total > 0 ) ? total : 0;
 		error = alGetError();
 		//fclose(pOggVorbisFile);
 		return true;
@@ -456,12 +479,34 @@ namespace CnotiAudio
 	}
 
 /*!
-	NOT IMPLEMENTED
+	Returns the percentage of the stream already played, or -1 if the length of the file is
+	not known.
 */
 	float Stream::percentPlay()
 	{
-		_lastError = CS_NOT_IMPLEMENT;
-		return -1.0;
+		PlayPosition position = playPosition();
+		if( position.frames <= 0 )
+		{
+			_lastError = CS_NOT_IMPLEMENT;
+			return -1.0;
+		}
+		return position.percent();
+	}
+
+/*!
+	Returns the position of the stream being played: the frames of the buffers already
+	unqueued plus the offset in the buffers still queued.
+*/
+	PlayPosition Stream::playPosition()
+	{
+		PlayPosition position = SoundBase::playPosition();
+		position.frame += _framesUnqueued;
+		position.frames = _streamFrames;
+		if( position.frames > 0 && position.frame > position.frames )
+		{
+			position.frame = position.frames;
+		}
+		return position;
 	}
 	
 /*!
@@ -469,42 +514,68 @@ namespace CnotiAudio
 */
 	void Stream::update()
 	{
-		int error = alGetError();
 		//
-		// Gets the buffer processed
+		// The source was stolen to play a sound with higher priority
 		//
-		_iBuffersProcessed = 0;
-		alGetSourcei(_uiSource, AL_BUFFERS_PROCESSED, &_iBuffersProcessed);
-
-		_iTotalBuffersProcessed += _iBuffersProcessed;
+		if( _uiSource == 0 )
+		{
+			stopSound();
+			return;
+		}
+		int error = alGetError();
 		//
-		// For each processed buffer, remove it from the Source Queue, read next chunk of audio
-		// data from disk, fill buffer with new data, and add it to the Source Queue
+		// Gets the buffer processed
 		//
-		while( _iBuffersProcessed )
-		{			
+		{
+			//
+			// The buffers are only unqueued and refilled while the source is owned
 			//
-			// Remove the Buffer from the Queue.  (uiBuffer contains the Buffer ID for the unqueued Buffer)
+			VoiceManager::SourceGuard guard( _soundMgr->getVoiceManager(), _uiSource, this );
+			_iBuffersProcessed = 0;
+			if( guard.source() )
+			{
+				alGetSourcei( guard.source(), AL_BUFFERS_PROCESSED, &_iBuffersProcessed );
+			}
+
+			_iTotalBuffersProcessed += _iBuffersProcessed;
 			//
-			_uiBuffer = 0;
-			alSourceUnqueueBuffers(_uiSource, 1, &_uiBuffer);
+			// All the queued buffers were played before this update, the stream ran dry
 			//
-			// Read more audio data (if there is any)
-			//					
-			_ulBytesWritten = DecodeOggVorbis( _sOggVorbisFile, _pDecodeBuffer, _ulBufferSize, _ulChannels );
-			if (_ulBytesWritten)
+			if( _iBuffersProcessed >= NUMBUFFERSOGG )
 			{
+				PerfCounters::add( PERF_STREAM_UNDERRUNS );
+			}
+			//
+			// For each processed buffer, remove it from the Source Queue, read next chunk of audio
+			// data from disk, fill buffer with new data, and add it to the Source Queue
+			//
+			while( _iBuffersProcessed )
+			{			
 				//
-				// Copy audio data to Buffer
-				//
-				alBufferData( _uiBuffer, _ulFormat, _pDecodeBuffer, _ulBytesWritten, _ulFrequency );
+				// Remove the Buffer from the Queue.  (uiBuffer contains the Buffer ID for the unqueued Buffer)
 				//
-				// Queue Buffer on the Source
+				_uiBuffer = 0;
+				alSourceUnqueueBuffers( guard.source(), 1, &_uiBuffer );
+				_framesUnqueued += bufferFrames( _uiBuffer );
 				//
-				alSourceQueueBuffers( _uiSource, 1, &_uiBuffer );
-			}		
-			_iBuffersProcessed--;
-		} // end while iBuffersProcessed
+				// Read more audio data (if there is any)
+				//					
+				_ulBytesWritten = DecodeOggVorbis( _sOggVorbisFile, _pDecodeBuffer, _ulBufferSize, _ulChannels );
+				if (_ulBytesWritten)
+				{
+					//
+					// Copy audio data to Buffer
+					//
+					alBufferData( _uiBuffer, _ulFormat, _pDecodeBuffer, _ulBytesWritten, _ulFrequency );
+					//
+					// Queue Buffer on the Source
+					//
+					alSourceQueueBuffers( guard.source(), 1, &_uiBuffer );
+					PerfCounters::add( PERF_STREAM_REFILLS );
+				}		
+				_iBuffersProcessed--;
+			} // end while iBuffersProcessed
+		}
 		
 		ALenum state; 
 		alGetSourcei( _uiSource, AL_SOURCE_STATE, &state) ;
@@ -543,7 +614,7 @@ namespace CnotiAudio
 				//
 				// else stop the sound and return false
 				//
-				qDebug() << "[Stream::update()]"<< " -------------------- Stop sound" + _name;
+				csDebug() << "[Stream::update()]"<< " -------------------- Stop sound" + _name;
                 stopSound();
 			}
 		}
@@ -0,0 +1,339 @@
+/**
+	\file Synthesizer.cpp
+*/
+#include "Synthesizer.h"
+// Qt
+#include <QReadLocker>
+#include <QWriteLocker>
+// Std
+#include <math.h>
+
+namespace CnotiAudio
+{
+	//
+	// Patch
+	//
+
+/*!
+	Constructs a patch of a sine, with a short attack and release.
+*/
+	SynthPatch::SynthPatch() :
+		harmonics (1, 1.0f),
+		attack (0.01f),
+		decay (0.1f),
+		sustain (0.8f),
+		release (0.05f),
+		gain (0.5f)
+	{
+	}
+
+/*!
+	Returns a patch that resembles \a instrument, a sine for the instruments unknown.
+*/
+	SynthPatch SynthPatch::forInstrument( EnumInstrument instrument )
+	{
+		SynthPatch p;
+		switch( instrument )
+		{
+		case PIANO:
+			p.harmonics << 0.5f << 0.33f << 0.25f << 0.2f << 0.12f << 0.08f << 0.05f;
+			p.attack = 0.005f;
+			p.decay = 0.6f;
+			p.sustain = 0.25f;
+			p.release = 0.15f;
+			break;
+		case FLUTE:
+			p.harmonics << 0.12f << 0.05f << 0.02f;
+			p.attack = 0.06f;
+			p.decay = 0.1f;
+			p.sustain = 0.85f;
+			p.release = 0.12f;
+			break;
+		case VIOLIN:
+			for( int h = 2; h <= 12; h++ )
+			{
+				p.harmonics << 1.0f / h;		// Sawtooth
+			}
+			p.attack = 0.08f;
+			p.decay = 0.1f;
+			p.sustain = 0.8f;
+			p.release = 0.15f;
+			break;
+		case XYLOPHONE:
+			p.harmonics << 0.0f << 0.0f << 0.35f << 0.0f << 0.0f << 0.0f << 0.0f << 0.0f << 0.1f;
+			p.attack = 0.002f;
+			p.decay = 0.25f;
+			p.sustain = 0.0f;
+			p.release = 0.05f;
+			break;
+		case TRUMPET:
+			p.harmonics << 0.8f << 0.6f << 0.5f << 0.4f << 0.3f << 0.2f << 0.15f << 0.1f;
+			p.attack = 0.03f;
+			p.decay = 0.1f;
+			p.sustain = 0.7f;
+			p.release = 0.1f;
+			break;
+		default:
+			break;
+		}
+		return p;
+	}
+
+	//
+	// Synthesizer
+	//
+
+/*!
+	Constructs a synthesizer that renders the notes at \a frequency, without instruments.
+*/
+	Synthesizer::Synthesizer( int frequency ) :
+		_frequency (qMax( frequency, 1 )),
+		_cacheBytes (0)
+	{
+	}
+
+/*!
+	Synthesizes \a instrument with \a patch, building its wavetables. The notes rendered
+	before are removed from the cache.
+*/
+	void Synthesizer::setPatch( int instrument, const SynthPatch& patch )
+	{
+		Voice voice;
+		voice.patch = patch;
+		if( voice.patch.harmonics.isEmpty() )
+		{
+			voice.patch.harmonics.append( 1.0f );
+		}
+		const int harmonics = voice.patch.harmonics.size();
+		QVector<float> sum( CS_SYNTH_TABLE + 1, 0.0f );
+		for( int h = 0; h < harmonics; h++ )
+		{
+			float amplitude = voice.patch.harmonics[h];
+			for( int j = 0; j < CS_SYNTH_TABLE; j++ )
+			{
+				sum[j] += amplitude * sinf( 6.2831853f * ( h + 1 ) * j / CS_SYNTH_TABLE );
+			}
+			//
+			// Table with the harmonics up to this one, with a peak of 1
+			//
+			QVector<float> table( sum );
+			float peak = 0.0f;
+			for( int j = 0; j < CS_SYNTH_TABLE; j++ )
+			{
+				peak = qMax( peak, fabsf( table[j] ) );
+			}
+			for( int j = 0; peak > 0.0f && j < CS_SYNTH_TABLE; j++ )
+			{
+				table[j] /= peak;
+			}
+			table[CS_SYNTH_TABLE] = table[0];		// For the interpolation of the last sample
+			voice.tables.append( table );
+		}
+		{
+			QWriteLocker locker( &_voicesLock );
+			_voices.insert( instrument, voice );
+		}
+		clearCache();
+	}
+
+/*!
+	Stops synthesizing \a instrument.
+*/
+	void Synthesizer::removePatch( int instrument )
+	{
+		{
+			QWriteLocker locker( &_voicesLock );
+			_voices.remove( instrument );
+		}
+		clearCache();
+	}
+
+/*!
+	Returns true if \a instrument is synthesized.
+*/
+	bool Synthesizer::hasPatch( int instrument ) const
+	{
+		QReadLocker locker( &_voicesLock );
+		return _voices.contains( instrument );
+	}
+
+/*!
+	Returns the patch of \a instrument, or a sine if it isn't synthesized.
+*/
+	SynthPatch Synthesizer::patch( int instrument ) const
+	{
+		QReadLocker locker( &_voicesLock );
+		return _voices.value( instrument ).patch;
+	}
+
+/*!
+	Returns the frequency of the notes rendered.
+*/
+	int Synthesizer::frequency() const
+	{
+		return _frequency;
+	}
+
+/*!
+	Returns true if \a key is a note of an instrument synthesized, or a pause.
+*/
+	bool Synthesizer::canRender( const NoteKey& key ) const
+	{
+		if( key.kind == NOTE_KEY_PAUSE )
+		{
+			return noteFrames( key.tempo, key.duration, _frequency ) > 0;
+		}
+		return key.kind == NOTE_KEY_NOTE && hasPatch( key.instrument );
+	}
+
+/*!
+	Returns the samples of the note or pause \a key, 16 bits mono at frequency(), from the
+	cache or rendered. Returns an empty buffer if the key can't be rendered.
+*/
+	PcmBuffer Synthesizer::render( const NoteKey& key ) const
+	{
+		{
+			QMutexLocker locker( &_cacheMutex );
+			QHash<NoteKey, PcmBuffer>::const_iterator it = _cache.constFind( key );
+			if( it != _cache.constEnd() )
+			{
+				return it.value();
+			}
+		}
+		int frames = noteFrames( key.tempo, key.duration, _frequency );
+		if( frames <= 0 || ( key.kind != NOTE_KEY_NOTE && key.kind != NOTE_KEY_PAUSE ) )
+		{
+			return PcmBuffer();
+		}
+		PcmBuffer data( frames );
+		if( key.kind == NOTE_KEY_PAUSE )
+		{
+			data.fill( 0 );
+		}
+		else
+		{
+			QReadLocker locker( &_voicesLock );
+			QHash<int, Voice>::const_iterator voice = _voices.constFind( key.instrument );
+			if( voice == _voices.constEnd() )
+			{
+				return PcmBuffer();
+			}
+			renderNote( voice.value(), noteFrequency( key.octave, key.height ), data.data(), frames );
+		}
+		cache( key, data );
+		return data;
+	}
+
+/*!
+	Removes all the notes from the cache.
+*/
+	void Synthesizer::clearCache()
+	{
+		QMutexLocker locker( &_cacheMutex );
+		_cache.clear();
+		_cacheOrder.clear();
+		_cacheBytes = 0;
+	}
+
+/*!
+	Returns the number of frames of a note of \a duration at \a tempo, at \a frequency. A
+	crotchet is a beat.
+*/
+	int Synthesizer::noteFrames( int tempo, int duration, int frequency )
+	{
+		if( tempo <= 0 || duration <= 0 || duration >= UNKNOWN_DURATION )
+		{
+			return 0;
+		}
+		return (int)( (qint64)duration * 60 * frequency / ( (qint64)CROTCHET * tempo ) );
+	}
+
+/*!
+	Returns the frequency, in Hz, of the note \a height of \a octave. The octave 4 has the
+	middle DO and the LA of 440 Hz.
+*/
+	float Synthesizer::noteFrequency( int octave, int height )
+	{
+		int midi = 12 * ( octave + 1 ) + height;
+		return 440.0f * powf( 2.0f, ( midi - 69 ) / 12.0f );
+	}
+
+/*!
+	Renders \a frames frames of \a voice at \a pitch into \a data.
+
+	The envelope is split in its segments, each one a straight line, so the loop of a segment
+	only has a multiplication and an addition more than the oscillator.
+*/
+	void Synthesizer::renderNote( const Voice& voice, float pitch, short* data, int frames ) const
+	{
+		const SynthPatch& p = voice.patch;
+		//
+		// Table with the harmonics under half the frequency
+		//
+		int harmonics = qBound( 1, (int)( _frequency / 2.0f / pitch ), voice.tables.size() );
+		const float* table = voice.tables[harmonics - 1].constData();
+		const float increment = pitch * CS_SYNTH_TABLE / _frequency;
+		//
+		// Frames and levels of the segments of the envelope, shortened to fit the note
+		//
+		int attackFull = qMax( 1, (int)( p.attack * _frequency ) );
+		int decayFull = qMax( 1, (int)( p.decay * _frequency ) );
+		int releaseFrames = qMin( (int)( p.release * _frequency ), frames / 2 );
+		int body = frames - releaseFrames;
+		int attackFrames = qMin( attackFull, body );
+		int decayFrames = qMin( decayFull, body - attackFrames );
+		int sustainFrames = body - attackFrames - decayFrames;
+		float attackEnd = (float)attackFrames / attackFull;
+		float decayEnd = attackEnd + ( p.sustain - attackEnd ) * decayFrames / decayFull;
+
+		int counts[4] = { attackFrames, decayFrames, sustainFrames, releaseFrames };
+		float starts[4] = { 0.0f, attackEnd, decayEnd, decayEnd };
+		float ends[4] = { attackEnd, decayEnd, decayEnd, 0.0f };
+
+		const float scale = p.gain * 32767.0f;
+		float phase = 0.0f;
+		int i = 0;
+		for( int s = 0; s < 4; s++ )
+		{
+			int count = counts[s];
+			if( count <= 0 )
+			{
+				continue;
+			}
+			float level = starts[s] * scale;
+			float step = ( ends[s] - starts[s] ) * scale / count;
+			for( int n = 0; n < count; n++, i++ )
+			{
+				int index = (int)phase;
+				float fraction = phase - index;
+				float value = table[index] + ( table[index + 1] - table[index] ) * fraction;
+				data[i] = (short)floorf( value * level + 0.5f );
+				level += step;
+				phase += increment;
+				if( phase >= CS_SYNTH_TABLE )
+				{
+					phase -= CS_SYNTH_TABLE;
+				}
+			}
+		}
+	}
+
+/*!
+	Keeps \a data of \a key in the cache, removing the oldest notes over CS_SYNTH_CACHE_BYTES.
+*/
+	void Synthesizer::cache( const NoteKey& key, const PcmBuffer& data ) const
+	{
+		QMutexLocker locker( &_cacheMutex );
+		if( _cache.contains( key ) || (int)data.size() > CS_SYNTH_CACHE_BYTES )
+		{
+			return;
+		}
+		_cache.insert( key, data );
+		_cacheOrder.append( key );
+		_cacheBytes += data.size();
+		while( _cacheBytes > CS_SYNTH_CACHE_BYTES && !_cacheOrder.isEmpty() )
+		{
+			_cacheBytes -= _cache.take( _cacheOrder.takeFirst() ).size();
+		}
+	}
+}
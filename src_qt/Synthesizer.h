@@ -0,0 +1,99 @@
+/*!
+ \class CnotiAudio::Synthesizer
+ \brief The Synthesizer class renders the notes of the instruments without sample files.
+
+ An instrument with a SynthPatch is synthesized: its notes are rendered for any tempo,
+ duration, octave and height, instead of read from the wav files. The sound is the sum of
+ the harmonics of the patch, read from a wavetable, shaped by an ADSR envelope.
+
+ The wavetables are built when the patch is set, one for each number of harmonics: a note
+ uses the table with the harmonics under half the frequency, so the high notes don't alias.
+ The rendered notes are kept in a cache by NoteKey, up to CS_SYNTH_CACHE_BYTES.
+
+ render() can be called from any thread, as the thread pool does in
+ SoundManager::preloadSamples(). The patches must be changed from the thread of the
+ SoundManager.
+
+ \version 2.2
+ \date 19-10-2026
+ \file Synthesizer.h
+*/
+#if !defined(_SYNTHESIZER_H)
+#define _SYNTHESIZER_H
+
+#include <QHash>
+#include <QList>
+#include <QMutex>
+#include <QReadWriteLock>
+#include <QVector>
+
+#include "CnotiAudio.h"
+#include "NoteKey.h"
+#include "PcmBuffer.h"
+#include "soundmanager_global.h"
+
+namespace CnotiAudio
+{
+	#define CS_SYNTH_FREQUENCY		(22050)				// Frequency of the notes rendered
+	#define CS_SYNTH_TABLE			(2048)				// Samples of a wavetable, a period
+	#define CS_SYNTH_CACHE_BYTES	(16 * 1024 * 1024)	// Bytes of the notes kept by the cache
+
+	//
+	// Sound of a synthesized instrument
+	//
+	struct SOUNDMANAGER_EXPORT SynthPatch
+	{
+		QVector<float>  harmonics;		// Amplitude of each harmonic, the first is the fundamental
+		float           attack;			// Seconds to the peak
+		float           decay;			// Seconds from the peak to the sustain
+		float           sustain;		// Level kept until the release, from 0 to 1
+		float           release;		// Seconds to silence, at the end of the note
+		float           gain;			// Level of the peak, from 0 to 1
+
+		SynthPatch();
+
+		static SynthPatch forInstrument( EnumInstrument instrument );
+	};
+
+	class SOUNDMANAGER_EXPORT Synthesizer
+	{
+	public:
+		Synthesizer( int frequency = CS_SYNTH_FREQUENCY );
+
+		void setPatch( int instrument, const SynthPatch& patch );
+		void removePatch( int instrument );
+		bool hasPatch( int instrument ) const;
+		SynthPatch patch( int instrument ) const;
+
+		int frequency() const;
+		bool canRender( const NoteKey& key ) const;
+		PcmBuffer render( const NoteKey& key ) const;
+		void clearCache();
+
+		static int noteFrames( int tempo, int duration, int frequency );
+		static float noteFrequency( int octave, int height );
+
+	private:
+		Q_DISABLE_COPY( Synthesizer )
+
+		struct Voice
+		{
+			SynthPatch                 patch;
+			QVector< QVector<float> >  tables;		// Table with the first i + 1 harmonics
+		};
+
+		void renderNote( const Voice& voice, float pitch, short* data, int frames ) const;
+		void cache( const NoteKey& key, const PcmBuffer& data ) const;
+
+		int                           _frequency;
+		QHash<int, Voice>             _voices;			// Patch of each instrument synthesized
+		mutable QReadWriteLock        _voicesLock;
+
+		mutable QHash<NoteKey, PcmBuffer>  _cache;		// Notes rendered
+		mutable QList<NoteKey>             _cacheOrder;	// Notes of the cache, the oldest first
+		mutable int                        _cacheBytes;
+		mutable QMutex                     _cacheMutex;
+	};
+}
+
+#endif //_SYNTHESIZER_H
@@ -0,0 +1,222 @@
+/**
+	\file TrackCursor.cpp
+*/
+#include "TrackCursor.h"
+#include "SoundManager.h"
+// Qt
+#include <QtAlgorithms>
+// Std
+#include <cstring>
+
+namespace CnotiAudio
+{
+/*!
+	Constructs an empty track.
+*/
+	TrackCursor::TrackCursor() :
+		_size (0),
+		_intensity (1.0),
+		_position (0),
+		_piece (0),
+		_pieceLoaded (-1),
+		_prefetch (0),
+		_prefetchEnd (0)
+	{
+		_offsets.append( 0 );
+	}
+
+/*!
+	Constructs a track with the samples of the \a notes, the names of the samples in the
+	SoundManager, mixed with \a intensity.
+
+	If \a length is not -1 the notes are repeated until \a length samples.
+*/
+	TrackCursor::TrackCursor( const QStringList& notes, float intensity, qint64 length ) :
+		_notes (notes),
+		_intensity (intensity),
+		_position (0),
+		_piece (0),
+		_pieceLoaded (-1),
+		_prefetch (0),
+		_prefetchEnd (0)
+	{
+		_offsets.reserve( notes.size() + 1 );
+		_offsets.append( 0 );
+		qint64 end = 0;
+		for( int i = 0; i < notes.size(); i++ )
+		{
+			end += SoundManager::instance()->getSize( notes[i] ) / sizeof(short);
+			_offsets.append( end );
+		}
+		setLength( length );
+	}
+
+/*!
+	Constructs a track with the samples of \a data, mixed with \a intensity.
+
+	If \a length is not -1 the samples are repeated until \a length samples.
+*/
+	TrackCursor::TrackCursor( const PcmBuffer& data, float intensity, qint64 length ) :
+		_data (data),
+		_intensity (intensity),
+		_position (0),
+		_piece (0),
+		_pieceLoaded (-1),
+		_prefetch (0),
+		_prefetchEnd (0)
+	{
+		_offsets.append( 0 );
+		_offsets.append( data.samples() );
+		setLength( length );
+	}
+
+/*!
+	Copies the next \a samples samples of the track into \a data, with silence after the end
+	of the track.
+
+	Returns the number of samples of the track copied, the others are silence.
+*/
+	int TrackCursor::read( short* data, int samples )
+	{
+		if( samples <= 0 )
+		{
+			return 0;
+		}
+		int count = (int)qBound( qint64( 0 ), _size - _position, qint64( samples ) );
+		qint64 period = _offsets.last();
+		int copied = 0;
+		while( copied < count )
+		{
+			qint64 local = _position % period;
+			if( local < _offsets[_piece] || local >= _offsets[_piece + 1] )
+			{
+				_piece = int( qUpperBound( _offsets.begin(), _offsets.end(), local ) - _offsets.begin() ) - 1;
+			}
+			int pieceSamples = (int)qMin( _offsets[_piece + 1] - local, qint64( count - copied ) );
+			PcmBuffer pieceData = piece( _piece );
+			int offset = int( local - _offsets[_piece] );
+			int available = qBound( 0, pieceData.samples() - offset, pieceSamples );
+			if( available > 0 )
+			{
+				memcpy( data + copied, pieceData.constData() + offset, available * sizeof(short) );
+			}
+			if( available < pieceSamples )
+			{
+				memset( data + copied + available, 0, ( pieceSamples - available ) * sizeof(short) );
+			}
+			copied += pieceSamples;
+			_position += pieceSamples;
+		}
+		if( count < samples )
+		{
+			memset( data + count, 0, ( samples - count ) * sizeof(short) );
+		}
+		return count;
+	}
+
+/*!
+	Moves the cursor to \a sample. Returns false if \a sample is out of the track.
+*/
+	bool TrackCursor::seek( qint64 sample )
+	{
+		if( sample < 0 || sample > _size )
+		{
+			return false;
+		}
+		_position = sample;
+		_piece = 0;
+		return true;
+	}
+
+/*!
+	Returns the next sample to be read.
+*/
+	qint64 TrackCursor::position() const
+	{
+		return _position;
+	}
+
+/*!
+	Returns the number of samples of the track.
+*/
+	qint64 TrackCursor::size() const
+	{
+		return _size;
+	}
+
+/*!
+	Returns true if all the samples of the track were read.
+*/
+	bool TrackCursor::atEnd() const
+	{
+		return _position >= _size;
+	}
+
+/*!
+	Returns the intensity of the track in the mix.
+*/
+	float TrackCursor::intensity() const
+	{
+		return _intensity;
+	}
+
+/*!
+	Reads ahead, in the thread pool, the data of the next \a notes notes when the cursor
+	reaches the half of the notes read before. 0, the default, doesn't read ahead. The data
+	read is kept by the cursor until the next notes are read ahead.
+
+	\sa SoundManager::prefetchSamples()
+*/
+	void TrackCursor::setPrefetch( int notes )
+	{
+		_prefetch = qMax( notes, 0 );
+		_prefetchEnd = 0;
+	}
+
+/*!
+	Returns the number of notes read ahead.
+*/
+	int TrackCursor::prefetch() const
+	{
+		return _prefetch;
+	}
+
+/*!
+	Sets the track size to \a length samples, repeating the pieces, or to the size of the
+	pieces if -1.
+*/
+	void TrackCursor::setLength( qint64 length )
+	{
+		_size = ( length < 0 || _offsets.last() == 0 ) ? _offsets.last() : length;
+	}
+
+/*!
+	Returns the samples of the piece \a index. Only the last piece used is kept.
+*/
+	PcmBuffer TrackCursor::piece( int index )
+	{
+		if( _notes.isEmpty() )
+		{
+			return _data;
+		}
+		if( _pieceLoaded != index )
+		{
+			if( _prefetch > 0 && ( index < _prefetchEnd - _prefetch || index + _prefetch / 2 >= _prefetchEnd ) )
+			{
+				_prefetched = SoundManager::instance()->prefetchSamples( _notes.mid( index, _prefetch ), &_prefetchedNames );
+				_prefetchEnd = index + _prefetch;
+			}
+			//
+			// The data read ahead, waiting for it if it is being read, as it is not kept by the samples
+			//
+			int fetched = _prefetchedNames.indexOf( _notes[index] );
+			_pieceData = ( fetched >= 0 ) ? _prefetched.resultAt( fetched ) : PcmBuffer();
+			if( _pieceData.isEmpty() )
+			{
+				_pieceData = SoundManager::instance()->getData( _notes[index] );
+			}
+			_pieceLoaded = index;
+		}
+		return _pieceData;
+	}
+}
@@ -0,0 +1,75 @@
+/*!
+ \class CnotiAudio::TrackCursor
+ \brief The TrackCursor class reads the samples of a track one block at a time.
+
+ A track is a sequence of pieces: the samples of the notes of a melody, given by their names
+ in the SoundManager, or a buffer of samples. The cursor keeps the position in the track and
+ only the samples of the current piece, so a track is read without joining all its notes.
+
+ A track can repeat its pieces until a given length, as the rhythms of a music. After the end
+ of the track read() gives silence.
+
+ With setPrefetch() the data of the next notes, when it is only in AL buffers, is read by
+ the thread pool before the notes are read. The notes must be loaded when the cursor is
+ created, the notes not loaded are silence.
+
+ The samples of the notes are taken from the SoundManager when they are read, the cursor must
+ be used from the thread of the SoundManager.
+
+ \version 2.2
+ \date 19-10-2026
+ \file TrackCursor.h
+*/
+#if !defined(_TRACKCURSOR_H)
+#define _TRACKCURSOR_H
+
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <QFuture>
+
+#include "PcmBuffer.h"
+#include "soundmanager_global.h"
+
+namespace CnotiAudio
+{
+	class SOUNDMANAGER_EXPORT TrackCursor
+	{
+	public:
+		TrackCursor();
+		TrackCursor( const QStringList& notes, float intensity = 1.0, qint64 length = -1 );
+		TrackCursor( const PcmBuffer& data, float intensity = 1.0, qint64 length = -1 );
+
+		int read( short* data, int samples );
+		bool seek( qint64 sample );
+
+		qint64 position() const;
+		qint64 size() const;
+		bool atEnd() const;
+		float intensity() const;
+
+		void setPrefetch( int notes );
+		int prefetch() const;
+
+	private:
+		void setLength( qint64 length );
+		PcmBuffer piece( int index );
+
+		QStringList      _notes;			// Names of the samples of the notes, empty for a buffer
+		PcmBuffer        _data;				// Samples of the track when it is a buffer
+		QVector<qint64>  _offsets;			// First sample of each piece, and the end of the last
+		qint64           _size;				// Number of samples of the track
+		float            _intensity;
+
+		qint64           _position;			// Next sample to read
+		int              _piece;			// Piece of the next sample
+		int              _pieceLoaded;		// Piece kept in _pieceData, -1 if none
+		PcmBuffer        _pieceData;
+		int              _prefetch;			// Notes read ahead, 0 if none
+		int              _prefetchEnd;		// End of the notes read ahead
+		QFuture<PcmBuffer> _prefetched;		// Data of the notes being read ahead
+		QStringList      _prefetchedNames;	// Samples of each result of _prefetched
+	};
+}
+
+#endif //_TRACKCURSOR_H
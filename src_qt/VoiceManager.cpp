@@ -0,0 +1,447 @@
+/**
+	\file VoiceManager.cpp
+*/
+#include "VoiceManager.h"
+#include "SourcePool.h"
+#include "SoundBase.h"
+#include "PerfCounters.h"
+// Qt
+#include <QThread>
+#include <QDebug>
+
+namespace CnotiAudio
+{
+	//
+	// QThread::msleep() is protected, this gives access to it to fade out the voices
+	//
+	class VoiceSleep : public QThread
+	{
+	public:
+		static void msleep( unsigned long msecs ) { QThread::msleep( msecs ); }
+	};
+
+	//
+	// Owner of the voices checked out without owner, they are never stolen
+	//
+	static char unownedVoice;
+
+/*!
+	Constructs a voice manager that uses the sources of \a pool.
+*/
+	VoiceManager::VoiceManager( SourcePool* pool ) :
+		_pool (pool),
+		_size (pool->maxSize()),
+		_serial (0),
+		_occupancy (0)
+	{
+		_owners = new QAtomicPointer<SoundBase>[_size > 0 ? _size : 1];
+		_priorities = new QAtomicInt[_size > 0 ? _size : 1];
+		_serials = new QAtomicInt[_size > 0 ? _size : 1];
+		_users = new QAtomicInt[_size > 0 ? _size : 1];
+		for( int i = 0; i < _size; ++i )
+		{
+			_owners[i] = NULL;
+		}
+	}
+
+/*!
+	Destroyes the voice manager, returning to the pool the sources still checked out.
+*/
+	VoiceManager::~VoiceManager()
+	{
+		for( int i = 0; i < _size; ++i )
+		{
+			if( _owners[i].fetchAndStoreOrdered( NULL ) != NULL )
+			{
+				PerfCounters::add( PERF_SOURCES_ACTIVE, -1 );
+				_pool->checkIn( _pool->sourceAt( i ) );
+			}
+		}
+		delete[] _owners;
+		delete[] _priorities;
+		delete[] _serials;
+		delete[] _users;
+	}
+
+/*!
+	Checks out a source from the pool to be used by \a owner with the priority \a priority.
+
+	If the pool has no available source, steals the voice with lowest priority, the quietest
+	and the oldest, from the sounds with a priority equal or lower then \a priority.
+
+	The \a owner can be NULL, in that case the voice will never be stolen.
+
+	Returns the source, or 0 if no source could be checked out.
+*/
+	ALuint VoiceManager::checkOut( SoundBase* owner, EnumVoicePriority priority )
+	{
+		ALuint source = _pool->checkOut();
+		if( source != 0 )
+		{
+			assign( _pool->slotOf( source ), owner, priority );
+			return source;
+		}
+
+		source = steal( owner, priority );
+		if( source == 0 )
+		{
+			PerfCounters::add( PERF_CHECKOUT_FAILURES );
+		}
+		return source;
+	}
+
+/*!
+	Returns the source \a source used by \a owner to the pool.
+
+	If the source was stolen from \a owner in the meantime nothing is done.
+*/
+	void VoiceManager::checkIn( ALuint source, SoundBase* owner )
+	{
+		int slot = _pool->slotOf( source );
+		if( slot < 0 )
+		{
+			return;
+		}
+		if( !_owners[slot].testAndSetOrdered( ownerKey( owner ), NULL ) )
+		{
+			//
+			// A steal in progress can be giving the voice back to \a owner, when
+			// it had a higher priority than the one stealing
+			//
+			QMutexLocker mLocker( &_stealMutex );
+			if( !_owners[slot].testAndSetOrdered( ownerKey( owner ), NULL ) )
+			{
+				return;
+			}
+		}
+		_occupancy.fetchAndAddRelaxed( -1 );
+		PerfCounters::add( PERF_SOURCES_ACTIVE, -1 );
+		_pool->checkIn( source );
+	}
+
+/*!
+	Returns to the pool all the sources used by \a owner.
+
+	Used when the sound is destroyed, so its voices can't be stolen anymore.
+*/
+	void VoiceManager::checkInOwner( SoundBase* owner )
+	{
+		if( owner == NULL )
+		{
+			return;
+		}
+		//
+		// Waits for a steal in progress, that can be notifying the owner
+		//
+		QMutexLocker mLocker( &_stealMutex );
+
+		for( int i = 0; i < _size; ++i )
+		{
+			if( _owners[i].testAndSetOrdered( owner, NULL ) )
+			{
+				_occupancy.fetchAndAddRelaxed( -1 );
+				PerfCounters::add( PERF_SOURCES_ACTIVE, -1 );
+				_pool->checkIn( _pool->sourceAt( i ) );
+			}
+		}
+	}
+
+/*!
+	Returns the number of voices being used.
+*/
+	int VoiceManager::occupancy()
+	{
+		return _occupancy;
+	}
+
+/*!
+	Returns the maximum number of voices.
+*/
+	int VoiceManager::capacity()
+	{
+		return _size;
+	}
+
+/*!
+	Returns the number of voices stolen since the counters were reset.
+*/
+	int VoiceManager::stealCount()
+	{
+		return PerfCounters::value( PERF_VOICE_STEALS );
+	}
+
+/*!
+	Returns the number of times that no voice could be checked out.
+*/
+	int VoiceManager::failureCount()
+	{
+		return PerfCounters::value( PERF_CHECKOUT_FAILURES );
+	}
+
+/*!
+	Returns the value kept as owner of the voices checked out by \a owner.
+*/
+	SoundBase* VoiceManager::ownerKey( SoundBase* owner ) const
+	{
+		return owner != NULL ? owner : reinterpret_cast<SoundBase*>( &unownedVoice );
+	}
+
+/*!
+	Gives the voice in \a slot, just checked out from the pool, to \a owner.
+*/
+	void VoiceManager::assign( int slot, SoundBase* owner, EnumVoicePriority priority )
+	{
+		_priorities[slot] = priority;
+		_serials[slot] = _serial.fetchAndAddRelaxed( 1 );
+		_owners[slot].fetchAndStoreRelease( ownerKey( owner ) );
+		_occupancy.fetchAndAddRelaxed( 1 );
+		PerfCounters::addGauge( PERF_SOURCES_ACTIVE, 1, PERF_SOURCES_PEAK );
+	}
+
+/*!
+	Steals a voice to be used by \a owner with the priority \a priority.
+
+	The voice is taken and its owner told inside the lock, the fade out is done after
+	releasing it. Meanwhile the voice is kept as an unowned voice, that is never stolen.
+
+	Returns the source of the voice, or 0 if there is no voice that can be stolen.
+*/
+	ALuint VoiceManager::steal( SoundBase* owner, EnumVoicePriority priority )
+	{
+		ALuint source = 0;
+		int slot = -1;
+		{
+			QMutexLocker mLocker( &_stealMutex );
+
+			for( int tries = 0; tries < CS_VOICE_STEAL_TRIES && slot < 0; ++tries )
+			{
+				//
+				// Some voice can be checked in while waiting for the lock
+				//
+				source = _pool->checkOut();
+				if( source != 0 )
+				{
+					assign( _pool->slotOf( source ), owner, priority );
+					return source;
+				}
+
+				SoundBase* victim = NULL;
+				int found = findVictim( priority, &victim );
+				if( found < 0 )
+				{
+					return 0;
+				}
+				if( !_owners[found].testAndSetOrdered( victim, ownerKey( NULL ) ) )
+				{
+					//
+					// The victim checked in the voice meanwhile
+					//
+					continue;
+				}
+				if( _priorities[found] > priority )
+				{
+					//
+					// The victim checked the voice in and out again, with a higher priority,
+					// since it was found
+					//
+					_owners[found].testAndSetOrdered( ownerKey( NULL ), victim );
+					continue;
+				}
+				_priorities[found] = priority;
+				_serials[found] = _serial.fetchAndAddRelaxed( 1 );
+				PerfCounters::add( PERF_VOICE_STEALS );
+				//
+				// The previous owner stops using the source before it is faded out
+				//
+				source = _pool->sourceAt( found );
+				victim->voiceStolen( source );
+				slot = found;
+			}
+		}
+		if( slot < 0 )
+		{
+			return 0;
+		}
+		//
+		// Only when the guards entered by the previous owner are left, the source is
+		// faded out and handed to the new owner
+		//
+		waitUsers( slot );
+		fadeOut( source );
+		alSourceStop( source );
+		_pool->resetSourceToDefaultValues( source );
+		_owners[slot].fetchAndStoreRelease( ownerKey( owner ) );
+		return source;
+	}
+
+/*!
+	Finds the voice to be stolen by a sound with \a priority.
+
+	The voice chosen is the one with the lowest priority, then the quietest and then the oldest.
+	Voices without owner or with higher priority then \a priority are never chosen.
+
+	The owner of the voice is returned in \a victimOwner.
+
+	Returns the slot of the voice, or -1 if there is none.
+*/
+	int VoiceManager::findVictim( EnumVoicePriority priority, SoundBase** victimOwner )
+	{
+		SoundBase* unowned = ownerKey( NULL );
+		int victim = -1;
+		int victimPriority = 0;
+		int victimSerial = 0;
+		ALfloat victimGain = 0.0;
+
+		for( int i = 0; i < _size; ++i )
+		{
+			SoundBase* voiceOwner = _owners[i];
+			int voicePriority = _priorities[i];
+			if( voiceOwner == NULL || voiceOwner == unowned || voicePriority > priority )
+			{
+				continue;
+			}
+			int voiceSerial = _serials[i];
+			//
+			// Current gain of the source, it can be changed while playing
+			//
+			ALfloat gain = 1.0;
+			alGetSourcef( _pool->sourceAt( i ), AL_GAIN, &gain );
+
+			bool better = false;
+			if( victim < 0 )
+			{
+				better = true;
+			}
+			else if( voicePriority != victimPriority )
+			{
+				better = voicePriority < victimPriority;
+			}
+			else if( gain != victimGain )
+			{
+				better = gain < victimGain;
+			}
+			else
+			{
+				better = ( voiceSerial - victimSerial ) < 0;
+			}
+
+			if( better )
+			{
+				victim = i;
+				*victimOwner = voiceOwner;
+				victimPriority = voicePriority;
+				victimSerial = voiceSerial;
+				victimGain = gain;
+			}
+		}
+		return victim;
+	}
+
+/*!
+	Marks the voice in \a slot in use by \a owner.
+
+	Returns false, without marking it, if \a owner doesn't own the voice anymore.
+*/
+	bool VoiceManager::enter( int slot, SoundBase* owner )
+	{
+		_users[slot].fetchAndAddOrdered( 1 );
+		if( _owners[slot] == ownerKey( owner ) )
+		{
+			return true;
+		}
+		_users[slot].fetchAndAddOrdered( -1 );
+		return false;
+	}
+
+/*!
+	Marks the voice in \a slot as not in use, after enter().
+*/
+	void VoiceManager::leave( int slot )
+	{
+		_users[slot].fetchAndAddOrdered( -1 );
+	}
+
+/*!
+	Waits until the voice in \a slot is not in use.
+
+	The voice was already taken from its owner, no guard is entered meanwhile.
+*/
+	void VoiceManager::waitUsers( int slot )
+	{
+		while( _users[slot].fetchAndAddOrdered( 0 ) != 0 )
+		{
+			QThread::yieldCurrentThread();
+		}
+	}
+
+/*!
+	Fades out the gain of \a source, to avoid clicks when the voice is stolen.
+*/
+	void VoiceManager::fadeOut( ALuint source )
+	{
+		ALint state;
+		alGetSourcei( source, AL_SOURCE_STATE, &state );
+		if( state != AL_PLAYING )
+		{
+			return;
+		}
+
+		ALfloat gain = 1.0;
+		alGetSourcef( source, AL_GAIN, &gain );
+		for( int i = CS_VOICE_FADE_STEPS - 1; i >= 0; --i )
+		{
+			alSourcef( source, AL_GAIN, gain * i / CS_VOICE_FADE_STEPS );
+			VoiceSleep::msleep( CS_VOICE_FADE_STEP_MS );
+		}
+	}
+
+/*!
+	\class CnotiAudio::VoiceManager::SourceGuard
+	\brief The SourceGuard class marks the source of a sound in use while it exists.
+
+	Constructs a guard of \a source, used by \a owner. Case the source was stolen from
+	\a owner the guard returns no source.
+*/
+	VoiceManager::SourceGuard::SourceGuard( VoiceManager* voices, ALuint source, SoundBase* owner ) :
+		_voices (voices),
+		_slot (-1),
+		_source (source)
+	{
+		if( _voices == NULL || _source == 0 )
+		{
+			return;
+		}
+		int slot = _voices->_pool->slotOf( _source );
+		if( slot < 0 )
+		{
+			return;
+		}
+		if( _voices->enter( slot, owner ) )
+		{
+			_slot = slot;
+		}
+		else
+		{
+			_source = 0;
+		}
+	}
+
+/*!
+	Destroyes the guard, the source can be stolen again.
+*/
+	VoiceManager::SourceGuard::~SourceGuard()
+	{
+		if( _slot >= 0 )
+		{
+			_voices->leave( _slot );
+		}
+	}
+
+/*!
+	Returns the source guarded, or 0 if it isn't owned anymore.
+*/
+	ALuint VoiceManager::SourceGuard::source() const
+	{
+		return _source;
+	}
+}
@@ -0,0 +1,109 @@
+/*!
+ \class CnotiAudio::VoiceManager
+ \brief The VoiceManager class hands out the sound sources of the SourcePool by priority.
+
+ Every source checked out is a voice, owned by the sound that is playing it. When the
+ pool is exhausted the voice manager steals a voice instead of failing: the voice with
+ the lowest priority is chosen and, between voices with the same priority, the quietest
+ and then the oldest one. The previous owner is told through SoundBase::voiceStolen(),
+ then the stolen voice is faded out, out of the lock, and given to the new owner.
+
+ An owner touches its source inside a SourceGuard, that tells if the source is still
+ owned. A steal waits for the guards entered before the voice was taken.
+
+ A voice is only stolen from a sound with the same or a lower priority than the one
+ requesting it. Case there is none, no valid source will be returned.
+
+ Checking out a free source and checking it in are lock-free, the voice information
+ is kept by pool slot. Only stealing a voice, and checking in a voice already stolen,
+ take a lock.
+
+ The active sources, steals and failures are also kept in the PerfCounters.
+
+ \version 2.2
+ \date 19-10-2026
+ \file VoiceManager.h
+*/
+#if !defined(_VOICEMANAGER_H)
+#define _VOICEMANAGER_H
+
+//
+// OpenAl
+//
+#if defined( __WIN32__ ) || defined( _WIN32 )
+#include "openal\win32\Framework.h"
+#else
+#include "openal/MacOSX/MyOpenALSupport.h"
+#endif
+//
+// Qt
+//
+#include <QMutex>
+#include <QAtomicInt>
+#include <QAtomicPointer>
+
+#include "CnotiAudio.h"
+
+namespace CnotiAudio
+{
+	#define CS_VOICE_FADE_STEPS		(5)		// Number of gain steps used to fade out a stolen voice
+	#define CS_VOICE_FADE_STEP_MS	(2)		// Duration of each fade step, in milliseconds
+	#define CS_VOICE_STEAL_TRIES	(4)		// Times a steal is retried when the victim is checked in meanwhile
+
+	class SourcePool;
+	class SoundBase;
+
+	class VoiceManager
+	{
+	public:
+		class SourceGuard
+		{
+		public:
+			SourceGuard( VoiceManager* voices, ALuint source, SoundBase* owner );
+			~SourceGuard();
+
+			ALuint source() const;
+
+		private:
+			Q_DISABLE_COPY( SourceGuard )
+
+			VoiceManager*  _voices;
+			int            _slot;		// Slot marked in use, -1 if none
+			ALuint         _source;		// 0 if the source was stolen
+		};
+
+		VoiceManager( SourcePool* pool );
+		~VoiceManager();
+
+		ALuint checkOut( SoundBase* owner, EnumVoicePriority priority );
+		void checkIn( ALuint source, SoundBase* owner );
+		void checkInOwner( SoundBase* owner );
+
+		int occupancy();
+		int capacity();
+		int stealCount();
+		int failureCount();
+
+	private:
+		SourcePool*                  _pool;
+		int                          _size;			// Number of slots of the pool
+		QAtomicPointer<SoundBase>*   _owners;		// Owner of each slot, NULL if free
+		QAtomicInt*                  _priorities;	// Priority of each slot
+		QAtomicInt*                  _serials;		// Order in which each slot was checked out
+		QAtomicInt*                  _users;		// SourceGuard entered in each slot
+		QAtomicInt                   _serial;
+		QAtomicInt                   _occupancy;
+		QMutex                       _stealMutex;	// Serializes the voice stealing
+		// Methods
+		SoundBase* ownerKey( SoundBase* owner ) const;
+		void assign( int slot, SoundBase* owner, EnumVoicePriority priority );
+		ALuint steal( SoundBase* owner, EnumVoicePriority priority );
+		int findVictim( EnumVoicePriority priority, SoundBase** victim );
+		bool enter( int slot, SoundBase* owner );
+		void leave( int slot );
+		void waitUsers( int slot );
+		void fadeOut( ALuint source );
+	};
+}
+
+#endif //_VOICEMANAGER_H
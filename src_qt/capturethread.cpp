@@ -5,6 +5,7 @@
 #include <QStringList>
 
 #include "LogManager.h"
+#include "PerfCounters.h"
 
 #include "DaisyFilter/DaisyFilter.h"
 
@@ -87,6 +88,13 @@ namespace CnotiAudio
 #endif
 			// Find out how many samples have been captured
 			alcGetIntegerv( _pCaptureDevice, ALC_CAPTURE_SAMPLES, 1, &_iSamplesAvailable );
+			//
+			// The device buffer was opened with BUFFERSIZE samples, when it is full samples are lost
+			//
+			if( _iSamplesAvailable >= BUFFERSIZE )
+			{
+				PerfCounters::add( PERF_CAPTURE_OVERRUNS );
+			}
 
 			// When we have enough data to fill our BUFFERSIZE byte buffer, grab the samples
 			if( _iSamplesAvailable > ( sampleSize ) ) 
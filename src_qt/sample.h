@@ -5,6 +5,10 @@
 	Emits signals with the sound name when the sample is started (soundPlaying()), 
 	is paused (soundPaused()) an is stopped (soundStopped()), unless they are deactivated on playSound().
 
+	The samples can be kept only in the AL buffer, only in memory (for offline rendering) or
+	in both, see setResidency(). When they are needed and not resident, they are read again
+	from the file or copied to a new AL buffer.
+
 	\version 2.0
 	\data 11-11-2008
 	\file Sample.h
@@ -28,9 +32,11 @@ namespace CnotiAudio
 		~Sample();
 
 		bool load( const QString filename );
+		bool load( const QString& filename, const PcmBuffer& data, ALenum format, ALint frequency );
 		void release();
 
 		bool playSound( bool loop = false, bool blockSignal = false );
+		bool playSound( EnumVoicePriority priority, bool loop = false, bool blockSignal = false );
 		bool pauseSound();
 		bool stopSound();
 
@@ -38,15 +44,33 @@ namespace CnotiAudio
 
 		bool compareSound( SoundBase* second );
 		float percentPlay();
+		PlayPosition playPosition();
 
 		bool save( const QString filename );
 
 		ALuint getBuffer();
+		PcmBuffer getData();
+
+		void setResidency( EnumSampleResidency residency );
+		EnumSampleResidency getResidency();
+
+		static bool decodeFile( const QString& filename, PcmBuffer* data, ALenum* format, ALint* frequency );
 
 	protected:
 		virtual void update();
 
 		ALuint _buffer;
+
+	private:
+		bool uploadBuffer( const PcmBuffer& data );
+		void deleteBuffer();
+		void setCpuData( const PcmBuffer& data );
+
+		EnumSampleResidency		_residency;
+		QString					_filename;		// File to read the samples again
+		ALenum					_format;
+		int						_alBytes;		// Bytes of the AL buffer created by this sample
+		int						_cpuBytes;		// Bytes of the samples read by this sample
 	};
 }
 
@@ -25,12 +25,12 @@
 #include "CnotiAudio.h"
 #include "SoundBase.h"
 #include "Melody.h"
+#include "Score.h"
+#include "DspGraph.h"
 #include "soundmanager_global.h"
 
 namespace CnotiAudio
 {
-	class XmlSoundHandler;
-
 	class SOUNDMANAGER_EXPORT Sound : public SoundBase
 	{
 		Q_OBJECT
@@ -50,6 +50,10 @@ namespace CnotiAudio
 
 		bool playSound( int melody, bool loop = false, bool blockSignal = false );
 		bool playSound( bool loop, bool blockSignal );
+		bool playRange( int melody, int from, int to = -1, bool loop = false, bool blockSignal = false );
+		bool playFrom( int melody, int note, bool loop = false, bool blockSignal = false );
+		bool playBars( int melody, int firstBar, int lastBar, bool loop = false, bool blockSignal = false );
+		bool seek( qint64 frame );
 
 		bool pauseSound();
 		bool stopSound();
@@ -70,6 +74,9 @@ namespace CnotiAudio
 
 		bool save(const QString filename);
 
+		bool setScore(const ScoreData& score);
+		ScoreData score();
+
 		bool isPlaying();
 		bool isPaused();
 		bool isEmpty();
@@ -78,6 +85,7 @@ namespace CnotiAudio
 		int compareMelody(int first_Melody, int second_melody);
 		bool compareSound(Sound* second);
 		float percentPlay();
+		PlayPosition playPosition();
 
 		bool setInstrument(EnumInstrument instrument, int melody = 0);
 		bool setMelodyTempo(TempoType tempo, int melody = 0);
@@ -101,9 +109,11 @@ namespace CnotiAudio
 		Note* getFirstNote(int melody=0);
 
 		ALuint getBufferFromNote(DurationType duration, NoteType height, int octave, EnumInstrument instrument);
-		short* getData();
+		PcmBuffer getData();
+		QList<TrackCursor> renderTracks();
+		QStringList sampleNames( int fromNote = 0, int count = -1 );
 		unsigned long getSize();
-		short* getData(int i);
+		PcmBuffer getData(int i);
 		unsigned long getSize(int i);
 
 		// Duration selected in the creation of a new music
@@ -112,6 +122,9 @@ namespace CnotiAudio
 
 		QList<int> getGraphicBreakLines( int i = 0 );
 
+		void voiceStolen( ALuint uiSource );
+		void deliverNoteEvent( const NoteEvent& event );
+
 	public slots:
 		bool playSound();
 
@@ -152,13 +165,23 @@ namespace CnotiAudio
 
 		// value of melody playing if is to play all the value is -1
 		int									_playMelody;
+		// Part of the melodies to play, in the units of the note durations, -1 to the end
+		int									_rangeFrom;
+		int									_rangeTo;
+
+		// Melodies and intensities of the mix kept in _data, to mix again only the changed samples
+		MelodyList							_mixMelodies;
+		QList<float>						_mixIntensities;
+		EnumMixMode							_mixMode;
+		DspEffects							_mixEffects;		// Effects of the mix, in MIX_MODE_GRAPH
 
+		ALuint checkOutMelodySource(int melodyId);
 		void connectMelody(int melodyId);
 		void disconnectMelody(int melodyId);
 		int numberOfCompassOfMelody(int melody);
 		int numberOfCompass();
 		bool checkIdMelody(int melodyId) const;
-		bool recoverDataToHandler(XmlSoundHandler *handler);
+		void mixSamples(int from, int to);
 		void update();
 
 
@@ -2,9 +2,15 @@
 #include <QFile>
 
 #include <QDebug>
+#include <QElapsedTimer>
+#include <QThreadPool>
+#include <QtConcurrentMap>
+#include <QtAlgorithms>
 
 #include "SoundBase.h"
+#include "SoundLog.h"
 #include "SoundManager.h"
+#include "PerfCounters.h"
 #include "Melody.h"
 #ifndef _WIN32
 #include "sndfile.h"
@@ -12,6 +18,66 @@
 
 namespace CnotiAudio
 {
+	//
+	// Mixes a range of samples of the tracks into the data, one track after the other
+	//
+	static void mixBlock( short* data, const QVector<MixTrack>& tracks, float firstIntensity, int from, int to )
+	{
+		for( int i = 0; i < tracks.size(); i++ )
+		{
+			const short* readTrack = tracks[i].samples;
+			float intensity = tracks[i].intensity;
+			int sizeTrack = qMin( tracks[i].size, to );
+
+			float fa, fb, fresult;
+			//
+			// Do  mix ( integer computation for accuracy)
+			//
+			for( int j = from; j < sizeTrack; j++ )
+			{
+				if( i == 0 )
+				{
+					fa = (((data[j] * firstIntensity) + 32768) / 65536.0);
+				}
+				else
+				{
+					fa = ((data[j] + 32768) / 65536.0);
+				}
+
+				fb = (((readTrack[j] * intensity) + 32768) / 65536.0);
+				if( fa < 0.5 || fb < 0.5 )
+				{
+					fresult = (((fa*fb)*2.0));
+				}
+				else
+				{
+					fresult = (2 * (fa + fb) - ((fa * fb) * 2.0) - 1);
+				}
+
+				data[j] = (short)((fresult * 65536) - 32768);
+			}
+		}
+	}
+
+	//
+	// Mixes a block of samples, for QtConcurrent
+	//
+	struct BlockMixer
+	{
+		short*                    data;
+		const QVector<MixTrack>*  tracks;
+		float                     firstIntensity;
+		int                       to;
+
+		BlockMixer( short* d, const QVector<MixTrack>* t, float f, int end ) :
+			data(d), tracks(t), firstIntensity(f), to(end) {}
+
+		void operator()( const int& from )
+		{
+			mixBlock( data, *tracks, firstIntensity, from, qMin( from + CS_MIX_BLOCK, to ) );
+		}
+	};
+
 /*!
 	Constructs an empty soundBase with the name \a name.
 */
@@ -28,12 +94,13 @@ namespace CnotiAudio
 		_stopped				= true;
 		_flagThreadSoundStopped	= false;
 		_intensity				= 1.0;
+		_priority				= VOICE_PRIORITY_MELODY;
+		_loadTime				= 0;
 
 		_sourcePos[0]	 = 0.0;
 		_sourcePos[1]	= 0.0;
 		_sourcePos[2]	= 0.0;
 
-		_data		= 0;
 		_size		= 0;
 
 		_uiSource   = 0;
@@ -59,6 +126,8 @@ namespace CnotiAudio
 		this->_stopped					= other._stopped;
 		this->_flagThreadSoundStopped	= other._flagThreadSoundStopped;
 		this->_intensity				= other._intensity;
+		this->_priority					= other._priority;
+		this->_loadTime					= other._loadTime;
 		this->_logFile					= other._logFile;
 
 		_sourcePos[0]			= other._sourcePos[0];
@@ -66,8 +135,13 @@ namespace CnotiAudio
 		_sourcePos[2]			= other._sourcePos[2];
 
 		_iFrequency				= other._iFrequency;
-		_data = new short[_size];
-		memcpy(_data, (short*)(other._data), _size);
+		_uiSource				= 0;
+		_soundMgr				= SoundManager::instance();
+		//
+		// The samples are shared, not copied
+		//
+		_data					= other._data;
+		_size					= other._size;
 	}
 
 /*!
@@ -85,6 +159,8 @@ namespace CnotiAudio
 		this->_stopped			= other._stopped;
 		this->_flagThreadSoundStopped			= other._flagThreadSoundStopped;
 		this->_intensity		= other._intensity;
+		this->_priority			= other._priority;
+		this->_loadTime			= other._loadTime;
 		this->_logFile          = other._logFile;
 
 		this->_name				= newName;
@@ -94,8 +170,13 @@ namespace CnotiAudio
 		_sourcePos[2]			= other._sourcePos[2];
 
 		_iFrequency				= other._iFrequency;
-		_data = new short[_size];
-		memcpy(_data, (short*)(other._data), _size);
+		_uiSource				= 0;
+		_soundMgr				= SoundManager::instance();
+		//
+		// The samples are shared, not copied
+		//
+		_data					= other._data;
+		_size					= other._size;
 	}
 
 /*!
@@ -105,6 +186,10 @@ namespace CnotiAudio
 	{
 		delete(_timer);
 		terminate();
+		//
+		// Sources still used can't be stolen from this sound anymore
+		//
+		_soundMgr->checkInSources( this );
 	}
 
 /*!
@@ -121,8 +206,8 @@ namespace CnotiAudio
 		//
 		// update of data and size
 		//
-		short* dataSound = getData();
-		if(dataSound == 0)
+		PcmBuffer dataSound = getData();
+		if(dataSound.isEmpty())
 		{
 			return false;
 		}
@@ -151,7 +236,7 @@ namespace CnotiAudio
 			filenameWav.append(".wav");
 		}
 
-		qDebug()<< "[SoundBase::saveWav]" << filenameWav;
+		csDebug()<< "[SoundBase::saveWav]" << filenameWav;
 
 		QFile fp( filenameWav );
 
@@ -186,7 +271,7 @@ namespace CnotiAudio
 		//
 		// Write data into file
 		//
-		fp.write( (char*)dataSound, sizeSound );
+		fp.write( (const char*)dataSound.constData(), sizeSound );
 		fp.close();
 
 #else
@@ -209,7 +294,7 @@ namespace CnotiAudio
 		//
 		if( !sf_format_check( &sfInfo ) )
 		{
-			qDebug() << "[SoundBase::saveWav]" << " Error SF_INFO parameters";
+			csDebug() << "[SoundBase::saveWav]" << " Error SF_INFO parameters";
 			return false;
 		}
 
@@ -220,22 +305,22 @@ namespace CnotiAudio
 		if( !( file = sf_open( filenameWav.toStdString().c_str(), SFM_WRITE, &sfInfo ) ) )
 		{
 			int sfError = sf_error( file ) ;
-			qDebug() << "[SoundBase::saveWav]" << " Error opening file";
+			csDebug() << "[SoundBase::saveWav]" << " Error opening file";
 			return false;
 		}
 
 		//
 		// get the data to save in to the file
 		//
-		short* dataSound = getData();
+		PcmBuffer dataSound = getData();
 
 		//
 		// Write the data to the file
 		//
-		if( sf_write_short( file, dataSound, sizeSound) != sizeSound )
+		if( sf_write_short( file, dataSound.constData(), sizeSound) != sizeSound )
 		{
 			//puts( sf_strerror(file) ) ;
-			qDebug() << "[SoundBase::saveWav]" << " Error writing file";
+			csDebug() << "[SoundBase::saveWav]" << " Error writing file";
 			return false;
 		}
 
@@ -256,7 +341,7 @@ namespace CnotiAudio
 */
 	bool SoundBase::saveMp3(const QString filename, int minimumRate, bool deleteWav)
 	{
-		qDebug()<< "[SoundBase::saveMp3]";
+		csDebug()<< "[SoundBase::saveMp3]";
 		QString newFileName = filename;
 		newFileName.remove(".mp3");
 		//
@@ -318,7 +403,7 @@ namespace CnotiAudio
 			alSourcef(_uiSource, AL_GAIN, _intensity);
 			if( alGetError() != AL_NO_ERROR )
 			{
-				qDebug() << "[SoundBase::setIntensity]"<< "------------  Error: updating volume -> " << _name;
+				csDebug() << "[SoundBase::setIntensity]"<< "------------  Error: updating volume -> " << _name;
 			}
 		}
 	}
@@ -338,19 +423,32 @@ namespace CnotiAudio
 */
 	void SoundBase::run()
 	{
+		QElapsedTimer wakeTimer;
 		forever
 		{
 			// Do waht it needs to do
 			update();
 			// Waits
+			wakeTimer.start();
 			msleep(CS_REFRESH);
+			//
+			// Time the thread woke up after the expected time
+			//
+			int lateness = (int)( wakeTimer.nsecsElapsed() / 1000 ) - CS_REFRESH * 1000;
+			if( lateness < 0 )
+			{
+				lateness = 0;
+			}
+			PerfCounters::add( PERF_UPDATE_WAKEUPS );
+			PerfCounters::add( PERF_UPDATE_LATENESS_TOTAL_US, lateness );
+			PerfCounters::raise( PERF_UPDATE_LATENESS_MAX_US, lateness );
 			// Check if is to stop the thread
 			_mutex.lock();
 			if( _flagThreadSoundStopped )
 			{
 				_flagThreadSoundStopped = false;
 				_mutex.unlock();
-				qDebug() << "[SoundBase::run()]"<< "------------  Stopping thread for file: " << _name;
+				csDebug() << "[SoundBase::run()]"<< "------------  Stopping thread for file: " << _name;
 				break;
 			}
 			_mutex.unlock();
@@ -362,6 +460,10 @@ namespace CnotiAudio
 */
 	bool SoundBase::isPlaying()
 	{
+		if( _uiSource == 0 )
+		{
+			return false;
+		}
 		ALenum state;
 		alGetSourcei(_uiSource, AL_SOURCE_STATE, &state);
 		if(state == AL_PLAYING)
@@ -383,6 +485,10 @@ namespace CnotiAudio
 */
 	bool SoundBase::isPaused()
 	{
+		if( _uiSource == 0 )
+		{
+			return false;
+		}
 		ALenum state;
 		alGetSourcei(_uiSource, AL_SOURCE_STATE, &state);
 		if(state == AL_PAUSED)
@@ -443,13 +549,52 @@ namespace CnotiAudio
 	}
 
 /*!
-	Returns the sound data.
+	Returns the sound data. The samples are shared with the sound, not copied.
 */
-	short* SoundBase::getData()
+	PcmBuffer SoundBase::getData()
 	{
 		return _data;
 	}
 
+/*!
+	Returns the tracks mixed by getData(), to be read by a RenderDevice: the first track is
+	mixed with the others one after the other, with the intensity of the first track.
+
+	By default the only track is the data of the sound.
+*/
+	QList<TrackCursor> SoundBase::renderTracks()
+	{
+		QList<TrackCursor> tracks;
+		tracks.append( TrackCursor( getData() ) );
+		return tracks;
+	}
+
+/*!
+	Returns the names of the samples used by \a count notes from \a fromNote, all the notes
+	after \a fromNote if \a count is -1, to be loaded by SoundManager::preloadSamples().
+
+	By default a sound uses no samples.
+*/
+	QStringList SoundBase::sampleNames( int fromNote, int count )
+	{
+		Q_UNUSED( fromNote );
+		Q_UNUSED( count );
+		return QStringList();
+	}
+
+/*!
+	Loads the samples of sampleNames() not loaded yet, when the SoundManager only loads the
+	samples used by the scores (SAMPLE_LOADING_SCORE). Called before the data is mixed
+	without playing the sound, as getData() does to save it.
+*/
+	void SoundBase::preloadScoreSamples()
+	{
+		if( _soundMgr->getSampleLoading() == SAMPLE_LOADING_SCORE )
+		{
+			_soundMgr->preloadSamples( sampleNames() );
+		}
+	}
+
 /*!
 	Returns the sound size.
 */
@@ -488,4 +633,210 @@ namespace CnotiAudio
 	{
 		return getSize() * 1.0 / (_iFrequency * ( 16 / 8));
 	}
+
+/*!
+	Returns the priority of the sound sources used by the sound.
+*/
+	EnumVoicePriority SoundBase::getPriority()
+	{
+		return _priority;
+	}
+
+/*!
+	Changes the priority of the sound sources used by the sound to \a priority.
+
+	When there are no sources available, the sources of the sounds with lower priority
+	are stolen. Only affects the sources checked out after the change.
+*/
+	void SoundBase::setPriority( EnumVoicePriority priority )
+	{
+		_priority = priority;
+	}
+
+/*!
+	Called by the voice manager when the sound source \a uiSource was stolen
+	to play another sound.
+
+	The sound stops using the source, the sound thread will find the sound stopped
+	and emit the signals. Must not call the SoundManager, because it is called while
+	the voice manager is locked. It is called from the thread of the new owner, so the
+	source is only cleared if it is still \a uiSource.
+
+	The derived classes must call SoundManager::checkInSources() before destroying what
+	this function uses, so it isn't called meanwhile.
+*/
+	void SoundBase::voiceStolen( ALuint uiSource )
+	{
+		_uiSource.testAndSetOrdered( (int)uiSource, 0 );
+	}
+
+/*!
+	Called by the SoundManager, in its thread, with an \a event queued by the sound thread.
+
+	Emits the signals of the note event. The base class has no notes and does nothing.
+
+	\sa SoundManager::setNoteEventDelivery()
+*/
+	void SoundBase::deliverNoteEvent( const NoteEvent& event )
+	{
+		Q_UNUSED( event );
+	}
+
+/*!
+	Queues the \a event of the \a note of the \a melody, played after \a sample frames, to be
+	delivered later by the SoundManager.
+
+	Returns false if the events are delivered directly, then the signals must be emitted
+	by the caller.
+*/
+	bool SoundBase::queueNoteEvent( int melody, int note, EnumNoteEvent event, qint64 sample )
+	{
+		if( _soundMgr == NULL || _soundMgr->getNoteEventDelivery() == NOTE_EVENTS_DIRECT )
+		{
+			return false;
+		}
+		_soundMgr->postNoteEvent( NoteEvent( _name, melody, note, event, sample ) );
+		return true;
+	}
+
+/*!
+	Returns the number of sample frames of the AL \a buffer.
+*/
+	qint64 SoundBase::bufferFrames( ALuint buffer )
+	{
+		ALint size = 0;
+		ALint bits = 0;
+		ALint channels = 0;
+		alGetBufferi( buffer, AL_SIZE, &size );
+		alGetBufferi( buffer, AL_BITS, &bits );
+		alGetBufferi( buffer, AL_CHANNELS, &channels );
+		if( bits <= 0 || channels <= 0 )
+		{
+			return 0;
+		}
+		return size / ( ( bits / 8 ) * channels );
+	}
+
+/*!
+	Returns the position of the sound being played, read from its sound source.
+
+	The base class doesn't know the length of the sound, the subclasses give it and the
+	note playing.
+*/
+	PlayPosition SoundBase::playPosition()
+	{
+		PlayPosition position;
+		if( _uiSource != 0 && !isStopped() )
+		{
+			ALint offset = 0;
+			alGetSourcei( _uiSource, AL_SAMPLE_OFFSET, &offset );
+			position.frame = offset;
+		}
+		return position;
+	}
+
+/*!
+	Returns the first sample frame of each of the \a count \a buffers, and the end of the last.
+
+	Computed once when the buffers are queued, so the position of a queue can be found without
+	asking the sizes of the buffers again.
+*/
+	QVector<qint64> SoundBase::bufferOffsets( const ALuint* buffers, int count )
+	{
+		QVector<qint64> offsets( count + 1 );
+		offsets[0] = 0;
+		for( int i = 0; i < count; ++i )
+		{
+			offsets[i + 1] = offsets[i] + bufferFrames( buffers[i] );
+		}
+		return offsets;
+	}
+
+/*!
+	Returns the position of the \a source playing a queue of buffers starting at \a offsets,
+	as given by bufferOffsets(), when the first \a unqueued buffers were already removed from
+	the source.
+
+	As the OpenAL specification says, the sample offset of the source is from the start of
+	the buffers still queued, the processed ones included. The note is the buffer with the
+	frame found.
+*/
+	PlayPosition SoundBase::queuePosition( ALuint source, const QVector<qint64>& offsets, int unqueued )
+	{
+		PlayPosition position;
+		int count = offsets.size() - 1;
+		if( count <= 0 )
+		{
+			return position;
+		}
+		position.frames = offsets[count];
+		if( source == 0 )
+		{
+			return position;
+		}
+		//
+		// The offset is read first, it is 0 when the last buffer ends and the source stops
+		//
+		ALint offset = 0;
+		ALint processed = 0;
+		alGetSourcei( source, AL_SAMPLE_OFFSET, &offset );
+		alGetSourcei( source, AL_BUFFERS_PROCESSED, &processed );
+		unqueued = qBound( 0, unqueued, count );
+		if( unqueued + processed >= count )
+		{
+			position.frame = position.frames;
+			position.note = count - 1;
+			return position;
+		}
+		qint64 frame = qBound( offsets[unqueued], offsets[unqueued] + offset, offsets[count] );
+		int note = int( qUpperBound( offsets.constBegin(), offsets.constEnd(), frame ) - offsets.constBegin() ) - 1;
+		position.frame = frame;
+		position.note = qBound( 0, note, count - 1 );
+		return position;
+	}
+
+/*!
+	Returns the time spent loading the sound file, in microseconds.
+*/
+	int SoundBase::getLoadTime()
+	{
+		return _loadTime;
+	}
+
+/*!
+	Keeps \a usecs as the time spent loading the sound file. Used by the SoundManager.
+*/
+	void SoundBase::setLoadTime( int usecs )
+	{
+		_loadTime = usecs;
+	}
+
+/*!
+	Mixes the samples from \a from to \a to of the \a tracks into \a data, that has the first
+	track. Each track is mixed with the result of the ones before, the first with its samples
+	multiplied by \a firstIntensity.
+
+	Each sample only depends on the same sample of the tracks, so the buffer is split in blocks
+	of CS_MIX_BLOCK samples mixed by the thread pool. Every sample goes through the same
+	operations, in the same order, as if mixed by one thread: the result doesn't depend on the
+	number of threads.
+*/
+	void SoundBase::mixTracks( short* data, const QVector<MixTrack>& tracks, float firstIntensity, int from, int to )
+	{
+		if( from >= to || tracks.isEmpty() )
+		{
+			return;
+		}
+		if( to - from <= CS_MIX_BLOCK || QThreadPool::globalInstance()->maxThreadCount() < 2 )
+		{
+			mixBlock( data, tracks, firstIntensity, from, to );
+			return;
+		}
+		QVector<int> blocks;
+		for( int block = from; block < to; block += CS_MIX_BLOCK )
+		{
+			blocks.append( block );
+		}
+		QtConcurrent::blockingMap( blocks, BlockMixer( data, &tracks, firstIntensity, to ) );
+	}
 }
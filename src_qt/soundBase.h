@@ -11,6 +11,9 @@
 
 #include "CnotiAudio.h"
 #include "soundmanager_global.h"
+#include "PcmBuffer.h"
+#include "NoteEventQueue.h"
+#include "TrackCursor.h"
 
 //
 // QT
@@ -18,6 +21,9 @@
 #include <QTime>
 #include <QThread>
 #include <QMutex>
+#include <QAtomicInt>
+#include <QVector>
+#include <QList>
 
 //
 // OpenAL FrameWork
@@ -33,11 +39,22 @@
 namespace CnotiAudio
 {
 	#define CS_REFRESH				(20)
+	#define CS_MIX_BLOCK			(32768)		// Samples mixed by each thread at a time
 
 //	class XmlSoundHandler;
 	class Melody;
 	class SoundManager;
 
+	struct MixTrack
+	{
+		const short*  samples;		// Samples of the track, kept by the caller while mixing
+		int           size;			// Number of samples
+		float         intensity;
+
+		MixTrack() : samples(0), size(0), intensity(1.0) {}
+		MixTrack( const short* s, int n, float i ) : samples(s), size(n), intensity(i) {}
+	};
+
 	class SoundBase: public QThread
 	{
 		Q_OBJECT
@@ -80,7 +97,9 @@ namespace CnotiAudio
 //		TypeSound getType();
 		float getIntensity();
 		
-		virtual short* getData();
+		virtual PcmBuffer getData();
+		virtual QList<TrackCursor> renderTracks();
+		virtual QStringList sampleNames( int fromNote = 0, int count = -1 );
 		virtual unsigned long getSize();
 		ALint getFrequency();
 		void setFrequency(ALint frequency);
@@ -91,6 +110,21 @@ namespace CnotiAudio
 
 		float getDuration();
 
+		EnumVoicePriority getPriority();
+		void setPriority( EnumVoicePriority priority );
+		virtual void voiceStolen( ALuint uiSource );
+		virtual void deliverNoteEvent( const NoteEvent& event );
+
+		virtual PlayPosition playPosition();
+
+		static qint64 bufferFrames( ALuint buffer );
+		static QVector<qint64> bufferOffsets( const ALuint* buffers, int count );
+		static PlayPosition queuePosition( ALuint source, const QVector<qint64>& offsets, int unqueued = 0 );
+		static void mixTracks( short* data, const QVector<MixTrack>& tracks, float firstIntensity, int from, int to );
+
+		int getLoadTime();
+		void setLoadTime( int usecs );
+
 	signals:
 /*!
 	This signal is emitted when the sound is stopped.
@@ -106,6 +140,9 @@ namespace CnotiAudio
 		void soundPaused(QString name);
 
 	protected:
+		bool queueNoteEvent( int melody, int note, EnumNoteEvent event, qint64 sample );
+		void preloadScoreSamples();
+
 		SoundManager*               _soundMgr;			// Pointer to SoundManager
 		QString                     _name;              // Sound name
 		CnotiErrorSound				_lastError;         // Last sound error
@@ -123,12 +160,14 @@ namespace CnotiAudio
 
 		bool						_loop;              // Keeps if sound is to bee played in a loop
 
-		short*						_data;              // Keeps the sound data
+		PcmBuffer					_data;              // Keeps the sound data, shared by the copies
 		unsigned long				_size;				// Keeps the data size
 		ALint						_iFrequency;		// Sound frequency
 		ALfloat						_sourcePos[3];      // Sound position
-		ALuint						_uiSource;          // Source to play sound
+		QAtomicInt					_uiSource;          // Source to play sound, cleared by the voice manager when stolen
 		float						_intensity;         // Sound volume
+		EnumVoicePriority			_priority;			// Priority of the sound sources
+		int							_loadTime;			// Time spent loading the file, in microseconds
 
 		QString                     _logFile;           // 
 
@@ -4,7 +4,6 @@ HEADERS +=  BladeMP3EncDLL.h \
 			singleton.h \
 			SoundManager.h \
 			SourcePool.h \
-			XmlSoundHandler.h \
 			capturethread.h \
 			CnotiAudio.h \
 			note.h \
@@ -13,7 +12,28 @@ HEADERS +=  BladeMP3EncDLL.h \
 			notemisc.h \
 			soundBase.h \
 			stream.h \
+			VoiceManager.h \
+			PerfCounters.h \
+			SoundLog.h \
+			Score.h \
+			ScoreXml.h \
+			ScoreBinary.h \
+			ScoreCatalog.h \
+			ScoreMidi.h \
+			MelodySimilarity.h \
+			PcmBuffer.h \
+			NoteEventQueue.h \
+			TrackCursor.h \
+			RenderDevice.h \
+			MixBus.h \
+			NoteKey.h \
+			SoundRegistry.h \
+			DspNode.h \
+			DspGraph.h \
+			DaisyFilter/DaisyFilter.h \
+			Synthesizer.h \
 			LogManager/logmanager.h \
+			LogManager/logwriter.h \
 			LogManager/logmanager_global.h
 
 win32 {
@@ -34,12 +54,31 @@ SOURCES +=  Music.cpp \
 			SoundManager.cpp \
 			SourcePool.cpp \
 			Stream.cpp \
-			XmlSoundHandler.cpp \
 			capturethread.cpp \
 			note.cpp \
 			notemisc.cpp \
 			soundBase.cpp \
-			LogManager/logmanager.cpp
+			VoiceManager.cpp \
+			PerfCounters.cpp \
+			SoundLog.cpp \
+			ScoreXml.cpp \
+			ScoreBinary.cpp \
+			ScoreCatalog.cpp \
+			ScoreMidi.cpp \
+			MelodySimilarity.cpp \
+			PcmBuffer.cpp \
+			NoteEventQueue.cpp \
+			TrackCursor.cpp \
+			RenderDevice.cpp \
+			MixBus.cpp \
+			NoteKey.cpp \
+			SoundRegistry.cpp \
+			DspNode.cpp \
+			DspGraph.cpp \
+			DaisyFilter/DaisyFilter.cpp \
+			Synthesizer.cpp \
+			LogManager/logmanager.cpp \
+			LogManager/logwriter.cpp
 
 win32 {
 SOURCES +=  openal/win32/aldlist.cpp \
@@ -1,6 +1,7 @@
 TARGET   = SoundManager
 
 QT += xml
+greaterThan(QT_MAJOR_VERSION, 4): QT += concurrent
 
 INCLUDEPATH += . \
                ../../include \
@@ -15,6 +15,7 @@ LIBS += -L$(OPENAL_HOME)/libs/Win32 \
 		-llibogg_static
 
 QT += xml
+greaterThan(QT_MAJOR_VERSION, 4): QT += concurrent
 
 ####################################################################
 #           DEFAULT CONFIGURATIONS
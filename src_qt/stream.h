@@ -67,6 +67,7 @@ namespace CnotiAudio
 
 		bool compareSound(SoundBase* second);
 		float percentPlay();
+		PlayPosition playPosition();
 
 		bool save(const QString filename);
 
@@ -93,6 +94,8 @@ namespace CnotiAudio
 		unsigned long               _ulBufferSize;				// Sound buffer size
 		unsigned long               _ulBytesWritten;			// Sound bytes written
 		ALint                       _ulFrequency;				// Sound frequency
+		qint64                      _framesUnqueued;			// Sample frames of the buffers already played and unqueued
+		qint64                      _streamFrames;				// Sample frames of the file, 0 if unknown
 		char*                       _pDecodeBuffer;				// ...
 
 		FILE*                       _oggFile;					// File pointer